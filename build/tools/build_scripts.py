@@ -15,8 +15,8 @@ out = sys.argv[3]
 if arch == "x86":
     QEMU_PATH_ENV_VAR = "PRANAOS_QEMU_X86"
     QEMU_STD_PATH = "qemu-system-i386"
-    qemu_run_cmd = "${2} -m 256M --drive file={1}/os-image.bin,format=raw,index=0,if=floppy -device piix3-ide,id=ide -drive id=disk,format=raw,file={1}/pranaos.img,if=none -device ide-hd,drive=disk,bus=ide.0 -serial mon:stdio -rtc base=utc -vga std".format(
-        base, out, QEMU_PATH_VAR)
+    qemu_run_cmd = "${2} -m 256M --drive file={1}/os-image.bin,format=raw,index=0,if=floppy -device piix3-ide,id=ide -drive id=disk,format=raw,file={1}/pranaos.img,if=none -device ide-hd,drive=disk,bus=ide.0 -smp ${3} -serial mon:stdio -rtc base=utc -vga std".format(
+        base, out, QEMU_PATH_VAR, QEMU_SMP_VAR)
 if arch == "aarch32":
     QEMU_PATH_ENV_VAR = "PRANAOS_QEMU_ARM"
     QEMU_STD_PATH = "qemu-system-arm"
@@ -9,9 +9,21 @@
 
 #include <libkern/types.h>
 
+/**
+ * Bits are kept in 32-bit words. A summary keeps a bit per word, which is
+ * set while all bits of the word are set, so searches skip full words 32 at
+ * a time. The summary is placed right after the words, BITMAP_SIZE(len)
+ * returns the size of the whole storage in bytes for @len bits.
+ */
+#define BITMAP_BITS_PER_WORD (32)
+#define BITMAP_WORDS(len) (((len) + BITMAP_BITS_PER_WORD - 1) / BITMAP_BITS_PER_WORD)
+#define BITMAP_SUMMARY_WORDS(len) ((BITMAP_WORDS(len) + BITMAP_BITS_PER_WORD - 1) / BITMAP_BITS_PER_WORD)
+#define BITMAP_SIZE(len) ((BITMAP_WORDS(len) + BITMAP_SUMMARY_WORDS(len)) * sizeof(uint32_t))
+
 struct bitmap {
-    uint8_t* data;
-    uint32_t len;
+    uint32_t* data;
+    uint32_t* summary;
+    uint32_t len; // in bits
 };
 typedef struct bitmap bitmap_t;
 
@@ -23,4 +35,4 @@ int bitmap_set(bitmap_t bitmap, int where);
 int bitmap_unset(bitmap_t bitmap, int where);
 int bitmap_set_range(bitmap_t bitmap, int start, int len);
 int bitmap_unset_range(bitmap_t bitmap, int start, int len);
-#endif //_KERNEL_ALGO_BITMAP_H
\ No newline at end of file
+#endif //_KERNEL_ALGO_BITMAP_H
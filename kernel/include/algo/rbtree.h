@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+/**
+ * Intrusive red-black tree. A node is embedded into an element, the owner
+ * walks the tree to find a place for a new node and links it there with
+ * rbtree_link(), so the tree itself knows nothing about keys.
+ * Augmented trees keep data of a subtree in its root element, @augment
+ * recomputes it for a node from the node and its children.
+ */
+
+#ifndef _KERNEL_ALGO_RBTREE_H
+#define _KERNEL_ALGO_RBTREE_H
+
+#include <libkern/types.h>
+
+struct rbtree_node {
+    struct rbtree_node* parent;
+    struct rbtree_node* left;
+    struct rbtree_node* right;
+    bool red;
+};
+typedef struct rbtree_node rbtree_node_t;
+
+typedef void (*rbtree_augment_t)(rbtree_node_t* node);
+
+struct rbtree {
+    rbtree_node_t* root;
+    rbtree_augment_t augment;
+    uint32_t size;
+};
+typedef struct rbtree rbtree_t;
+
+void rbtree_init(rbtree_t* tree, rbtree_augment_t augment);
+void rbtree_link(rbtree_t* tree, rbtree_node_t* node, rbtree_node_t* parent, rbtree_node_t** link);
+void rbtree_erase(rbtree_t* tree, rbtree_node_t* node);
+
+rbtree_node_t* rbtree_first(rbtree_t* tree);
+rbtree_node_t* rbtree_last(rbtree_t* tree);
+rbtree_node_t* rbtree_next(rbtree_node_t* node);
+rbtree_node_t* rbtree_prev(rbtree_node_t* node);
+
+#endif // _KERNEL_ALGO_RBTREE_H
@@ -13,6 +13,7 @@
 #include <platform/aarch32/target/cortex-a15/device_settings.h>
 
 #define PL181_SECTOR_SIZE 512
+#define PL181_MAX_BLOCKS_PER_CMD 64 /* Data length register is 16 bits wide. */
 
 enum PL181CommandMasks {
     MASKDEFINE(MMC_CMD_IDX, 0, 6),
@@ -25,10 +26,13 @@ enum PL181CommandMasks {
 
 enum PL181StatusMasks {
     MASKDEFINE(MMC_STAT_CRC_FAIL, 0, 1),
+    MASKDEFINE(MMC_STAT_DATA_CRC_FAIL, 1, 1),
     MASKDEFINE(MMC_STAT_CMD_TIMEOUT, 2, 1),
+    MASKDEFINE(MMC_STAT_DATA_TIMEOUT, 3, 1),
     MASKDEFINE(MMC_STAT_CMD_RESP_END, 6, 1),
     MASKDEFINE(MMC_STAT_CMD_SENT, 7, 1),
     MASKDEFINE(MMC_STAT_CMD_ACTIVE, 11, 1),
+    MASKDEFINE(MMC_STAT_TRANSMIT_FIFO_FULL, 16, 1),
     MASKDEFINE(MMC_STAT_TRANSMIT_FIFO_EMPTY, 18, 1),
     MASKDEFINE(MMC_STAT_FIFO_DATA_AVAIL_TO_READ, 21, 1),
 };
@@ -40,9 +44,12 @@ enum PL181Commands {
     CMD_SELECT = 7,
     CMD_SEND_CSD = 9,
     CMD_SEND_CID = 10,
+    CMD_STOP_TRANSMISSION = 12,
     CMD_SET_SECTOR_SIZE = 16,
     CMD_READ_SINGLE_BLOCK = 17,
+    CMD_READ_MULTIPLE_BLOCK = 18,
     CMD_WRITE_SINGLE_BLOCK = 24,
+    CMD_WRITE_MULTIPLE_BLOCK = 25,
     CMD_SD_SEND_OP_COND = 41,
     CMD_APP_CMD = 55,
 };
@@ -40,4 +40,7 @@ typedef struct sp804_registers sp804_registers_t;
 
 void sp804_install();
 
+void timer_sync_tick();
+uint32_t timer_ns_since_tick();
+
 #endif //_KERNEL_DRIVERS_AARCH32_SP804_H
@@ -70,6 +70,8 @@ enum DRIVER_STORAGE_OPERTAION {
     DRIVER_STORAGE_WRITE,
     DRIVER_STORAGE_FLUSH,
     DRIVER_STORAGE_CAPACITY,
+    DRIVER_STORAGE_READ_BLOCKS, /* int (*)(device_t*, uint32_t lba, uint32_t count, uint8_t* buf) */
+    DRIVER_STORAGE_WRITE_BLOCKS, /* int (*)(device_t*, uint32_t lba, uint32_t count, uint8_t* buf) */
 };
 
 enum DRIVER_INPUT_SYSTEMS_OPERTAION {
@@ -114,6 +116,7 @@ enum DRIVER_FILE_SYSTEM_OPERTAION {
     DRIVER_FILE_SYSTEM_FSTAT,
     DRIVER_FILE_SYSTEM_IOCTL,
     DRIVER_FILE_SYSTEM_MMAP,
+    DRIVER_FILE_SYSTEM_WAIT_QUEUE,
 };
 
 typedef struct {
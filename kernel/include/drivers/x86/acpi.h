@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_DRIVERS_X86_ACPI_H
+#define _KERNEL_DRIVERS_X86_ACPI_H
+
+#include <libkern/c_attrs.h>
+#include <libkern/types.h>
+#include <platform/generic/cpu.h>
+
+#define ACPI_ISA_IRQS 16
+
+/* Flags of interrupt source overrides, MPS INTI format. */
+#define ACPI_IRQ_POLARITY_MASK 0x3
+#define ACPI_IRQ_POLARITY_LOW 0x3
+#define ACPI_IRQ_TRIGGER_MASK 0xc
+#define ACPI_IRQ_TRIGGER_LEVEL 0xc
+
+struct PACKED acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_paddr;
+};
+typedef struct acpi_rsdp acpi_rsdp_t;
+
+struct PACKED acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+};
+typedef struct acpi_sdt_header acpi_sdt_header_t;
+
+enum ACPI_MADT_ENTRY_TYPE {
+    ACPI_MADT_LAPIC = 0,
+    ACPI_MADT_IOAPIC = 1,
+    ACPI_MADT_INT_OVERRIDE = 2,
+};
+
+struct PACKED acpi_madt_entry {
+    uint8_t type;
+    uint8_t length;
+    union PACKED {
+        struct PACKED {
+            uint8_t acpi_id;
+            uint8_t apic_id;
+            uint32_t flags;
+        } lapic;
+        struct PACKED {
+            uint8_t ioapic_id;
+            uint8_t reserved;
+            uint32_t paddr;
+            uint32_t gsi_base;
+        } ioapic;
+        struct PACKED {
+            uint8_t bus;
+            uint8_t irq;
+            uint32_t gsi;
+            uint16_t flags;
+        } int_override;
+    };
+};
+typedef struct acpi_madt_entry acpi_madt_entry_t;
+
+/**
+ * What the kernel needs from the MADT to run the APICs: cpus which could
+ * be started and where ISA interrupts are wired to.
+ */
+struct acpi_apic_info {
+    uint32_t lapic_paddr;
+    int cpus_count;
+    uint8_t lapic_ids[CPU_CNT];
+    uint32_t ioapic_paddr;
+    uint32_t ioapic_gsi_base;
+    uint32_t isa_irq_gsi[ACPI_ISA_IRQS];
+    uint16_t isa_irq_flags[ACPI_ISA_IRQS];
+};
+typedef struct acpi_apic_info acpi_apic_info_t;
+
+int acpi_find_apic_info(acpi_apic_info_t* info);
+
+#endif /* _KERNEL_DRIVERS_X86_ACPI_H */
@@ -9,6 +9,8 @@
 
 #include <drivers/driver_manager.h>
 #include <drivers/x86/display.h>
+#include <libkern/c_attrs.h>
+#include <libkern/lock.h>
 #include <libkern/types.h>
 #include <mem/kmalloc.h>
 #include <platform/x86/port.h>
@@ -25,8 +27,55 @@ typedef struct { // LBA28 | LBA48
     uint32_t control;
 } ata_ports_t;
 
+#define ATA_SECTOR_SIZE 512
+#define ATA_MAX_SECTORS_PER_CMD 128 /* Fits into the 8bit sector count and a single PRD entry. */
+#define ATA_DMA_BUFFER_SIZE (ATA_MAX_SECTORS_PER_CMD * ATA_SECTOR_SIZE)
+#define ATA_MAX_CHANNELS 4
+
+enum ATA_COMMANDS {
+    ATA_CMD_READ_SECTORS = 0x20,
+    ATA_CMD_READ_SECTORS_NO_RETRY = 0x21,
+    ATA_CMD_WRITE_SECTORS = 0x30,
+    ATA_CMD_WRITE_SECTORS_NO_RETRY = 0x31,
+    ATA_CMD_READ_MULTIPLE = 0xC4,
+    ATA_CMD_WRITE_MULTIPLE = 0xC5,
+    ATA_CMD_SET_MULTIPLE = 0xC6,
+    ATA_CMD_READ_DMA = 0xC8,
+    ATA_CMD_WRITE_DMA = 0xCA,
+    ATA_CMD_FLUSH = 0xE7,
+    ATA_CMD_IDENTIFY = 0xEC,
+};
+
+/* Bus master IDE registers, offsets from the BAR4 of the controller. */
+enum ATA_BUS_MASTER_REGISTERS {
+    ATA_BM_COMMAND = 0x0,
+    ATA_BM_STATUS = 0x2,
+    ATA_BM_PRDT = 0x4,
+};
+
+#define ATA_BM_CMD_START 0x1
+#define ATA_BM_CMD_READ 0x8 /* Direction is from the device into memory. */
+#define ATA_BM_STATUS_ACTIVE 0x1
+#define ATA_BM_STATUS_ERROR 0x2
+#define ATA_BM_STATUS_IRQ 0x4
+#define ATA_PRD_END_OF_TABLE 0x8000
+
+struct PACKED ata_prd {
+    uint32_t paddr;
+    uint16_t len; /* 0 stands for 64KB. */
+    uint16_t flags;
+};
+typedef struct ata_prd ata_prd_t;
+
+/* Drives on a channel share its task file and bus master registers. */
+typedef struct {
+    uint32_t data_port;
+    lock_t lock;
+} ata_channel_t;
+
 typedef struct {
     ata_ports_t port;
+    ata_channel_t* channel;
     bool is_master;
     uint16_t cylindres;
     uint16_t heads;
@@ -34,6 +83,13 @@ typedef struct {
     bool dma;
     bool lba;
     uint32_t capacity; // in sectors
+    uint8_t multiple; // sectors per DRQ block for READ/WRITE MULTIPLE, 0 if unsupported
+
+    uint32_t bm_port; // 0 if bus master DMA isn't available
+    ata_prd_t* prdt;
+    uint32_t prdt_paddr;
+    uint8_t* dma_buf;
+    uint32_t dma_buf_paddr;
 } ata_t;
 
 extern ata_t _ata_drives[MAX_DEVICES_COUNT];
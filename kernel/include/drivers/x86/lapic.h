@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_DRIVERS_X86_LAPIC_H
+#define _KERNEL_DRIVERS_X86_LAPIC_H
+
+#include <libkern/types.h>
+
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xb0
+#define LAPIC_SVR 0xf0
+#define LAPIC_ESR 0x280
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_LVT_ERROR 0x370
+#define LAPIC_TIMER_INIT 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIV 0x3e0
+
+#define LAPIC_SVR_ENABLE 0x100
+#define LAPIC_LVT_MASKED 0x10000
+#define LAPIC_TIMER_PERIODIC 0x20000
+#define LAPIC_TIMER_DIV_16 0x3
+
+#define LAPIC_ICR_FIXED 0x000
+#define LAPIC_ICR_NMI 0x400
+#define LAPIC_ICR_INIT 0x500
+#define LAPIC_ICR_STARTUP 0x600
+#define LAPIC_ICR_PENDING 0x1000
+#define LAPIC_ICR_ASSERT 0x4000
+
+#define LAPIC_CALIBRATION_US 10000
+
+int lapic_install(uint32_t paddr);
+void lapic_setup_cpu();
+bool lapic_is_enabled();
+
+uint8_t lapic_id();
+void lapic_eoi();
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector);
+void lapic_send_nmi(uint8_t apic_id);
+void lapic_send_init(uint8_t apic_id);
+void lapic_send_startup(uint8_t apic_id, uint32_t paddr);
+
+#endif /* _KERNEL_DRIVERS_X86_LAPIC_H */
@@ -12,8 +12,14 @@
 
 #define PIT_BASE_FREQ 1193180
 #define TIMER_TICKS_PER_SECOND 125
+#define PIT_TSC_CALIBRATION_TICKS TIMER_TICKS_PER_SECOND
+#define PIT_WAIT_CHUNK_US 50000
 
 void pit_setup();
 void pit_handler();
+void pit_wait_us(uint32_t us);
+
+void timer_sync_tick();
+uint32_t timer_ns_since_tick();
 
 #endif /* _KERNEL_DRIVERS_X86_PIT_H */
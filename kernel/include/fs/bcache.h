@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_FS_BCACHE_H
+#define _KERNEL_FS_BCACHE_H
+
+#include <fs/vfs.h>
+#include <libkern/types.h>
+
+#define BCACHE_BLOCK_SIZE 512 /* Matches the sector size of storage drivers. */
+#define BCACHE_BLOCKS_COUNT 2048
+#define BCACHE_HASH_SIZE 512 /* Must be a power of 2. */
+#define BCACHE_READ_AHEAD_BLOCKS 16
+#define BCACHE_IO_BLOCKS 32 /* Max blocks moved by a single driver call. */
+#define BCACHE_NO_BLOCK 0xffffffff
+
+#define BCACHE_VALID 0x1
+#define BCACHE_DIRTY 0x2
+#define BCACHE_BUSY 0x4 /* The entry is being read or written back by the driver. */
+
+struct bcache_entry {
+    device_t* dev;
+    uint32_t block;
+    uint32_t flags;
+    uint8_t* data;
+    struct bcache_entry* hash_next;
+    struct bcache_entry* lru_prev;
+    struct bcache_entry* lru_next;
+};
+typedef struct bcache_entry bcache_entry_t;
+
+struct bcache_stat {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t read_ahead;
+    uint32_t evictions;
+    uint32_t write_backs;
+    uint32_t dirty;
+    uint32_t cached;
+    uint32_t capacity;
+};
+typedef struct bcache_stat bcache_stat_t;
+
+void bcache_init();
+
+int bcache_read(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+int bcache_write(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+
+int bcache_flush_device(device_t* dev);
+int bcache_invalidate_device(device_t* dev);
+void bcache_flusher();
+
+void bcache_get_stat(bcache_stat_t* stat);
+
+#endif // _KERNEL_FS_BCACHE_H
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_FS_PAGE_CACHE_H
+#define _KERNEL_FS_PAGE_CACHE_H
+
+#include <algo/rbtree.h>
+#include <libkern/types.h>
+
+#define PAGE_CACHE_DIRTY 0x1
+
+struct dentry;
+
+struct page_cache_entry {
+    rbtree_node_t node;
+    uint32_t index; /* Page number in the file. */
+    uint32_t frame;
+    uint32_t flags;
+};
+typedef struct page_cache_entry page_cache_entry_t;
+
+struct page_cache_stat {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t write_backs;
+    uint32_t cached;
+};
+typedef struct page_cache_stat page_cache_stat_t;
+
+void page_cache_init();
+
+uint32_t page_cache_get_frame(struct dentry* dentry, uint32_t offset);
+void page_cache_mark_dirty(struct dentry* dentry, uint32_t offset);
+void page_cache_update(struct dentry* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+
+int page_cache_flush(struct dentry* dentry);
+void page_cache_drop(struct dentry* dentry);
+
+void page_cache_get_stat(page_cache_stat_t* stat);
+
+#endif // _KERNEL_FS_PAGE_CACHE_H
@@ -7,11 +7,13 @@
 #ifndef _KERNEL_FS_VFS_H
 #define _KERNEL_FS_VFS_H
 
+#include <algo/rbtree.h>
 #include <algo/sync_ringbuffer.h>
 #include <drivers/driver_manager.h>
 #include <fs/ext2/ext2.h>
 #include <libkern/lock.h>
 #include <libkern/syscall_structs.h>
+#include <tasking/wait_queue.h>
 
 #define DENTRY_WAS_IN_CACHE 0
 #define DENTRY_NEWLY_ALLOCATED 1
@@ -70,17 +72,56 @@ struct dentry {
     struct dentry* mounted_dentry;
 
     struct socket* sock;
+
+    rbtree_t pages; /* Cached pages of the file, see fs/page_cache.c. */
+
+    /* Dentry cache, guarded by its lock, see fs/dentry.c. */
+    uint32_t cache_flags;
+    struct dentry* hash_next;
+    struct dentry* lru_prev;
+    struct dentry* lru_next;
 };
 typedef struct dentry dentry_t;
 
-struct dentry_cache_list {
-    struct dentry_cache_list* prev;
-    struct dentry_cache_list* next;
-    dentry_t* data;
+#define DENTRY_HASH_SIZE 256 /* Must be a power of 2. */
+#define DENTRY_UNUSED_MAX 1024 /* Unused dentries kept while memory is plentiful. */
+#define DENTRY_UNUSED_MIN 32
+
+#define DENTRY_CACHE_HASHED 0x1
+#define DENTRY_CACHE_ON_LRU 0x2
+
+/* Path components resolved in a directory, inode_indx is 0 for a name which doesn't exist. */
+#define DENTRY_NAME_LEN 32
+#define DENTRY_NAMES_HASH_SIZE 512 /* Must be a power of 2. */
+#define DENTRY_NAMES_MAX 2048
+#define DENTRY_NAMES_MIN 64
+struct dentry_name {
+    struct dentry_name* hash_next;
+    struct dentry_name* lru_prev;
+    struct dentry_name* lru_next;
+    uint32_t hash;
+    uint32_t dev_indx;
+    uint32_t parent_inode_indx;
+    uint32_t inode_indx;
     uint32_t len;
-    lock_t lock;
+    char name[DENTRY_NAME_LEN];
+};
+typedef struct dentry_name dentry_name_t;
+
+struct dentry_cache_stat {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t cached;
+    uint32_t unused;
+    uint32_t unused_limit;
+    uint32_t name_hits;
+    uint32_t negative_hits;
+    uint32_t name_misses;
+    uint32_t names;
+    uint32_t negative_names;
 };
-typedef struct dentry_cache_list dentry_cache_list_t;
+typedef struct dentry_cache_stat dentry_cache_stat_t;
 
 struct file_descriptor;
 struct file_ops {
@@ -99,6 +140,7 @@ struct file_ops {
     int (*ioctl)(dentry_t* dentry, uint32_t cmd, uint32_t arg);
     int (*fstat)(dentry_t* dentry, fstat_t* stat);
     struct proc_zone* (*mmap)(dentry_t* dentry, mmap_params_t* params);
+    wait_queue_t* (*wait_queue)(dentry_t* dentry);
 };
 typedef struct file_ops file_ops_t;
 
@@ -129,30 +171,47 @@ typedef struct fs_desc fs_desc_t;
 enum FD_TYPE {
     FD_TYPE_FILE,
     FD_TYPE_SOCKET,
+    FD_TYPE_EPOLL,
 };
 
+struct epoll;
+struct epoll_item;
+
 // TODO: Locks might be implemented as RWLocks.
 struct file_descriptor {
     uint32_t type;
     union {
         dentry_t* dentry; // type == FD_TYPE_FILE
         struct socket* sock_entry; // type == FD_TYPE_SOCKET
+        struct epoll* epoll_entry; // type == FD_TYPE_EPOLL
     };
     uint32_t offset;
     uint32_t flags;
     file_ops_t* ops;
     lock_t lock;
+    struct epoll_item* epoll_items; // Epoll instances watching the fd.
 };
 typedef struct file_descriptor file_descriptor_t;
 
+#define SOCKET_BACKLOG_SIZE 8
+
 struct socket {
     uint32_t d_count;
     int domain;
     int type;
     int protocol;
-    sync_ringbuffer_t buffer;
+    int state;
+    sync_ringbuffer_t buffer; // Data sent by the peer to this end.
     file_descriptor_t bind_file;
-    lock_t lock;
+    wait_queue_t wait_queue;
+
+    /* Connected sockets */
+    struct socket* peer;
+
+    /* Listening sockets */
+    struct socket* backlog[SOCKET_BACKLOG_SIZE];
+    uint32_t backlog_start;
+    uint32_t backlog_cnt;
 };
 typedef struct socket socket_t;
 
@@ -160,6 +219,7 @@ typedef struct socket socket_t;
  * DENTRIES
  */
 
+void dentry_init();
 void dentry_flusher();
 
 void dentry_set_parent(dentry_t* to, dentry_t* parent);
@@ -185,6 +245,12 @@ void dentry_rem_flag_lockless(dentry_t* dentry, uint32_t flag);
 bool dentry_inode_test_flag_lockless(dentry_t* dentry, mode_t mode);
 
 uint32_t dentry_stat_cached_count();
+void dentry_get_stat(dentry_cache_stat_t* stat);
+
+int dentry_name_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result, uint32_t* generation);
+void dentry_name_add(dentry_t* dir, const char* name, uint32_t len, dentry_t* child, uint32_t generation);
+void dentry_name_forget(dentry_t* dir, const char* name, uint32_t len);
+void dentry_name_forget_inode(dentry_t* dentry);
 
 /**
  * VFS HELPERS
@@ -215,6 +281,7 @@ int vfs_open(dentry_t* file, file_descriptor_t* fd, uint32_t flags);
 int vfs_close(file_descriptor_t* fd);
 bool vfs_can_read(file_descriptor_t* fd);
 bool vfs_can_write(file_descriptor_t* fd);
+wait_queue_t* vfs_wait_queue(file_descriptor_t* fd);
 int vfs_read(file_descriptor_t* fd, void* buf, uint32_t len);
 int vfs_write(file_descriptor_t* fd, void* buf, uint32_t len);
 int vfs_mkdir(dentry_t* dir, const char* name, size_t len, mode_t mode);
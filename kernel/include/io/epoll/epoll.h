@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_IO_EPOLL_EPOLL_H
+#define _KERNEL_IO_EPOLL_EPOLL_H
+
+#include <fs/vfs.h>
+#include <libkern/lock.h>
+#include <libkern/syscall_structs.h>
+#include <libkern/types.h>
+#include <tasking/wait_queue.h>
+
+struct epoll;
+
+/**
+ * An item is a registration of an fd in an epoll instance. The item
+ * sits in the wait queue of the file, so the file marks the item as
+ * ready when it wakes its waiters.
+ */
+struct epoll_item {
+    struct epoll* epoll;
+    file_descriptor_t* fd;
+    int fd_id;
+    uint32_t events;
+    epoll_data_t data;
+    wait_queue_entry_t wait_entry;
+    bool has_wait_queue;
+    bool ready;
+    struct epoll_item* next; // in epoll->items
+    struct epoll_item* ready_next; // in epoll->ready_head
+    struct epoll_item* fd_next; // in fd->epoll_items
+};
+typedef struct epoll_item epoll_item_t;
+
+struct epoll {
+    lock_t lock;
+    epoll_item_t* items;
+    epoll_item_t* ready_head;
+    epoll_item_t* ready_tail;
+    int items_without_wait_queue;
+    wait_queue_t wait_queue; // Threads blocked in epoll_wait
+};
+typedef struct epoll epoll_t;
+
+int epoll_create(file_descriptor_t* fd);
+int epoll_free(epoll_t* ep);
+int epoll_ctl(epoll_t* ep, int op, int fd_id, file_descriptor_t* fd, epoll_event_t* event);
+int epoll_collect(epoll_t* ep, epoll_event_t* events, int maxevents);
+bool epoll_has_ready(epoll_t* ep);
+void epoll_forget_fd(file_descriptor_t* fd);
+
+#endif /* _KERNEL_IO_EPOLL_EPOLL_H */
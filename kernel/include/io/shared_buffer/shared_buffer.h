@@ -13,5 +13,8 @@ int shared_buffer_init();
 int shared_buffer_create(uint8_t** buffer, size_t size);
 int shared_buffer_get(int id, uint8_t** buffer);
 int shared_buffer_free(int id);
+int shared_buffer_publish(int id, uint32_t key);
+int shared_buffer_find(uint32_t key);
+void shared_buffer_release_proc(pid_t pid);
 
 #endif /* _KERNEL_IO_SHARED_BUFFER_SHARED_BUFFER_H */
\ No newline at end of file
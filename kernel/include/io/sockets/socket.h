@@ -11,10 +11,23 @@
 #include <libkern/syscall_structs.h>
 #include <libkern/types.h>
 
-#define MAX_SOCKET_COUNT 16
+enum SOCKET_STATE {
+    SOCKET_UNCONNECTED,
+    SOCKET_LISTENING,
+    SOCKET_CONNECTED,
+    SOCKET_DISCONNECTED, // The peer has closed the connection.
+};
 
+void socket_init();
 int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, file_ops_t* ops);
 socket_t* socket_duplicate(socket_t* sock);
 int socket_put(socket_t* sock);
 
+socket_t* socket_get_peer(socket_t* sock);
+int socket_connect_to(socket_t* sock, socket_t* listener);
+socket_t* socket_take_pending(socket_t* listener);
+bool socket_has_pending(socket_t* listener);
+uint32_t socket_space_to_write(socket_t* sock);
+int socket_write_to_peer(socket_t* sock, const uint8_t* buf, uint32_t len);
+
 #endif /* _KERNEL_IO_SOCKETS_SOCKET_H */
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include <algo/sync_ringbuffer.h>
 #include <fs/vfs.h>
+#include <tasking/wait_queue.h>
 
 #ifndef PTYS_COUNT
 #define PTYS_COUNT 16
@@ -18,6 +19,7 @@ struct pty_slave_entry;
 struct pty_master_entry {
     sync_ringbuffer_t buffer;
     struct pty_slave_entry* pts;
+    wait_queue_t wait_queue;
     dentry_t dentry;
 };
 typedef struct pty_master_entry pty_master_entry_t;
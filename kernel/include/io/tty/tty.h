@@ -10,6 +10,7 @@
 #include <algo/sync_ringbuffer.h>
 #include <drivers/x86/keyboard.h>
 #include <libkern/types.h>
+#include <tasking/wait_queue.h>
 
 #define TTY_MAX_COUNT 8
 #define TTY_BUFFER_SIZE 1024
@@ -81,6 +82,7 @@ struct tty_entry {
     int lines_avail;
     uint32_t pgid;
     termios_t termios;
+    wait_queue_t wait_queue;
 };
 typedef struct tty_entry tty_entry_t;
 
@@ -48,6 +48,18 @@ enum __sysid {
     SYS_SHBUF_CREATE,
     SYS_SHBUF_GET,
     SYS_SHBUF_FREE,
+    SYS_NANOSLEEP,
+    SYS_CLOCK_NANOSLEEP,
+    SYS_EPOLL_CREATE,
+    SYS_EPOLL_CTL,
+    SYS_EPOLL_WAIT,
+    SYS_ACCEPT,
+    SYS_SHBUF_PUBLISH,
+    SYS_SHBUF_FIND,
+    SYS_FUTEX,
+    SYS_THREAD_EXIT,
+    SYS_SCHED_SETAFFINITY,
+    SYS_SCHED_GETAFFINITY,
 };
 typedef enum __sysid sysid_t;
 
@@ -48,4 +48,6 @@ typedef enum {
     CLOCK_THREAD_CPUTIME_ID,
 } clockid_t;
 
+#define TIMER_ABSTIME 1
+
 #endif // _KERNEL_LIBKERN_BITS_TIME_H
@@ -34,6 +34,11 @@ static ALWAYS_INLINE void lock_acquire(lock_t* lock)
     }
 }
 
+static ALWAYS_INLINE bool lock_try_acquire(lock_t* lock)
+{
+    return __atomic_exchange_n(&lock->status, 1, __ATOMIC_ACQUIRE) == 0;
+}
+
 static ALWAYS_INLINE void lock_release(lock_t* lock)
 {
     ASSERT(lock->status == 1);
@@ -2,6 +2,7 @@
 #define _KERNEL_LIBKERN_SYSCALL_STRUCTS_H
 
 #include <libkern/bits/fcntl.h>
+#include <libkern/bits/sys/epoll.h>
 #include <libkern/bits/sys/ioctls.h>
 #include <libkern/bits/sys/mman.h>
 #include <libkern/bits/sys/select.h>
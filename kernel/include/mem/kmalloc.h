@@ -10,8 +10,28 @@
 #include <libkern/types.h>
 #include <mem/vmm/vmm.h>
 
-#define KMALLOC_SPACE_SIZE (4 * MB)
-#define KMALLOC_BLOCK_SIZE 32
+#define KMALLOC_SPACE_SIZE (8 * MB)
+#define KMALLOC_PAGES (KMALLOC_SPACE_SIZE / VMM_PAGE_SIZE)
+
+/* Generic caches serve power-of-two sizes from 16 up to KMALLOC_MAX_CACHED_SIZE bytes. */
+#define KMALLOC_MIN_CACHE_SHIFT 4
+#define KMALLOC_GENERIC_CACHES 8
+#define KMALLOC_MAX_CACHED_SIZE (1 << (KMALLOC_MIN_CACHE_SHIFT + KMALLOC_GENERIC_CACHES - 1))
+
+#define KMEM_MIN_OBJECTS_PER_SLAB 8
+#define KMEM_MAGAZINE_SIZE 16
+
+struct kmem_cache;
+typedef struct kmem_cache kmem_cache_t;
+
+struct kmem_cache_stat {
+    const char* name;
+    uint32_t object_size;
+    uint32_t active_objects;
+    uint32_t total_objects;
+    uint32_t slabs;
+};
+typedef struct kmem_cache_stat kmem_cache_stat_t;
 
 void kmalloc_init();
 void* kmalloc(uint32_t size);
@@ -21,4 +41,11 @@ void kfree(void* ptr);
 void kfree_aligned(void* ptr);
 void* krealloc(void* ptr, uint32_t size);
 
+/* Objects of a cache could be freed with kfree as well. */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* ptr);
+int kmem_cache_get_stat(int index, kmem_cache_stat_t* stat);
+uint32_t kmalloc_large_pages();
+
 #endif // _KERNEL_MEM_KMALLOC_H
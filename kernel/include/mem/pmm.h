@@ -4,6 +4,13 @@
 #include <libkern/types.h>
 #include <platform/generic/pmm/settings.h>
 
+#define PMM_FRAME_REF_MAX 0xffff
+typedef uint16_t pmm_frame_ref_t;
+
+// Free memory is kept in chunks of up to 2^PMM_MAX_ORDER blocks.
+#define PMM_MAX_ORDER 15
+#define PMM_HOT_LIST_SIZE 32
+
 typedef struct {
     uint32_t startLo;
     uint32_t startHi;
@@ -25,15 +32,23 @@ static uint8_t* pmm_mat;
 static uint32_t pmm_mat_size;
 
 void pmm_setup(mem_desc_t* mem_desc);
+uint32_t pmm_buddy_table_size();
+void pmm_setup_buddy(void* table);
 
 void* pmm_alloc(uint32_t act_size);
 void* pmm_alloc_aligned(uint32_t act_size, uint32_t alignment);
 void* pmm_alloc_block();
 void* pmm_alloc_blocks(uint32_t t_size);
+void* pmm_alloc_blocks_aligned(uint32_t t_size, uint32_t al);
 bool pmm_free(void* block, uint32_t act_size);
 bool pmm_free_block(void* t_block);
 bool pmm_free_blocks(void* t_block, uint32_t t_size);
 
+void pmm_setup_frame_refs(pmm_frame_ref_t* refs);
+uint32_t pmm_frame_ref(uint32_t paddr);
+uint32_t pmm_frame_unref(uint32_t paddr);
+uint32_t pmm_frame_refcount(uint32_t paddr);
+
 uint32_t pmm_get_ram_size();
 uint32_t pmm_get_max_blocks();
 uint32_t pmm_get_used_blocks();
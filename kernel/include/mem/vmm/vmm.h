@@ -49,7 +49,7 @@ enum VMM_PF_HANDLER {
     SHOULD_CRASH = -1,
 };
 
-struct dynamic_array;
+struct rbtree;
 
 /**
  * PUBLIC FUNCTIONS
@@ -59,8 +59,8 @@ int vmm_setup();
 int vmm_setup_secondary_cpu();
 
 int vmm_allocate_ptable(uint32_t vaddr);
-int vmm_free_ptable(uint32_t vaddr, struct dynamic_array* zones);
-int vmm_free_pdir(pdirectory_t* pdir, struct dynamic_array* zones);
+int vmm_free_ptable(uint32_t vaddr, struct rbtree* zones);
+int vmm_free_pdir(pdirectory_t* pdir, struct rbtree* zones);
 
 int vmm_map_page(uint32_t vaddr, uint32_t paddr, uint32_t settings);
 int vmm_map_pages(uint32_t vaddr, uint32_t paddr, uint32_t n_pages, uint32_t settings);
@@ -72,8 +72,10 @@ pdirectory_t* vmm_new_user_pdir();
 pdirectory_t* vmm_new_forked_user_pdir();
 void* vmm_bring_to_kernel(uint8_t* src, uint32_t length);
 void vmm_prepare_active_pdir_for_copying_at(uint32_t dest_vaddr, uint32_t length);
+uint32_t vmm_get_user_frame_for_writing(uint32_t vaddr);
 void vmm_copy_to_user(void* dest, void* src, uint32_t length);
-void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
+int vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
+void vmm_copy_image_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
 void vmm_zero_user_pages(pdirectory_t* pdir);
 
 pdirectory_t* vmm_get_active_pdir();
@@ -82,7 +84,8 @@ pdirectory_t* vmm_get_kernel_pdir();
 int vmm_load_page(uint32_t vaddr, uint32_t settings);
 int vmm_tune_page(uint32_t vaddr, uint32_t settings);
 int vmm_tune_pages(uint32_t vaddr, uint32_t length, uint32_t settings);
-int vmm_free_page(uint32_t vaddr, page_desc_t* page, struct dynamic_array* zones);
+int vmm_free_page(uint32_t vaddr, page_desc_t* page, struct rbtree* zones);
+int vmm_free_user_pages(uint32_t vaddr, uint32_t length, struct rbtree* zones);
 
 int vmm_switch_pdir(pdirectory_t* pdir);
 void vmm_enable_paging();
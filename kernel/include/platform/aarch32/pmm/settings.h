@@ -14,5 +14,6 @@
 #define PMM_BLOCK_SIZE (1024)
 #define PMM_BLOCK_SIZE_KB (1)
 #define PMM_BLOCKS_PER_BYTE (8)
+#define PMM_HOT_ORDER (2) // Chunks of a VMM page are cached per cpu.
 
 #endif /* _KERNEL_PLATFORM_AARCH32_PMM_SETTINGS_H */
\ No newline at end of file
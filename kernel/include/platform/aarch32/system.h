@@ -57,6 +57,27 @@ inline static void system_flush_whole_tlb()
     system_data_synchronise_barrier();
 }
 
+/* Inner shareable variants are broadcast to all cpus by the hardware. */
+inline static void system_flush_tlb_entry_all_cpus(uint32_t vaddr)
+{
+    system_data_synchronise_barrier();
+    asm volatile("mcr p15, 0, %0, c8, c3, 1"
+                 :
+                 : "r"(vaddr)
+                 : "memory");
+    system_data_synchronise_barrier();
+    system_instruction_barrier();
+}
+
+inline static void system_flush_whole_tlb_all_cpus()
+{
+    asm volatile("mcr p15, 0, %0, c8, c3, 0"
+                 :
+                 : "r"(0)
+                 : "memory");
+    system_data_synchronise_barrier();
+}
+
 inline static void system_set_pdir(uint32_t pdir)
 {
     system_data_synchronise_barrier();
@@ -118,4 +139,9 @@ inline static int system_cpu_id()
     return res & 0x3;
 }
 
+/* Idle cpus pick up new threads on their next timer tick. */
+inline static void system_wake_cpu(int cpu_id)
+{
+}
+
 #endif /* _KERNEL_PLATFORM_AARCH32_SYSTEM_H */
\ No newline at end of file
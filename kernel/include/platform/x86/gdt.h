@@ -10,12 +10,12 @@
 #include <libkern/c_attrs.h>
 #include <libkern/types.h>
 
-#define GDT_MAX_ENTRIES 6
 #define SEG_KCODE 1 // kernel code
 #define SEG_KDATA 2 // kernel data+stack
 #define SEG_UCODE 3 // user code
 #define SEG_UDATA 4 // user data+stack
-#define SEG_TSS 5 // task state NOT USED CURRENTLY
+#define SEG_TSS 5 // task state, one per cpu
+#define GDT_MAX_ENTRIES (SEG_TSS + CPU_CNT)
 
 #define SEGF_X 0x8 // exec
 #define SEGF_A 0x1 // accessed
@@ -45,7 +45,7 @@ struct PACKED gdt_entry {
     uint32_t base_31_24 : 8;
 };
 
-extern struct gdt_entry gdt[GDT_MAX_ENTRIES];
+extern struct gdt_entry gdt[];
 
 // segment with page granularity
 #define SEG_PG(type, base, limit, dpl)                                    \
@@ -66,5 +66,6 @@ extern struct gdt_entry gdt[GDT_MAX_ENTRIES];
     }
 
 void gdt_setup();
+void gdt_load();
 
 #endif // _KERNEL_PLATFORM_X86_GDT_H
\ No newline at end of file
@@ -31,6 +31,7 @@ struct PACKED idt_entry { // call gate
 extern struct idt_entry idt[IDT_ENTRIES];
 extern void** handlers[IDT_ENTRIES];
 
+void lidt(void* p, uint16_t size);
 void idt_element_setup(uint8_t n, void* handler_addr, bool user);
 void interrupts_setup();
 
@@ -87,6 +88,10 @@ extern void irq12();
 extern void irq13();
 extern void irq14();
 extern void irq15();
+extern void irq_lapic_timer();
+extern void irq_ipi_resched();
+extern void irq_lapic_spurious();
+extern void isr_nmi();
 extern void irq_null();
 extern void irq_empty_handler();
 
@@ -109,4 +114,9 @@ extern void syscall();
 #define IRQ14 46
 #define IRQ15 47
 
+/* Vectors of local APIC interrupts. */
+#define IRQ_LAPIC_TIMER 48
+#define IRQ_IPI_RESCHED 49
+#define IRQ_LAPIC_SPURIOUS 0xff
+
 #endif // _KERNEL_PLATFORM_X86_IDT_H
@@ -16,5 +16,6 @@
 #define ICW4_8086 0x01
 
 void pic_remap(unsigned int offset1, unsigned int offset2);
+void pic_disable();
 
 #endif
\ No newline at end of file
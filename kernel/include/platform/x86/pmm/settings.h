@@ -13,5 +13,6 @@
 #define PMM_BLOCK_SIZE (4096)
 #define PMM_BLOCK_SIZE_KB (4)
 #define PMM_BLOCKS_PER_BYTE (8)
+#define PMM_HOT_ORDER (0) // Chunks of a VMM page are cached per cpu.
 
 #endif /* _KERNEL_PLATFORM_X86_PMM_SETTINGS_H */
\ No newline at end of file
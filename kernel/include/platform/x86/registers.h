@@ -37,4 +37,12 @@ static inline void write_cr0(uint32_t val)
                  : "r"(val));
 }
 
+static inline uint64_t read_tsc()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc"
+                 : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 #endif /* _KERNEL_PLATFORM_X86_REGISTERS_H */
\ No newline at end of file
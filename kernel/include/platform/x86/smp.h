@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_PLATFORM_X86_SMP_H
+#define _KERNEL_PLATFORM_X86_SMP_H
+
+#include <libkern/types.h>
+
+/* Application processors start in real mode at this page. */
+#define SMP_TRAMPOLINE_PADDR 0x70000
+#define SMP_AP_BOOT_STACK_SIZE 4096
+#define SMP_AP_START_TIMEOUT_MS 100
+
+/* Vaddrs are page aligned, so low bits mark requests of TLB shootdowns. */
+#define SMP_TLB_PENDING 0x1
+#define SMP_TLB_FLUSH_ALL 0x2
+
+int smp_install();
+void smp_setup_secondary_cpu();
+
+void smp_tlb_shootdown(uint32_t vaddr);
+void smp_nmi_handler();
+void smp_send_resched(int cpu_id);
+
+#endif /* _KERNEL_PLATFORM_X86_SMP_H */
@@ -10,6 +10,8 @@
 #include <libkern/c_attrs.h>
 #include <libkern/types.h>
 #include <platform/generic/registers.h>
+#include <platform/x86/gdt.h>
+#include <platform/x86/smp.h>
 
 /**
  * INTS
@@ -41,18 +43,37 @@ inline static void system_flush_whole_tlb()
     system_set_pdir(read_cr3());
 }
 
+/* Other cpus are asked to flush with an IPI, see smp_tlb_shootdown(). */
+inline static void system_flush_tlb_entry_all_cpus(uint32_t vaddr)
+{
+    system_flush_tlb_entry(vaddr);
+    smp_tlb_shootdown(vaddr);
+}
+
+inline static void system_flush_whole_tlb_all_cpus()
+{
+    system_flush_whole_tlb();
+    smp_tlb_shootdown(SMP_TLB_FLUSH_ALL);
+}
+
 inline static void system_enable_write_protect()
 {
-    asm volatile("mov %cr0, %eax");
-    asm volatile("or $0x10000, %eax");
-    asm volatile("mov %eax, %cr0");
+    asm volatile("mov %%cr0, %%eax\n"
+                 "or $0x10000, %%eax\n"
+                 "mov %%eax, %%cr0"
+                 :
+                 :
+                 : "eax", "memory");
 }
 
 inline static void system_disable_write_protect()
 {
-    asm volatile("mov %cr0, %eax");
-    asm volatile("and $0xFFFEFFFF, %eax");
-    asm volatile("mov %eax, %cr0");
+    asm volatile("mov %%cr0, %%eax\n"
+                 "and $0xFFFEFFFF, %%eax\n"
+                 "mov %%eax, %%cr0"
+                 :
+                 :
+                 : "eax", "memory");
 }
 
 inline static void system_enable_paging()
@@ -85,9 +106,21 @@ NORETURN inline static void system_stop()
  * CPU
  */
 
+/**
+ * Every cpu loads its own TSS (see tss_load()), so the task register tells
+ * the id of the cpu. It's 0 only on the boot cpu before its TSS is loaded.
+ */
 inline static int system_cpu_id()
 {
-    return 0;
+    uint16_t tr;
+    asm volatile("str %0"
+                 : "=r"(tr));
+    return tr ? (tr >> 3) - SEG_TSS : 0;
+}
+
+inline static void system_wake_cpu(int cpu_id)
+{
+    smp_send_resched(cpu_id);
 }
 
 #endif /* _KERNEL_PLATFORM_X86_SYSTEM_H */
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <libkern/types.h>
 struct thread;
 
+#define SIGNAL_IMPL_FRAME_SIZE (14 * sizeof(uint32_t)) // Pushed to the user stack by signal_impl_prepare_stack.
+
 int signal_impl_prepare_stack(struct thread* thread, int signo, uint32_t old_sp, uint32_t magic);
 int signal_impl_restore_stack(struct thread* thread, uint32_t* old_sp, uint32_t* magic);
 
@@ -55,8 +55,9 @@ struct PACKED tss {
 };
 typedef struct tss tss_t;
 
-extern tss_t tss;
+extern tss_t tss[];
 
 void ltr(uint16_t seg);
+void tss_load(int cpu_id);
 
 #endif //_KERNEL_PLATFORM_X86_TASKING_TSS_H
\ No newline at end of file
@@ -46,15 +46,20 @@ void sys_munmap(trapframe_t* tf);
 void sys_socket(trapframe_t* tf);
 void sys_bind(trapframe_t* tf);
 void sys_connect(trapframe_t* tf);
+void sys_accept(trapframe_t* tf);
 void sys_getdents(trapframe_t* tf);
 void sys_ioctl(trapframe_t* tf);
 void sys_setpgid(trapframe_t* tf);
 void sys_getpgid(trapframe_t* tf);
 void sys_create_thread(trapframe_t* tf);
+void sys_thread_exit(trapframe_t* tf);
+void sys_futex(trapframe_t* tf);
 void sys_sleep(trapframe_t* tf);
 void sys_select(trapframe_t* tf);
 void sys_fstat(trapframe_t* tf);
 void sys_sched_yield(trapframe_t* tf);
+void sys_sched_setaffinity(trapframe_t* tf);
+void sys_sched_getaffinity(trapframe_t* tf);
 void sys_uname(trapframe_t* tf);
 void sys_clock_settime(trapframe_t* tf);
 void sys_clock_gettime(trapframe_t* tf);
@@ -63,6 +68,13 @@ void sys_nice(trapframe_t* tf);
 void sys_shbuf_create(trapframe_t* tf);
 void sys_shbuf_get(trapframe_t* tf);
 void sys_shbuf_free(trapframe_t* tf);
+void sys_shbuf_publish(trapframe_t* tf);
+void sys_shbuf_find(trapframe_t* tf);
+void sys_nanosleep(trapframe_t* tf);
+void sys_clock_nanosleep(trapframe_t* tf);
+void sys_epoll_create(trapframe_t* tf);
+void sys_epoll_ctl(trapframe_t* tf);
+void sys_epoll_wait(trapframe_t* tf);
 
 void sys_none(trapframe_t* tf);
 
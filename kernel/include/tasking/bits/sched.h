@@ -7,6 +7,9 @@
 #ifndef _KERNEL_TASKING_BITS_SCHED_H
 #define _KERNEL_TASKING_BITS_SCHED_H
 
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
 #define MAX_PRIO 0
 #define MIN_PRIO 11
 #define IDLE_PRIO (MIN_PRIO + 1)
@@ -16,6 +19,12 @@
 #define SCHED_INT 10
 #define LAST_CPU_NOT_SET 0xffff
 
+/* Load balancing, see sched.c. */
+#define SCHED_BALANCE_INTERVAL 25 /* Ticks between periodic balancing of a busy cpu. */
+#define SCHED_IMBALANCE_MIN 2 /* Difference of queues which is worth a migration. */
+#define SCHED_MIGRATION_COST 2 /* Ticks a thread stays cache hot after it ran. */
+#define SCHED_BALANCE_FAILED_MAX 4 /* Failed attempts after which hot threads are moved too. */
+
 struct thread;
 
 struct runqueue {
@@ -24,11 +33,15 @@ struct runqueue {
 };
 typedef struct runqueue runqueue_t;
 
+/* Other cpus enqueue woken threads, so runqueues are guarded by the lock. */
 struct sched_data {
+    lock_t lock;
     int next_read_prio;
     runqueue_t* master_buf;
     runqueue_t* slave_buf;
     int enqueued_tasks;
+    time_t next_balance_tick;
+    int balance_failed;
 };
 typedef struct sched_data sched_data_t;
 
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_TASKING_FUTEX_H
+#define _KERNEL_TASKING_FUTEX_H
+
+#include <libkern/types.h>
+#include <tasking/thread.h>
+
+#define FUTEX_HASH_SIZE 64 /* Must be a power of 2. */
+#define FUTEX_WAKE_ALL 0x7fffffff
+
+void futex_init();
+
+int futex_wait(thread_t* thread, uint32_t* uaddr, uint32_t val, uint64_t unblock_time, bool private);
+int futex_wake(thread_t* thread, uint32_t* uaddr, int count, bool private);
+
+#endif // _KERNEL_TASKING_FUTEX_H
@@ -8,6 +8,7 @@
 #define _KERNEL_TASKING_PROC_H
 
 #include <algo/dynamic_array.h>
+#include <algo/rbtree.h>
 #include <fs/vfs.h>
 #include <io/tty/tty.h>
 #include <libkern/atomic.h>
@@ -17,7 +18,7 @@
 #include <mem/vmm/zoner.h>
 
 #define MAX_PROCESS_COUNT 1024
-#define MAX_OPENED_FILES 16
+#define MAX_OPENED_FILES 64
 
 struct blocker;
 
@@ -44,12 +45,19 @@ enum ZONE_TYPES {
 };
 
 struct proc_zone {
+    rbtree_node_t node; /* Should be the first, zones are nodes of proc->zones. */
     uint32_t start;
     uint32_t len;
     uint32_t type;
     uint32_t flags;
     dentry_t* file;
     uint32_t offset;
+    uint32_t file_size; /* Bytes of the zone backed by the file, the rest reads as zeros. */
+
+    /* Span of the subtree and the largest free gap between its zones. */
+    uint32_t subtree_start;
+    uint32_t subtree_end;
+    uint32_t subtree_gap;
 };
 typedef struct proc_zone proc_zone_t;
 
@@ -78,7 +86,8 @@ struct proc {
     uid_t suid;
     gid_t sgid;
 
-    dynamic_array_t zones;
+    rbtree_t zones;
+    struct proc* pdir_next; /* Next proc in the same bucket of the pdir lookup table. */
 
     dentry_t* proc_file;
     dentry_t* cwd;
@@ -137,13 +146,20 @@ int proc_get_fd_id(proc_t* proc, file_descriptor_t* fd);
  * PROC ZONER FUNCTIONS
  */
 
+void proc_zoner_init();
+void proc_zones_init(rbtree_t* zones);
+int proc_zones_copy(rbtree_t* to, rbtree_t* from);
+void proc_zones_free(rbtree_t* zones);
+
 proc_zone_t* proc_new_zone(proc_t* p, uint32_t start, uint32_t len);
 proc_zone_t* proc_extend_zone(proc_t* proc, uint32_t start, uint32_t len);
 proc_zone_t* proc_new_random_zone(proc_t* p, uint32_t len);
 proc_zone_t* proc_new_random_zone_backward(proc_t* p, uint32_t len);
+proc_zone_t* proc_split_zone(proc_t* p, proc_zone_t* zone, uint32_t at);
 proc_zone_t* proc_find_zone(proc_t* p, uint32_t addr);
-proc_zone_t* proc_find_zone_no_proc(dynamic_array_t* zones, uint32_t addr);
-int proc_delete_zone_no_proc(dynamic_array_t*, proc_zone_t*);
+proc_zone_t* proc_find_zone_no_proc(rbtree_t* zones, uint32_t addr);
+bool proc_is_range_writable(proc_t* p, uint32_t start, uint32_t len);
+int proc_delete_zone_no_proc(rbtree_t*, proc_zone_t*);
 int proc_delete_zone(proc_t*, proc_zone_t*);
 
 #endif // _KERNEL_TASKING_PROC_H
\ No newline at end of file
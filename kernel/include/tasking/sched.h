@@ -21,6 +21,9 @@ void sched_enqueue(thread_t* thread);
 void sched_dequeue(thread_t* thread);
 uint32_t active_cpu_count();
 
+#define SCHED_CPU_MASK_ALL ((uint32_t)((1 << CPU_CNT) - 1))
+int sched_set_affinity(thread_t* thread, uint32_t mask);
+
 static inline void sched_tick()
 {
     if (RUNNING_THREAD) {
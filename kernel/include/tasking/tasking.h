@@ -20,13 +20,15 @@
 
 #define MAX_PROCESS_COUNT 1024
 #define MAX_DYING_PROCESS_COUNT 8
-#define MAX_OPENED_FILES 16
+#define MAX_OPENED_FILES 64
 #define SIGNALS_CNT 32
 
 extern proc_t proc[MAX_PROCESS_COUNT];
 
 proc_t* tasking_get_proc(uint32_t pid);
+thread_t* tasking_get_thread(uint32_t tid);
 proc_t* tasking_get_proc_by_pdir(pdirectory_t* pdir);
+void tasking_set_proc_pdir(proc_t* p, pdirectory_t* pdir);
 
 /**
  * CPU FUNCTIONS
@@ -14,6 +14,7 @@
 #include <platform/generic/tasking/context.h>
 #include <platform/generic/tasking/trapframe.h>
 #include <tasking/signal.h>
+#include <tasking/wait_queue.h>
 #include <time/time_manager.h>
 
 enum THREAD_STATUS {
@@ -34,6 +35,9 @@ struct blocker {
 };
 typedef struct blocker blocker_t;
 
+/* A thread in select could wait for reading and writing of each fd. */
+#define BLOCKER_MAX_WAIT_QUEUES (2 * FD_SETSIZE)
+
 enum BLOCKER_REASON {
     BLOCKER_INVALID,
     BLOCKER_JOIN,
@@ -41,7 +45,9 @@ enum BLOCKER_REASON {
     BLOCKER_WRITE,
     BLOCKER_SLEEP,
     BLOCKER_SELECT,
+    BLOCKER_EPOLL,
     BLOCKER_DUMPING,
+    BLOCKER_FUTEX,
 };
 
 struct proc;
@@ -60,19 +66,29 @@ struct thread {
     struct thread* sched_prev;
     struct thread* sched_next;
     int last_cpu;
+    uint32_t cpu_mask; // Cpus the thread is allowed to run on.
     time_t ticks_until_preemption;
     time_t start_time_in_ticks; // Time when the task was put to run.
+    time_t last_run_tick; // Tick of the last cpu when the task stopped running.
+    bool on_cpu; // Set from the switch to the thread till its context is saved.
 
     /* Blocker data */
     blocker_t blocker;
+    wait_queue_entry_t wait_entries[BLOCKER_MAX_WAIT_QUEUES];
+    int wait_entries_cnt;
+    timer_entry_t timer;
+    wait_queue_t join_queue; // Threads waiting for the thread to die
     int exit_code;
     struct thread* joinee;
     file_descriptor_t* blocker_fd;
-    time_t unblock_time;
+    uint64_t unblock_time; // Monotonic time in ns, 0 if not set.
     int nfds;
     fd_set_t readfds;
     fd_set_t writefds;
     fd_set_t exceptfds;
+    uint32_t futex_space; // Key of the futex the thread waits on, see futex.c.
+    uint32_t futex_addr;
+    bool futex_woken;
 
     /* Stat data */
     time_t stat_total_running_ticks;
@@ -124,8 +140,17 @@ static ALWAYS_INLINE int thread_is_free(thread_t* thread) { return (thread->stat
 int init_join_blocker(thread_t* p);
 int init_read_blocker(thread_t* p, file_descriptor_t* bfd);
 int init_write_blocker(thread_t* thread, file_descriptor_t* bfd);
-int init_sleep_blocker(thread_t* thread, uint32_t time);
+int init_sleep_blocker(thread_t* thread, uint64_t unblock_time);
 int init_select_blocker(thread_t* thread, int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds, timeval_t* timeout);
+int init_epoll_blocker(thread_t* thread, file_descriptor_t* epfd, uint64_t unblock_time);
+int init_futex_blocker(thread_t* thread, wait_queue_t* wq, uint32_t* uaddr, uint32_t val, uint64_t unblock_time);
+
+void blocker_init_thread(thread_t* thread);
+bool blocker_try_wake(thread_t* thread);
+bool blocker_wake_for_signal(thread_t* thread);
+void blocker_switched_out(thread_t* thread);
+void blocker_detach(thread_t* thread);
+void blocker_wake_expired();
 
 /**
  * DEBUG FUNCTIONS
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_TASKING_WAIT_QUEUE_H
+#define _KERNEL_TASKING_WAIT_QUEUE_H
+
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
+struct thread;
+struct wait_queue;
+
+struct wait_queue_entry {
+    struct thread* thread;
+    void (*callback)(struct wait_queue_entry* entry); // Called instead of waking the thread, if set.
+    void* data;
+    struct wait_queue* queue;
+    struct wait_queue_entry* prev;
+    struct wait_queue_entry* next;
+};
+typedef struct wait_queue_entry wait_queue_entry_t;
+
+/**
+ * A wait queue holds threads blocked on an object. The object wakes
+ * the queue when its state changes, so only threads waiting on it
+ * recheck their blockers.
+ */
+struct wait_queue {
+    lock_t lock;
+    wait_queue_entry_t* head;
+    wait_queue_entry_t* tail;
+};
+typedef struct wait_queue wait_queue_t;
+
+void wait_queue_init(wait_queue_t* wq);
+void wait_queue_add(wait_queue_t* wq, wait_queue_entry_t* entry, struct thread* thread);
+void wait_queue_add_callback(wait_queue_t* wq, wait_queue_entry_t* entry, void (*callback)(wait_queue_entry_t*), void* data);
+void wait_queue_remove(wait_queue_entry_t* entry);
+int wait_queue_wake_all(wait_queue_t* wq);
+void wait_queue_clear(wait_queue_t* wq);
+
+static inline bool wait_queue_is_empty(wait_queue_t* wq) { return !wq->head; }
+
+#endif // _KERNEL_TASKING_WAIT_QUEUE_H
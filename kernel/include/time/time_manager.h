@@ -12,9 +12,11 @@
 #include <libkern/bits/time.h>
 #include <libkern/types.h>
 #include <platform/generic/cpu.h>
+#include <time/timer_wheel.h>
+
+#define NSEC_PER_SEC 1000000000
 
 extern time_t ticks_since_boot;
-extern time_t ticks_since_second;
 
 bool timeman_is_leap_year(uint32_t year);
 uint32_t timeman_days_in_years_since_epoch(uint32_t year);
@@ -24,10 +26,17 @@ time_t timeman_to_seconds_since_epoch(uint8_t secs, uint8_t mins, uint8_t hrs, u
 int timeman_setup();
 void timeman_timer_tick();
 
+/* Monotonic clock, has sub-tick resolution. */
+uint64_t timeman_monotonic_ns();
+void timeman_monotonic(timespec_t* ts);
+void timeman_realtime(timespec_t* ts);
+uint64_t timeman_realtime_to_monotonic_ns(const timespec_t* ts);
+
 time_t timeman_now();
 time_t timeman_seconds_since_boot();
 time_t timeman_get_ticks_from_last_second();
 static inline time_t timeman_ticks_per_second() { return TIMER_TICKS_PER_SECOND; };
+static inline uint32_t timeman_ns_per_tick() { return NSEC_PER_SEC / TIMER_TICKS_PER_SECOND; };
 static inline time_t timeman_ticks_since_boot() { return THIS_CPU->stat_ticks_since_boot; };
 
 #endif /* _KERNEL_TIME_TIME_MANAGER_H */
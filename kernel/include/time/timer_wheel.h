@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _KERNEL_TIME_TIMER_WHEEL_H
+#define _KERNEL_TIME_TIMER_WHEEL_H
+
+#include <libkern/lock.h>
+#include <libkern/types.h>
+
+#define TIMER_WHEEL_SLOTS 64
+
+struct timer_wheel;
+
+struct timer_entry {
+    uint32_t expire_tick;
+    void (*callback)(void* data);
+    void* data;
+    struct timer_wheel* wheel;
+    struct timer_entry* prev;
+    struct timer_entry* next;
+};
+typedef struct timer_entry timer_entry_t;
+
+/**
+ * A hashed timer wheel. Timers are put into a slot by their expire tick,
+ * so on every tick only one slot is visited. Timers which are more than
+ * TIMER_WHEEL_SLOTS ticks away stay in the slot for several rounds.
+ */
+struct timer_wheel {
+    lock_t lock;
+    uint32_t next_tick; // The first tick which has not been processed yet.
+    timer_entry_t* slots[TIMER_WHEEL_SLOTS];
+};
+typedef struct timer_wheel timer_wheel_t;
+
+void timer_wheel_init(timer_wheel_t* wheel, uint32_t now_tick);
+void timer_wheel_add(timer_wheel_t* wheel, timer_entry_t* entry, uint64_t expire_ns, void (*callback)(void*), void* data);
+void timer_wheel_remove(timer_entry_t* entry);
+void timer_wheel_advance(timer_wheel_t* wheel, uint32_t now_tick);
+
+static inline bool timer_entry_is_pending(timer_entry_t* entry) { return entry->wheel != NULL; }
+
+#endif // _KERNEL_TIME_TIMER_WHEEL_H
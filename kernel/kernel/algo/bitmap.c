@@ -6,166 +6,210 @@
 
 #include <algo/bitmap.h>
 #include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
 #include <mem/kmalloc.h>
 
-#define BITMAP_BLOCKS_PER_BYTE (8)
+#define BITMAP_FULL_WORD (0xffffffff)
 
+static inline uint32_t _bitmap_mask_from(uint32_t bit)
+{
+    return BITMAP_FULL_WORD << bit;
+}
+
+static inline void _bitmap_update_summary(bitmap_t bitmap, uint32_t word)
+{
+    uint32_t bit = 1U << (word % BITMAP_BITS_PER_WORD);
+    if (bitmap.data[word] == BITMAP_FULL_WORD) {
+        bitmap.summary[word / BITMAP_BITS_PER_WORD] |= bit;
+    } else {
+        bitmap.summary[word / BITMAP_BITS_PER_WORD] &= ~bit;
+    }
+}
+
+/**
+ * The function wraps @data, which should hold BITMAP_SIZE(@len) bytes.
+ * The summary is rebuilt from the words, so @data could already be filled.
+ */
 bitmap_t bitmap_wrap(uint8_t* data, uint32_t len)
 {
     bitmap_t bitmap;
-    bitmap.data = data;
+    bitmap.data = (uint32_t*)data;
+    bitmap.summary = &bitmap.data[BITMAP_WORDS(len)];
     bitmap.len = len;
+
+    for (uint32_t i = 0; i < BITMAP_SUMMARY_WORDS(len); i++) {
+        bitmap.summary[i] = 0;
+    }
+    for (uint32_t i = 0; i < BITMAP_WORDS(len); i++) {
+        _bitmap_update_summary(bitmap, i);
+    }
     return bitmap;
 }
 
 /* FIXME: Let user know if alloction was unsucessful */
 bitmap_t bitmap_allocate(uint32_t len)
 {
-    uint32_t alloc_len = len / BITMAP_BLOCKS_PER_BYTE;
-    if (len % BITMAP_BLOCKS_PER_BYTE) {
-        alloc_len++;
-    }
-    uint8_t* data = kmalloc(alloc_len);
+    uint8_t* data = kmalloc(BITMAP_SIZE(len));
+    memset(data, 0, BITMAP_SIZE(len));
     return bitmap_wrap(data, len);
 }
 
-/* TODO: can be speeded up with tzcnt */
-int bitmap_find_space(bitmap_t bitmap, int req)
+/**
+ * The function returns the first zero bit at or after @from, full words
+ * are skipped with the summary.
+ */
+static int _bitmap_next_zero(bitmap_t bitmap, uint32_t from)
 {
-    int taken = 0;
-    int start = 0;
-    for (int i = 0; i < bitmap.len; i++) {
-        if (bitmap.data[i] == 0xff) {
-            taken = 0;
-            continue;
+    if (from >= bitmap.len) {
+        return -ENODATA;
+    }
+
+    uint32_t word = from / BITMAP_BITS_PER_WORD;
+    uint32_t free_bits = ~bitmap.data[word] & _bitmap_mask_from(from % BITMAP_BITS_PER_WORD);
+    if (!free_bits) {
+        word++;
+        uint32_t summary_words = BITMAP_SUMMARY_WORDS(bitmap.len);
+        uint32_t sword = word / BITMAP_BITS_PER_WORD;
+        if (sword >= summary_words) {
+            return -ENODATA;
         }
-        for (int j = 0; j < BITMAP_BLOCKS_PER_BYTE; j++) {
-            if ((bitmap.data[i] >> j) & 1) {
-                taken = 0;
-            } else {
-                if (taken == 0) {
-                    start = i * BITMAP_BLOCKS_PER_BYTE + j;
-                }
-                taken++;
-                if (taken == req) {
-                    return start;
-                }
+
+        uint32_t not_full = ~bitmap.summary[sword] & _bitmap_mask_from(word % BITMAP_BITS_PER_WORD);
+        while (!not_full) {
+            if (++sword >= summary_words) {
+                return -ENODATA;
             }
+            not_full = ~bitmap.summary[sword];
         }
+
+        word = sword * BITMAP_BITS_PER_WORD + __builtin_ctz(not_full);
+        if (word >= BITMAP_WORDS(bitmap.len)) {
+            return -ENODATA;
+        }
+        free_bits = ~bitmap.data[word];
+    }
+
+    uint32_t res = word * BITMAP_BITS_PER_WORD + __builtin_ctz(free_bits);
+    return res < bitmap.len ? (int)res : -ENODATA;
+}
+
+/**
+ * The function returns the first set bit in [@from, @to) or @to.
+ */
+static uint32_t _bitmap_next_one(bitmap_t bitmap, uint32_t from, uint32_t to)
+{
+    uint32_t word = from / BITMAP_BITS_PER_WORD;
+    uint32_t taken_bits = bitmap.data[word] & _bitmap_mask_from(from % BITMAP_BITS_PER_WORD);
+    uint32_t last_word = (to - 1) / BITMAP_BITS_PER_WORD;
+    while (!taken_bits) {
+        if (++word > last_word) {
+            return to;
+        }
+        taken_bits = bitmap.data[word];
     }
-    return -ENODATA;
+
+    uint32_t res = word * BITMAP_BITS_PER_WORD + __builtin_ctz(taken_bits);
+    return res < to ? res : to;
+}
+
+int bitmap_find_space(bitmap_t bitmap, int req)
+{
+    return bitmap_find_space_aligned(bitmap, req, 1);
 }
 
 int bitmap_find_space_aligned(bitmap_t bitmap, int req, int alignment)
 {
-    int taken = 0;
-    int start = 0;
-    for (int i = 0; i < bitmap.len; i++) {
-        if (bitmap.data[i] == 0xff) {
-            taken = 0;
-            continue;
+    if (req <= 0) {
+        return -EINVAL;
+    }
+    if (alignment <= 0) {
+        alignment = 1;
+    }
+
+    uint32_t start = 0;
+    for (;;) {
+        int free_bit = _bitmap_next_zero(bitmap, start);
+        if (free_bit < 0) {
+            return -ENODATA;
         }
-        for (int j = 0; j < BITMAP_BLOCKS_PER_BYTE; j++) {
-            if ((bitmap.data[i] >> j) & 1) {
-                taken = 0;
-            } else {
-                if (taken == 0) {
-                    start = i * BITMAP_BLOCKS_PER_BYTE + j;
-                }
-                if ((start % alignment) == 0) {
-                    taken++;
-                }
-                if (taken == req) {
-                    return start;
-                }
-            }
+
+        start = ((uint32_t)free_bit + alignment - 1) / alignment * alignment;
+        if (start + req > bitmap.len || start + req < start) {
+            return -ENODATA;
+        }
+
+        uint32_t taken_bit = _bitmap_next_one(bitmap, start, start + req);
+        if (taken_bit == start + req) {
+            return start;
         }
+        start = taken_bit + 1;
     }
-    return -ENODATA;
 }
 
 int bitmap_set(bitmap_t bitmap, int where)
 {
-    if (where >= bitmap.len * BITMAP_BLOCKS_PER_BYTE) {
+    if (where < 0 || where >= bitmap.len) {
         return -EFAULT;
     }
 
-    int block = where / BITMAP_BLOCKS_PER_BYTE;
-    int offset = where % BITMAP_BLOCKS_PER_BYTE;
-    bitmap.data[block] |= (1 << offset);
-
+    uint32_t word = where / BITMAP_BITS_PER_WORD;
+    bitmap.data[word] |= (1U << (where % BITMAP_BITS_PER_WORD));
+    _bitmap_update_summary(bitmap, word);
     return 0;
 }
 
 int bitmap_unset(bitmap_t bitmap, int where)
 {
-    if (where >= bitmap.len * BITMAP_BLOCKS_PER_BYTE) {
+    if (where < 0 || where >= bitmap.len) {
         return -EFAULT;
     }
 
-    int block = where / BITMAP_BLOCKS_PER_BYTE;
-    int offset = where % BITMAP_BLOCKS_PER_BYTE;
-    bitmap.data[block] &= ~((1 << offset));
-
+    uint32_t word = where / BITMAP_BITS_PER_WORD;
+    bitmap.data[word] &= ~(1U << (where % BITMAP_BITS_PER_WORD));
+    _bitmap_update_summary(bitmap, word);
     return 0;
 }
 
-int bitmap_set_range(bitmap_t bitmap, int start, int len)
+/**
+ * Range functions work on whole words, only the first and the last words
+ * of the range are masked.
+ */
+static int _bitmap_fill_range(bitmap_t bitmap, int start, int len, bool set)
 {
-    if (start + len - 1 >= bitmap.len * BITMAP_BLOCKS_PER_BYTE) {
+    if (start < 0 || len < 0 || (uint32_t)start + len > bitmap.len) {
         return -EFAULT;
     }
-
-    int where = start;
-
-    while (len && (where % BITMAP_BLOCKS_PER_BYTE) != 0) {
-        bitmap_set(bitmap, where);
-        where++;
-        len--;
+    if (!len) {
+        return 0;
     }
 
-    while (len >= BITMAP_BLOCKS_PER_BYTE) {
-        int block = where / BITMAP_BLOCKS_PER_BYTE;
-        bitmap.data[block] = 0xff;
-        where += BITMAP_BLOCKS_PER_BYTE;
-        len -= BITMAP_BLOCKS_PER_BYTE;
-    }
+    uint32_t first_word = start / BITMAP_BITS_PER_WORD;
+    uint32_t last_word = (start + len - 1) / BITMAP_BITS_PER_WORD;
+    for (uint32_t word = first_word; word <= last_word; word++) {
+        uint32_t mask = BITMAP_FULL_WORD;
+        if (word == first_word) {
+            mask &= _bitmap_mask_from(start % BITMAP_BITS_PER_WORD);
+        }
+        if (word == last_word) {
+            mask &= BITMAP_FULL_WORD >> (BITMAP_BITS_PER_WORD - 1 - (start + len - 1) % BITMAP_BITS_PER_WORD);
+        }
 
-    while (len) {
-        bitmap_set(bitmap, where);
-        where++;
-        len--;
+        if (set) {
+            bitmap.data[word] |= mask;
+        } else {
+            bitmap.data[word] &= ~mask;
+        }
+        _bitmap_update_summary(bitmap, word);
     }
-
     return 0;
 }
 
-int bitmap_unset_range(bitmap_t bitmap, int start, int len)
+int bitmap_set_range(bitmap_t bitmap, int start, int len)
 {
-    if (start + len - 1 >= bitmap.len * BITMAP_BLOCKS_PER_BYTE) {
-        return -EFAULT;
-    }
-
-    int where = start;
-
-    while (len && (where % BITMAP_BLOCKS_PER_BYTE) != 0) {
-        bitmap_unset(bitmap, where);
-        where++;
-        len--;
-    }
-
-    while (len >= BITMAP_BLOCKS_PER_BYTE) {
-        int block = where / BITMAP_BLOCKS_PER_BYTE;
-        bitmap.data[block] = 0x0;
-        where += BITMAP_BLOCKS_PER_BYTE;
-        len -= BITMAP_BLOCKS_PER_BYTE;
-    }
-
-    while (len) {
-        bitmap_unset(bitmap, where);
-        where++;
-        len--;
-    }
+    return _bitmap_fill_range(bitmap, start, len, true);
+}
 
-    return 0;
-}
\ No newline at end of file
+int bitmap_unset_range(bitmap_t bitmap, int start, int len)
+{
+    return _bitmap_fill_range(bitmap, start, len, false);
+}
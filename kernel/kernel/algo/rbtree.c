@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algo/rbtree.h>
+
+static inline void _rbtree_augment(rbtree_t* tree, rbtree_node_t* node)
+{
+    if (tree->augment) {
+        tree->augment(node);
+    }
+}
+
+/**
+ * The function recomputes augmented data from @node up to the root.
+ */
+static inline void _rbtree_propagate(rbtree_t* tree, rbtree_node_t* node)
+{
+    if (!tree->augment) {
+        return;
+    }
+    for (; node; node = node->parent) {
+        tree->augment(node);
+    }
+}
+
+static inline void _rbtree_replace_child(rbtree_t* tree, rbtree_node_t* old, rbtree_node_t* new)
+{
+    rbtree_node_t* parent = old->parent;
+    if (!parent) {
+        tree->root = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+/**
+ * Rotations keep the set of nodes of the subtree, so only the two
+ * rotated nodes have to be augmented again, the lower one first.
+ */
+static void _rbtree_rotate_left(rbtree_t* tree, rbtree_node_t* node)
+{
+    rbtree_node_t* right = node->right;
+    node->right = right->left;
+    if (right->left) {
+        right->left->parent = node;
+    }
+    right->parent = node->parent;
+    _rbtree_replace_child(tree, node, right);
+    right->left = node;
+    node->parent = right;
+    _rbtree_augment(tree, node);
+    _rbtree_augment(tree, right);
+}
+
+static void _rbtree_rotate_right(rbtree_t* tree, rbtree_node_t* node)
+{
+    rbtree_node_t* left = node->left;
+    node->left = left->right;
+    if (left->right) {
+        left->right->parent = node;
+    }
+    left->parent = node->parent;
+    _rbtree_replace_child(tree, node, left);
+    left->right = node;
+    node->parent = left;
+    _rbtree_augment(tree, node);
+    _rbtree_augment(tree, left);
+}
+
+static inline bool _rbtree_is_red(rbtree_node_t* node)
+{
+    return node && node->red;
+}
+
+static void _rbtree_insert_fixup(rbtree_t* tree, rbtree_node_t* node)
+{
+    rbtree_node_t* parent;
+    while ((parent = node->parent) && parent->red) {
+        rbtree_node_t* gparent = parent->parent;
+        if (parent == gparent->left) {
+            rbtree_node_t* uncle = gparent->right;
+            if (_rbtree_is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                _rbtree_rotate_left(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            _rbtree_rotate_right(tree, gparent);
+        } else {
+            rbtree_node_t* uncle = gparent->left;
+            if (_rbtree_is_red(uncle)) {
+                parent->red = false;
+                uncle->red = false;
+                gparent->red = true;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                _rbtree_rotate_right(tree, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->red = false;
+            gparent->red = true;
+            _rbtree_rotate_left(tree, gparent);
+        }
+    }
+    tree->root->red = false;
+}
+
+/**
+ * The function restores colors after a black node is removed. @node took
+ * the place of the removed one and could be NULL, so @parent is passed.
+ */
+static void _rbtree_erase_fixup(rbtree_t* tree, rbtree_node_t* node, rbtree_node_t* parent)
+{
+    while (node != tree->root && !_rbtree_is_red(node)) {
+        if (node == parent->left) {
+            rbtree_node_t* sibling = parent->right;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                _rbtree_rotate_left(tree, parent);
+                sibling = parent->right;
+            }
+            if (!_rbtree_is_red(sibling->left) && !_rbtree_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!_rbtree_is_red(sibling->right)) {
+                sibling->left->red = false;
+                sibling->red = true;
+                _rbtree_rotate_right(tree, sibling);
+                sibling = parent->right;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->right->red = false;
+            _rbtree_rotate_left(tree, parent);
+        } else {
+            rbtree_node_t* sibling = parent->left;
+            if (sibling->red) {
+                sibling->red = false;
+                parent->red = true;
+                _rbtree_rotate_right(tree, parent);
+                sibling = parent->left;
+            }
+            if (!_rbtree_is_red(sibling->left) && !_rbtree_is_red(sibling->right)) {
+                sibling->red = true;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (!_rbtree_is_red(sibling->left)) {
+                sibling->right->red = false;
+                sibling->red = true;
+                _rbtree_rotate_left(tree, sibling);
+                sibling = parent->left;
+            }
+            sibling->red = parent->red;
+            parent->red = false;
+            sibling->left->red = false;
+            _rbtree_rotate_right(tree, parent);
+        }
+        node = tree->root;
+    }
+
+    if (node) {
+        node->red = false;
+    }
+}
+
+void rbtree_init(rbtree_t* tree, rbtree_augment_t augment)
+{
+    tree->root = NULL;
+    tree->augment = augment;
+    tree->size = 0;
+}
+
+/**
+ * The function links @node as a child of @parent at @link, which is the
+ * empty left or right pointer of @parent (or the root of an empty tree).
+ */
+void rbtree_link(rbtree_t* tree, rbtree_node_t* node, rbtree_node_t* parent, rbtree_node_t** link)
+{
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->red = true;
+    *link = node;
+    tree->size++;
+
+    _rbtree_propagate(tree, node);
+    _rbtree_insert_fixup(tree, node);
+}
+
+void rbtree_erase(rbtree_t* tree, rbtree_node_t* node)
+{
+    rbtree_node_t* child;
+    rbtree_node_t* parent;
+    bool removed_red;
+
+    if (!node->left || !node->right) {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        removed_red = node->red;
+        if (child) {
+            child->parent = parent;
+        }
+        _rbtree_replace_child(tree, node, child);
+    } else {
+        // The successor takes the place of the node.
+        rbtree_node_t* next = node->right;
+        while (next->left) {
+            next = next->left;
+        }
+
+        child = next->right;
+        removed_red = next->red;
+        if (next->parent == node) {
+            parent = next;
+        } else {
+            parent = next->parent;
+            parent->left = child;
+            if (child) {
+                child->parent = parent;
+            }
+            next->right = node->right;
+            node->right->parent = next;
+        }
+
+        next->left = node->left;
+        node->left->parent = next;
+        next->parent = node->parent;
+        next->red = node->red;
+        _rbtree_replace_child(tree, node, next);
+    }
+
+    tree->size--;
+    _rbtree_propagate(tree, parent);
+    if (!removed_red) {
+        _rbtree_erase_fixup(tree, child, parent);
+    }
+}
+
+rbtree_node_t* rbtree_first(rbtree_t* tree)
+{
+    rbtree_node_t* node = tree->root;
+    if (!node) {
+        return NULL;
+    }
+    while (node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+rbtree_node_t* rbtree_last(rbtree_t* tree)
+{
+    rbtree_node_t* node = tree->root;
+    if (!node) {
+        return NULL;
+    }
+    while (node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+rbtree_node_t* rbtree_next(rbtree_node_t* node)
+{
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return node;
+    }
+
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+rbtree_node_t* rbtree_prev(rbtree_node_t* node)
+{
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return node;
+    }
+
+    while (node->parent && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
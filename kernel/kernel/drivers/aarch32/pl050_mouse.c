@@ -21,6 +21,7 @@
 // #define MOUSE_DRIVER_DEBUG
 
 static ringbuffer_t mouse_buffer;
+static wait_queue_t mouse_wait_queue;
 static zone_t mapped_zone;
 static volatile pl050_registers_t* registers = (pl050_registers_t*)PL050_MOUSE_BASE;
 
@@ -37,6 +38,11 @@ static bool _mouse_can_read(dentry_t* dentry, uint32_t start)
     return ringbuffer_space_to_read(&mouse_buffer) >= 1;
 }
 
+static wait_queue_t* _mouse_wait_queue(dentry_t* dentry)
+{
+    return &mouse_wait_queue;
+}
+
 static int _mouse_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     uint32_t leno = ringbuffer_space_to_read(&mouse_buffer);
@@ -57,6 +63,7 @@ static void pl050_mouse_recieve_notification(uint32_t msg, uint32_t param)
         file_ops_t fops = { 0 };
         fops.can_read = _mouse_can_read;
         fops.read = _mouse_read;
+        fops.wait_queue = _mouse_wait_queue;
         devfs_inode_t* res = devfs_register(mp, MKDEV(10, 1), "mouse", 5, 0, &fops);
 
         dentry_put(mp);
@@ -134,6 +141,7 @@ static void _pl050_mouse_int_handler()
     }
 
     ringbuffer_write(&mouse_buffer, (uint8_t*)&packet, sizeof(mouse_packet_t));
+    wait_queue_wake_all(&mouse_wait_queue);
 
 #ifdef MOUSE_DRIVER_DEBUG
     log("%x ", packet.button_states);
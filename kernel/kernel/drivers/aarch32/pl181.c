@@ -5,6 +5,9 @@
  */
 
 #include <drivers/aarch32/pl181.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
@@ -14,6 +17,7 @@
 static sd_card_t sd_cards[MAX_DEVICES_COUNT];
 static zone_t mapped_zone;
 static volatile pl181_registers_t* registers = (pl181_registers_t*)PL181_BASE;
+static lock_t _pl181_lock; // All cards share the command and data path of the controller.
 
 static inline int _pl181_map_itself()
 {
@@ -67,7 +71,7 @@ inline static int _pl181_select_card(uint32_t rca)
     return _pl181_send_cmd(CMD_SELECT | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, rca);
 }
 
-static int _pl181_read_block(device_t* device, uint32_t lba_like, void* read_data)
+static int _pl181_read_block_lockless(device_t* device, uint32_t lba_like, void* read_data)
 {
     sd_card_t* sd_card = &sd_cards[device->id];
     uint32_t* read_data32 = (uint32_t*)read_data;
@@ -90,7 +94,15 @@ static int _pl181_read_block(device_t* device, uint32_t lba_like, void* read_dat
     return bytes_read;
 }
 
-static int _pl181_write_block(device_t* device, uint32_t lba_like, void* write_data)
+static int _pl181_read_block(device_t* device, uint32_t lba_like, void* read_data)
+{
+    lock_acquire(&_pl181_lock);
+    int res = _pl181_read_block_lockless(device, lba_like, read_data);
+    lock_release(&_pl181_lock);
+    return res;
+}
+
+static int _pl181_write_block_lockless(device_t* device, uint32_t lba_like, void* write_data)
 {
     sd_card_t* sd_card = &sd_cards[device->id];
     uint32_t* write_data32 = (uint32_t*)write_data;
@@ -113,6 +125,121 @@ static int _pl181_write_block(device_t* device, uint32_t lba_like, void* write_d
     return bytes_written;
 }
 
+static int _pl181_write_block(device_t* device, uint32_t lba_like, void* write_data)
+{
+    lock_acquire(&_pl181_lock);
+    int res = _pl181_write_block_lockless(device, lba_like, write_data);
+    lock_release(&_pl181_lock);
+    return res;
+}
+
+#define PL181_DATA_ERROR_MASK (MMC_STAT_DATA_CRC_FAIL_MASK | MMC_STAT_DATA_TIMEOUT_MASK)
+
+static inline uint32_t _pl181_block_address(sd_card_t* sd_card, uint32_t lba_like)
+{
+    return sd_card->ishc ? lba_like : lba_like * PL181_SECTOR_SIZE;
+}
+
+/**
+ * Multi block transfers issue one command for the whole run of blocks and
+ * stop the card with CMD_STOP_TRANSMISSION after the data is moved.
+ */
+static int _pl181_read_blocks_impl(device_t* device, uint32_t lba_like, uint32_t count, uint32_t* read_data32)
+{
+    sd_card_t* sd_card = &sd_cards[device->id];
+    uint32_t words_to_read = count * PL181_SECTOR_SIZE / 4;
+
+    registers->data_length = count * PL181_SECTOR_SIZE;
+    registers->data_control = 0b11; // Enable dpsm and set direction from card to host
+    _pl181_send_cmd(CMD_READ_MULTIPLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, _pl181_block_address(sd_card, lba_like));
+
+    while (words_to_read) {
+        uint32_t status = registers->status;
+        if (status & PL181_DATA_ERROR_MASK) {
+            _pl181_send_cmd(CMD_STOP_TRANSMISSION | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, 0);
+            return -EIO;
+        }
+        if (status & MMC_STAT_FIFO_DATA_AVAIL_TO_READ_MASK) {
+            *read_data32 = registers->fifo_data[0];
+            read_data32++;
+            words_to_read--;
+        }
+    }
+
+    return _pl181_send_cmd(CMD_STOP_TRANSMISSION | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, 0);
+}
+
+static int _pl181_write_blocks_impl(device_t* device, uint32_t lba_like, uint32_t count, uint32_t* write_data32)
+{
+    sd_card_t* sd_card = &sd_cards[device->id];
+    uint32_t words_to_write = count * PL181_SECTOR_SIZE / 4;
+
+    registers->data_length = count * PL181_SECTOR_SIZE;
+    registers->data_control = 0b01; // Enable dpsm and set direction from host to card
+    _pl181_send_cmd(CMD_WRITE_MULTIPLE_BLOCK | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, _pl181_block_address(sd_card, lba_like));
+
+    while (words_to_write) {
+        uint32_t status = registers->status;
+        if (status & PL181_DATA_ERROR_MASK) {
+            _pl181_send_cmd(CMD_STOP_TRANSMISSION | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, 0);
+            return -EIO;
+        }
+        if (!(status & MMC_STAT_TRANSMIT_FIFO_FULL_MASK)) {
+            registers->fifo_data[0] = *write_data32;
+            write_data32++;
+            words_to_write--;
+        }
+    }
+
+    return _pl181_send_cmd(CMD_STOP_TRANSMISSION | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, 0);
+}
+
+static int _pl181_read_blocks_lockless(device_t* device, uint32_t lba_like, uint32_t count, uint8_t* buf)
+{
+    while (count) {
+        uint32_t blocks = min(count, PL181_MAX_BLOCKS_PER_CMD);
+        int err = _pl181_read_blocks_impl(device, lba_like, blocks, (uint32_t*)buf);
+        if (err) {
+            return err;
+        }
+        lba_like += blocks;
+        buf += blocks * PL181_SECTOR_SIZE;
+        count -= blocks;
+    }
+    return 0;
+}
+
+static int _pl181_read_blocks(device_t* device, uint32_t lba_like, uint32_t count, uint8_t* buf)
+{
+    lock_acquire(&_pl181_lock);
+    int res = _pl181_read_blocks_lockless(device, lba_like, count, buf);
+    lock_release(&_pl181_lock);
+    return res;
+}
+
+static int _pl181_write_blocks_lockless(device_t* device, uint32_t lba_like, uint32_t count, uint8_t* buf)
+{
+    while (count) {
+        uint32_t blocks = min(count, PL181_MAX_BLOCKS_PER_CMD);
+        int err = _pl181_write_blocks_impl(device, lba_like, blocks, (uint32_t*)buf);
+        if (err) {
+            return err;
+        }
+        lba_like += blocks;
+        buf += blocks * PL181_SECTOR_SIZE;
+        count -= blocks;
+    }
+    return 0;
+}
+
+static int _pl181_write_blocks(device_t* device, uint32_t lba_like, uint32_t count, uint8_t* buf)
+{
+    lock_acquire(&_pl181_lock);
+    int res = _pl181_write_blocks_lockless(device, lba_like, count, buf);
+    lock_release(&_pl181_lock);
+    return res;
+}
+
 static void _pl181_add_new_device(device_t* new_device)
 {
     bool ishc = new_device->device_desc.args[0] & 1;
@@ -120,9 +247,12 @@ static void _pl181_add_new_device(device_t* new_device)
     sd_cards[new_device->id].rca = rca;
     sd_cards[new_device->id].ishc = ishc;
     sd_cards[new_device->id].capacity = new_device->device_desc.args[1];
+    lock_acquire(&_pl181_lock);
     _pl181_select_card(rca);
     _pl181_send_cmd(CMD_SET_SECTOR_SIZE | MMC_CMD_ENABLE_MASK | MMC_CMD_RESP_MASK, PL181_SECTOR_SIZE);
-    if (registers->response[0] != 0x900) {
+    uint32_t response = registers->response[0];
+    lock_release(&_pl181_lock);
+    if (response != 0x900) {
         log_error("PL181(pl181_add_new_device): Can't set sector size");
     }
 }
@@ -161,6 +291,8 @@ static driver_desc_t _pl181_driver_info()
     ata_desc.functions[DRIVER_STORAGE_WRITE] = _pl181_write_block;
     ata_desc.functions[DRIVER_STORAGE_FLUSH] = 0;
     ata_desc.functions[DRIVER_STORAGE_CAPACITY] = _pl181_get_capacity;
+    ata_desc.functions[DRIVER_STORAGE_READ_BLOCKS] = _pl181_read_blocks;
+    ata_desc.functions[DRIVER_STORAGE_WRITE_BLOCKS] = _pl181_write_blocks;
     ata_desc.pci_serve_class = 0x08;
     ata_desc.pci_serve_subclass = 0x05;
     ata_desc.pci_serve_vendor_id = 0x00;
@@ -170,6 +302,7 @@ static driver_desc_t _pl181_driver_info()
 
 void pl181_install()
 {
+    lock_init(&_pl181_lock);
     if (_pl181_map_itself()) {
 #ifdef DEBUG_PL181
         log_error("PL181: Can't map itself!");
@@ -45,4 +45,24 @@ void sp804_install()
     timer1->load = SP804_CLK_HZ / TIMER_TICKS_PER_SECOND;
     timer1->control = SP804_ENABLE_MASK | SP804_PERIODIC_MASK | SP804_32_BIT_MASK | SP804_INTS_ENABLED_MASK;
     irq_register_handler(SP804_TIMER1_IRQ_LINE, 0, IRQ_TYPE_EDGE_TRIGGERED_MASK, _sp804_int_handler, ALL_CPU_MASK);
-}
\ No newline at end of file
+}
+
+void timer_sync_tick()
+{
+}
+
+/**
+ * The timer counts down from its load value, so the time passed since the
+ * last tick is read right from the value register. If the counter has
+ * already wrapped but the interrupt is not handled yet, we stay at the end
+ * of the current tick to keep the clock monotonic.
+ */
+uint32_t timer_ns_since_tick()
+{
+    uint32_t load = timer1->load;
+    uint32_t value = timer1->value;
+    if (timer1->ris & 1 || value > load) {
+        return timeman_ns_per_tick() - 1;
+    }
+    return (load - value) * (NSEC_PER_SEC / SP804_CLK_HZ);
+}
@@ -10,6 +10,7 @@
 #include <libkern/libkern.h>
 
 static ringbuffer_t gkeyboard_buffer;
+static wait_queue_t gkeyboard_wait_queue;
 static bool _gkeyboard_has_prefix_e0 = false;
 static bool _gkeyboard_shift_enabled = false;
 static bool _gkeyboard_ctrl_enabled = false;
@@ -30,6 +31,11 @@ static bool _generic_keyboard_can_read(dentry_t* dentry, uint32_t start)
     return ringbuffer_space_to_read(&gkeyboard_buffer) >= 1;
 }
 
+static wait_queue_t* _generic_keyboard_wait_queue(dentry_t* dentry)
+{
+    return &gkeyboard_wait_queue;
+}
+
 static int _generic_keyboard_read(dentry_t* dentry, uint8_t* buf,
     uint32_t start, uint32_t len)
 {
@@ -52,6 +58,7 @@ int generic_keyboard_create_devfs()
     file_ops_t fops = { 0 };
     fops.can_read = _generic_keyboard_can_read;
     fops.read = _generic_keyboard_read;
+    fops.wait_queue = _generic_keyboard_wait_queue;
     devfs_inode_t* res = devfs_register(mp, MKDEV(11, 0), "kbd", 3, 0, &fops);
 
     dentry_put(mp);
@@ -133,6 +140,7 @@ void generic_emit_key_set1(uint32_t scancode)
     }
 
     ringbuffer_write(&gkeyboard_buffer, (uint8_t*)&packet, sizeof(kbd_packet_t));
+    wait_queue_wake_all(&gkeyboard_wait_queue);
 }
 
 static key_t _generic_keyboard_apply_modifiers(key_t key)
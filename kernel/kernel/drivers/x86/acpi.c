@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/x86/acpi.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/x86/memmap.h>
+
+// #define ACPI_DEBUG
+
+#define ACPI_EBDA_SEGMENT_PTR 0x40e
+#define ACPI_BIOS_AREA_START 0xe0000
+#define ACPI_BIOS_AREA_END 0x100000
+
+/**
+ * The first 4mb of physical memory are mapped at BIOS_SETTING_BASE, so the
+ * RSDP is looked up there. Other tables could be anywhere, they are mapped
+ * while parsed.
+ */
+static inline void* _acpi_low_memory(uint32_t paddr)
+{
+    return (void*)(BIOS_SETTING_BASE + paddr);
+}
+
+static void* _acpi_map(uint32_t paddr, uint32_t len, zone_t* zone)
+{
+    uint32_t start = paddr & ~(VMM_PAGE_SIZE - 1);
+    uint32_t pages = (paddr + len - start + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    *zone = zoner_new_zone(pages * VMM_PAGE_SIZE);
+    vmm_map_pages(zone->start, start, pages, PAGE_READABLE);
+    return zone->ptr + (paddr - start);
+}
+
+static void _acpi_unmap(zone_t zone)
+{
+    vmm_unmap_pages(zone.start, zone.len / VMM_PAGE_SIZE);
+    zoner_free_zone(zone);
+}
+
+static bool _acpi_checksum_ok(void* ptr, uint32_t len)
+{
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        sum += ((uint8_t*)ptr)[i];
+    }
+    return sum == 0;
+}
+
+static acpi_rsdp_t* _acpi_find_rsdp_in(uint32_t start, uint32_t end)
+{
+    for (uint32_t paddr = start; paddr + sizeof(acpi_rsdp_t) <= end; paddr += 16) {
+        acpi_rsdp_t* rsdp = _acpi_low_memory(paddr);
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && _acpi_checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+static acpi_rsdp_t* _acpi_find_rsdp()
+{
+    uint32_t ebda = (uint32_t)(*(uint16_t*)_acpi_low_memory(ACPI_EBDA_SEGMENT_PTR)) << 4;
+    if (ebda) {
+        acpi_rsdp_t* rsdp = _acpi_find_rsdp_in(ebda, ebda + 1024);
+        if (rsdp) {
+            return rsdp;
+        }
+    }
+    return _acpi_find_rsdp_in(ACPI_BIOS_AREA_START, ACPI_BIOS_AREA_END);
+}
+
+/**
+ * The function maps the whole table at @paddr, the caller unmaps @zone.
+ */
+static acpi_sdt_header_t* _acpi_map_table(uint32_t paddr, zone_t* zone)
+{
+    acpi_sdt_header_t* header = _acpi_map(paddr, sizeof(acpi_sdt_header_t), zone);
+    uint32_t len = header->length;
+    _acpi_unmap(*zone);
+    return _acpi_map(paddr, len, zone);
+}
+
+static void _acpi_parse_madt(acpi_sdt_header_t* madt, acpi_apic_info_t* info)
+{
+    uint8_t* ptr = (uint8_t*)madt + sizeof(acpi_sdt_header_t);
+    uint8_t* end = (uint8_t*)madt + madt->length;
+    info->lapic_paddr = *(uint32_t*)ptr;
+    ptr += 8; // Skipping the address of LAPIC and flags.
+
+    for (int i = 0; i < ACPI_ISA_IRQS; i++) {
+        info->isa_irq_gsi[i] = i;
+        info->isa_irq_flags[i] = 0;
+    }
+
+    while (ptr + 2 <= end) {
+        acpi_madt_entry_t* entry = (acpi_madt_entry_t*)ptr;
+        if (entry->length < 2) {
+            break;
+        }
+
+        switch (entry->type) {
+        case ACPI_MADT_LAPIC:
+            if ((entry->lapic.flags & 0x1) && info->cpus_count < CPU_CNT) {
+                info->lapic_ids[info->cpus_count++] = entry->lapic.apic_id;
+            }
+            break;
+        case ACPI_MADT_IOAPIC:
+            // ISA interrupts are routed through the first IOAPIC.
+            if (!info->ioapic_paddr) {
+                info->ioapic_paddr = entry->ioapic.paddr;
+                info->ioapic_gsi_base = entry->ioapic.gsi_base;
+            }
+            break;
+        case ACPI_MADT_INT_OVERRIDE:
+            if (entry->int_override.irq < ACPI_ISA_IRQS) {
+                info->isa_irq_gsi[entry->int_override.irq] = entry->int_override.gsi;
+                info->isa_irq_flags[entry->int_override.irq] = entry->int_override.flags;
+            }
+            break;
+        }
+        ptr += entry->length;
+    }
+}
+
+/**
+ * The function looks up the MADT and fills @info. Returns -ENODEV if there
+ * are no ACPI tables or no APICs.
+ */
+int acpi_find_apic_info(acpi_apic_info_t* info)
+{
+    memset(info, 0, sizeof(acpi_apic_info_t));
+    acpi_rsdp_t* rsdp = _acpi_find_rsdp();
+    if (!rsdp) {
+        return -ENODEV;
+    }
+
+    zone_t rsdt_zone;
+    acpi_sdt_header_t* rsdt = _acpi_map_table(rsdp->rsdt_paddr, &rsdt_zone);
+    uint32_t* tables = (uint32_t*)((uint8_t*)rsdt + sizeof(acpi_sdt_header_t));
+    uint32_t tables_count = (rsdt->length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+
+    for (uint32_t i = 0; i < tables_count; i++) {
+        zone_t zone;
+        acpi_sdt_header_t* table = _acpi_map_table(tables[i], &zone);
+        if (memcmp(table->signature, "APIC", 4) == 0 && _acpi_checksum_ok(table, table->length)) {
+            _acpi_parse_madt(table, info);
+        }
+        _acpi_unmap(zone);
+    }
+    _acpi_unmap(rsdt_zone);
+
+    if (!info->lapic_paddr || !info->ioapic_paddr || !info->cpus_count) {
+        return -ENODEV;
+    }
+
+#ifdef ACPI_DEBUG
+    log("[ACPI] %d cpus, LAPIC at %x, IOAPIC at %x", info->cpus_count, info->lapic_paddr, info->ioapic_paddr);
+#endif
+    return 0;
+}
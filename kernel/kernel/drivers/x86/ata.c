@@ -6,18 +6,28 @@
 
 #include <drivers/x86/ata.h>
 #include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
 
 ata_t _ata_drives[MAX_DEVICES_COUNT];
+static ata_channel_t _ata_channels[ATA_MAX_CHANNELS];
+static int _ata_channels_count = 0;
 
 static uint8_t _ata_drives_count = 0;
 static driver_desc_t _ata_driver_info();
 
 static uint8_t _ata_gen_drive_head_register(bool is_lba, bool is_master, uint8_t head);
+static int _ata_flush_lockless(ata_t* dev);
 
 static int ata_write(device_t* device, uint32_t sector, uint8_t* data, uint32_t size);
 static int ata_read(device_t* device, uint32_t sector, uint8_t* read_data);
 static int ata_flush(device_t* device);
 static uint32_t ata_get_capacity(device_t* device);
+static int ata_read_blocks(device_t* device, uint32_t lba, uint32_t count, uint8_t* buf);
+static int ata_write_blocks(device_t* device, uint32_t lba, uint32_t count, uint8_t* buf);
 
 /**
  * Drive/Head register:
@@ -48,6 +58,8 @@ driver_desc_t _ata_driver_info()
     ata_desc.functions[DRIVER_STORAGE_WRITE] = ata_write;
     ata_desc.functions[DRIVER_STORAGE_FLUSH] = ata_flush;
     ata_desc.functions[DRIVER_STORAGE_CAPACITY] = ata_get_capacity;
+    ata_desc.functions[DRIVER_STORAGE_READ_BLOCKS] = ata_read_blocks;
+    ata_desc.functions[DRIVER_STORAGE_WRITE_BLOCKS] = ata_write_blocks;
     ata_desc.pci_serve_class = 0x01;
     ata_desc.pci_serve_subclass = 0x05;
     ata_desc.pci_serve_vendor_id = 0x00;
@@ -55,14 +67,107 @@ driver_desc_t _ata_driver_info()
     return ata_desc;
 }
 
+static inline void _ata_delay_400ns(ata_t* dev)
+{
+    for (int i = 0; i < 4; i++) {
+        port_8bit_in(dev->port.control);
+    }
+}
+
+static uint8_t _ata_wait_not_busy(ata_t* dev)
+{
+    uint8_t status = port_8bit_in(dev->port.command);
+    while (((status >> 7) & 1) == 1 && ((status >> 0) & 1) != 1) {
+        status = port_8bit_in(dev->port.command);
+    }
+    return status;
+}
+
+static inline void _ata_setup_lba(ata_t* dev, uint32_t lba, uint8_t count)
+{
+    uint8_t dev_config = _ata_gen_drive_head_register(true, !dev->is_master, (lba >> 24) & 0xF);
+
+    port_8bit_out(dev->port.device, dev_config);
+    port_8bit_out(dev->port.sector_count, count);
+    port_8bit_out(dev->port.lba_lo, lba & 0x000000FF);
+    port_8bit_out(dev->port.lba_mid, (lba & 0x0000FF00) >> 8);
+    port_8bit_out(dev->port.lba_hi, (lba & 0x00FF0000) >> 16);
+    port_8bit_out(dev->port.error, 0);
+}
+
+static void _ata_setup_multiple(ata_t* dev)
+{
+    _ata_setup_lba(dev, 0, dev->multiple);
+    port_8bit_out(dev->port.command, ATA_CMD_SET_MULTIPLE);
+    _ata_delay_400ns(dev);
+    uint8_t status = _ata_wait_not_busy(dev);
+    if (status & 0x01) {
+        dev->multiple = 0;
+    }
+}
+
+static void _ata_setup_dma(ata_t* dev)
+{
+    uint32_t dma_buf_paddr = (uint32_t)pmm_alloc_aligned(ATA_DMA_BUFFER_SIZE, ATA_DMA_BUFFER_SIZE);
+    uint32_t prdt_paddr = (uint32_t)pmm_alloc_block();
+    if (!dma_buf_paddr || !prdt_paddr) {
+        log_warn("ATA: Can't allocate DMA buffers, using PIO");
+        return;
+    }
+
+    zone_t dma_zone = zoner_new_zone(ATA_DMA_BUFFER_SIZE);
+    vmm_map_pages(dma_zone.start, dma_buf_paddr, ATA_DMA_BUFFER_SIZE / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+    zone_t prdt_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(prdt_zone.start, prdt_paddr, PAGE_READABLE | PAGE_WRITABLE);
+
+    dev->dma_buf = dma_zone.ptr;
+    dev->dma_buf_paddr = dma_buf_paddr;
+    dev->prdt = (ata_prd_t*)prdt_zone.ptr;
+    dev->prdt_paddr = prdt_paddr;
+}
+
+static ata_channel_t* _ata_get_channel(uint32_t data_port)
+{
+    for (int i = 0; i < _ata_channels_count; i++) {
+        if (_ata_channels[i].data_port == data_port) {
+            return &_ata_channels[i];
+        }
+    }
+
+    if (_ata_channels_count == ATA_MAX_CHANNELS) {
+        return NULL;
+    }
+
+    ata_channel_t* channel = &_ata_channels[_ata_channels_count++];
+    channel->data_port = data_port;
+    lock_init(&channel->lock);
+    return channel;
+}
+
 void ata_add_new_device(device_t* new_device)
 {
     bool is_master = new_device->device_desc.port_base >> 31;
     uint16_t port = new_device->device_desc.port_base & 0xFFF;
-    ata_init(&_ata_drives[new_device->id], port, is_master);
-    if (ata_indentify(&_ata_drives[new_device->id])) {
+    ata_t* dev = &_ata_drives[new_device->id];
+    ata_init(dev, port, is_master);
+    dev->channel = _ata_get_channel(port);
+    if (!dev->channel) {
+        log_warn("ATA: Too many channels, skipping device");
+        return;
+    }
+
+    lock_acquire(&dev->channel->lock);
+    if (ata_indentify(dev)) {
         kprintf("Device added to ata driver\n");
+        if (dev->multiple) {
+            _ata_setup_multiple(dev);
+        }
+        dev->bm_port = new_device->device_desc.args[0];
+        if (dev->dma && dev->bm_port) {
+            _ata_setup_dma(dev);
+        }
     }
+    lock_release(&dev->channel->lock);
 }
 
 void ata_install()
@@ -124,6 +229,9 @@ bool ata_indentify(ata_t* ata)
         if (i == 6) {
             ata->sectors = data;
         }
+        if (i == 47) {
+            ata->multiple = data & 0xFF;
+        }
         if (i == 49) {
             if (((data >> 8) & 0x1) == 1) {
                 ata->dma = true;
@@ -144,10 +252,8 @@ bool ata_indentify(ata_t* ata)
     return true;
 }
 
-int ata_write(device_t* device, uint32_t sectorNum, uint8_t* data, uint32_t size)
+static int _ata_write_lockless(ata_t* dev, uint32_t sectorNum, uint8_t* data, uint32_t size)
 {
-    ata_t* dev = &_ata_drives[device->id];
-
     uint8_t dev_config = _ata_gen_drive_head_register(true, !dev->is_master, 0);
 
     port_8bit_out(dev->port.device, dev_config);
@@ -180,13 +286,20 @@ int ata_write(device_t* device, uint32_t sectorNum, uint8_t* data, uint32_t size
         port_16bit_out(dev->port.data, 0);
     }
 
-    return ata_flush(device);
+    return _ata_flush_lockless(dev);
 }
 
-int ata_read(device_t* device, uint32_t sectorNum, uint8_t* read_data)
+int ata_write(device_t* device, uint32_t sectorNum, uint8_t* data, uint32_t size)
 {
     ata_t* dev = &_ata_drives[device->id];
+    lock_acquire(&dev->channel->lock);
+    int err = _ata_write_lockless(dev, sectorNum, data, size);
+    lock_release(&dev->channel->lock);
+    return err;
+}
 
+static int _ata_read_lockless(ata_t* dev, uint32_t sectorNum, uint8_t* read_data)
+{
     uint8_t dev_config = _ata_gen_drive_head_register(true, !dev->is_master, 0);
 
     port_8bit_out(dev->port.device, dev_config);
@@ -224,10 +337,17 @@ int ata_read(device_t* device, uint32_t sectorNum, uint8_t* read_data)
     return 0;
 }
 
-int ata_flush(device_t* device)
+int ata_read(device_t* device, uint32_t sectorNum, uint8_t* read_data)
 {
     ata_t* dev = &_ata_drives[device->id];
+    lock_acquire(&dev->channel->lock);
+    int err = _ata_read_lockless(dev, sectorNum, read_data);
+    lock_release(&dev->channel->lock);
+    return err;
+}
 
+static int _ata_flush_lockless(ata_t* dev)
+{
     uint8_t dev_config = _ata_gen_drive_head_register(true, !dev->is_master, 0);
 
     port_8bit_out(dev->port.device, dev_config);
@@ -249,6 +369,143 @@ int ata_flush(device_t* device)
     return 0;
 }
 
+int ata_flush(device_t* device)
+{
+    ata_t* dev = &_ata_drives[device->id];
+    lock_acquire(&dev->channel->lock);
+    int err = _ata_flush_lockless(dev);
+    lock_release(&dev->channel->lock);
+    return err;
+}
+
+/**
+ * Transfers up to ATA_MAX_SECTORS_PER_CMD sectors with a single command.
+ * READ/WRITE MULTIPLE is used when the drive supports it, so an interrupt
+ * is raised once per DRQ block instead of once per sector.
+ */
+static int _ata_pio_transfer(ata_t* dev, uint32_t lba, uint32_t count, uint8_t* buf, bool write)
+{
+    uint32_t sectors_per_drq = 1;
+    uint8_t cmd = write ? ATA_CMD_WRITE_SECTORS : ATA_CMD_READ_SECTORS;
+    if (dev->multiple) {
+        sectors_per_drq = dev->multiple;
+        cmd = write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    }
+
+    _ata_setup_lba(dev, lba, count);
+    port_8bit_out(dev->port.command, cmd);
+
+    while (count) {
+        _ata_delay_400ns(dev);
+        uint8_t status = _ata_wait_not_busy(dev);
+        if (((status >> 0) & 1) == 1) {
+            return -EIO;
+        }
+        if (((status >> 3) & 1) == 0) {
+            return -ENODEV;
+        }
+
+        uint32_t sectors = min(sectors_per_drq, count);
+        uint16_t* buf16 = (uint16_t*)buf;
+        for (int i = 0; i < sectors * (ATA_SECTOR_SIZE / 2); i++) {
+            if (write) {
+                port_16bit_out(dev->port.data, buf16[i]);
+            } else {
+                buf16[i] = port_16bit_in(dev->port.data);
+            }
+        }
+        buf += sectors * ATA_SECTOR_SIZE;
+        count -= sectors;
+    }
+
+    return 0;
+}
+
+static int _ata_dma_transfer(ata_t* dev, uint32_t lba, uint32_t count, uint8_t* buf, bool write)
+{
+    uint32_t len = count * ATA_SECTOR_SIZE;
+    uint8_t direction = write ? 0 : ATA_BM_CMD_READ;
+
+    if (write) {
+        memcpy(dev->dma_buf, buf, len);
+    }
+
+    dev->prdt[0].paddr = dev->dma_buf_paddr;
+    dev->prdt[0].len = len & 0xFFFF;
+    dev->prdt[0].flags = ATA_PRD_END_OF_TABLE;
+
+    port_8bit_out(dev->bm_port + ATA_BM_COMMAND, 0);
+    port_dword_out(dev->bm_port + ATA_BM_PRDT, dev->prdt_paddr);
+    port_8bit_out(dev->bm_port + ATA_BM_STATUS, port_8bit_in(dev->bm_port + ATA_BM_STATUS) | ATA_BM_STATUS_ERROR | ATA_BM_STATUS_IRQ);
+    port_8bit_out(dev->bm_port + ATA_BM_COMMAND, direction);
+
+    _ata_setup_lba(dev, lba, count);
+    port_8bit_out(dev->port.command, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+    port_8bit_out(dev->bm_port + ATA_BM_COMMAND, direction | ATA_BM_CMD_START);
+
+    uint8_t bm_status = port_8bit_in(dev->bm_port + ATA_BM_STATUS);
+    while (!(bm_status & (ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR))) {
+        bm_status = port_8bit_in(dev->bm_port + ATA_BM_STATUS);
+    }
+    port_8bit_out(dev->bm_port + ATA_BM_COMMAND, 0);
+
+    uint8_t status = _ata_wait_not_busy(dev);
+    if ((bm_status & ATA_BM_STATUS_ERROR) || ((status >> 0) & 1) == 1) {
+        return -EIO;
+    }
+
+    if (!write) {
+        memcpy(buf, dev->dma_buf, len);
+    }
+    return 0;
+}
+
+/**
+ * The channel lock is held for the whole run, since the task file, the bus
+ * master registers and the DMA buffer stay in use until a command is done.
+ */
+static int _ata_transfer_blocks_lockless(ata_t* dev, uint32_t lba, uint32_t count, uint8_t* buf, bool write)
+{
+    while (count) {
+        uint32_t sectors = min(count, ATA_MAX_SECTORS_PER_CMD);
+        int err;
+        if (dev->dma_buf) {
+            err = _ata_dma_transfer(dev, lba, sectors, buf, write);
+        } else {
+            err = _ata_pio_transfer(dev, lba, sectors, buf, write);
+        }
+        if (err) {
+            return err;
+        }
+        lba += sectors;
+        buf += sectors * ATA_SECTOR_SIZE;
+        count -= sectors;
+    }
+
+    return 0;
+}
+
+int ata_read_blocks(device_t* device, uint32_t lba, uint32_t count, uint8_t* buf)
+{
+    ata_t* dev = &_ata_drives[device->id];
+    lock_acquire(&dev->channel->lock);
+    int err = _ata_transfer_blocks_lockless(dev, lba, count, buf, false);
+    lock_release(&dev->channel->lock);
+    return err;
+}
+
+int ata_write_blocks(device_t* device, uint32_t lba, uint32_t count, uint8_t* buf)
+{
+    ata_t* dev = &_ata_drives[device->id];
+    lock_acquire(&dev->channel->lock);
+    int err = _ata_transfer_blocks_lockless(dev, lba, count, buf, true);
+    if (!err) {
+        err = _ata_flush_lockless(dev);
+    }
+    lock_release(&dev->channel->lock);
+    return err;
+}
+
 /* Returns a disk size in bytes */
 uint32_t ata_get_capacity(device_t* device)
 {
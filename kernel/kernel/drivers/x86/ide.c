@@ -5,6 +5,7 @@
  */
 
 #include <drivers/x86/ide.h>
+#include <drivers/x86/pci.h>
 
 // ------------
 // Private
@@ -39,6 +40,33 @@ void ide_install()
     driver_install(_ide_driver_info(), "ide86");
 }
 
+#define IDE_PCI_COMMAND_REG 0x04
+#define IDE_PCI_COMMAND_BUS_MASTER 0x4
+#define IDE_INTERFACE_BUS_MASTER 0x80
+
+// Returns the base port of bus master registers of the channel, or 0.
+static uint32_t _ide_bus_master_port(device_t* t_device, uint32_t ata_port)
+{
+    if (!(t_device->device_desc.interface_id & IDE_INTERFACE_BUS_MASTER)) {
+        return 0;
+    }
+
+    // BAR4 is an I/O space BAR, the low bits are flags.
+    uint32_t bm_base = pci_read_bar(t_device, 4) & 0xfffffffc;
+    if (!bm_base) {
+        return 0;
+    }
+
+    uint8_t bus = t_device->device_desc.bus;
+    uint8_t device = t_device->device_desc.device;
+    uint8_t function = t_device->device_desc.function;
+    uint32_t command = pci_read(bus, device, function, IDE_PCI_COMMAND_REG) & 0xFFFF;
+    pci_write(bus, device, function, IDE_PCI_COMMAND_REG, command | IDE_PCI_COMMAND_BUS_MASTER);
+
+    // Secondary channel registers follow primary ones.
+    return ata_port == 0x170 ? bm_base + 8 : bm_base;
+}
+
 // [Stub]
 // Scanning IDE to find all drives.
 // Try to recognise thier type (now by calling check function of diff techs)
@@ -58,6 +86,7 @@ void ide_find_devices(device_t* t_device)
             new_device.revision_id = 0;
             new_device.port_base = ask_ports[i] | (1 << 31);
             new_device.interrupt = IRQ14;
+            new_device.args[0] = _ide_bus_master_port(t_device, ask_ports[i]);
             device_install(new_device);
         }
     }
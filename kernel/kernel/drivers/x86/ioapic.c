@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/x86/ioapic.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/x86/idt.h>
+
+// #define IOAPIC_DEBUG
+
+/**
+ * ISA interrupts are delivered by the IOAPIC instead of the PIC. They keep
+ * their vectors (IRQ0 - IRQ15), so drivers are not aware of the change.
+ * Interrupts are sent to the boot cpu.
+ */
+
+static zone_t _ioapic_zone;
+static volatile uint32_t* _ioapic_registers;
+static acpi_apic_info_t* _ioapic_info;
+
+static inline uint32_t _ioapic_read(uint32_t reg)
+{
+    _ioapic_registers[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    return _ioapic_registers[IOAPIC_WINDOW / sizeof(uint32_t)];
+}
+
+static inline void _ioapic_write(uint32_t reg, uint32_t val)
+{
+    _ioapic_registers[IOAPIC_REGSEL / sizeof(uint32_t)] = reg;
+    _ioapic_registers[IOAPIC_WINDOW / sizeof(uint32_t)] = val;
+}
+
+static void _ioapic_set_entry(uint32_t pin, uint32_t low, uint8_t dest_apic_id)
+{
+    _ioapic_write(IOAPIC_REG_REDTBL + 2 * pin + 1, (uint32_t)dest_apic_id << 24);
+    _ioapic_write(IOAPIC_REG_REDTBL + 2 * pin, low);
+}
+
+int ioapic_install(acpi_apic_info_t* info, uint8_t dest_apic_id)
+{
+    _ioapic_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(_ioapic_zone.start, info->ioapic_paddr, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    _ioapic_registers = (uint32_t*)_ioapic_zone.ptr;
+    _ioapic_info = info;
+
+    uint32_t pins = ((_ioapic_read(IOAPIC_REG_VER) >> 16) & 0xff) + 1;
+    for (uint32_t pin = 0; pin < pins; pin++) {
+        _ioapic_set_entry(pin, IOAPIC_MASKED, 0);
+    }
+
+    // IRQ2 is the cascade of the PICs, it never fires.
+    for (int irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        uint32_t pin = info->isa_irq_gsi[irq] - info->ioapic_gsi_base;
+        if (irq == 2 || pin >= pins) {
+            continue;
+        }
+
+        uint32_t low = IRQ_MASTER_OFFSET + irq;
+        if ((info->isa_irq_flags[irq] & ACPI_IRQ_POLARITY_MASK) == ACPI_IRQ_POLARITY_LOW) {
+            low |= IOAPIC_POLARITY_LOW;
+        }
+        if ((info->isa_irq_flags[irq] & ACPI_IRQ_TRIGGER_MASK) == ACPI_IRQ_TRIGGER_LEVEL) {
+            low |= IOAPIC_TRIGGER_LEVEL;
+        }
+        _ioapic_set_entry(pin, low, dest_apic_id);
+    }
+
+#ifdef IOAPIC_DEBUG
+    log("[IOAPIC] %d pins, ISA IRQs routed to LAPIC %d", pins, dest_apic_id);
+#endif
+    return 0;
+}
+
+void ioapic_mask_irq(int irq)
+{
+    uint32_t pin = _ioapic_info->isa_irq_gsi[irq] - _ioapic_info->ioapic_gsi_base;
+    uint32_t low = _ioapic_read(IOAPIC_REG_REDTBL + 2 * pin);
+    _ioapic_write(IOAPIC_REG_REDTBL + 2 * pin, low | IOAPIC_MASKED);
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/x86/lapic.h>
+#include <drivers/x86/pit.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+#include <platform/x86/idt.h>
+#include <tasking/cpu.h>
+#include <tasking/sched.h>
+#include <time/time_manager.h>
+
+// #define LAPIC_DEBUG
+
+/**
+ * Every cpu has its own local APIC at the same physical address, so one
+ * mapping serves all of them. Each cpu runs a periodic LAPIC timer, it is
+ * calibrated once against the PIT, since all timers run from the same bus
+ * clock.
+ */
+
+static zone_t _lapic_zone;
+static volatile uint32_t* _lapic_registers;
+static bool _lapic_enabled = false;
+static uint32_t _lapic_ticks_per_timer_tick;
+
+static inline uint32_t _lapic_read(uint32_t reg)
+{
+    return _lapic_registers[reg / sizeof(uint32_t)];
+}
+
+static inline void _lapic_write(uint32_t reg, uint32_t val)
+{
+    _lapic_registers[reg / sizeof(uint32_t)] = val;
+}
+
+static void _lapic_timer_handler()
+{
+    cpu_tick();
+    timeman_timer_tick();
+    sched_tick();
+}
+
+static void _lapic_calibrate_timer()
+{
+    _lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    _lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+    _lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+    pit_wait_us(LAPIC_CALIBRATION_US);
+    uint32_t elapsed = 0xffffffff - _lapic_read(LAPIC_TIMER_CURRENT);
+    _lapic_write(LAPIC_TIMER_INIT, 0);
+
+    _lapic_ticks_per_timer_tick = elapsed * (1000000 / LAPIC_CALIBRATION_US) / TIMER_TICKS_PER_SECOND;
+#ifdef LAPIC_DEBUG
+    log("[LAPIC] %d timer ticks per sched tick", _lapic_ticks_per_timer_tick);
+#endif
+}
+
+static inline void _lapic_send_icr(uint8_t apic_id, uint32_t low)
+{
+    _lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    _lapic_write(LAPIC_ICR_LOW, low);
+    while (_lapic_read(LAPIC_ICR_LOW) & LAPIC_ICR_PENDING) { }
+}
+
+/**
+ * The function maps the LAPIC and calibrates its timer, it's called by
+ * the boot cpu. Every cpu turns its own LAPIC on with lapic_setup_cpu().
+ */
+int lapic_install(uint32_t paddr)
+{
+    _lapic_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(_lapic_zone.start, paddr, PAGE_READABLE | PAGE_WRITABLE | PAGE_NOT_CACHEABLE);
+    _lapic_registers = (uint32_t*)_lapic_zone.ptr;
+
+    idt_element_setup(IRQ_LAPIC_TIMER, (void*)irq_lapic_timer, false);
+    idt_element_setup(IRQ_LAPIC_SPURIOUS, (void*)irq_lapic_spurious, false);
+    set_irq_handler(IRQ_LAPIC_TIMER, _lapic_timer_handler);
+
+    _lapic_calibrate_timer();
+    _lapic_enabled = true;
+    return 0;
+}
+
+void lapic_setup_cpu()
+{
+    _lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | IRQ_LAPIC_SPURIOUS);
+    _lapic_write(LAPIC_TPR, 0);
+    _lapic_write(LAPIC_LVT_ERROR, LAPIC_LVT_MASKED);
+    _lapic_write(LAPIC_ESR, 0);
+    lapic_eoi();
+
+    _lapic_write(LAPIC_TIMER_DIV, LAPIC_TIMER_DIV_16);
+    _lapic_write(LAPIC_LVT_TIMER, IRQ_LAPIC_TIMER | LAPIC_TIMER_PERIODIC);
+    _lapic_write(LAPIC_TIMER_INIT, _lapic_ticks_per_timer_tick);
+}
+
+bool lapic_is_enabled()
+{
+    return _lapic_enabled;
+}
+
+uint8_t lapic_id()
+{
+    return _lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi()
+{
+    _lapic_write(LAPIC_EOI, 0);
+}
+
+void lapic_send_ipi(uint8_t apic_id, uint8_t vector)
+{
+    _lapic_send_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_FIXED | vector);
+}
+
+void lapic_send_nmi(uint8_t apic_id)
+{
+    _lapic_send_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_NMI);
+}
+
+void lapic_send_init(uint8_t apic_id)
+{
+    _lapic_send_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_INIT);
+}
+
+void lapic_send_startup(uint8_t apic_id, uint32_t paddr)
+{
+    _lapic_send_icr(apic_id, LAPIC_ICR_ASSERT | LAPIC_ICR_STARTUP | (paddr >> 12));
+}
@@ -6,8 +6,10 @@
 
 #include <drivers/x86/pit.h>
 #include <libkern/kassert.h>
+#include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <platform/generic/system.h>
+#include <platform/x86/registers.h>
 #include <tasking/cpu.h>
 #include <tasking/sched.h>
 #include <time/time_manager.h>
@@ -16,6 +18,17 @@ static int ticks_to_sched = 0;
 static int second = TIMER_TICKS_PER_SECOND;
 static int _pit_set_frequency(uint16_t freq);
 
+/**
+ * The PIT gives us a tick resolution only, so the TSC is used to measure
+ * time between ticks. The TSC rate is calibrated against the PIT during
+ * the first second after boot; until then the clock has tick resolution.
+ */
+static uint64_t tsc_at_tick = 0;
+static uint64_t tsc_at_calibration_start = 0;
+static uint32_t calibration_ticks = 0;
+static uint32_t tsc_per_tick = 0;
+static uint64_t tsc_to_ns_mult = 0; // ns per tsc cycle in 32.32 fixed point
+
 static int _pit_set_frequency(uint16_t freq)
 {
     system_disable_interrupts();
@@ -41,9 +54,62 @@ void pit_setup()
     set_irq_handler(IRQ0, pit_handler);
 }
 
+/**
+ * The function busy waits using the channel 2 of the PIT, so it works
+ * before interrupts are set up. A count is 16 bits, longer waits are
+ * split into chunks.
+ */
+void pit_wait_us(uint32_t us)
+{
+    while (us) {
+        uint32_t chunk = min(us, PIT_WAIT_CHUNK_US);
+        uint32_t count = (PIT_BASE_FREQ / 1000) * chunk / 1000;
+
+        // Gate on, speaker off, one-shot mode.
+        port_byte_out(0x61, (port_byte_in(0x61) & ~0x02) | 0x01);
+        port_byte_out(0x43, 0xb0); // 0b10110000
+        port_byte_out(0x42, count & 0xff);
+        port_byte_out(0x42, (count >> 8) & 0xff);
+        while (!(port_byte_in(0x61) & 0x20)) { }
+
+        us -= chunk;
+    }
+}
+
 void pit_handler()
 {
     cpu_tick();
     timeman_timer_tick();
     sched_tick();
 }
+
+void timer_sync_tick()
+{
+    tsc_at_tick = read_tsc();
+
+    if (calibration_ticks < PIT_TSC_CALIBRATION_TICKS) {
+        if (calibration_ticks == 0) {
+            tsc_at_calibration_start = tsc_at_tick;
+        }
+        calibration_ticks++;
+        if (calibration_ticks == PIT_TSC_CALIBRATION_TICKS) {
+            tsc_per_tick = (tsc_at_tick - tsc_at_calibration_start) / (PIT_TSC_CALIBRATION_TICKS - 1);
+            if (tsc_per_tick) {
+                tsc_to_ns_mult = ((uint64_t)timeman_ns_per_tick() << 32) / tsc_per_tick;
+            }
+        }
+    }
+}
+
+uint32_t timer_ns_since_tick()
+{
+    if (!tsc_to_ns_mult) {
+        return 0;
+    }
+
+    uint64_t cycles = read_tsc() - tsc_at_tick;
+    if (cycles >= tsc_per_tick) {
+        return timeman_ns_per_tick() - 1;
+    }
+    return (uint32_t)((cycles * tsc_to_ns_mult) >> 32);
+}
@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/bcache.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/vmm/zoner.h>
+#include <syscalls/handlers.h>
+
+// #define BCACHE_DEBUG
+
+/**
+ * The block cache sits between filesystems and storage drivers. Blocks are
+ * looked up by (device, block) through a hash table, the least recently used
+ * one is reused on a miss, and dirty blocks are written back by bcache_flusher().
+ *
+ * _bcache_lock is not held while a driver moves data. Entries under a transfer
+ * are marked BCACHE_BUSY: they are not reused, not changed, and blocks which
+ * are being read are not valid yet. Others wait for such entries, yielding
+ * the cpu with the lock released. The bounce buffer is used by one transfer
+ * at a time, single block transfers go to the entry directly. Transfers to
+ * one device are serialized by its IO lock, since the flusher runs them
+ * next to the filesystems.
+ */
+
+typedef int (*bcache_read_fn)(device_t* dev, uint32_t sector, uint8_t* buf);
+typedef int (*bcache_write_fn)(device_t* dev, uint32_t sector, uint8_t* buf, uint32_t size);
+typedef int (*bcache_blocks_fn)(device_t* dev, uint32_t lba, uint32_t count, uint8_t* buf);
+
+static lock_t _bcache_lock;
+static zone_t _bcache_zone;
+static zone_t _bcache_io_zone; /* Bounce buffer for multi block transfers. */
+static bcache_entry_t* _bcache_entries;
+static bcache_entry_t* _bcache_hash[BCACHE_HASH_SIZE];
+static bcache_entry_t* _bcache_lru_head; /* Most recently used. */
+static bcache_entry_t* _bcache_lru_tail; /* Least recently used. */
+static bcache_stat_t _bcache_stat;
+static bool _bcache_io_zone_busy;
+
+/* Tracks the last missed block per device to detect sequential access. */
+static uint32_t _bcache_last_miss[MAX_DEVICES_COUNT];
+static lock_t _bcache_dev_locks[MAX_DEVICES_COUNT];
+
+static inline uint32_t _bcache_hash_index(device_t* dev, uint32_t block)
+{
+    return (block ^ ((uint32_t)dev->id << 24)) & (BCACHE_HASH_SIZE - 1);
+}
+
+static inline uint32_t _bcache_device_blocks(device_t* dev)
+{
+    uint32_t (*get_size)(device_t * d) = dm_function_handler(dev, DRIVER_STORAGE_CAPACITY);
+    if (!get_size) {
+        return 0;
+    }
+    return get_size(dev) / BCACHE_BLOCK_SIZE;
+}
+
+/**
+ * LRU
+ */
+
+static inline void _bcache_lru_remove(bcache_entry_t* entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        _bcache_lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        _bcache_lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static inline void _bcache_lru_push_front(bcache_entry_t* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = _bcache_lru_head;
+    if (_bcache_lru_head) {
+        _bcache_lru_head->lru_prev = entry;
+    }
+    _bcache_lru_head = entry;
+    if (!_bcache_lru_tail) {
+        _bcache_lru_tail = entry;
+    }
+}
+
+static inline void _bcache_lru_push_back(bcache_entry_t* entry)
+{
+    entry->lru_next = NULL;
+    entry->lru_prev = _bcache_lru_tail;
+    if (_bcache_lru_tail) {
+        _bcache_lru_tail->lru_next = entry;
+    }
+    _bcache_lru_tail = entry;
+    if (!_bcache_lru_head) {
+        _bcache_lru_head = entry;
+    }
+}
+
+static inline void _bcache_touch(bcache_entry_t* entry)
+{
+    if (_bcache_lru_head != entry) {
+        _bcache_lru_remove(entry);
+        _bcache_lru_push_front(entry);
+    }
+}
+
+/**
+ * HASH
+ */
+
+static bcache_entry_t* _bcache_lookup_lockless(device_t* dev, uint32_t block)
+{
+    bcache_entry_t* entry = _bcache_hash[_bcache_hash_index(dev, block)];
+    while (entry) {
+        if (entry->dev == dev && entry->block == block) {
+            return entry;
+        }
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+static void _bcache_hash_insert_lockless(bcache_entry_t* entry)
+{
+    uint32_t index = _bcache_hash_index(entry->dev, entry->block);
+    entry->hash_next = _bcache_hash[index];
+    _bcache_hash[index] = entry;
+}
+
+static void _bcache_hash_remove_lockless(bcache_entry_t* entry)
+{
+    bcache_entry_t** link = &_bcache_hash[_bcache_hash_index(entry->dev, entry->block)];
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->hash_next;
+            entry->hash_next = NULL;
+            return;
+        }
+        link = &(*link)->hash_next;
+    }
+}
+
+/**
+ * IO
+ */
+
+static int _bcache_dev_read_locked(device_t* dev, uint32_t block, uint32_t count, uint8_t* buf)
+{
+    bcache_blocks_fn read_blocks = dm_function_handler(dev, DRIVER_STORAGE_READ_BLOCKS);
+    if (read_blocks) {
+        return read_blocks(dev, block, count, buf);
+    }
+
+    bcache_read_fn read = dm_function_handler(dev, DRIVER_STORAGE_READ);
+    for (uint32_t i = 0; i < count; i++) {
+        int err = read(dev, block + i, buf + i * BCACHE_BLOCK_SIZE);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int _bcache_dev_write_locked(device_t* dev, uint32_t block, uint32_t count, uint8_t* buf)
+{
+    bcache_blocks_fn write_blocks = dm_function_handler(dev, DRIVER_STORAGE_WRITE_BLOCKS);
+    if (write_blocks) {
+        return write_blocks(dev, block, count, buf);
+    }
+
+    bcache_write_fn write = dm_function_handler(dev, DRIVER_STORAGE_WRITE);
+    for (uint32_t i = 0; i < count; i++) {
+        int err = write(dev, block + i, buf + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+        if (err < 0) {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static int _bcache_dev_read(device_t* dev, uint32_t block, uint32_t count, uint8_t* buf)
+{
+    lock_acquire(&_bcache_dev_locks[dev->id]);
+    int err = _bcache_dev_read_locked(dev, block, count, buf);
+    lock_release(&_bcache_dev_locks[dev->id]);
+    return err;
+}
+
+static int _bcache_dev_write(device_t* dev, uint32_t block, uint32_t count, uint8_t* buf)
+{
+    lock_acquire(&_bcache_dev_locks[dev->id]);
+    int err = _bcache_dev_write_locked(dev, block, count, buf);
+    lock_release(&_bcache_dev_locks[dev->id]);
+    return err;
+}
+
+/**
+ * The function is called with the lock held and returns with it held. It
+ * lets the owners of busy entries finish their transfers.
+ */
+static void _bcache_wait_lockless()
+{
+    lock_release(&_bcache_lock);
+    ksys0(SYS_SCHEDYIELD);
+    lock_acquire(&_bcache_lock);
+}
+
+/**
+ * Writes the entry back together with the dirty blocks which follow it,
+ * so the driver gets one request per run of blocks. The lock is released
+ * while the driver writes. Blocks stay dirty if the write fails.
+ */
+static int _bcache_write_back_lockless(bcache_entry_t* entry)
+{
+    bcache_entry_t* run[BCACHE_IO_BLOCKS];
+    uint32_t count = 0;
+    uint32_t max_count = _bcache_io_zone_busy ? 1 : BCACHE_IO_BLOCKS;
+    device_t* dev = entry->dev;
+    uint32_t block = entry->block;
+
+    bcache_entry_t* cur = entry;
+    while (cur && (cur->flags & BCACHE_DIRTY) && !(cur->flags & BCACHE_BUSY) && count < max_count) {
+        cur->flags |= BCACHE_BUSY;
+        run[count++] = cur;
+        cur = _bcache_lookup_lockless(dev, block + count);
+    }
+    if (!count) {
+        return 0;
+    }
+
+    uint8_t* buf = run[0]->data;
+    if (count > 1) {
+        _bcache_io_zone_busy = true;
+        buf = _bcache_io_zone.ptr;
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(buf + i * BCACHE_BLOCK_SIZE, run[i]->data, BCACHE_BLOCK_SIZE);
+        }
+    }
+
+    lock_release(&_bcache_lock);
+    int err = _bcache_dev_write(dev, block, count, buf);
+    lock_acquire(&_bcache_lock);
+
+    uint32_t clear_flags = err < 0 ? BCACHE_BUSY : (BCACHE_DIRTY | BCACHE_BUSY);
+    for (uint32_t i = 0; i < count; i++) {
+        run[i]->flags &= ~clear_flags;
+    }
+    if (count > 1) {
+        _bcache_io_zone_busy = false;
+    }
+
+    if (err < 0) {
+        log_warn("[Bcache] Can't write blocks %d-%d of dev %d: %d", block, block + count - 1, dev->id, err);
+        return err;
+    }
+    _bcache_stat.dirty -= count;
+    _bcache_stat.write_backs += count;
+    return 0;
+}
+
+/**
+ * Returns the least recently used entry which could be reused without a
+ * transfer, NULL if there is no such one.
+ */
+static bcache_entry_t* _bcache_find_victim_lockless()
+{
+    for (bcache_entry_t* entry = _bcache_lru_tail; entry; entry = entry->lru_prev) {
+        if (!(entry->flags & (BCACHE_BUSY | BCACHE_DIRTY))) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Makes sure the next allocation won't need a transfer. Returns -EAGAIN if
+ * the lock was released meanwhile, then the caller has to look the block up
+ * again.
+ */
+static int _bcache_prepare_alloc_lockless()
+{
+    bcache_entry_t* tail = _bcache_lru_tail;
+    if ((tail->flags & BCACHE_DIRTY) && !(tail->flags & BCACHE_BUSY)) {
+        int err = _bcache_write_back_lockless(tail);
+        if (err < 0) {
+            if (!_bcache_find_victim_lockless()) {
+                return err;
+            }
+            // The block stays dirty, it's moved away so clean ones are reused.
+            if (tail->flags & BCACHE_DIRTY) {
+                _bcache_touch(tail);
+            }
+        }
+        return -EAGAIN;
+    }
+    if (!_bcache_find_victim_lockless()) {
+        _bcache_wait_lockless();
+        return -EAGAIN;
+    }
+    return 0;
+}
+
+/**
+ * Returns an entry for the block which is already in the hash table and at
+ * the front of the LRU list, NULL if all entries are busy or dirty. The data
+ * is not filled.
+ */
+static bcache_entry_t* _bcache_alloc_lockless(device_t* dev, uint32_t block, uint32_t flags)
+{
+    bcache_entry_t* entry = _bcache_find_victim_lockless();
+    if (!entry) {
+        return NULL;
+    }
+
+    if (entry->flags & BCACHE_VALID) {
+        _bcache_hash_remove_lockless(entry);
+        _bcache_stat.evictions++;
+        _bcache_stat.cached--;
+    }
+    entry->dev = dev;
+    entry->block = block;
+    entry->flags = flags;
+    _bcache_hash_insert_lockless(entry);
+    _bcache_touch(entry);
+    _bcache_stat.cached++;
+    return entry;
+}
+
+/**
+ * Returns how many blocks starting from the given one are not cached
+ * yet and could be fetched with a single request.
+ */
+static uint32_t _bcache_read_ahead_len_lockless(device_t* dev, uint32_t block)
+{
+    uint32_t dev_blocks = _bcache_device_blocks(dev);
+    uint32_t end = min(block + 1 + BCACHE_READ_AHEAD_BLOCKS, dev_blocks);
+    uint32_t count = 1;
+
+    for (uint32_t cur = block + 1; cur < end; cur++) {
+        if (_bcache_lookup_lockless(dev, cur)) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Reads the missed block with the blocks which follow it, if the access
+ * looks sequential. The lock is released while the driver reads. Entries
+ * of a failed read are dropped, so nothing is cached from it.
+ */
+static int _bcache_read_lockless(device_t* dev, uint32_t block, bcache_entry_t** result)
+{
+    uint32_t count = 1;
+    uint32_t last_miss = _bcache_last_miss[dev->id];
+    if (!_bcache_io_zone_busy && last_miss != BCACHE_NO_BLOCK && last_miss + 1 == block) {
+        count = _bcache_read_ahead_len_lockless(dev, block);
+    }
+
+    // Entries are not valid till the read ends, others wait for them.
+    bcache_entry_t* run[BCACHE_IO_BLOCKS];
+    uint32_t allocated = 0;
+    while (allocated < count) {
+        run[allocated] = _bcache_alloc_lockless(dev, block + allocated, BCACHE_BUSY);
+        if (!run[allocated]) {
+            break;
+        }
+        allocated++;
+    }
+    count = allocated;
+    _bcache_last_miss[dev->id] = block + count - 1;
+
+    // Read-ahead blocks are allocated later, so the requested one is made the most recent.
+    _bcache_touch(run[0]);
+
+    uint8_t* buf = run[0]->data;
+    if (count > 1) {
+        _bcache_io_zone_busy = true;
+        buf = _bcache_io_zone.ptr;
+    }
+
+    lock_release(&_bcache_lock);
+    int err = _bcache_dev_read(dev, block, count, buf);
+    if (!err && count > 1) {
+        for (uint32_t i = 0; i < count; i++) {
+            memcpy(run[i]->data, buf + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+        }
+    }
+    lock_acquire(&_bcache_lock);
+
+    if (count > 1) {
+        _bcache_io_zone_busy = false;
+    }
+
+    if (err < 0) {
+        log_warn("[Bcache] Can't read blocks %d-%d of dev %d: %d", block, block + count - 1, dev->id, err);
+        for (uint32_t i = 0; i < count; i++) {
+            _bcache_hash_remove_lockless(run[i]);
+            run[i]->flags = 0;
+            _bcache_lru_remove(run[i]);
+            _bcache_lru_push_back(run[i]);
+            _bcache_stat.cached--;
+        }
+        _bcache_last_miss[dev->id] = BCACHE_NO_BLOCK;
+        return err;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        run[i]->flags = BCACHE_VALID;
+    }
+    _bcache_stat.read_ahead += count - 1;
+    *result = run[0];
+    return 0;
+}
+
+/**
+ * Puts the valid entry of the block to @result. The lock could be released
+ * while waiting for a transfer. If @for_write is set, the entry is not under
+ * a write back, so it could be changed.
+ */
+static int _bcache_get_lockless(device_t* dev, uint32_t block, bool need_data, bool for_write, bcache_entry_t** result)
+{
+    for (;;) {
+        bcache_entry_t* entry = _bcache_lookup_lockless(dev, block);
+        if (entry) {
+            if (!(entry->flags & BCACHE_VALID) || (for_write && (entry->flags & BCACHE_BUSY))) {
+                _bcache_wait_lockless();
+                continue;
+            }
+            _bcache_stat.hits++;
+            _bcache_touch(entry);
+            *result = entry;
+            return 0;
+        }
+
+        int err = _bcache_prepare_alloc_lockless();
+        if (err == -EAGAIN) {
+            continue;
+        }
+        if (err < 0) {
+            return err;
+        }
+
+        _bcache_stat.misses++;
+        if (!need_data) {
+            *result = _bcache_alloc_lockless(dev, block, BCACHE_VALID);
+            return 0;
+        }
+        return _bcache_read_lockless(dev, block, result);
+    }
+}
+
+/**
+ * API
+ */
+
+void bcache_init()
+{
+    lock_init(&_bcache_lock);
+    _bcache_zone = zoner_new_zone(BCACHE_BLOCKS_COUNT * BCACHE_BLOCK_SIZE);
+    _bcache_io_zone = zoner_new_zone(BCACHE_IO_BLOCKS * BCACHE_BLOCK_SIZE);
+    _bcache_entries = kmalloc(BCACHE_BLOCKS_COUNT * sizeof(bcache_entry_t));
+    memset(_bcache_entries, 0, BCACHE_BLOCKS_COUNT * sizeof(bcache_entry_t));
+
+    for (int i = 0; i < BCACHE_BLOCKS_COUNT; i++) {
+        _bcache_entries[i].data = _bcache_zone.ptr + i * BCACHE_BLOCK_SIZE;
+        _bcache_lru_push_back(&_bcache_entries[i]);
+    }
+    _bcache_stat.capacity = BCACHE_BLOCKS_COUNT;
+
+    for (int i = 0; i < MAX_DEVICES_COUNT; i++) {
+        _bcache_last_miss[i] = BCACHE_NO_BLOCK;
+        lock_init(&_bcache_dev_locks[i]);
+    }
+}
+
+int bcache_read(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    uint32_t block = start / BCACHE_BLOCK_SIZE;
+    uint32_t offset = start % BCACHE_BLOCK_SIZE;
+    int already_read = 0;
+
+    lock_acquire(&_bcache_lock);
+    while (len) {
+        bcache_entry_t* entry;
+        int err = _bcache_get_lockless(dev->dev, block, true, false, &entry);
+        if (err < 0) {
+            lock_release(&_bcache_lock);
+            return err;
+        }
+        uint32_t chunk = min(BCACHE_BLOCK_SIZE - offset, len);
+        memcpy(buf + already_read, entry->data + offset, chunk);
+        already_read += chunk;
+        len -= chunk;
+        block++;
+        offset = 0;
+    }
+    lock_release(&_bcache_lock);
+    return already_read;
+}
+
+int bcache_write(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    uint32_t block = start / BCACHE_BLOCK_SIZE;
+    uint32_t offset = start % BCACHE_BLOCK_SIZE;
+    int already_written = 0;
+
+    lock_acquire(&_bcache_lock);
+    while (len) {
+        uint32_t chunk = min(BCACHE_BLOCK_SIZE - offset, len);
+        bool need_data = (chunk != BCACHE_BLOCK_SIZE);
+        bcache_entry_t* entry;
+        int err = _bcache_get_lockless(dev->dev, block, need_data, true, &entry);
+        if (err < 0) {
+            lock_release(&_bcache_lock);
+            return err;
+        }
+        memcpy(entry->data + offset, buf + already_written, chunk);
+        if (!(entry->flags & BCACHE_DIRTY)) {
+            entry->flags |= BCACHE_DIRTY;
+            _bcache_stat.dirty++;
+        }
+        already_written += chunk;
+        len -= chunk;
+        block++;
+        offset = 0;
+    }
+    lock_release(&_bcache_lock);
+    return already_written;
+}
+
+/**
+ * Entries under a transfer are waited for, so all blocks which were dirty
+ * when the function was called are on the drive when it returns. Returns
+ * the last error, failed blocks stay dirty.
+ */
+static int _bcache_flush_lockless(device_t* dev)
+{
+    int res = 0;
+    for (int i = 0; i < BCACHE_BLOCKS_COUNT; i++) {
+        bcache_entry_t* entry = &_bcache_entries[i];
+        while ((entry->flags & BCACHE_BUSY) && (!dev || entry->dev == dev)) {
+            _bcache_wait_lockless();
+        }
+        if ((entry->flags & BCACHE_DIRTY) && (!dev || entry->dev == dev)) {
+            int err = _bcache_write_back_lockless(entry);
+            if (err < 0) {
+                res = err;
+            }
+        }
+    }
+    return res;
+}
+
+int bcache_flush_device(device_t* dev)
+{
+    lock_acquire(&_bcache_lock);
+    int err = _bcache_flush_lockless(dev);
+    lock_release(&_bcache_lock);
+
+    void (*flush)(device_t * d) = dm_function_handler(dev, DRIVER_STORAGE_FLUSH);
+    if (flush) {
+        lock_acquire(&_bcache_dev_locks[dev->id]);
+        flush(dev);
+        lock_release(&_bcache_dev_locks[dev->id]);
+    }
+    return err;
+}
+
+/**
+ * Writes back and drops all blocks of the device, used when it's ejected.
+ */
+int bcache_invalidate_device(device_t* dev)
+{
+    lock_acquire(&_bcache_lock);
+    _bcache_flush_lockless(dev);
+    for (int i = 0; i < BCACHE_BLOCKS_COUNT; i++) {
+        bcache_entry_t* entry = &_bcache_entries[i];
+        while ((entry->flags & BCACHE_BUSY) && entry->dev == dev) {
+            _bcache_wait_lockless();
+        }
+        if ((entry->flags & BCACHE_VALID) && entry->dev == dev) {
+            _bcache_hash_remove_lockless(entry);
+            if (entry->flags & BCACHE_DIRTY) {
+                _bcache_stat.dirty--;
+            }
+            entry->flags = 0;
+            _bcache_lru_remove(entry);
+            _bcache_lru_push_back(entry);
+            _bcache_stat.cached--;
+        }
+    }
+    _bcache_last_miss[dev->id] = BCACHE_NO_BLOCK;
+    lock_release(&_bcache_lock);
+    return 0;
+}
+
+/**
+ * Is a thread entry point. The function writes dirty blocks back to drives.
+ */
+void bcache_flusher()
+{
+    for (;;) {
+#ifdef BCACHE_DEBUG
+        log("WORK bcache_flusher: %d dirty", _bcache_stat.dirty);
+#endif
+        if (_bcache_stat.dirty) {
+            lock_acquire(&_bcache_lock);
+            _bcache_flush_lockless(NULL);
+            lock_release(&_bcache_lock);
+        }
+        ksys1(SYS_SLEEP, 2);
+    }
+}
+
+void bcache_get_stat(bcache_stat_t* stat)
+{
+    lock_acquire(&_bcache_lock);
+    memcpy(stat, &_bcache_stat, sizeof(bcache_stat_t));
+    lock_release(&_bcache_lock);
+}
@@ -5,13 +5,17 @@
  */
 
 #include <algo/dynamic_array.h>
+#include <fs/page_cache.h>
 #include <fs/vfs.h>
 #include <libkern/atomic.h>
+#include <libkern/bits/errno.h>
 #include <libkern/kassert.h>
+#include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <libkern/mem.h>
 #include <mem/kmalloc.h>
+#include <mem/pmm.h>
 #include <platform/generic/system.h>
 #include <syscalls/handlers.h>
 
@@ -19,107 +23,346 @@
 
 #define NOT_READ_INODE 0
 #define READ_INODE 1
-#define DENTRY_ALLOC_SIZE (4 * KB) /* Shows the size of list's parts. */
-#define DENTRY_SWAP_THRESHOLD_FOR_INODE_CACHE (16 * KB)
+
+/**
+ * Dentries are unique per inode and are found by (device, inode) through a
+ * hash table. A dentry which is not held by anyone stays in the cache with
+ * its inode and is put to the LRU list, so it's reused without reading the
+ * inode again. The least recently used ones are freed when there are more
+ * of them than the limit, which goes down when free memory runs low.
+ *
+ * Names resolved by lookups are cached too, keyed by (device, directory
+ * inode, name). A failed lookup leaves a negative entry, so a missing file
+ * is not searched on the disk again. Only names of real devices are cached,
+ * files of devfs and procfs come and go without the vfs.
+ *
+ * _dentry_cache_lock guards the tables, the lists and cache_flags. It's
+ * taken while holding the lock of a dentry, so dentries are locked under it
+ * with lock_try_acquire() only.
+ */
 
 extern vfs_device_t _vfs_devices[MAX_DEVICES_COUNT];
 extern dynamic_array_t _vfs_fses;
 extern uint32_t root_fs_dev_id;
 
-static bool can_cache_inodes = 1;
+static lock_t _dentry_cache_lock;
+static kmem_cache_t* _dentry_cache;
+static kmem_cache_t* _dentry_names_cache;
+static kmem_cache_t* inode_cache;
+static dentry_t* _dentry_hash[DENTRY_HASH_SIZE];
+static dentry_t* _dentry_lru_head; /* Most recently used. */
+static dentry_t* _dentry_lru_tail; /* Least recently used. */
+static dentry_name_t* _dentry_names_hash[DENTRY_NAMES_HASH_SIZE];
+static dentry_name_t* _dentry_names_lru_head;
+static dentry_name_t* _dentry_names_lru_tail;
+static uint32_t _dentry_names_generation; /* Changes every time names are forgotten. */
+static dentry_cache_stat_t _dentry_stat;
 static uint32_t stat_cached_dentries = 0; /* Count of dentries which are held. */
-static uint32_t stat_cached_inodes_area_size = 0; /* Sum of all areas which is used for holding inodes. */
-static dentry_cache_list_t* dentry_cache;
-static uint16_t* dentry_cahced;
 
-static inline bool need_to_free_inode_cache()
+/**
+ * The function scales @max_limit down with free memory, when less than a
+ * quarter of memory is free.
+ */
+static uint32_t _dentry_limit_by_memory(uint32_t max_limit, uint32_t min_limit)
 {
-    return (stat_cached_inodes_area_size > DENTRY_SWAP_THRESHOLD_FOR_INODE_CACHE);
+    uint32_t free_blocks = pmm_get_free_blocks();
+    uint32_t quarter = pmm_get_max_blocks() / 4;
+    if (!quarter || free_blocks >= quarter) {
+        return max_limit;
+    }
+
+    uint32_t sixteenths = (free_blocks * 16) / quarter;
+    return max((max_limit / 16) * sixteenths, min_limit);
 }
 
-static inline bool free_inode_cache()
+/**
+ * LRU
+ */
+
+static inline void _dentry_lru_remove(dentry_t* dentry)
 {
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    dentry_t* valid_dentry_candidate = NULL;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].d_count == 0) {
-                dentry_cache_block->data[i].inode_indx = 0;
-                stat_cached_inodes_area_size -= INODE_LEN;
-                kfree(dentry_cache_block->data[i].inode);
-            }
-        }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
+    if (dentry->lru_prev) {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    } else {
+        _dentry_lru_head = dentry->lru_next;
     }
 
-    if (need_to_free_inode_cache()) {
-        can_cache_inodes = 0;
+    if (dentry->lru_next) {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    } else {
+        _dentry_lru_tail = dentry->lru_prev;
     }
-    return true;
+
+    dentry->lru_prev = NULL;
+    dentry->lru_next = NULL;
+    dentry->cache_flags &= ~DENTRY_CACHE_ON_LRU;
+}
+
+static inline void _dentry_lru_push_front(dentry_t* dentry)
+{
+    dentry->lru_prev = NULL;
+    dentry->lru_next = _dentry_lru_head;
+    if (_dentry_lru_head) {
+        _dentry_lru_head->lru_prev = dentry;
+    }
+    _dentry_lru_head = dentry;
+    if (!_dentry_lru_tail) {
+        _dentry_lru_tail = dentry;
+    }
+    dentry->cache_flags |= DENTRY_CACHE_ON_LRU;
 }
 
-static void dentry_cache_alloc()
+static inline void _dentry_lru_push_back(dentry_t* dentry)
 {
-    dentry_cache_list_t* list_block = (dentry_cache_list_t*)kmalloc(DENTRY_ALLOC_SIZE);
-    memset((uint8_t*)list_block, 0, DENTRY_ALLOC_SIZE);
-    lock_init(&list_block->lock);
-    list_block->data = (dentry_t*)&list_block[1];
-    list_block->len = DENTRY_ALLOC_SIZE - ((uint32_t)&list_block[1] - (uint32_t)&list_block[0]);
+    dentry->lru_next = NULL;
+    dentry->lru_prev = _dentry_lru_tail;
+    if (_dentry_lru_tail) {
+        _dentry_lru_tail->lru_next = dentry;
+    }
+    _dentry_lru_tail = dentry;
+    if (!_dentry_lru_head) {
+        _dentry_lru_head = dentry;
+    }
+    dentry->cache_flags |= DENTRY_CACHE_ON_LRU;
+}
+
+static inline void _dentry_names_lru_remove(dentry_name_t* entry)
+{
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        _dentry_names_lru_head = entry->lru_next;
+    }
 
-    if (dentry_cache == 0) {
-        dentry_cache = list_block;
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
     } else {
-        dentry_cache_list_t* last = dentry_cache;
-        while (last->next != 0) {
-            last = last->next;
+        _dentry_names_lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static inline void _dentry_names_lru_push_front(dentry_name_t* entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = _dentry_names_lru_head;
+    if (_dentry_names_lru_head) {
+        _dentry_names_lru_head->lru_prev = entry;
+    }
+    _dentry_names_lru_head = entry;
+    if (!_dentry_names_lru_tail) {
+        _dentry_names_lru_tail = entry;
+    }
+}
+
+/**
+ * HASH
+ */
+
+static inline uint32_t _dentry_hash_index(uint32_t dev_indx, uint32_t inode_indx)
+{
+    return (inode_indx ^ (inode_indx >> 16) ^ (dev_indx << 8)) & (DENTRY_HASH_SIZE - 1);
+}
+
+static dentry_t* _dentry_hash_lookup_lockless(uint32_t dev_indx, uint32_t inode_indx)
+{
+    dentry_t* dentry = _dentry_hash[_dentry_hash_index(dev_indx, inode_indx)];
+    while (dentry) {
+        if (dentry->dev_indx == dev_indx && dentry->inode_indx == inode_indx) {
+            return dentry;
+        }
+        dentry = dentry->hash_next;
+    }
+    return NULL;
+}
+
+static void _dentry_hash_insert_lockless(dentry_t* dentry)
+{
+    uint32_t index = _dentry_hash_index(dentry->dev_indx, dentry->inode_indx);
+    dentry->hash_next = _dentry_hash[index];
+    _dentry_hash[index] = dentry;
+    dentry->cache_flags |= DENTRY_CACHE_HASHED;
+}
+
+static void _dentry_hash_remove_lockless(dentry_t* dentry)
+{
+    dentry_t** link = &_dentry_hash[_dentry_hash_index(dentry->dev_indx, dentry->inode_indx)];
+    while (*link) {
+        if (*link == dentry) {
+            *link = dentry->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    dentry->hash_next = NULL;
+    dentry->cache_flags &= ~DENTRY_CACHE_HASHED;
+}
+
+/* FNV-1a over the key. */
+static inline uint32_t _dentry_name_hash(uint32_t dev_indx, uint32_t parent_inode_indx, const char* name, uint32_t len)
+{
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ dev_indx) * 16777619u;
+    hash = (hash ^ parent_inode_indx) * 16777619u;
+    for (uint32_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static inline bool _dentry_names_cacheable(dentry_t* dir, uint32_t len)
+{
+    return len <= DENTRY_NAME_LEN && !dir->dev->dev->is_virtual;
+}
+
+static dentry_name_t* _dentry_name_lookup_lockless(uint32_t hash, dentry_t* dir, const char* name, uint32_t len)
+{
+    dentry_name_t* entry = _dentry_names_hash[hash & (DENTRY_NAMES_HASH_SIZE - 1)];
+    while (entry) {
+        if (entry->hash == hash && entry->dev_indx == dir->dev_indx && entry->parent_inode_indx == dir->inode_indx
+            && entry->len == len && memcmp(entry->name, name, len) == 0) {
+            return entry;
         }
-        last->next = list_block;
-        list_block->prev = last;
+        entry = entry->hash_next;
+    }
+    return NULL;
+}
+
+static void _dentry_name_remove_lockless(dentry_name_t* entry)
+{
+    dentry_name_t** link = &_dentry_names_hash[entry->hash & (DENTRY_NAMES_HASH_SIZE - 1)];
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    _dentry_names_lru_remove(entry);
+
+    _dentry_stat.names--;
+    if (!entry->inode_indx) {
+        _dentry_stat.negative_names--;
+    }
+    kmem_cache_free(_dentry_names_cache, entry);
+}
+
+/**
+ * ALLOCATION
+ */
+
+/**
+ * The function frees a dentry which is not held and is out of the lists.
+ * Dentries of deleted inodes have already given their inodes back.
+ */
+static void _dentry_free(dentry_t* dentry)
+{
+    if (dentry->inode) {
+        kfree(dentry->inode);
     }
+    kmem_cache_free(_dentry_cache, dentry);
 }
 
 /**
- * In this function, we try to find an entry to fill it with a new dentry.
- * Since we have a valid dentries in the cache, which isn't held by someone, they are
- * also condidates to be replaced. But because we want to have more valid entries in the
- * cache, we will start to look for a complitely free entry.
+ * The function frees unused dentries from the cold end of the LRU list till
+ * there are no more than the limit. Dentries of deleted inodes are freed
+ * first, they sit at the very end. The last holder of a dentry could still
+ * be leaving its lock, such dentries are skipped.
  */
-static dentry_t* dentry_cache_find_empty_entry()
-{
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    dentry_t* valid_dentry_candidate = NULL;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].inode_indx == 0) {
-                lock_release(&dentry_cache_block->lock);
-                return &dentry_cache_block->data[i];
+static void _dentry_shrink()
+{
+    uint32_t limit = _dentry_limit_by_memory(DENTRY_UNUSED_MAX, DENTRY_UNUSED_MIN);
+    dentry_t* victims = NULL;
+
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_stat.unused_limit = limit;
+    dentry_t* dentry = _dentry_lru_tail;
+    while (dentry) {
+        dentry_t* prev = dentry->lru_prev;
+        bool deleted = !(dentry->cache_flags & DENTRY_CACHE_HASHED);
+        if (!deleted && _dentry_stat.unused <= limit) {
+            break;
+        }
+
+        if (lock_try_acquire(&dentry->lock)) {
+            ASSERT(dentry->d_count == 0);
+            _dentry_lru_remove(dentry);
+            if (!deleted) {
+                _dentry_hash_remove_lockless(dentry);
+                _dentry_stat.evictions++;
             }
-            if (dentry_cache_block->data[i].d_count == 0) {
-                valid_dentry_candidate = &dentry_cache_block->data[i];
+            _dentry_stat.unused--;
+            _dentry_stat.cached--;
+            lock_release(&dentry->lock);
+            dentry->lru_next = victims;
+            victims = dentry;
+        }
+        dentry = prev;
+    }
+    lock_release(&_dentry_cache_lock);
+
+    while (victims) {
+        dentry_t* next = victims->lru_next;
+        _dentry_free(victims);
+        victims = next;
+    }
+}
+
+/**
+ * The function drops unused dentries of a device which is gone.
+ */
+static void _dentry_evict_dev(uint32_t dev_indx)
+{
+    dentry_t* victims = NULL;
+
+    lock_acquire(&_dentry_cache_lock);
+    dentry_t* dentry = _dentry_lru_head;
+    while (dentry) {
+        dentry_t* next = dentry->lru_next;
+        if (dentry->dev_indx == dev_indx && lock_try_acquire(&dentry->lock)) {
+            _dentry_lru_remove(dentry);
+            if (dentry->cache_flags & DENTRY_CACHE_HASHED) {
+                _dentry_hash_remove_lockless(dentry);
             }
+            _dentry_stat.unused--;
+            _dentry_stat.cached--;
+            lock_release(&dentry->lock);
+            dentry->lru_next = victims;
+            victims = dentry;
         }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
+        dentry = next;
     }
+    lock_release(&_dentry_cache_lock);
 
-    /* If we hasn't found a complitely free entry, let's erase a 
-       valid dentries in the cache, which isn't held by someone. */
-    if (valid_dentry_candidate) {
-        return valid_dentry_candidate;
+    while (victims) {
+        dentry_t* next = victims->lru_next;
+        _dentry_free(victims);
+        victims = next;
     }
+}
 
-    /* If there is no space, let's allocate a bigger area. */
-    dentry_cache_alloc();
-    dentry_cache_list_t* last = dentry_cache;
-    while (last->next != NULL) {
-        last = last->next;
+static void _dentry_names_shrink_lockless(uint32_t limit)
+{
+    while (_dentry_names_lru_tail && _dentry_stat.names > limit) {
+        _dentry_name_remove_lockless(_dentry_names_lru_tail);
     }
-    return &last->data[0];
+}
+
+static void _dentry_names_forget_dev(uint32_t dev_indx)
+{
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_names_generation++;
+    dentry_name_t* entry = _dentry_names_lru_head;
+    while (entry) {
+        dentry_name_t* next = entry->lru_next;
+        if (entry->dev_indx == dev_indx) {
+            _dentry_name_remove_lockless(entry);
+        }
+        entry = next;
+    }
+    lock_release(&_dentry_cache_lock);
 }
 
 static inline void dentry_delete_inode(dentry_t* dentry)
@@ -141,36 +384,34 @@ static inline void dentry_flush_inode(dentry_t* dentry)
  * In case when file was deleted and after that a new was created
  * with the same inode_id, dentry can't recognize and could use old
  * inode data. We need delete dentry from cache and free inode.
+ * The caller still holds the lock of the dentry, so it's left at the
+ * end of the LRU list for the shrinker to free.
  */
 static void dentry_delete_from_cache(dentry_t* dentry)
 {
-    /* This marks the dentry as deleted. */
-    dentry->inode_indx = 0;
-    if (dentry->inode) {
-        kfree(dentry->inode);
-    }
-    stat_cached_inodes_area_size -= INODE_LEN;
-    if (!need_to_free_inode_cache()) {
-        can_cache_inodes = 1;
-    }
+    kfree(dentry->inode);
+    dentry->inode = NULL;
+
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_hash_remove_lockless(dentry);
+    _dentry_lru_push_back(dentry);
+    _dentry_stat.unused++;
+    stat_cached_dentries--;
+    lock_release(&_dentry_cache_lock);
 }
 
 /**
- * dentry_prefree puts the dentry in a state when it can be
- * safely replaced with a new one.
+ * dentry_prefree puts the dentry to the LRU list.
  * Note: the dentry stays valid and can be reused without needless to
- *       read all data again.
+ *       read all data again, till the shrinker frees it.
  */
 static void dentry_prefree(dentry_t* dentry)
 {
-    if (!can_cache_inodes) {
-        dentry_delete_from_cache(dentry);
-    } else {
-        if (need_to_free_inode_cache()) {
-            free_inode_cache();
-        }
-    }
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_lru_push_front(dentry);
+    _dentry_stat.unused++;
     stat_cached_dentries--;
+    lock_release(&_dentry_cache_lock);
 }
 
 static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int need_to_read_inode)
@@ -179,12 +420,14 @@ static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int ne
         return NULL;
     }
 
-    dentry_t* dentry = dentry_cache_find_empty_entry();
-    fs_desc_t* fs_desc;
+    _dentry_shrink();
+    dentry_t* dentry = (dentry_t*)kmem_cache_alloc(_dentry_cache);
+    if (!dentry) {
+        return NULL;
+    }
+    memset((void*)dentry, 0, sizeof(dentry_t));
 
-    /* If inode_indx isn't 0, so we can say that we replace a valid dentry, which
-       has area for storing inode allocated. */
-    bool already_allocated_inode = (dentry->inode_indx != 0);
+    fs_desc_t* fs_desc;
     lock_init(&dentry->lock);
     dentry->d_count = 1;
     dentry->flags = 0;
@@ -195,21 +438,107 @@ static dentry_t* dentry_alloc_new(uint32_t dev_indx, uint32_t inode_indx, int ne
     dentry->inode_indx = inode_indx;
     dentry->fsdata = dentry->ops->dentry.get_fsdata(dentry);
     dentry->parent = NULL;
+    rbtree_init(&dentry->pages, NULL);
 
-    if (!already_allocated_inode) {
-        dentry->inode = (inode_t*)kmalloc(INODE_LEN);
-        stat_cached_inodes_area_size += INODE_LEN;
+    dentry->inode = (inode_t*)kmem_cache_alloc(inode_cache);
+    if (!dentry->inode) {
+        kmem_cache_free(_dentry_cache, dentry);
+        return NULL;
     }
+    memset((void*)dentry->inode, 0, INODE_LEN);
 
     if (need_to_read_inode && dentry->ops->dentry.read_inode(dentry) < 0) {
         log_error("[Dentry] Can't read inode %d %d (dev, ino)", dev_indx, inode_indx);
+        _dentry_free(dentry);
         return NULL;
     }
 
-    stat_cached_dentries++;
     return dentry;
 }
 
+/**
+ * The function returns a cached dentry of the inode with a new reference,
+ * or NULL if it's not cached.
+ */
+static dentry_t* _dentry_cache_get(uint32_t dev_indx, uint32_t inode_indx)
+{
+    for (;;) {
+        lock_acquire(&_dentry_cache_lock);
+        dentry_t* dentry = _dentry_hash_lookup_lockless(dev_indx, inode_indx);
+        if (!dentry) {
+            _dentry_stat.misses++;
+            lock_release(&_dentry_cache_lock);
+            return NULL;
+        }
+
+        // The last holder could still be putting it, let it finish.
+        if (!lock_try_acquire(&dentry->lock)) {
+            lock_release(&_dentry_cache_lock);
+            continue;
+        }
+
+        if (dentry->d_count == 0) {
+            _dentry_lru_remove(dentry);
+            _dentry_stat.unused--;
+            stat_cached_dentries++;
+        }
+        dentry->d_count++;
+        _dentry_stat.hits++;
+        lock_release(&dentry->lock);
+        lock_release(&_dentry_cache_lock);
+        return dentry;
+    }
+}
+
+/**
+ * The function adds a new dentry to the cache. Returns false if other
+ * thread has brought the same inode meanwhile.
+ */
+static bool _dentry_cache_insert(dentry_t* dentry)
+{
+    lock_acquire(&_dentry_cache_lock);
+    if (_dentry_hash_lookup_lockless(dentry->dev_indx, dentry->inode_indx)) {
+        lock_release(&_dentry_cache_lock);
+        return false;
+    }
+
+    _dentry_hash_insert_lockless(dentry);
+    _dentry_stat.cached++;
+    stat_cached_dentries++;
+    lock_release(&_dentry_cache_lock);
+    return true;
+}
+
+static dentry_t* _dentry_get(uint32_t dev_indx, uint32_t inode_indx, int need_to_read_inode, int* newly_allocated)
+{
+    for (;;) {
+        dentry_t* dentry = _dentry_cache_get(dev_indx, inode_indx);
+        if (dentry) {
+            *newly_allocated = DENTRY_WAS_IN_CACHE;
+            return dentry;
+        }
+
+        dentry = dentry_alloc_new(dev_indx, inode_indx, need_to_read_inode);
+        if (!dentry) {
+            return NULL;
+        }
+
+        if (_dentry_cache_insert(dentry)) {
+            *newly_allocated = DENTRY_NEWLY_ALLOCATED;
+            return dentry;
+        }
+        _dentry_free(dentry);
+    }
+}
+
+void dentry_init()
+{
+    lock_init(&_dentry_cache_lock);
+    _dentry_cache = kmem_cache_create("dentry", sizeof(dentry_t));
+    _dentry_names_cache = kmem_cache_create("dentry_name", sizeof(dentry_name_t));
+    inode_cache = kmem_cache_create("inode", INODE_LEN);
+}
+
 void dentry_set_inode(dentry_t* dentry, inode_t* inode)
 {
     lock_acquire(&dentry->lock);
@@ -223,6 +552,13 @@ void dentry_set_inode(dentry_t* dentry, inode_t* inode)
 void dentry_set_parent(dentry_t* to, dentry_t* parent)
 {
     lock_acquire(&to->lock);
+    if (to->parent == parent) {
+        lock_release(&to->lock);
+        return;
+    }
+    if (to->parent) {
+        dentry_put(to->parent);
+    }
     to->parent = dentry_duplicate(parent);
     lock_release(&to->lock);
 }
@@ -236,7 +572,38 @@ dentry_t* dentry_get_parent(dentry_t* dentry)
 }
 
 /**
- * Is a thread enrty point. The function flushes all inodes to drive.
+ * The function takes a reference of the @index-th dentry in @bucket, so it
+ * could be used without the cache lock. Returns false at the end of the
+ * bucket, @result is NULL if the dentry is not held or is busy.
+ */
+static bool _dentry_hash_take(int bucket, int index, dentry_t** result)
+{
+    *result = NULL;
+    lock_acquire(&_dentry_cache_lock);
+    dentry_t* dentry = _dentry_hash[bucket];
+    for (int i = 0; dentry && i < index; i++) {
+        dentry = dentry->hash_next;
+    }
+    if (!dentry) {
+        lock_release(&_dentry_cache_lock);
+        return false;
+    }
+
+    // Unused dentries were flushed by their last put.
+    if (lock_try_acquire(&dentry->lock)) {
+        if (dentry->d_count) {
+            dentry->d_count++;
+            *result = dentry;
+        }
+        lock_release(&dentry->lock);
+    }
+    lock_release(&_dentry_cache_lock);
+    return true;
+}
+
+/**
+ * Is a thread enrty point. The function flushes all inodes to drive and
+ * shrinks caches, so they follow free memory.
  */
 void dentry_flusher()
 {
@@ -244,79 +611,47 @@ void dentry_flusher()
 #ifdef DENTRY_DEBUG
         log("WORK dentry_flusher");
 #endif
-        dentry_cache_list_t* dentry_cache_block = dentry_cache;
-        while (dentry_cache_block) {
-            lock_acquire(&dentry_cache_block->lock);
-            int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-            for (int i = 0; i < dentries_in_block; i++) {
-                if (dentry_cache_block->data[i].inode_indx != 0) {
-                    // Keep only locks here might not be as effective as with disabled interrupts.
-                    lock_acquire(&dentry_cache_block->data[i].lock);
-                    system_disable_interrupts();
-                    dentry_flush_inode(&dentry_cache_block->data[i]);
-                    system_enable_interrupts();
-                    lock_release(&dentry_cache_block->data[i].lock);
+        for (int bucket = 0; bucket < DENTRY_HASH_SIZE; bucket++) {
+            dentry_t* dentry;
+            for (int i = 0; _dentry_hash_take(bucket, i, &dentry); i++) {
+                if (!dentry) {
+                    continue;
                 }
+                page_cache_flush(dentry);
+                // Keep only locks here might not be as effective as with disabled interrupts.
+                lock_acquire(&dentry->lock);
+                system_disable_interrupts();
+                dentry_flush_inode(dentry);
+                system_enable_interrupts();
+                lock_release(&dentry->lock);
+                dentry_put(dentry);
             }
-            lock_release(&dentry_cache_block->lock);
-            dentry_cache_block = dentry_cache_block->next;
         }
+
+        _dentry_shrink();
+        uint32_t names_limit = _dentry_limit_by_memory(DENTRY_NAMES_MAX, DENTRY_NAMES_MIN);
+        lock_acquire(&_dentry_cache_lock);
+        _dentry_names_shrink_lockless(names_limit);
+        lock_release(&_dentry_cache_lock);
         ksys1(SYS_SLEEP, 2);
     }
 }
 
 /**
- * There are 3 cases for each entry in a cache array:
- * 1) We have a valid dentry which is held by someone.
- * 2) We have a valid dentry which isn'y held by someone and ready to swapped out.
- * 3) We have an unsed entry in the cache array.
+ * There are 2 cases for a dentry in the cache:
+ * 1) It's a valid dentry which is held by someone.
+ * 2) It's a valid dentry which isn't held by someone and sits in the LRU
+ *    list, ready to be freed.
  */
 dentry_t* dentry_get(uint32_t dev_indx, uint32_t inode_indx)
 {
-    /* We try to find the dentry in the cache */
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].dev_indx == dev_indx && dentry_cache_block->data[i].inode_indx == inode_indx) {
-                if (!dentry_cache_block->data[i].d_count)
-                    stat_cached_dentries++;
-                lock_release(&dentry_cache_block->lock);
-                return dentry_duplicate(&dentry_cache_block->data[i]);
-            }
-        }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
-    }
-
-    /* It means no dentry in the cache. Let's add it. */
-    return dentry_alloc_new(dev_indx, inode_indx, READ_INODE);
+    int newly_allocated;
+    return _dentry_get(dev_indx, inode_indx, READ_INODE, &newly_allocated);
 }
 
 dentry_t* dentry_get_no_inode(uint32_t dev_indx, uint32_t inode_indx, int* newly_allocated)
 {
-    /* We try to find the dentry in the cache */
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].dev_indx == dev_indx && dentry_cache_block->data[i].inode_indx == inode_indx) {
-                if (!dentry_cache_block->data[i].d_count)
-                    stat_cached_dentries++;
-                *newly_allocated = DENTRY_WAS_IN_CACHE;
-                lock_release(&dentry_cache_block->lock);
-                return dentry_duplicate(&dentry_cache_block->data[i]);
-            }
-        }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
-    }
-
-    /* It means no dentry in the cache. Let's add it. */
-    *newly_allocated = DENTRY_NEWLY_ALLOCATED;
-    return dentry_alloc_new(dev_indx, inode_indx, NOT_READ_INODE);
+    return _dentry_get(dev_indx, inode_indx, NOT_READ_INODE, newly_allocated);
 }
 
 dentry_t* dentry_duplicate(dentry_t* dentry)
@@ -331,6 +666,7 @@ static inline void dentry_put_impl(dentry_t* dentry)
 {
     if (dentry->parent) {
         dentry_put(dentry->parent);
+        dentry->parent = NULL;
     }
 
     if (dentry_test_flag_lockless(dentry, DENTRY_CUSTOM)) {
@@ -345,6 +681,7 @@ static inline void dentry_put_impl(dentry_t* dentry)
 #ifdef DENTRY_DEBUG
         log("Inode delete %d", dentry->inode_indx);
 #endif
+        page_cache_drop(dentry);
         dentry_delete_inode(dentry);
         dentry_delete_from_cache(dentry);
         return;
@@ -352,6 +689,7 @@ static inline void dentry_put_impl(dentry_t* dentry)
 #ifdef DENTRY_DEBUG
     log("Inode flushed %d", dentry->inode_indx);
 #endif
+    page_cache_drop(dentry);
     dentry_flush_inode(dentry);
     dentry_prefree(dentry);
 }
@@ -364,6 +702,11 @@ void dentry_force_put(dentry_t* dentry)
         return;
     }
 
+    if (!dentry->d_count) {
+        lock_release(&dentry->lock);
+        return;
+    }
+
     dentry->d_count = 0;
     dentry_put_impl(dentry);
     lock_release(&dentry->lock);
@@ -388,18 +731,24 @@ void dentry_put(dentry_t* dentry)
 
 void dentry_put_all_dentries_of_dev(uint32_t dev_indx)
 {
-    dentry_cache_list_t* dentry_cache_block = dentry_cache;
-    while (dentry_cache_block) {
-        lock_acquire(&dentry_cache_block->lock);
-        int dentries_in_block = dentry_cache_block->len / sizeof(dentry_t);
-        for (int i = 0; i < dentries_in_block; i++) {
-            if (dentry_cache_block->data[i].dev_indx == dev_indx && dentry_cache_block->data[i].inode != 0) {
-                dentry_force_put(&dentry_cache_block->data[i]);
+    for (int bucket = 0; bucket < DENTRY_HASH_SIZE; bucket++) {
+        for (;;) {
+            lock_acquire(&_dentry_cache_lock);
+            dentry_t* dentry = _dentry_hash[bucket];
+            while (dentry && !(dentry->dev_indx == dev_indx && dentry->d_count && !dentry_test_flag_lockless(dentry, DENTRY_MOUNTPOINT))) {
+                dentry = dentry->hash_next;
+            }
+            lock_release(&_dentry_cache_lock);
+
+            if (!dentry) {
+                break;
             }
+            dentry_force_put(dentry);
         }
-        lock_release(&dentry_cache_block->lock);
-        dentry_cache_block = dentry_cache_block->next;
     }
+
+    _dentry_evict_dev(dev_indx);
+    _dentry_names_forget_dev(dev_indx);
 }
 
 inline void dentry_set_flag_lockless(dentry_t* dentry, uint32_t flag)
@@ -475,4 +824,144 @@ inline void dentry_inode_rem_flag(dentry_t* dentry, mode_t mode)
 uint32_t dentry_stat_cached_count()
 {
     return stat_cached_dentries;
+}
+
+void dentry_get_stat(dentry_cache_stat_t* stat)
+{
+    lock_acquire(&_dentry_cache_lock);
+    *stat = _dentry_stat;
+    lock_release(&_dentry_cache_lock);
+}
+
+/**
+ * NAMES
+ */
+
+/**
+ * The function looks for @name in @dir among resolved names. Returns 0 with
+ * a held dentry in @result, -ENOENT if the name is known to be missing, and
+ * -ENODATA if the name is not cached. @generation is passed then to
+ * dentry_name_add() with the result of the lookup.
+ */
+int dentry_name_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result, uint32_t* generation)
+{
+    if (!_dentry_names_cacheable(dir, len)) {
+        return -ENODATA;
+    }
+
+    uint32_t hash = _dentry_name_hash(dir->dev_indx, dir->inode_indx, name, len);
+    lock_acquire(&_dentry_cache_lock);
+    *generation = _dentry_names_generation;
+    dentry_name_t* entry = _dentry_name_lookup_lockless(hash, dir, name, len);
+    if (!entry) {
+        _dentry_stat.name_misses++;
+        lock_release(&_dentry_cache_lock);
+        return -ENODATA;
+    }
+
+    if (_dentry_names_lru_head != entry) {
+        _dentry_names_lru_remove(entry);
+        _dentry_names_lru_push_front(entry);
+    }
+
+    uint32_t inode_indx = entry->inode_indx;
+    if (!inode_indx) {
+        _dentry_stat.negative_hits++;
+        lock_release(&_dentry_cache_lock);
+        return -ENOENT;
+    }
+    _dentry_stat.name_hits++;
+    lock_release(&_dentry_cache_lock);
+
+    dentry_t* dentry = dentry_get(dir->dev_indx, inode_indx);
+    if (!dentry) {
+        return -ENODATA;
+    }
+    *result = dentry;
+    return 0;
+}
+
+/**
+ * The function remembers the result of a lookup of @name in @dir, @child is
+ * NULL if the lookup failed. Names forgotten while the filesystem was looked
+ * up could make the result stale, then it's dropped.
+ */
+void dentry_name_add(dentry_t* dir, const char* name, uint32_t len, dentry_t* child, uint32_t generation)
+{
+    if (!_dentry_names_cacheable(dir, len) || (child && child->dev_indx != dir->dev_indx)) {
+        return;
+    }
+
+    dentry_name_t* entry = (dentry_name_t*)kmem_cache_alloc(_dentry_names_cache);
+    if (!entry) {
+        return;
+    }
+    entry->hash = _dentry_name_hash(dir->dev_indx, dir->inode_indx, name, len);
+    entry->dev_indx = dir->dev_indx;
+    entry->parent_inode_indx = dir->inode_indx;
+    entry->inode_indx = child ? child->inode_indx : 0;
+    entry->len = len;
+    memcpy(entry->name, name, len);
+
+    uint32_t limit = _dentry_limit_by_memory(DENTRY_NAMES_MAX, DENTRY_NAMES_MIN);
+    lock_acquire(&_dentry_cache_lock);
+    if (generation != _dentry_names_generation || _dentry_name_lookup_lockless(entry->hash, dir, name, len)) {
+        lock_release(&_dentry_cache_lock);
+        kmem_cache_free(_dentry_names_cache, entry);
+        return;
+    }
+
+    uint32_t index = entry->hash & (DENTRY_NAMES_HASH_SIZE - 1);
+    entry->hash_next = _dentry_names_hash[index];
+    _dentry_names_hash[index] = entry;
+    _dentry_names_lru_push_front(entry);
+    _dentry_stat.names++;
+    if (!entry->inode_indx) {
+        _dentry_stat.negative_names++;
+    }
+    _dentry_names_shrink_lockless(limit);
+    lock_release(&_dentry_cache_lock);
+}
+
+/**
+ * The function is called when @name is created in @dir.
+ */
+void dentry_name_forget(dentry_t* dir, const char* name, uint32_t len)
+{
+    if (!_dentry_names_cacheable(dir, len)) {
+        return;
+    }
+
+    uint32_t hash = _dentry_name_hash(dir->dev_indx, dir->inode_indx, name, len);
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_names_generation++;
+    dentry_name_t* entry = _dentry_name_lookup_lockless(hash, dir, name, len);
+    if (entry) {
+        _dentry_name_remove_lockless(entry);
+    }
+    lock_release(&_dentry_cache_lock);
+}
+
+/**
+ * The function forgets names which lead to the inode of @dentry and names
+ * inside of it. Called when the inode is unlinked, since its number could
+ * be given to a new file.
+ */
+void dentry_name_forget_inode(dentry_t* dentry)
+{
+    if (!_dentry_names_cacheable(dentry, 0)) {
+        return;
+    }
+
+    lock_acquire(&_dentry_cache_lock);
+    _dentry_names_generation++;
+    dentry_name_t* entry = _dentry_names_lru_head;
+    while (entry) {
+        dentry_name_t* next = entry->lru_next;
+        if (entry->dev_indx == dentry->dev_indx && (entry->inode_indx == dentry->inode_indx || entry->parent_inode_indx == dentry->inode_indx)) {
+            _dentry_name_remove_lockless(entry);
+        }
+        entry = next;
+    }
+    lock_release(&_dentry_cache_lock);
 }
\ No newline at end of file
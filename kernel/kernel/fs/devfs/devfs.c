@@ -494,6 +494,15 @@ proc_zone_t* devfs_mmap(dentry_t* dentry, mmap_params_t* params)
     return (proc_zone_t*)VFS_USE_STD_MMAP;
 }
 
+wait_queue_t* devfs_wait_queue(dentry_t* dentry)
+{
+    devfs_inode_t* devfs_inode = (devfs_inode_t*)dentry->inode;
+    if (devfs_inode->handlers->wait_queue) {
+        return devfs_inode->handlers->wait_queue(dentry);
+    }
+    return NULL;
+}
+
 /**
  * Driver install functions.
  */
@@ -530,6 +539,7 @@ driver_desc_t _devfs_driver_info()
     fs_desc.functions[DRIVER_FILE_SYSTEM_FSTAT] = devfs_fstat;
     fs_desc.functions[DRIVER_FILE_SYSTEM_IOCTL] = devfs_ioctl;
     fs_desc.functions[DRIVER_FILE_SYSTEM_MMAP] = devfs_mmap;
+    fs_desc.functions[DRIVER_FILE_SYSTEM_WAIT_QUEUE] = devfs_wait_queue;
 
     return fs_desc;
 }
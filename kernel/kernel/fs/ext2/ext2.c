@@ -5,6 +5,7 @@
 */
 
 // includes
+#include <fs/bcache.h>
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
@@ -30,8 +31,8 @@ static lock_t _ext2_lock;
 
 driver_desc_t _ext2_driver_info();
 
-static void _ext2_read_from_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
-static void _ext2_write_to_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+static int _ext2_read_from_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
+static int _ext2_write_to_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len);
 static uint32_t _ext2_get_disk_size(vfs_device_t* dev);
 
 static inline bool _ext2_bitmap_get(uint8_t* bitmap, uint32_t index);
@@ -96,45 +97,16 @@ int ext2_getdirent(dentry_t* dir, uint32_t* offset, dirent_t* res);
 int ext2_create(dentry_t* dir, const char* name, uint32_t len, mode_t mode);
 int ext2_rm(dentry_t* dentry);
 
-static void _ext2_read_from_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+static int _ext2_read_from_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
 {
-   void (*read)(device_t * d, uint32_t s, uint8_t * r) = dm_function_handler(dev->dev, DRIVER_STORAGE_READ);
-   int already_read = 0;
-   uint32_t sector = start / 512;
-   uint32_t start_offset = start % 512;
-   uint8_t tmp_buf[512];
-
-   while (len) {
-       read(dev->dev, sector, tmp_buf);
-       for (int i = 0; i < min(512 - start_offset, len); i++) {
-           buf[already_read++] = tmp_buf[start_offset + i];
-       }
-       len -= min(512 - start_offset, len);
-       sector++;
-       start_offset = 0;
-   }
+   int err = bcache_read(dev, buf, start, len);
+   return err < 0 ? err : 0;
 }
 
-static void _ext2_write_to_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
+static int _ext2_write_to_dev(vfs_device_t* dev, uint8_t* buf, uint32_t start, uint32_t len)
 {
-   void (*read)(device_t * d, uint32_t s, uint8_t * r) = dm_function_handler(dev->dev, DRIVER_STORAGE_READ);
-   void (*write)(device_t * d, uint32_t s, uint8_t * r, uint32_t siz) = dm_function_handler(dev->dev, DRIVER_STORAGE_WRITE);
-   int already_written = 0;
-   uint32_t sector = start / 512;
-   uint32_t start_offset = start % 512;
-   uint8_t tmp_buf[512];
-   while (len != 0) {
-       if (start_offset != 0 || len < 512) {
-           read(dev->dev, sector, tmp_buf);
-       }
-       for (int i = 0; i < min(512 - start_offset, len); i++) {
-           tmp_buf[start_offset + i] = buf[already_written++];
-       }
-       write(dev->dev, sector, tmp_buf, 512);
-       len -= min(512 - start_offset, len);
-       sector++;
-       start_offset = 0;
-   }
+   int err = bcache_write(dev, buf, start, len);
+   return err < 0 ? err : 0;
 }
 
 static uint32_t _ext2_get_disk_size(vfs_device_t* dev)
@@ -179,7 +151,9 @@ static uint32_t _ext2_get_block_of_inode_lev0(dentry_t* dentry, uint32_t cur_blo
 {
    uint32_t offset = inode_block_index;
    uint32_t res;
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   if (_ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4) < 0) {
+       return 0;
+   }
    return res;
 }
 
@@ -189,7 +163,9 @@ static uint32_t _ext2_get_block_of_inode_lev1(dentry_t* dentry, uint32_t cur_blo
    uint32_t offset = inode_block_index / lev_contain;
    uint32_t offset_inner = inode_block_index % lev_contain;
    uint32_t res;
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   if (_ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4) < 0) {
+       return 0;
+   }
    return res ? _ext2_get_block_of_inode_lev0(dentry, res, offset_inner) : 0;
 }
 
@@ -200,7 +176,9 @@ static uint32_t _ext2_get_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_blo
    uint32_t offset = inode_block_index / lev_contain;
    uint32_t offset_inner = inode_block_index % lev_contain;
    uint32_t res;
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   if (_ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4) < 0) {
+       return 0;
+   }
    return res ? _ext2_get_block_of_inode_lev1(dentry, res, offset_inner) : 0;
 }
 
@@ -222,8 +200,7 @@ static uint32_t _ext2_get_block_of_inode(dentry_t* dentry, uint32_t inode_block_
 static int _ext2_set_block_of_inode_lev0(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val)
 {
    uint32_t offset = inode_block_index;
-   _ext2_write_to_dev(dentry->dev, (uint8_t*)&val, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
-   return 0;
+   return _ext2_write_to_dev(dentry->dev, (uint8_t*)&val, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
 }
 
 static int _ext2_set_block_of_inode_lev1(dentry_t* dentry, uint32_t cur_block, uint32_t inode_block_index, uint32_t val)
@@ -232,7 +209,10 @@ static int _ext2_set_block_of_inode_lev1(dentry_t* dentry, uint32_t cur_block, u
    uint32_t offset = inode_block_index / lev_contain;
    uint32_t offset_inner = inode_block_index % lev_contain;
    uint32_t res;
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   int err = _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   if (err < 0) {
+       return err;
+   }
    return res ? _ext2_set_block_of_inode_lev0(dentry, res, offset_inner, val) : -1;
 }
 
@@ -243,7 +223,10 @@ static int _ext2_set_block_of_inode_lev2(dentry_t* dentry, uint32_t cur_block, u
    uint32_t offset = inode_block_index / lev_contain;
    uint32_t offset_inner = inode_block_index % lev_contain;
    uint32_t res;
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   int err = _ext2_read_from_dev(dentry->dev, (uint8_t*)&res, _ext2_get_block_offset(dentry->fsdata.sb, cur_block) + offset * 4, 4);
+   if (err < 0) {
+       return err;
+   }
    return res ? _ext2_set_block_of_inode_lev1(dentry, res, offset_inner, val) : -1;
 }
 
@@ -267,14 +250,16 @@ int _ext2_set_block_of_inode(dentry_t* dentry, uint32_t inode_block_index, uint3
 static int _ext2_find_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* block_index, uint32_t group_index)
 {
    uint8_t block_bitmap[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
+   int err = _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
+   if (err < 0) {
+       return err;
+   }
 
    for (uint32_t off = 0; off < 8 * BLOCK_LEN(fsdata.sb); off++) {
        if (!_ext2_bitmap_get(block_bitmap, off)) {
            *block_index = fsdata.sb->blocks_per_group * group_index + off + 1;
            _ext2_bitmap_set_bit(block_bitmap, off);
-           _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
-           return 0;
+           return _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), BLOCK_LEN(fsdata.sb));
        }
    }
    return -ENOSPC;
@@ -302,11 +287,13 @@ static int _ext2_free_block_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t b
    uint32_t off = block_index % block_len;
 
    uint8_t block_bitmap[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
+   int err = _ext2_read_from_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
+   if (err < 0) {
+       return err;
+   }
 
    _ext2_bitmap_unset_bit(block_bitmap, off);
-   _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
-   return 0;
+   return _ext2_write_to_dev(dev, block_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].block_bitmap), block_len);
 }
 static int _ext2_allocate_block_for_inode(dentry_t* dentry, uint32_t pref_group, uint32_t* block_index)
 {
@@ -327,8 +314,7 @@ int ext2_read_inode(dentry_t* dentry)
    uint32_t holder_group = (dentry->inode_indx - 1) / inodes_per_group;
    uint32_t pos_inside_group = (dentry->inode_indx - 1) % inodes_per_group;
    uint32_t inode_start = _ext2_get_block_offset(dentry->fsdata.sb, dentry->fsdata.gt->table[holder_group].inode_table) + (pos_inside_group * INODE_LEN);
-   _ext2_read_from_dev(dentry->dev, (uint8_t*)dentry->inode, inode_start, INODE_LEN);
-   return 0;
+   return _ext2_read_from_dev(dentry->dev, (uint8_t*)dentry->inode, inode_start, INODE_LEN);
 }
 
 int ext2_write_inode(dentry_t* dentry)
@@ -337,21 +323,22 @@ int ext2_write_inode(dentry_t* dentry)
    uint32_t holder_group = (dentry->inode_indx - 1) / inodes_per_group;
    uint32_t pos_inside_group = (dentry->inode_indx - 1) % inodes_per_group;
    uint32_t inode_start = _ext2_get_block_offset(dentry->fsdata.sb, dentry->fsdata.gt->table[holder_group].inode_table) + (pos_inside_group * INODE_LEN);
-   _ext2_write_to_dev(dentry->dev, (uint8_t*)dentry->inode, inode_start, INODE_LEN);
-   return 0;
+   return _ext2_write_to_dev(dentry->dev, (uint8_t*)dentry->inode, inode_start, INODE_LEN);
 }
 
 static int _ext2_find_free_inode_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t* inode_index, uint32_t group_index)
 {
    uint8_t inode_bitmap[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), BLOCK_LEN(fsdata.sb));
+   int err = _ext2_read_from_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), BLOCK_LEN(fsdata.sb));
+   if (err < 0) {
+       return err;
+   }
 
    for (uint32_t off = 0; off < 8 * BLOCK_LEN(fsdata.sb); off++) {
        if (!_ext2_bitmap_get(inode_bitmap, off)) {
            *inode_index = SUPERBLOCK->inodes_per_group * group_index + off + 1;
            _ext2_bitmap_set_bit(inode_bitmap, off);
-           _ext2_write_to_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), BLOCK_LEN(fsdata.sb));
-           return 0;
+           return _ext2_write_to_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), BLOCK_LEN(fsdata.sb));
        }
    }
    return -ENOSPC;
@@ -380,11 +367,13 @@ static int _ext2_free_inode_index(vfs_device_t* dev, fsdata_t fsdata, uint32_t i
    uint32_t off = inode_index % inodes_per_group;
 
    uint8_t inode_bitmap[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), block_len);
+   int err = _ext2_read_from_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), block_len);
+   if (err < 0) {
+       return err;
+   }
 
    _ext2_bitmap_unset_bit(inode_bitmap, off);
-   _ext2_write_to_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), block_len);
-   return 0;
+   return _ext2_write_to_dev(dev, inode_bitmap, _ext2_get_block_offset(fsdata.sb, fsdata.gt->table[group_index].inode_bitmap), block_len);
 }
 
 int ext2_free_inode(dentry_t* dentry)
@@ -392,13 +381,18 @@ int ext2_free_inode(dentry_t* dentry)
    ASSERT(dentry->d_count == 0 && dentry->inode->links_count == 0);
    uint32_t block_per_dir = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
 
+   int err = 0;
    for (int block_index = 0; block_index < block_per_dir; block_index++) {
        uint32_t data_block_index = _ext2_get_block_of_inode(dentry, block_index);
-       _ext2_free_block_index(dentry->dev, dentry->fsdata, data_block_index);
+       if (data_block_index && _ext2_free_block_index(dentry->dev, dentry->fsdata, data_block_index) < 0) {
+           err = -EIO;
+       }
    }
 
-   _ext2_free_inode_index(dentry->dev, dentry->fsdata, dentry->inode_indx);
-   return 0;
+   if (_ext2_free_inode_index(dentry->dev, dentry->fsdata, dentry->inode_indx) < 0) {
+       err = -EIO;
+   }
+   return err;
 }
 
 static int _ext2_decriment_links_count(dentry_t* dentry)
@@ -413,7 +407,10 @@ static int _ext2_lookup_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t block
    }
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   if (err < 0) {
+       return err;
+   }
    dir_entry_t* start_of_entry = (dir_entry_t*)tmp_buf;
    for (;;) {
        if (start_of_entry->inode == 0) {
@@ -449,7 +446,10 @@ static int _ext2_getdirent_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t bl
    uint32_t internal_offset = *offset % block_len;
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   if (err < 0) {
+       return err;
+   }
    for (;;) {
        dir_entry_t* start_of_entry = (dir_entry_t*)((uint32_t)tmp_buf + internal_offset);
        internal_offset += start_of_entry->rec_len;
@@ -482,7 +482,10 @@ static int _ext2_get_dir_entries_count_in_block(vfs_device_t* dev, fsdata_t fsda
    int result = 0;
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   if (err < 0) {
+       return err;
+   }
    for (;;) {
        dir_entry_t* start_of_entry = (dir_entry_t*)((uint32_t)tmp_buf + internal_offset);
        internal_offset += start_of_entry->rec_len;
@@ -506,8 +509,12 @@ static bool _ext2_is_dir_empty(dentry_t* dir)
 
    for (uint32_t block_index = 0; block_index < end_block_index; block_index++) {
        uint32_t data_block_index = _ext2_get_block_of_inode(dir, block_index);
-       result += _ext2_get_dir_entries_count_in_block(dir->dev, dir->fsdata, data_block_index);
+       int entries = _ext2_get_dir_entries_count_in_block(dir->dev, dir->fsdata, data_block_index);
+       if (entries < 0) {
+           return false;
+       }
 
+       result += entries;
        if (result > 2) {
            return false;
        }
@@ -525,7 +532,10 @@ static int _ext2_getdents_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t blo
    int already_read = 0;
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), block_len);
+   if (err < 0) {
+       return err;
+   }
    for (;;) {
        dir_entry_t* start_of_entry = (dir_entry_t*)((uint32_t)tmp_buf + inner_offset);
        uint32_t record_name_len = NORM_FILENAME(start_of_entry->name_len);
@@ -567,7 +577,10 @@ static int _ext2_add_first_entry_to_dir_block(vfs_device_t* dev, fsdata_t fsdata
    dir_entry_t new_entry;
 
    uint8_t tmp_buf[DIR_ENTRY_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), DIR_ENTRY_LEN);
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), DIR_ENTRY_LEN);
+   if (err < 0) {
+       return err;
+   }
    dir_entry_t* start_of_entry = (dir_entry_t*)tmp_buf;
    new_entry.inode = child_dentry->inode_indx;
    new_entry.rec_len = BLOCK_LEN(fsdata.sb);
@@ -575,8 +588,7 @@ static int _ext2_add_first_entry_to_dir_block(vfs_device_t* dev, fsdata_t fsdata
    memcpy((void*)start_of_entry, (void*)&new_entry, 8);
    memcpy((void*)((uint32_t)start_of_entry + 8), (void*)filename, len);
    memset((void*)((uint32_t)start_of_entry + 8 + len), 0, record_name_len - len);
-   _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), DIR_ENTRY_LEN);
-   return 0;
+   return _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), DIR_ENTRY_LEN);
 }
 
 static int _ext2_add_to_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t block_index, dentry_t* child_dentry, const char* filename, uint32_t len)
@@ -590,7 +602,10 @@ static int _ext2_add_to_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t b
    dir_entry_t new_entry;
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   if (err < 0) {
+       return err;
+   }
    dir_entry_t* start_of_entry = (dir_entry_t*)tmp_buf;
    dir_entry_t* start_of_new_entry;
 
@@ -621,8 +636,7 @@ update_res:
    memcpy((void*)start_of_new_entry, (void*)&new_entry, 8);
    memcpy((void*)((uint32_t)start_of_new_entry + 8), (void*)filename, len);
    memset((void*)((uint32_t)start_of_new_entry + 8 + len), 0, record_name_len - len);
-   _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
-   return 0;
+   return _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
 }
 
 static int _ext2_rm_from_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t block_index, dentry_t* child_dentry)
@@ -632,7 +646,10 @@ static int _ext2_rm_from_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t
    }
 
    uint8_t tmp_buf[MAX_BLOCK_LEN];
-   _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   int err = _ext2_read_from_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
+   if (err < 0) {
+       return err;
+   }
    dir_entry_t* start_of_entry = (dir_entry_t*)tmp_buf;
    dir_entry_t* prev_entry = (dir_entry_t*)0;
 
@@ -647,9 +664,7 @@ static int _ext2_rm_from_dir_block(vfs_device_t* dev, fsdata_t fsdata, uint32_t
            start_of_entry->inode = 0;
            prev_entry->rec_len += start_of_entry->rec_len;
 
-           _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
-
-           return 0;
+           return _ext2_write_to_dev(dev, tmp_buf, _ext2_get_block_offset(fsdata.sb, block_index), BLOCK_LEN(fsdata.sb));
        }
 
        prev_entry = start_of_entry;
@@ -759,17 +774,24 @@ int ext2_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
    uint32_t have_to_read = min(len, dentry->inode->size - start);
    uint32_t read_offset = start % block_len;
    uint32_t already_read = 0;
+   int err = 0;
 
    for (uint32_t virt_block_index = start_block_index; virt_block_index <= end_block_index; virt_block_index++) {
        uint32_t data_block_index = _ext2_get_block_of_inode(dentry, virt_block_index);
        uint32_t read_from_block = min(have_to_read, block_len - read_offset);
-       _ext2_read_from_dev(dentry->dev, buf + already_read, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + read_offset, read_from_block);
+       err = _ext2_read_from_dev(dentry->dev, buf + already_read, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + read_offset, read_from_block);
+       if (err < 0) {
+           break;
+       }
        have_to_read -= read_from_block;
        already_read += read_from_block;
        read_offset = 0;
    }
 
    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+   if (!already_read && err < 0) {
+       return err;
+   }
    return already_read;
 }
 
@@ -783,29 +805,40 @@ int ext2_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
    uint32_t to_write = len;
    uint32_t already_written = 0;
    uint32_t blocks_allocated = TO_EXT_BLOCKS_CNT(dentry->fsdata.sb, dentry->inode->blocks);
+   int err = 0;
 
    for (uint32_t data_block_index, virt_block_index = start_block_index; virt_block_index <= end_block_index; virt_block_index++) {
        uint32_t write_to_block = min(to_write, block_len - write_offset);
 
        if (blocks_allocated <= virt_block_index) {
-           _ext2_allocate_block_for_inode(dentry, 0, &data_block_index);
+           err = _ext2_allocate_block_for_inode(dentry, 0, &data_block_index);
        } else {
            data_block_index = _ext2_get_block_of_inode(dentry, virt_block_index);
+           err = data_block_index ? 0 : -EIO;
+       }
+       if (err < 0) {
+           break;
        }
 
-       _ext2_write_to_dev(dentry->dev, buf + already_written, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + write_offset, write_to_block);
+       err = _ext2_write_to_dev(dentry->dev, buf + already_written, _ext2_get_block_offset(dentry->fsdata.sb, data_block_index) + write_offset, write_to_block);
+       if (err < 0) {
+           break;
+       }
        to_write -= write_to_block;
        already_written += write_to_block;
        write_offset = 0;
    }
 
-   if (dentry->inode->size < start + len) {
-       dentry->inode->size = start + len;
+   if (dentry->inode->size < start + already_written) {
+       dentry->inode->size = start + already_written;
    }
    dentry->inode->mtime = (uint32_t)timeman_now();
    dentry_set_flag(dentry, DENTRY_DIRTY);
 
    lock_release(&VFS_DEVICE_LOCK_OWNED_BY(dentry));
+   if (!already_written && err < 0) {
+       return err;
+   }
    return already_written;
 }
 
@@ -1006,7 +1039,12 @@ int ext2_recognize_drive(vfs_device_t* dev)
 {
    lock_acquire(&VFS_DEVICE_LOCK);
    superblock_t* superblock = (superblock_t*)kmalloc(SUPERBLOCK_LEN);
-   _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
+   int err = _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
+   if (err < 0) {
+       kfree(superblock);
+       lock_release(&VFS_DEVICE_LOCK);
+       return err;
+   }
 
    if (superblock->magic != 0xEF53) {
        kfree(superblock);
@@ -1028,14 +1066,25 @@ int ext2_prepare_fs(vfs_device_t* dev)
 {
    lock_acquire(&VFS_DEVICE_LOCK);
    superblock_t* superblock = (superblock_t*)kmalloc(SUPERBLOCK_LEN);
-   _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
-   _ext2_superblocks[dev->dev->id] = superblock;
+   int err = _ext2_read_from_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
+   if (err < 0) {
+       kfree(superblock);
+       lock_release(&VFS_DEVICE_LOCK);
+       return err;
+   }
 
    uint32_t groups_cnt = _ext2_get_groups_cnt(dev, superblock);
    uint32_t group_table_len = groups_cnt * GROUP_LEN;
    group_desc_t* group_table = (group_desc_t*)kmalloc(group_table_len);
-   _ext2_read_from_dev(dev, (uint8_t*)group_table, _ext2_get_block_offset(superblock, 2), group_table_len);
+   err = _ext2_read_from_dev(dev, (uint8_t*)group_table, _ext2_get_block_offset(superblock, 2), group_table_len);
+   if (err < 0) {
+       kfree(group_table);
+       kfree(superblock);
+       lock_release(&VFS_DEVICE_LOCK);
+       return err;
+   }
 
+   _ext2_superblocks[dev->dev->id] = superblock;
    _ext2_group_table_info[dev->dev->id].count = groups_cnt;
    _ext2_group_table_info[dev->dev->id].table = group_table;
    lock_release(&VFS_DEVICE_LOCK);
@@ -1054,13 +1103,13 @@ int ext2_save_state(vfs_device_t* dev)
 
    uint32_t group_table_len = _ext2_group_table_info[dev->dev->id].count * GROUP_LEN;
    group_desc_t* group_table = _ext2_group_table_info[dev->dev->id].table;
-   _ext2_write_to_dev(dev, (uint8_t*)group_table, _ext2_get_block_offset(superblock, 2), group_table_len);
+   int gt_err = _ext2_write_to_dev(dev, (uint8_t*)group_table, _ext2_get_block_offset(superblock, 2), group_table_len);
    kfree(group_table);
 
-   _ext2_write_to_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
+   int sb_err = _ext2_write_to_dev(dev, (uint8_t*)superblock, SUPERBLOCK_START, SUPERBLOCK_LEN);
    kfree(superblock);
    lock_release(&VFS_DEVICE_LOCK);
-   return 0;
+   return gt_err < 0 ? gt_err : sb_err;
 }
 
 fsdata_t get_fsdata(dentry_t* dentry)
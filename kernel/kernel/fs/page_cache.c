@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <fs/page_cache.h>
+#include <fs/vfs.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <mem/pmm.h>
+#include <mem/vmm/vmm.h>
+#include <mem/vmm/zoner.h>
+
+// #define PAGE_CACHE_DEBUG
+
+/**
+ * The page cache keeps pages of files which are mapped into memory. Pages of
+ * a file are kept in a tree of its dentry, dentries are unique per inode, so
+ * all mappings of a file use the same frames.
+ * The cache holds a reference of every frame, a mapping takes one more.
+ * Pages live while the dentry is held (every mapping holds it). Dirty ones
+ * are written back by page_cache_flush(), which is called when a shared
+ * mapping goes away and by the dentry flusher, so no dirty pages are left
+ * when the last holder releases the dentry and pages are dropped.
+ *
+ * Trees of all dentries are guarded by _page_cache_lock.
+ */
+
+static lock_t _page_cache_lock;
+static kmem_cache_t* _page_cache_entries;
+static page_cache_stat_t _page_cache_stat;
+
+static inline void* _page_cache_map_frame(zone_t* zone, uint32_t frame)
+{
+    *zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(zone->start, frame, PAGE_READABLE | PAGE_WRITABLE);
+    return zone->ptr;
+}
+
+static inline void _page_cache_unmap_frame(zone_t zone)
+{
+    vmm_unmap_page(zone.start);
+    zoner_free_zone(zone);
+}
+
+static page_cache_entry_t* _page_cache_find(dentry_t* dentry, uint32_t index, rbtree_node_t** parent, rbtree_node_t*** link)
+{
+    rbtree_node_t* node_parent = NULL;
+    rbtree_node_t** node_link = &dentry->pages.root;
+    while (*node_link) {
+        page_cache_entry_t* entry = (page_cache_entry_t*)*node_link;
+        if (entry->index == index) {
+            return entry;
+        }
+        node_parent = *node_link;
+        node_link = index < entry->index ? &node_parent->left : &node_parent->right;
+    }
+
+    if (parent) {
+        *parent = node_parent;
+        *link = node_link;
+    }
+    return NULL;
+}
+
+/**
+ * The function returns the first dirty page of @dentry starting from @index.
+ */
+static page_cache_entry_t* _page_cache_find_dirty(dentry_t* dentry, uint32_t index)
+{
+    // Looking for the lowest page which is not less than @index.
+    rbtree_node_t* node = dentry->pages.root;
+    rbtree_node_t* lower_bound = NULL;
+    while (node) {
+        if (((page_cache_entry_t*)node)->index >= index) {
+            lower_bound = node;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+
+    for (node = lower_bound; node; node = rbtree_next(node)) {
+        if (((page_cache_entry_t*)node)->flags & PAGE_CACHE_DIRTY) {
+            return (page_cache_entry_t*)node;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The function reads a page of the file into a new frame. It's called
+ * without the cache lock, reading could take a while.
+ */
+static uint32_t _page_cache_read_frame(dentry_t* dentry, uint32_t offset)
+{
+    uint32_t frame = (uint32_t)pmm_alloc_aligned(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+    if (!frame) {
+        return 0;
+    }
+
+    zone_t tmp_zone;
+    uint8_t* ptr = _page_cache_map_frame(&tmp_zone, frame);
+    memset(ptr, 0, VMM_PAGE_SIZE);
+    lock_acquire(&dentry->lock);
+    dentry->ops->file.read(dentry, ptr, offset, VMM_PAGE_SIZE);
+    lock_release(&dentry->lock);
+    _page_cache_unmap_frame(tmp_zone);
+    return frame;
+}
+
+/**
+ * The function writes a page back, bytes after the end of the file are
+ * not written.
+ */
+static void _page_cache_write_frame(dentry_t* dentry, uint32_t frame, uint32_t offset)
+{
+    uint32_t size = dentry->inode->size;
+    if (offset >= size) {
+        return;
+    }
+
+    zone_t tmp_zone;
+    uint8_t* ptr = _page_cache_map_frame(&tmp_zone, frame);
+    dentry->ops->file.write(dentry, ptr, offset, min(size - offset, VMM_PAGE_SIZE));
+    _page_cache_unmap_frame(tmp_zone);
+}
+
+void page_cache_init()
+{
+    lock_init(&_page_cache_lock);
+    _page_cache_entries = kmem_cache_create("page_cache", sizeof(page_cache_entry_t));
+}
+
+/**
+ * The function returns a frame with the page of @dentry at @offset, which
+ * has to be page aligned. The frame is referenced for the caller, who gives
+ * the reference back with pmm_frame_unref(). Returns 0 if there is no memory.
+ */
+uint32_t page_cache_get_frame(dentry_t* dentry, uint32_t offset)
+{
+    uint32_t index = offset / VMM_PAGE_SIZE;
+
+    lock_acquire(&_page_cache_lock);
+    page_cache_entry_t* entry = _page_cache_find(dentry, index, NULL, NULL);
+    if (entry) {
+        uint32_t frame = entry->frame;
+        pmm_frame_ref(frame);
+        _page_cache_stat.hits++;
+        lock_release(&_page_cache_lock);
+        return frame;
+    }
+    _page_cache_stat.misses++;
+    lock_release(&_page_cache_lock);
+
+    uint32_t frame = _page_cache_read_frame(dentry, offset);
+    if (!frame) {
+        return 0;
+    }
+
+    rbtree_node_t* parent;
+    rbtree_node_t** link;
+    lock_acquire(&_page_cache_lock);
+    // Other thread could read the page meanwhile, the first one wins.
+    entry = _page_cache_find(dentry, index, &parent, &link);
+    if (entry) {
+        uint32_t cached_frame = entry->frame;
+        pmm_frame_ref(cached_frame);
+        lock_release(&_page_cache_lock);
+        pmm_free((void*)frame, VMM_PAGE_SIZE);
+        return cached_frame;
+    }
+
+    entry = kmem_cache_alloc(_page_cache_entries);
+    if (!entry) {
+        lock_release(&_page_cache_lock);
+        pmm_free((void*)frame, VMM_PAGE_SIZE);
+        return 0;
+    }
+    entry->index = index;
+    entry->frame = frame;
+    entry->flags = 0;
+    rbtree_link(&dentry->pages, &entry->node, parent, link);
+    _page_cache_stat.cached++;
+    pmm_frame_ref(frame);
+    lock_release(&_page_cache_lock);
+
+#ifdef PAGE_CACHE_DEBUG
+    log("[PageCache] Read page %d of inode %d", index, dentry->inode_indx);
+#endif
+    return frame;
+}
+
+void page_cache_mark_dirty(dentry_t* dentry, uint32_t offset)
+{
+    lock_acquire(&_page_cache_lock);
+    page_cache_entry_t* entry = _page_cache_find(dentry, offset / VMM_PAGE_SIZE, NULL, NULL);
+    if (entry) {
+        entry->flags |= PAGE_CACHE_DIRTY;
+    }
+    lock_release(&_page_cache_lock);
+}
+
+/**
+ * The function copies data written to the file into its cached pages, so
+ * mappings see the same content as reads do.
+ */
+void page_cache_update(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    if (!dentry->pages.root) {
+        return;
+    }
+
+    uint32_t end = start + len;
+    while (start < end) {
+        uint32_t page_offset = start % VMM_PAGE_SIZE;
+        uint32_t chunk = min(end - start, VMM_PAGE_SIZE - page_offset);
+
+        lock_acquire(&_page_cache_lock);
+        page_cache_entry_t* entry = _page_cache_find(dentry, start / VMM_PAGE_SIZE, NULL, NULL);
+        uint32_t frame = 0;
+        if (entry) {
+            frame = entry->frame;
+            pmm_frame_ref(frame);
+        }
+        lock_release(&_page_cache_lock);
+
+        if (frame) {
+            zone_t tmp_zone;
+            uint8_t* ptr = _page_cache_map_frame(&tmp_zone, frame);
+            memcpy(ptr + page_offset, buf, chunk);
+            _page_cache_unmap_frame(tmp_zone);
+            if (pmm_frame_unref(frame) == 0) {
+                pmm_free((void*)frame, VMM_PAGE_SIZE);
+            }
+        }
+
+        buf += chunk;
+        start += chunk;
+    }
+}
+
+/**
+ * The function writes dirty pages of @dentry back. Pages which are still
+ * mapped could be changed again without a fault, so they stay dirty.
+ * Filesystems take the lock of the dentry while writing, so it's called
+ * without it by a holder of the dentry. Pages are looked up by index
+ * every time and their frames are referenced, since the cache lock is
+ * left while a page is written.
+ */
+int page_cache_flush(dentry_t* dentry)
+{
+    if (!dentry->pages.root || !dentry->ops->file.write) {
+        return 0;
+    }
+
+    int written = 0;
+    uint32_t next_index = 0;
+    for (;;) {
+        lock_acquire(&_page_cache_lock);
+        page_cache_entry_t* entry = _page_cache_find_dirty(dentry, next_index);
+        if (!entry) {
+            lock_release(&_page_cache_lock);
+            break;
+        }
+
+        uint32_t frame = entry->frame;
+        uint32_t index = entry->index;
+        if (pmm_frame_refcount(frame) == 1) {
+            entry->flags &= ~PAGE_CACHE_DIRTY;
+        }
+        pmm_frame_ref(frame);
+        _page_cache_stat.write_backs++;
+        lock_release(&_page_cache_lock);
+
+        _page_cache_write_frame(dentry, frame, index * VMM_PAGE_SIZE);
+        if (pmm_frame_unref(frame) == 0) {
+            pmm_free((void*)frame, VMM_PAGE_SIZE);
+        }
+        written++;
+        next_index = index + 1;
+    }
+
+#ifdef PAGE_CACHE_DEBUG
+    if (written) {
+        log("[PageCache] Wrote %d pages of inode %d", written, dentry->inode_indx);
+    }
+#endif
+    return written;
+}
+
+/**
+ * The function gives all pages of @dentry back without writing them, the
+ * frames are freed when the last mapping of them goes away.
+ */
+void page_cache_drop(dentry_t* dentry)
+{
+    lock_acquire(&_page_cache_lock);
+    rbtree_node_t* node;
+    while ((node = dentry->pages.root)) {
+        page_cache_entry_t* entry = (page_cache_entry_t*)node;
+        rbtree_erase(&dentry->pages, node);
+        if (pmm_frame_unref(entry->frame) == 0) {
+            pmm_free((void*)entry->frame, VMM_PAGE_SIZE);
+        }
+        kmem_cache_free(_page_cache_entries, entry);
+        _page_cache_stat.cached--;
+    }
+    lock_release(&_page_cache_lock);
+}
+
+void page_cache_get_stat(page_cache_stat_t* stat)
+{
+    lock_acquire(&_page_cache_lock);
+    *stat = _page_cache_stat;
+    lock_release(&_page_cache_lock);
+}
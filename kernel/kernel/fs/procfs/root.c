@@ -4,10 +4,13 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <fs/bcache.h>
+#include <fs/page_cache.h>
 #include <fs/procfs/procfs.h>
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
+#include <mem/kmalloc.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <time/time_manager.h>
@@ -30,6 +33,14 @@ static bool procfs_root_uptime_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_root_uptime_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 static bool procfs_root_stat_can_read(dentry_t* dentry, uint32_t start);
 static int procfs_root_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_bcache_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_bcache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_dcache_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_dcache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_pagecache_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_pagecache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
+static bool procfs_root_slabinfo_can_read(dentry_t* dentry, uint32_t start);
+static int procfs_root_slabinfo_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 
 /**
  * DATA
@@ -50,7 +61,31 @@ const file_ops_t procfs_root_stat_ops = {
     .read = procfs_root_stat_read,
 };
 
+const file_ops_t procfs_root_bcache_ops = {
+    .can_read = procfs_root_bcache_can_read,
+    .read = procfs_root_bcache_read,
+};
+
+const file_ops_t procfs_root_dcache_ops = {
+    .can_read = procfs_root_dcache_can_read,
+    .read = procfs_root_dcache_read,
+};
+
+const file_ops_t procfs_root_pagecache_ops = {
+    .can_read = procfs_root_pagecache_can_read,
+    .read = procfs_root_pagecache_read,
+};
+
+const file_ops_t procfs_root_slabinfo_ops = {
+    .can_read = procfs_root_slabinfo_can_read,
+    .read = procfs_root_slabinfo_read,
+};
+
 static const procfs_files_t static_procfs_files[] = {
+    { .name = "bcache", .mode = 0, .ops = &procfs_root_bcache_ops },
+    { .name = "dcache", .mode = 0, .ops = &procfs_root_dcache_ops },
+    { .name = "pagecache", .mode = 0, .ops = &procfs_root_pagecache_ops },
+    { .name = "slabinfo", .mode = 0, .ops = &procfs_root_slabinfo_ops },
     { .name = "stat", .mode = 0, .ops = &procfs_root_stat_ops },
     { .name = "uptime", .mode = 0, .ops = &procfs_root_uptime_ops },
 };
@@ -236,4 +271,117 @@ static int procfs_root_stat_read(dentry_t* dentry, uint8_t* buf, uint32_t start,
 
     memcpy(buf, res, size);
     return size;
-}
\ No newline at end of file
+}
+
+static bool procfs_root_bcache_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+static int procfs_root_bcache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[192];
+    bcache_stat_t stat;
+    bcache_get_stat(&stat);
+    snprintf(res, 192, "hits %u\nmisses %u\nread_ahead %u\nevictions %u\nwrite_backs %u\ndirty %u\ncached %u\ncapacity %u\n",
+        stat.hits, stat.misses, stat.read_ahead, stat.evictions, stat.write_backs, stat.dirty, stat.cached, stat.capacity);
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
+static bool procfs_root_dcache_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+static int procfs_root_dcache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[320];
+    dentry_cache_stat_t stat;
+    dentry_get_stat(&stat);
+    snprintf(res, 320, "hits %u\nmisses %u\nevictions %u\ncached %u\nunused %u\nunused_limit %u\nname_hits %u\nnegative_hits %u\nname_misses %u\nnames %u\nnegative_names %u\n",
+        stat.hits, stat.misses, stat.evictions, stat.cached, stat.unused, stat.unused_limit, stat.name_hits, stat.negative_hits, stat.name_misses, stat.names, stat.negative_names);
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
+static bool procfs_root_pagecache_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+static int procfs_root_pagecache_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char res[128];
+    page_cache_stat_t stat;
+    page_cache_get_stat(&stat);
+    snprintf(res, 128, "hits %u\nmisses %u\nwrite_backs %u\ncached %u\n",
+        stat.hits, stat.misses, stat.write_backs, stat.cached);
+    size_t size = strlen(res);
+
+    if (start == size) {
+        return 0;
+    }
+
+    if (len < size) {
+        return -EFAULT;
+    }
+
+    memcpy(buf, res, size);
+    return size;
+}
+
+static bool procfs_root_slabinfo_can_read(dentry_t* dentry, uint32_t start)
+{
+    return true;
+}
+
+/**
+ * Every line describes a cache: name, object size, objects in use,
+ * objects in all slabs and the number of slabs.
+ */
+static int procfs_root_slabinfo_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    char* res = kmalloc(VMM_PAGE_SIZE);
+    kmem_cache_stat_t stat;
+    int offset = 0;
+    for (int i = 0; kmem_cache_get_stat(i, &stat) == 0 && offset < VMM_PAGE_SIZE; i++) {
+        snprintf(res + offset, VMM_PAGE_SIZE - offset, "%s %u %u %u %u\n",
+            stat.name, stat.object_size, stat.active_objects, stat.total_objects, stat.slabs);
+        offset = strlen(res);
+    }
+    snprintf(res + offset, VMM_PAGE_SIZE - offset, "large_pages %u\n", kmalloc_large_pages());
+    size_t size = strlen(res);
+
+    int ret = size;
+    if (start == size) {
+        ret = 0;
+    } else if (len < size) {
+        ret = -EFAULT;
+    } else {
+        memcpy(buf, res, size);
+    }
+
+    kfree(res);
+    return ret;
+}
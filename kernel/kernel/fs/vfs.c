@@ -5,7 +5,10 @@
  */
 
 #include <algo/dynamic_array.h>
+#include <fs/bcache.h>
+#include <fs/page_cache.h>
 #include <fs/vfs.h>
+#include <io/epoll/epoll.h>
 #include <io/sockets/socket.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
@@ -46,6 +49,9 @@ void vfs_install()
 {
     driver_install(_vfs_driver_info(), "vfs");
     dynamic_array_init_of_size(&_vfs_fses, sizeof(fs_desc_t), MAX_FS);
+    bcache_init();
+    page_cache_init();
+    dentry_init();
 }
 
 int vfs_choose_fs_of_dev(vfs_device_t* vfs_dev)
@@ -136,6 +142,7 @@ void vfs_eject_device(device_t* dev)
         eject(&_vfs_devices[dev->id]);
     }
     dentry_put_all_dentries_of_dev(dev->id);
+    bcache_invalidate_device(dev);
 }
 
 void vfs_add_fs(driver_t* new_driver)
@@ -165,6 +172,7 @@ void vfs_add_fs(driver_t* new_driver)
     new_ops->file.fstat = new_driver->desc.functions[DRIVER_FILE_SYSTEM_FSTAT];
     new_ops->file.ioctl = new_driver->desc.functions[DRIVER_FILE_SYSTEM_IOCTL];
     new_ops->file.mmap = new_driver->desc.functions[DRIVER_FILE_SYSTEM_MMAP];
+    new_ops->file.wait_queue = new_driver->desc.functions[DRIVER_FILE_SYSTEM_WAIT_QUEUE];
 
     new_ops->dentry.write_inode = new_driver->desc.functions[DRIVER_FILE_SYSTEM_WRITE_INODE];
     new_ops->dentry.read_inode = new_driver->desc.functions[DRIVER_FILE_SYSTEM_READ_INODE];
@@ -209,14 +217,21 @@ int vfs_open(dentry_t* file, file_descriptor_t* fd, uint32_t flags)
     fd->dentry = dentry_duplicate(file);
     fd->offset = 0;
     fd->ops = &file->ops->file;
+    fd->epoll_items = NULL;
     lock_init(&fd->lock);
     return 0;
 }
 
 static int _int_vfs_do_close(file_descriptor_t* fd)
 {
+    if (fd->epoll_items) {
+        epoll_forget_fd(fd);
+    }
+
     if (fd->type == FD_TYPE_FILE) {
         dentry_put(fd->dentry);
+    } else if (fd->type == FD_TYPE_EPOLL) {
+        epoll_free(fd->epoll_entry);
     } else {
         socket_put(fd->sock_entry);
     }
@@ -246,7 +261,11 @@ int vfs_create(dentry_t* dir, const char* name, uint32_t len, mode_t mode)
         return -EEXIST;
     }
 
-    return dir->ops->file.create(dir, name, len, mode);
+    int err = dir->ops->file.create(dir, name, len, mode);
+    if (!err) {
+        dentry_name_forget(dir, name, len);
+    }
+    return err;
 }
 
 int vfs_unlink(dentry_t* file)
@@ -263,7 +282,11 @@ int vfs_unlink(dentry_t* file)
 #endif
     }
 
-    return file->ops->file.unlink(file);
+    int err = file->ops->file.unlink(file);
+    if (!err) {
+        dentry_name_forget_inode(file);
+    }
+    return err;
 }
 
 int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
@@ -296,11 +319,21 @@ int vfs_lookup(dentry_t* dir, const char* name, uint32_t len, dentry_t** result)
         return -ENOEXEC;
     }
 
-    int err = dir->ops->file.lookup(dir, name, len, result);
+    uint32_t generation;
+    int err = dentry_name_lookup(dir, name, len, result, &generation);
+    if (err != -ENODATA) {
+        return err;
+    }
+
+    err = dir->ops->file.lookup(dir, name, len, result);
     if (err) {
+        if (err == -ENOENT) {
+            dentry_name_add(dir, name, len, NULL, generation);
+        }
         return err;
     }
 
+    dentry_name_add(dir, name, len, *result, generation);
     return 0;
 }
 
@@ -326,6 +359,18 @@ bool vfs_can_write(file_descriptor_t* fd)
     return res;
 }
 
+/**
+ * Returns the wait queue which is woken when the file state changes,
+ * NULL if the file does not provide one.
+ */
+wait_queue_t* vfs_wait_queue(file_descriptor_t* fd)
+{
+    if (fd->ops->wait_queue) {
+        return fd->ops->wait_queue(fd->dentry);
+    }
+    return NULL;
+}
+
 int vfs_read(file_descriptor_t* fd, void* buf, uint32_t len)
 {
     lock_acquire(&fd->lock);
@@ -342,6 +387,7 @@ int vfs_write(file_descriptor_t* fd, void* buf, uint32_t len)
     lock_acquire(&fd->lock);
     int written = fd->ops->write(fd->dentry, (uint8_t*)buf, fd->offset, len);
     if (written > 0) {
+        page_cache_update(fd->dentry, (uint8_t*)buf, fd->offset, written);
         fd->offset += written;
     }
 
@@ -363,7 +409,11 @@ int vfs_mkdir(dentry_t* dir, const char* name, size_t len, mode_t mode)
     if (!dentry_inode_test_flag(dir, S_IFDIR)) {
         return -ENOTDIR;
     }
-    return dir->ops->file.mkdir(dir, name, len, mode | S_IFDIR);
+    int err = dir->ops->file.mkdir(dir, name, len, mode | S_IFDIR);
+    if (!err) {
+        dentry_name_forget(dir, name, len);
+    }
+    return err;
 }
 
 /**
@@ -382,6 +432,7 @@ int vfs_rmdir(dentry_t* dir)
     if (!err) {
         log("Rmdir: will be deleted %d", dir->inode_indx);
         dentry_set_flag(dir, DENTRY_INODE_TO_BE_DELETED);
+        dentry_name_forget_inode(dir);
     }
     return err;
 }
@@ -449,6 +500,7 @@ int vfs_resolve_path_start_from(dentry_t* dentry, const char* path, dentry_t** r
 
         dentry_t* parent_dent = cur_dent;
         if (vfs_lookup(cur_dent, name, len, &cur_dent) < 0) {
+            dentry_put(parent_dent);
             return -ENOENT;
         }
 
@@ -555,11 +607,27 @@ static proc_zone_t* _vfs_do_mmap(file_descriptor_t* fd, mmap_params_t* params)
 
     if (map_private) {
         zone = proc_new_random_zone(RUNNING_THREAD->process, params->size);
+        if (!zone) {
+            return 0;
+        }
         zone->type = ZONE_TYPE_MAPPED_FILE_PRIVATLY;
         zone->file = dentry_duplicate(fd->dentry);
         zone->offset = params->offset;
+        zone->file_size = zone->len;
+    } else if (map_shared) {
+        // Pages are taken from the page cache, which keeps whole pages of files.
+        if (params->offset % VMM_PAGE_SIZE) {
+            return 0;
+        }
+        zone = proc_new_random_zone(RUNNING_THREAD->process, params->size);
+        if (!zone) {
+            return 0;
+        }
+        zone->type = ZONE_TYPE_MAPPED_FILE_SHAREDLY;
+        zone->file = dentry_duplicate(fd->dentry);
+        zone->offset = params->offset;
+        zone->file_size = zone->len;
     } else {
-        /* TODO */
         return 0;
     }
 
@@ -584,15 +652,18 @@ proc_zone_t* vfs_mmap(file_descriptor_t* fd, mmap_params_t* params)
 
 int vfs_munmap(proc_t* p, proc_zone_t* zone)
 {
-    if (!(zone->flags & ZONE_TYPE_MAPPED_FILE_PRIVATLY) && !(zone->flags & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+    if (!(zone->type & (ZONE_TYPE_MAPPED_FILE_PRIVATLY | ZONE_TYPE_MAPPED_FILE_SHAREDLY))) {
         return -EFAULT;
     }
 
-    dentry_put(zone->file);
+    vmm_free_user_pages(zone->start, zone->len, &p->zones);
 
-    for (uint32_t vaddr = zone->start; vaddr < zone->start + zone->len + 1; vaddr += VMM_PAGE_SIZE) {
-        system_flush_tlb_entry(vaddr);
+    // Changes of a shared mapping reach the file when it's unmapped.
+    dentry_t* file = zone->file;
+    if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+        page_cache_flush(file);
     }
+    dentry_put(file);
     proc_delete_zone(p, zone);
 
     return 0;
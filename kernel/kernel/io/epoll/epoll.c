@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <io/epoll/epoll.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+
+// #define EPOLL_DEBUG
+
+/**
+ * FILE OPS
+ */
+
+static bool _epoll_can_read(dentry_t* dentry, uint32_t start)
+{
+    return epoll_has_ready((epoll_t*)dentry);
+}
+
+static bool _epoll_can_write(dentry_t* dentry, uint32_t start)
+{
+    return false;
+}
+
+static int _epoll_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return -EINVAL;
+}
+
+static int _epoll_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
+{
+    return -EINVAL;
+}
+
+static wait_queue_t* _epoll_wait_queue(dentry_t* dentry)
+{
+    return &((epoll_t*)dentry)->wait_queue;
+}
+
+static file_ops_t _epoll_ops = {
+    .can_read = _epoll_can_read,
+    .can_write = _epoll_can_write,
+    .read = _epoll_read,
+    .write = _epoll_write,
+    .wait_queue = _epoll_wait_queue,
+};
+
+/**
+ * READY LIST
+ */
+
+static void _epoll_mark_ready_lockless(epoll_t* ep, epoll_item_t* item)
+{
+    if (item->ready) {
+        return;
+    }
+
+    item->ready = true;
+    item->ready_next = NULL;
+    if (ep->ready_tail) {
+        ep->ready_tail->ready_next = item;
+    } else {
+        ep->ready_head = item;
+    }
+    ep->ready_tail = item;
+}
+
+static void _epoll_unmark_ready_lockless(epoll_t* ep, epoll_item_t* prev, epoll_item_t* item)
+{
+    if (prev) {
+        prev->ready_next = item->ready_next;
+    } else {
+        ep->ready_head = item->ready_next;
+    }
+
+    if (ep->ready_tail == item) {
+        ep->ready_tail = prev;
+    }
+
+    item->ready_next = NULL;
+    item->ready = false;
+}
+
+static void _epoll_drop_ready_lockless(epoll_t* ep, epoll_item_t* item)
+{
+    if (!item->ready) {
+        return;
+    }
+
+    epoll_item_t* prev = NULL;
+    for (epoll_item_t* it = ep->ready_head; it; prev = it, it = it->ready_next) {
+        if (it == item) {
+            _epoll_unmark_ready_lockless(ep, prev, item);
+            return;
+        }
+    }
+}
+
+/**
+ * The callback is called by the file with its wait queue locked, so the
+ * item is only queued here and polled later by epoll_wait.
+ */
+static void _epoll_item_woken(wait_queue_entry_t* entry)
+{
+    epoll_item_t* item = (epoll_item_t*)entry->data;
+    epoll_t* ep = item->epoll;
+
+    lock_acquire(&ep->lock);
+    _epoll_mark_ready_lockless(ep, item);
+    lock_release(&ep->lock);
+
+    wait_queue_wake_all(&ep->wait_queue);
+}
+
+static uint32_t _epoll_item_poll(epoll_item_t* item)
+{
+    file_descriptor_t* fd = item->fd;
+    uint32_t revents = 0;
+
+    if ((item->events & EPOLLIN) && fd->ops->can_read && fd->ops->can_read(fd->dentry, fd->offset)) {
+        revents |= EPOLLIN;
+    }
+    if ((item->events & EPOLLOUT) && fd->ops->can_write && fd->ops->can_write(fd->dentry, fd->offset)) {
+        revents |= EPOLLOUT;
+    }
+    return revents;
+}
+
+/**
+ * Walks the ready list. Items which are not ready anymore are dropped,
+ * they come back with the next wakeup of their file. Edge-triggered items
+ * are dropped once reported. Items of files without a wait queue are never
+ * woken, so they stay in the list and are polled on every call.
+ * If events is NULL, only checks if there is anything to report.
+ */
+static int _epoll_scan_lockless(epoll_t* ep, epoll_event_t* events, int maxevents)
+{
+    int cnt = 0;
+    epoll_item_t* prev = NULL;
+    epoll_item_t* item = ep->ready_head;
+
+    while (item && (!events || cnt < maxevents)) {
+        epoll_item_t* next = item->ready_next;
+        uint32_t revents = _epoll_item_poll(item);
+        bool keep = !item->has_wait_queue;
+
+        if (revents) {
+            if (!events) {
+                return 1;
+            }
+            events[cnt].events = revents;
+            events[cnt].data = item->data;
+            cnt++;
+            keep |= !(item->events & EPOLLET);
+        }
+
+        if (keep) {
+            prev = item;
+        } else {
+            _epoll_unmark_ready_lockless(ep, prev, item);
+        }
+        item = next;
+    }
+
+    return cnt;
+}
+
+/**
+ * ITEMS
+ */
+
+static epoll_item_t* _epoll_find_item_lockless(epoll_t* ep, file_descriptor_t* fd)
+{
+    for (epoll_item_t* item = ep->items; item; item = item->next) {
+        if (item->fd == fd) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void _epoll_unlink_item_lockless(epoll_t* ep, epoll_item_t* item)
+{
+    epoll_item_t** it = &ep->items;
+    while (*it && *it != item) {
+        it = &(*it)->next;
+    }
+    if (*it) {
+        *it = item->next;
+    }
+
+    if (!item->has_wait_queue) {
+        ep->items_without_wait_queue--;
+    }
+}
+
+static void _epoll_unlink_item_from_fd(epoll_item_t* item)
+{
+    epoll_item_t** it = &item->fd->epoll_items;
+    while (*it && *it != item) {
+        it = &(*it)->fd_next;
+    }
+    if (*it) {
+        *it = item->fd_next;
+    }
+}
+
+/**
+ * Wakers take the file queue lock before ours, so the entry is removed
+ * unlocked. The item could be queued by a wakeup in between, so it is
+ * dropped from the ready list only after that.
+ */
+static void _epoll_release_item(epoll_t* ep, epoll_item_t* item)
+{
+    wait_queue_remove(&item->wait_entry);
+
+    lock_acquire(&ep->lock);
+    _epoll_drop_ready_lockless(ep, item);
+    lock_release(&ep->lock);
+    kfree(item);
+}
+
+static int _epoll_add(epoll_t* ep, int fd_id, file_descriptor_t* fd, epoll_event_t* event)
+{
+    epoll_item_t* item = kmalloc(sizeof(epoll_item_t));
+    if (!item) {
+        return -ENOMEM;
+    }
+    memset(item, 0, sizeof(epoll_item_t));
+    item->epoll = ep;
+    item->fd = fd;
+    item->fd_id = fd_id;
+    item->events = event->events;
+    item->data = event->data;
+
+    lock_acquire(&ep->lock);
+    if (_epoll_find_item_lockless(ep, fd)) {
+        lock_release(&ep->lock);
+        kfree(item);
+        return -EEXIST;
+    }
+
+    wait_queue_t* wq = vfs_wait_queue(fd);
+    item->has_wait_queue = (wq != NULL);
+    if (!item->has_wait_queue) {
+        ep->items_without_wait_queue++;
+    }
+
+    item->next = ep->items;
+    ep->items = item;
+    item->fd_next = fd->epoll_items;
+    fd->epoll_items = item;
+
+    /* The file could be ready already, so the first epoll_wait polls it. */
+    _epoll_mark_ready_lockless(ep, item);
+    lock_release(&ep->lock);
+
+    if (wq) {
+        wait_queue_add_callback(wq, &item->wait_entry, _epoll_item_woken, item);
+    }
+
+#ifdef EPOLL_DEBUG
+    log("Epoll %x: add fd %d, events %x", ep, fd_id, item->events);
+#endif
+    wait_queue_wake_all(&ep->wait_queue);
+    return 0;
+}
+
+static int _epoll_mod(epoll_t* ep, file_descriptor_t* fd, epoll_event_t* event)
+{
+    lock_acquire(&ep->lock);
+    epoll_item_t* item = _epoll_find_item_lockless(ep, fd);
+    if (!item) {
+        lock_release(&ep->lock);
+        return -ENOENT;
+    }
+
+    item->events = event->events;
+    item->data = event->data;
+    _epoll_mark_ready_lockless(ep, item);
+    lock_release(&ep->lock);
+
+    wait_queue_wake_all(&ep->wait_queue);
+    return 0;
+}
+
+static int _epoll_del(epoll_t* ep, file_descriptor_t* fd)
+{
+    lock_acquire(&ep->lock);
+    epoll_item_t* item = _epoll_find_item_lockless(ep, fd);
+    if (!item) {
+        lock_release(&ep->lock);
+        return -ENOENT;
+    }
+    _epoll_unlink_item_lockless(ep, item);
+    _epoll_unlink_item_from_fd(item);
+    lock_release(&ep->lock);
+
+    _epoll_release_item(ep, item);
+    return 0;
+}
+
+/**
+ * API
+ */
+
+int epoll_create(file_descriptor_t* fd)
+{
+    epoll_t* ep = kmalloc(sizeof(epoll_t));
+    if (!ep) {
+        return -ENOMEM;
+    }
+    memset(ep, 0, sizeof(epoll_t));
+    lock_init(&ep->lock);
+    wait_queue_init(&ep->wait_queue);
+
+    fd->type = FD_TYPE_EPOLL;
+    fd->epoll_entry = ep;
+    fd->ops = &_epoll_ops;
+    fd->offset = 0;
+    fd->flags = 0;
+    fd->epoll_items = NULL;
+    lock_init(&fd->lock);
+    return 0;
+}
+
+int epoll_free(epoll_t* ep)
+{
+    lock_acquire(&ep->lock);
+    epoll_item_t* item = ep->items;
+    while (item) {
+        _epoll_unlink_item_from_fd(item);
+        item = item->next;
+    }
+    item = ep->items;
+    ep->items = NULL;
+    lock_release(&ep->lock);
+
+    while (item) {
+        epoll_item_t* next = item->next;
+        _epoll_release_item(ep, item);
+        item = next;
+    }
+
+    wait_queue_clear(&ep->wait_queue);
+    kfree(ep);
+    return 0;
+}
+
+int epoll_ctl(epoll_t* ep, int op, int fd_id, file_descriptor_t* fd, epoll_event_t* event)
+{
+    if (fd->type == FD_TYPE_EPOLL) {
+        return -EINVAL;
+    }
+
+    switch (op) {
+    case EPOLL_CTL_ADD:
+        if (!event) {
+            return -EFAULT;
+        }
+        return _epoll_add(ep, fd_id, fd, event);
+    case EPOLL_CTL_MOD:
+        if (!event) {
+            return -EFAULT;
+        }
+        return _epoll_mod(ep, fd, event);
+    case EPOLL_CTL_DEL:
+        return _epoll_del(ep, fd);
+    default:
+        return -EINVAL;
+    }
+}
+
+int epoll_collect(epoll_t* ep, epoll_event_t* events, int maxevents)
+{
+    lock_acquire(&ep->lock);
+    int res = _epoll_scan_lockless(ep, events, maxevents);
+    lock_release(&ep->lock);
+    return res;
+}
+
+bool epoll_has_ready(epoll_t* ep)
+{
+    return epoll_collect(ep, NULL, 0) > 0;
+}
+
+/**
+ * Called when the fd is closed, drops its items from all epoll instances.
+ */
+void epoll_forget_fd(file_descriptor_t* fd)
+{
+    epoll_item_t* item = fd->epoll_items;
+    while (item) {
+        epoll_item_t* next = item->fd_next;
+        epoll_t* ep = item->epoll;
+
+        lock_acquire(&ep->lock);
+        _epoll_unlink_item_lockless(ep, item);
+        lock_release(&ep->lock);
+
+        _epoll_release_item(ep, item);
+        item = next;
+    }
+    fd->epoll_items = NULL;
+}
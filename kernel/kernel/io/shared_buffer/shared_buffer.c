@@ -12,15 +12,41 @@
 #include <libkern/log.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
+#include <tasking/tasking.h>
 
 // #define SHARED_BUFFER_DEBUG
 
 #define SHBUF_SPACE_SIZE (128 * MB)
 #define SHBUF_BLOCK_SIZE (4 * KB)
 #define SHBUF_MAX_BUFFERS 128
+#define SHBUF_MAX_PUBLISHED 32
+#define SHBUF_MAX_HOLDERS 16
 
 uint8_t* buffers[SHBUF_MAX_BUFFERS];
 
+/**
+ * A buffer could be published under a key, so other processes can find
+ * it without getting its id from its creator. Key 0 means unpublished.
+ *
+ * A published buffer becomes read-only and is refcounted: its creator and
+ * every process which found it are holders, which give it back with
+ * shared_buffer_free() or when they die. It is freed with its last holder.
+ * Only SHBUF_MAX_PUBLISHED buffers are published at once, the least
+ * recently found one is unpublished to make room, and lives on till its
+ * holders are gone.
+ */
+struct shared_buffer_info {
+    uint32_t key;
+    bool refcounted;
+    uint32_t last_use;
+    int holders_count;
+    pid_t holders[SHBUF_MAX_HOLDERS];
+};
+typedef struct shared_buffer_info shared_buffer_info_t;
+
+static shared_buffer_info_t _shared_buffer_infos[SHBUF_MAX_BUFFERS];
+static uint32_t _shared_buffer_use_clock = 0;
+
 struct shared_buffer_header {
     size_t len;
 };
@@ -55,13 +81,13 @@ static inline int _shared_buffer_alloc_id()
 static void _shared_buffer_init_bitmap()
 {
     _shared_buffer_bitmap = _shared_buffer_zone.ptr;
-    _shared_buffer_bitmap_len = (SHBUF_SPACE_SIZE / SHBUF_BLOCK_SIZE / 8);
+    _shared_buffer_bitmap_len = SHBUF_SPACE_SIZE / SHBUF_BLOCK_SIZE;
 
+    memset(_shared_buffer_bitmap, 0, BITMAP_SIZE(_shared_buffer_bitmap_len));
     bitmap = bitmap_wrap(_shared_buffer_bitmap, _shared_buffer_bitmap_len);
-    memset(_shared_buffer_bitmap, 0, _shared_buffer_bitmap_len);
 
     /* Setting bitmap as a busy region. */
-    int blocks_needed = (_shared_buffer_bitmap_len + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
+    int blocks_needed = (BITMAP_SIZE(_shared_buffer_bitmap_len) + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
     bitmap_set_range(bitmap, _shared_buffer_to_index((uint32_t)_shared_buffer_bitmap), blocks_needed);
 }
 
@@ -91,13 +117,20 @@ int shared_buffer_create(uint8_t** res_buffer, size_t size)
         return -ENOMEM;
     }
 
+    // The space could be left read-only by a published buffer, so it is
+    // tuned before the header is written.
     shared_buffer_header_t* space = (shared_buffer_header_t*)_shared_buffer_to_vaddr(start);
-    space->len = act_size;
     bitmap_set_range(bitmap, start, blocks_needed);
     vmm_tune_pages((uint32_t)space, act_size, PAGE_WRITABLE | PAGE_EXECUTABLE | PAGE_READABLE | PAGE_USER);
+    space->len = act_size;
 
     *res_buffer = (uint8_t*)&space[1];
     buffers[buf_id] = (uint8_t*)&space[1];
+    shared_buffer_info_t* info = &_shared_buffer_infos[buf_id];
+    info->key = 0;
+    info->refcounted = false;
+    info->holders_count = 1;
+    info->holders[0] = RUNNING_THREAD->process->pid;
 #ifdef SHARED_BUFFER_DEBUG
     log("Buffer created at %x %d", buffers[buf_id], buf_id);
 #endif
@@ -124,6 +157,46 @@ int shared_buffer_get(int id, uint8_t** res_buffer)
     return 0;
 }
 
+static void _shared_buffer_free_lockless(int id)
+{
+    shared_buffer_header_t* sptr = (shared_buffer_header_t*)buffers[id];
+    size_t blocks_to_delete = (sptr[-1].len + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
+    bitmap_unset_range(bitmap, _shared_buffer_to_index((uint32_t)&sptr[-1]), blocks_to_delete);
+    buffers[id] = 0;
+    _shared_buffer_infos[id].key = 0;
+    _shared_buffer_infos[id].refcounted = false;
+    _shared_buffer_infos[id].holders_count = 0;
+}
+
+static int _shared_buffer_find_holder(shared_buffer_info_t* info, pid_t pid)
+{
+    for (int i = 0; i < info->holders_count; i++) {
+        if (info->holders[i] == pid) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Drops @pid from the holders of a refcounted buffer, freeing the buffer
+ * if it was the last one. Returns -EPERM if @pid doesn't hold it.
+ */
+static int _shared_buffer_release_lockless(int id, pid_t pid)
+{
+    shared_buffer_info_t* info = &_shared_buffer_infos[id];
+    int holder = _shared_buffer_find_holder(info, pid);
+    if (holder < 0) {
+        return -EPERM;
+    }
+
+    info->holders[holder] = info->holders[--info->holders_count];
+    if (!info->holders_count) {
+        _shared_buffer_free_lockless(id);
+    }
+    return 0;
+}
+
 int shared_buffer_free(int id)
 {
     if (unlikely(id < 0 || SHBUF_MAX_BUFFERS <= id)) {
@@ -136,10 +209,114 @@ int shared_buffer_free(int id)
         return -EINVAL;
     }
 
+    int err = 0;
+    if (_shared_buffer_infos[id].refcounted) {
+        err = _shared_buffer_release_lockless(id, RUNNING_THREAD->process->pid);
+    } else {
+        _shared_buffer_free_lockless(id);
+    }
+    lock_release(&_shared_buffer_lock);
+    return err;
+}
+
+void shared_buffer_release_proc(pid_t pid)
+{
+    lock_acquire(&_shared_buffer_lock);
+    for (int i = 0; i < SHBUF_MAX_BUFFERS; i++) {
+        if (buffers[i] && _shared_buffer_infos[i].refcounted) {
+            _shared_buffer_release_lockless(i, pid);
+        }
+    }
+    lock_release(&_shared_buffer_lock);
+}
+
+static inline int _shared_buffer_find_lockless(uint32_t key)
+{
+    for (int i = 0; i < SHBUF_MAX_BUFFERS; i++) {
+        if (buffers[i] && _shared_buffer_infos[i].key == key) {
+            return i;
+        }
+    }
+    return -ENOENT;
+}
+
+static void _shared_buffer_evict_lockless()
+{
+    int published = 0;
+    int victim = -1;
+    for (int i = 0; i < SHBUF_MAX_BUFFERS; i++) {
+        if (!buffers[i] || !_shared_buffer_infos[i].key) {
+            continue;
+        }
+        published++;
+        if (victim < 0 || _shared_buffer_infos[i].last_use < _shared_buffer_infos[victim].last_use) {
+            victim = i;
+        }
+    }
+
+    if (published >= SHBUF_MAX_PUBLISHED) {
+        _shared_buffer_infos[victim].key = 0;
+    }
+}
+
+int shared_buffer_publish(int id, uint32_t key)
+{
+    if (unlikely(id < 0 || SHBUF_MAX_BUFFERS <= id || !key)) {
+        return -EINVAL;
+    }
+
+    lock_acquire(&_shared_buffer_lock);
+    if (unlikely(buffers[id] == 0)) {
+        lock_release(&_shared_buffer_lock);
+        return -EINVAL;
+    }
+
+    int owner = _shared_buffer_find_lockless(key);
+    if (owner >= 0) {
+        lock_release(&_shared_buffer_lock);
+        return owner == id ? 0 : -EEXIST;
+    }
+
+    // Only the creator publishes, and only once.
+    shared_buffer_info_t* info = &_shared_buffer_infos[id];
+    if (info->refcounted || info->holders[0] != RUNNING_THREAD->process->pid) {
+        lock_release(&_shared_buffer_lock);
+        return -EPERM;
+    }
+
+    _shared_buffer_evict_lockless();
     shared_buffer_header_t* sptr = (shared_buffer_header_t*)buffers[id];
-    size_t blocks_to_delete = (sptr[-1].len + SHBUF_BLOCK_SIZE - 1) / SHBUF_BLOCK_SIZE;
-    bitmap_unset_range(bitmap, _shared_buffer_to_index((uint32_t)&sptr[-1]), blocks_to_delete);
-    buffers[id] = 0;
+    vmm_tune_pages((uint32_t)&sptr[-1], sptr[-1].len, PAGE_READABLE | PAGE_USER);
+    info->key = key;
+    info->refcounted = true;
+    info->last_use = ++_shared_buffer_use_clock;
     lock_release(&_shared_buffer_lock);
     return 0;
+}
+
+int shared_buffer_find(uint32_t key)
+{
+    if (unlikely(!key)) {
+        return -EINVAL;
+    }
+
+    lock_acquire(&_shared_buffer_lock);
+    int id = _shared_buffer_find_lockless(key);
+    if (id < 0) {
+        lock_release(&_shared_buffer_lock);
+        return id;
+    }
+
+    shared_buffer_info_t* info = &_shared_buffer_infos[id];
+    pid_t pid = RUNNING_THREAD->process->pid;
+    if (_shared_buffer_find_holder(info, pid) < 0) {
+        if (info->holders_count == SHBUF_MAX_HOLDERS) {
+            lock_release(&_shared_buffer_lock);
+            return -EBUSY;
+        }
+        info->holders[info->holders_count++] = pid;
+    }
+    info->last_use = ++_shared_buffer_use_clock;
+    lock_release(&_shared_buffer_lock);
+    return id;
 }
\ No newline at end of file
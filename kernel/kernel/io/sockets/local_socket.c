@@ -30,6 +30,7 @@ static file_ops_t local_socket_ops = {
     .fstat = 0,
     .ioctl = 0,
     .mmap = 0,
+    .wait_queue = local_socket_wait_queue,
 };
 
 int local_socket_create(int type, int protocol, file_descriptor_t* fd)
@@ -37,32 +38,66 @@ int local_socket_create(int type, int protocol, file_descriptor_t* fd)
     return socket_create(PF_LOCAL, type, protocol, fd, &local_socket_ops);
 }
 
+/**
+ * Each end of a connection has its own buffer, the data written to one end
+ * goes to the buffer of its peer. A listening socket is readable when it has
+ * connections to accept.
+ */
 bool local_socket_can_read(dentry_t* dentry, uint32_t start)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    return sync_ringbuffer_space_to_read_with_custom_start(&sock_entry->buffer, start) != 0;
+    if (sock_entry->state == SOCKET_LISTENING) {
+        return socket_has_pending(sock_entry);
+    }
+    if (sock_entry->state == SOCKET_DISCONNECTED) {
+        return true;
+    }
+    return sync_ringbuffer_space_to_read(&sock_entry->buffer) != 0;
 }
 
 int local_socket_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    uint32_t read = sync_ringbuffer_read_with_start(&sock_entry->buffer, start, buf, len);
+    if (sock_entry->state == SOCKET_LISTENING || sock_entry->state == SOCKET_UNCONNECTED) {
+        return -ENOTCONN;
+    }
+
+    uint32_t read = sync_ringbuffer_read(&sock_entry->buffer, buf, len);
+    if (read) {
+        /* The peer could wait for free space in our buffer. */
+        socket_t* peer = socket_get_peer(sock_entry);
+        if (peer) {
+            wait_queue_wake_all(&peer->wait_queue);
+            socket_put(peer);
+        }
+    }
     return read;
 }
 
-/* Each process has it's own start when reading from a local socket.
-   We ignore their offsets and write always, hope all readers could
-   read all needed data. */
+/* A writer blocks until the peer has read some data, a closed peer
+   does not block writers, they get EPIPE. */
 bool local_socket_can_write(dentry_t* dentry, uint32_t start)
 {
-    return true;
+    socket_t* sock_entry = (socket_t*)dentry;
+    if (sock_entry->state != SOCKET_CONNECTED) {
+        return true;
+    }
+    return socket_space_to_write(sock_entry) != 0;
 }
 
 int local_socket_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len)
 {
     socket_t* sock_entry = (socket_t*)dentry;
-    uint32_t written = sync_ringbuffer_write_ignore_bounds(&sock_entry->buffer, buf, len);
-    return 0;
+    if (sock_entry->state == SOCKET_LISTENING || sock_entry->state == SOCKET_UNCONNECTED) {
+        return -ENOTCONN;
+    }
+    return socket_write_to_peer(sock_entry, buf, len);
+}
+
+wait_queue_t* local_socket_wait_queue(dentry_t* dentry)
+{
+    socket_t* sock_entry = (socket_t*)dentry;
+    return &sock_entry->wait_queue;
 }
 
 int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
@@ -106,6 +141,7 @@ int local_socket_bind(file_descriptor_t* sock, char* path, uint32_t len)
     log("Bind local socket at %x : %d pid", sock->sock_entry, p->pid);
 #endif
     sock->sock_entry->bind_file.dentry->sock = socket_duplicate(sock->sock_entry);
+    sock->sock_entry->state = SOCKET_LISTENING;
     vfs_helper_restore_full_path_after_split(path, name);
     lock_release(&sock->lock);
     return 0;
@@ -129,19 +165,50 @@ int local_socket_connect(file_descriptor_t* sock, char* path, uint32_t len)
 #ifdef LOCAL_SOCKET_DEBUG
         log_error("Connect: file not a socket : %d pid\n", p->pid);
 #endif
+        dentry_put(bind_dentry);
         lock_release(&sock->lock);
         return -ENOTSOCK;
     }
 
     if (!bind_dentry->sock) {
+        dentry_put(bind_dentry);
         lock_release(&sock->lock);
-        return -EBADF;
+        return -ECONNREFUSED;
     }
-    sock->sock_entry = socket_duplicate(bind_dentry->sock);
-    sock->offset = bind_dentry->sock->buffer.ringbuffer.end; /* Starting to read from the end */
+
+    res = socket_connect_to(sock->sock_entry, bind_dentry->sock);
 #ifdef LOCAL_SOCKET_DEBUG
-    log("Connected to local socket at %x : %d pid", bind_dentry->sock, p->pid);
+    log("Connect to local socket at %x [%d] : %d pid", bind_dentry->sock, res, p->pid);
 #endif
+    dentry_put(bind_dentry);
     lock_release(&sock->lock);
+    return res;
+}
+
+/**
+ * Gives the oldest pending connection its own fd. Returns -EAGAIN if there
+ * is nothing to accept, the caller decides if it should block.
+ */
+int local_socket_accept(file_descriptor_t* sock, file_descriptor_t* fd, uint32_t flags)
+{
+    if (sock->sock_entry->state != SOCKET_LISTENING) {
+        return -EINVAL;
+    }
+
+    socket_t* conn = socket_take_pending(sock->sock_entry);
+    if (!conn) {
+        return -EAGAIN;
+    }
+
+    fd->type = FD_TYPE_SOCKET;
+    fd->sock_entry = conn;
+    fd->ops = &local_socket_ops;
+    fd->offset = 0;
+    fd->flags = flags;
+    fd->epoll_items = NULL;
+    lock_init(&fd->lock);
+#ifdef LOCAL_SOCKET_DEBUG
+    log("Accepted local socket %x on %x", conn, sock->sock_entry);
+#endif
     return 0;
 }
\ No newline at end of file
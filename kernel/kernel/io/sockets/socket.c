@@ -6,20 +6,47 @@
 
 #include <algo/sync_ringbuffer.h>
 #include <io/sockets/socket.h>
+#include <libkern/bits/errno.h>
 #include <libkern/kassert.h>
+#include <mem/kmalloc.h>
 
-socket_t socket_list[MAX_SOCKET_COUNT];
-static int next_socket = 0;
+/**
+ * The lock protects reference counters, peers and backlogs of all sockets.
+ * Wait queues are never woken with the lock held, since wakers recheck
+ * socket state from inside the queue lock.
+ */
+static lock_t _sockets_lock;
+static kmem_cache_t* _socket_cache;
+
+void socket_init()
+{
+    lock_init(&_sockets_lock);
+    _socket_cache = kmem_cache_create("socket", sizeof(socket_t));
+}
 
 static socket_t* _socket_create(int domain, int type, int protocol)
 {
-    socket_list[next_socket].domain = domain;
-    socket_list[next_socket].type = type;
-    socket_list[next_socket].protocol = protocol;
-    socket_list[next_socket].buffer = sync_ringbuffer_create_std();
-    socket_list[next_socket].d_count = 1;
-    lock_init(&socket_list[next_socket].lock);
-    return &socket_list[next_socket++];
+    socket_t* sock = kmem_cache_alloc(_socket_cache);
+    if (!sock) {
+        return NULL;
+    }
+    memset(sock, 0, sizeof(socket_t));
+
+    sock->domain = domain;
+    sock->type = type;
+    sock->protocol = protocol;
+    sock->state = SOCKET_UNCONNECTED;
+    sock->buffer = sync_ringbuffer_create_std();
+    sock->d_count = 1;
+    wait_queue_init(&sock->wait_queue);
+    return sock;
+}
+
+static void _socket_free(socket_t* sock)
+{
+    sync_ringbuffer_free(&sock->buffer);
+    wait_queue_clear(&sock->wait_queue);
+    kmem_cache_free(_socket_cache, sock);
 }
 
 int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, file_ops_t* ops)
@@ -27,28 +54,178 @@ int socket_create(int domain, int type, int protocol, file_descriptor_t* fd, fil
     fd->type = FD_TYPE_SOCKET;
     fd->sock_entry = _socket_create(domain, type, protocol);
     fd->ops = ops;
+    fd->epoll_items = NULL;
     if (!fd->sock_entry) {
-        return -1;
+        return -ENOMEM;
     }
     return 0;
 }
 
 socket_t* socket_duplicate(socket_t* sock)
 {
-    lock_acquire(&sock->lock);
+    lock_acquire(&_sockets_lock);
     sock->d_count++;
-    lock_release(&sock->lock);
+    lock_release(&_sockets_lock);
     return sock;
 }
 
+/**
+ * When the last reference goes away the peer is told that the connection
+ * is closed, and pending connections of a listening socket are dropped.
+ */
 int socket_put(socket_t* sock)
 {
-    lock_acquire(&sock->lock);
-    sock->d_count--;
+    lock_acquire(&_sockets_lock);
     ASSERT(sock->d_count > 0);
-    if (sock->d_count == 0) {
-        sync_ringbuffer_free(&sock->buffer);
+    sock->d_count--;
+    if (sock->d_count > 0) {
+        lock_release(&_sockets_lock);
+        return 0;
+    }
+
+    socket_t* peer = sock->peer;
+    if (peer) {
+        peer->peer = NULL;
+        peer->state = SOCKET_DISCONNECTED;
+        peer->d_count++;
+    }
+    lock_release(&_sockets_lock);
+
+    if (peer) {
+        wait_queue_wake_all(&peer->wait_queue);
+        socket_put(peer);
+    }
+
+    for (uint32_t i = 0; i < sock->backlog_cnt; i++) {
+        socket_put(sock->backlog[(sock->backlog_start + i) % SOCKET_BACKLOG_SIZE]);
+    }
+
+    _socket_free(sock);
+    return 0;
+}
+
+/**
+ * Returns a referenced peer of the socket, NULL if it is not connected.
+ */
+socket_t* socket_get_peer(socket_t* sock)
+{
+    lock_acquire(&_sockets_lock);
+    socket_t* peer = sock->peer;
+    if (peer) {
+        peer->d_count++;
+    }
+    lock_release(&_sockets_lock);
+    return peer;
+}
+
+/**
+ * Creates the server end of a connection and puts it into the backlog
+ * of the listener, where it waits to be accepted.
+ */
+int socket_connect_to(socket_t* sock, socket_t* listener)
+{
+    socket_t* server_end = _socket_create(listener->domain, listener->type, listener->protocol);
+    if (!server_end) {
+        return -ENOMEM;
+    }
+
+    lock_acquire(&_sockets_lock);
+    if (listener->state != SOCKET_LISTENING || listener->backlog_cnt == SOCKET_BACKLOG_SIZE) {
+        lock_release(&_sockets_lock);
+        _socket_free(server_end);
+        return -ECONNREFUSED;
+    }
+    if (sock->state != SOCKET_UNCONNECTED) {
+        lock_release(&_sockets_lock);
+        _socket_free(server_end);
+        return -EISCONN;
     }
-    lock_release(&sock->lock);
+
+    sock->peer = server_end;
+    sock->state = SOCKET_CONNECTED;
+    server_end->peer = sock;
+    server_end->state = SOCKET_CONNECTED;
+
+    uint32_t slot = (listener->backlog_start + listener->backlog_cnt) % SOCKET_BACKLOG_SIZE;
+    listener->backlog[slot] = server_end;
+    listener->backlog_cnt++;
+    lock_release(&_sockets_lock);
+
+    wait_queue_wake_all(&listener->wait_queue);
     return 0;
+}
+
+/**
+ * Returns the oldest pending connection of the listener, the caller
+ * gets the reference which was held by the backlog.
+ */
+socket_t* socket_take_pending(socket_t* listener)
+{
+    lock_acquire(&_sockets_lock);
+    if (!listener->backlog_cnt) {
+        lock_release(&_sockets_lock);
+        return NULL;
+    }
+
+    socket_t* sock = listener->backlog[listener->backlog_start];
+    listener->backlog_start = (listener->backlog_start + 1) % SOCKET_BACKLOG_SIZE;
+    listener->backlog_cnt--;
+    lock_release(&_sockets_lock);
+    return sock;
+}
+
+bool socket_has_pending(socket_t* listener)
+{
+    return listener->backlog_cnt != 0;
+}
+
+/**
+ * Writers are limited by the free space in the buffer of the peer, so
+ * nothing is overwritten. One byte is kept free to tell a full buffer
+ * from an empty one.
+ */
+static inline uint32_t _socket_peer_space_lockless(socket_t* peer)
+{
+    uint32_t space = ringbuffer_space_to_write(&peer->buffer.ringbuffer);
+    return space ? space - 1 : 0;
+}
+
+uint32_t socket_space_to_write(socket_t* sock)
+{
+    lock_acquire(&_sockets_lock);
+    uint32_t space = 0;
+    socket_t* peer = sock->peer;
+    if (peer) {
+        lock_acquire(&peer->buffer.lock);
+        space = _socket_peer_space_lockless(peer);
+        lock_release(&peer->buffer.lock);
+    }
+    lock_release(&_sockets_lock);
+    return space;
+}
+
+/**
+ * Writes as much as fits into the buffer of the peer and returns
+ * the amount written, -EPIPE if the peer is gone.
+ */
+int socket_write_to_peer(socket_t* sock, const uint8_t* buf, uint32_t len)
+{
+    socket_t* peer = socket_get_peer(sock);
+    if (!peer) {
+        return -EPIPE;
+    }
+
+    lock_acquire(&peer->buffer.lock);
+    uint32_t space = _socket_peer_space_lockless(peer);
+    if (len > space) {
+        len = space;
+    }
+    uint32_t written = ringbuffer_write(&peer->buffer.ringbuffer, buf, len);
+    lock_release(&peer->buffer.lock);
+
+    if (written) {
+        wait_queue_wake_all(&peer->wait_queue);
+    }
+    socket_put(peer);
+    return written;
 }
\ No newline at end of file
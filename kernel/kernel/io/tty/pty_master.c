@@ -27,6 +27,7 @@ bool pty_master_can_write(dentry_t* dentry, uint32_t start);
 int pty_master_read(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 int pty_master_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len);
 int pty_master_fstat(dentry_t* dentry, fstat_t* stat);
+wait_queue_t* pty_master_wait_queue(dentry_t* dentry);
 
 static fs_ops_t pty_master_ops = {
     .recognize = 0,
@@ -54,6 +55,7 @@ static fs_ops_t pty_master_ops = {
         .fstat = pty_master_fstat,
         .ioctl = 0,
         .mmap = 0,
+        .wait_queue = pty_master_wait_queue,
     }
 };
 
@@ -106,9 +108,17 @@ int pty_master_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t le
     pty_master_entry_t* ptm = _ptm_get(dentry);
     ASSERT(ptm);
     sync_ringbuffer_write(&ptm->pts->buffer, buf, len);
+    wait_queue_wake_all(&ptm->pts->wait_queue);
     return len;
 }
 
+wait_queue_t* pty_master_wait_queue(dentry_t* dentry)
+{
+    pty_master_entry_t* ptm = _ptm_get(dentry);
+    ASSERT(ptm);
+    return &ptm->wait_queue;
+}
+
 int pty_master_fstat(dentry_t* dentry, fstat_t* stat)
 {
     pty_master_entry_t* ptm = _ptm_get(dentry);
@@ -143,12 +153,14 @@ int pty_master_alloc(file_descriptor_t* fd)
     ptm->dentry.flags = 0;
     dentry_set_flag(&ptm->dentry, DENTRY_CUSTOM);
     ptm->dentry.ops = &pty_master_ops;
+    wait_queue_init(&ptm->wait_queue);
 
     fd->dentry = &ptm->dentry;
     fd->ops = &pty_master_ops.file;
     fd->flags = 0;
     fd->offset = 0;
     fd->type = FD_TYPE_FILE;
+    fd->epoll_items = NULL;
 
     pty_slave_create(INODE2PTSNO(ptm->dentry.inode_indx), ptm);
     ptm->buffer = sync_ringbuffer_create_std();
@@ -53,6 +53,7 @@ int pty_slave_write(dentry_t* dentry, uint8_t* buf, uint32_t start, uint32_t len
     pty_slave_entry_t* pts = _pts_get(dentry);
     ASSERT(pts);
     sync_ringbuffer_write(&pts->ptm->buffer, buf, len);
+    wait_queue_wake_all(&pts->ptm->wait_queue);
     return len;
 }
 
@@ -61,6 +62,13 @@ int pty_slave_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
     return 0;
 }
 
+wait_queue_t* pty_slave_wait_queue(dentry_t* dentry)
+{
+    pty_slave_entry_t* pts = _pts_get(dentry);
+    ASSERT(pts);
+    return &pts->wait_queue;
+}
+
 int pty_slave_create(int id, pty_master_entry_t* ptm)
 {
     ASSERT(0 <= id && id < 10 && id <= PTYS_COUNT);
@@ -80,10 +88,12 @@ int pty_slave_create(int id, pty_master_entry_t* ptm)
         fops.read = pty_slave_read;
         fops.write = pty_slave_write;
         fops.ioctl = pty_slave_ioctl;
+        fops.wait_queue = pty_slave_wait_queue;
         devfs_inode_t* res = devfs_register(mp, MKDEV(136, id), name, 4, 0, &fops);
         pty_slaves[id].inode_indx = res->index;
         pty_slaves[id].ptm = ptm;
         pty_slaves[id].buffer = sync_ringbuffer_create_std();
+        wait_queue_init(&pty_slaves[id].wait_queue);
         ASSERT(pty_slaves[id].buffer.ringbuffer.zone.start);
         ptm->pts = &pty_slaves[id];
     } else {
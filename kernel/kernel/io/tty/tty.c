@@ -160,12 +160,18 @@ int tty_ioctl(dentry_t* dentry, uint32_t cmd, uint32_t arg)
         if (cmd == TCSETSF) {
             _tty_flush_input(tty);
         }
+        wait_queue_wake_all(&tty->wait_queue);
         return 0;
     }
 
     return -EINVAL;
 }
 
+wait_queue_t* tty_wait_queue(dentry_t* dentry)
+{
+    return &_tty_get(dentry)->wait_queue;
+}
+
 static void _tty_setup_termios(tty_entry_t* tty)
 {
     tty->termios.c_lflag |= ECHO | ICANON;
@@ -186,11 +192,13 @@ tty_entry_t* tty_new()
     fops.read = tty_read;
     fops.write = tty_write;
     fops.ioctl = tty_ioctl;
+    fops.wait_queue = tty_wait_queue;
     devfs_inode_t* res = devfs_register(mp, MKDEV(4, next_tty), name, 4, 0, &fops);
     ttys[next_tty].id = next_tty;
     ttys[next_tty].inode_indx = res->index;
     ttys[next_tty].buffer = sync_ringbuffer_create_std();
     ttys[next_tty].lines_avail = 0;
+    wait_queue_init(&ttys[next_tty].wait_queue);
     _tty_setup_termios(&ttys[next_tty]);
     if (!ttys[next_tty].buffer.ringbuffer.zone.start) {
         log_error("Error: tty buffer allocation");
@@ -235,4 +243,6 @@ void tty_eat_key(key_t key)
         sync_ringbuffer_write_one(&tty->buffer, (char)key);
         _tty_echo_key(tty, key);
     }
+
+    wait_queue_wake_all(&tty->wait_queue);
 }
\ No newline at end of file
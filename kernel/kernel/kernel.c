@@ -15,12 +15,14 @@
 #include <mem/kmalloc.h>
 #include <mem/pmm.h>
 
+#include <fs/bcache.h>
 #include <fs/devfs/devfs.h>
 #include <fs/ext2/ext2.h>
 #include <fs/procfs/procfs.h>
 #include <fs/vfs.h>
 
 #include <io/shared_buffer/shared_buffer.h>
+#include <io/sockets/socket.h>
 #include <io/tty/ptmx.h>
 #include <io/tty/tty.h>
 
@@ -51,6 +53,7 @@ static inline void wait_for_boot_cpu_to_finish(int* wt)
 void launching()
 {
     tasking_run_kernel_thread(dentry_flusher, NULL);
+    tasking_run_kernel_thread(bcache_flusher, NULL);
     tasking_start_init_proc();
     ksys1(SYS_EXIT, 0);
 }
@@ -85,6 +88,7 @@ void stage3(mem_desc_t* mem_desc)
 
     // ipc
     shared_buffer_init();
+    socket_init();
 
     // pty
     ptmx_install();
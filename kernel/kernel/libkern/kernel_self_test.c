@@ -1,12 +1,16 @@
 #ifdef __i386__
 
+#include <algo/bitmap.h>
 #include <drivers/x86/display.h>
 #include <libkern/kernel_self_test.h>
+#include <libkern/libkern.h>
 #include <mem/kmalloc.h>
 #include <mem/vmm/vmm.h>
 
 bool _test_kmalloc();
 bool _test_page_fault();
+bool _test_bitmap();
+bool _test_mem();
 
 bool _test_kmalloc()
 {
@@ -24,6 +28,103 @@ bool _test_page_fault()
     return *newpage == 8;
 }
 
+#define TEST_BITMAP_LEN 4096
+#define TEST_BITMAP_LIVE 256
+
+// _test_bitmap allocates and frees 100k runs of mixed sizes checking them
+// against a byte per bit.
+bool _test_bitmap()
+{
+    static uint32_t storage[BITMAP_SIZE(TEST_BITMAP_LEN) / sizeof(uint32_t)];
+    static uint8_t shadow[TEST_BITMAP_LEN];
+    static int live_start[TEST_BITMAP_LIVE];
+    static int live_len[TEST_BITMAP_LIVE];
+    memset(storage, 0, sizeof(storage));
+    memset(shadow, 0, sizeof(shadow));
+    bitmap_t bitmap = bitmap_wrap((uint8_t*)storage, TEST_BITMAP_LEN);
+
+    uint32_t seed = 1;
+    int live = 0;
+    for (int i = 0; i < 100000; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t rnd = seed >> 8;
+        if (live < TEST_BITMAP_LIVE && (rnd & 1)) {
+            int req = 1 + (rnd >> 1) % ((rnd & 6) ? 8 : 96);
+            int alignment = (rnd & 0x18) ? 1 : 8;
+            int start = bitmap_find_space_aligned(bitmap, req, alignment);
+            if (start < 0) {
+                continue;
+            }
+            if (start % alignment) {
+                return false;
+            }
+            for (int j = 0; j < req; j++) {
+                if (shadow[start + j]) {
+                    return false;
+                }
+                shadow[start + j] = 1;
+            }
+            bitmap_set_range(bitmap, start, req);
+            live_start[live] = start;
+            live_len[live] = req;
+            live++;
+        } else if (live) {
+            int k = (rnd >> 1) % live;
+            bitmap_unset_range(bitmap, live_start[k], live_len[k]);
+            memset(&shadow[live_start[k]], 0, live_len[k]);
+            live--;
+            live_start[k] = live_start[live];
+            live_len[k] = live_len[live];
+        }
+    }
+
+    for (int j = 0; j < TEST_BITMAP_LEN; j++) {
+        bool bit = (storage[j / 32] >> (j % 32)) & 1;
+        if (bit != shadow[j]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define TEST_MEM_LEN 512
+
+// _test_mem runs copies, fills and moves with all head and tail alignments
+// checking them byte by byte.
+bool _test_mem()
+{
+    static uint8_t buf[TEST_MEM_LEN];
+    static uint8_t ref[TEST_MEM_LEN];
+    for (int len = 0; len < 80; len++) {
+        for (int off = 0; off < 8; off++) {
+            for (int i = 0; i < TEST_MEM_LEN; i++) {
+                buf[i] = ref[i] = i * 7;
+            }
+            memcpy(&buf[256 + off], &buf[3], len);
+            for (int i = 0; i < len; i++) {
+                ref[256 + off + i] = ref[3 + i];
+            }
+            memset(&buf[128 + off], off, len);
+            for (int i = 0; i < len; i++) {
+                ref[128 + off + i] = off;
+            }
+            memmove(&buf[off + 1], &buf[off], len);
+            for (int i = len - 1; i >= 0; i--) {
+                ref[off + 1 + i] = ref[off + i];
+            }
+            if (memcmp(buf, ref, TEST_MEM_LEN)) {
+                return false;
+            }
+            ref[off + len] ^= 1;
+            if (len && memcmp(&buf[off + 1], &ref[off + 1], len) == 0) {
+                return false;
+            }
+            ref[off + len] ^= 1;
+        }
+    }
+    return strlen((char*)"pranaOS kernel") == 14;
+}
+
 void kpanic_at_test(char* t_err_msg, uint16_t test_no)
 {
     while (1) { }
@@ -34,6 +135,8 @@ bool kernel_self_test(bool throw_kernel_panic)
     void* active_test[] = {
         _test_kmalloc,
         _test_page_fault,
+        _test_bitmap,
+        _test_mem,
         0 // end sign
     };
 
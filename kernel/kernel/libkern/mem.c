@@ -7,35 +7,90 @@
 #include <libkern/libkern.h>
 #include <mem/kmalloc.h>
 
+/* Word-at-a-time routines access memory through this type, so the compiler
+   doesn't assume it can't alias the bytes of the buffers. */
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+#define WORD_MASK (sizeof(word_t) - 1)
+
 #ifdef __i386__
+/**
+ * The kernel doesn't touch SSE registers, FPU state is saved lazily for
+ * userspace. String instructions are fast once the destination is aligned.
+ */
 void* memset(void* dest, uint8_t fll, uint32_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i) {
-        *((uint8_t*)dest + i) = fll;
+    void* ret = dest;
+    uint32_t pattern = fll * 0x01010101u;
+    if (nbytes >= 16) {
+        uint32_t head = (-(uint32_t)dest) & WORD_MASK;
+        uint32_t words = (nbytes - head) >> 2;
+        nbytes = (nbytes - head) & WORD_MASK;
+        asm volatile("rep stosb"
+                     : "+D"(dest), "+c"(head)
+                     : "a"(pattern)
+                     : "memory");
+        asm volatile("rep stosl"
+                     : "+D"(dest), "+c"(words)
+                     : "a"(pattern)
+                     : "memory");
     }
-    return dest;
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(nbytes)
+                 : "a"(pattern)
+                 : "memory");
+    return ret;
 }
-#endif
 
 void* memcpy(void* dest, const void* src, uint32_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i) {
-        *(char*)(dest + i) = *(char*)(src + i);
+    void* ret = dest;
+    if (nbytes >= 16) {
+        uint32_t head = (-(uint32_t)dest) & WORD_MASK;
+        uint32_t words = (nbytes - head) >> 2;
+        nbytes = (nbytes - head) & WORD_MASK;
+        asm volatile("rep movsb"
+                     : "+D"(dest), "+S"(src), "+c"(head)
+                     :
+                     : "memory");
+        asm volatile("rep movsl"
+                     : "+D"(dest), "+S"(src), "+c"(words)
+                     :
+                     : "memory");
     }
-    return dest;
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(nbytes)
+                 :
+                 : "memory");
+    return ret;
 }
+#endif
 
+/**
+ * memcpy copies forward and reads a block before writing it, so it's used
+ * when the destination is lower.
+ */
 void* memmove(void* dest, const void* src, uint32_t nbytes)
 {
-    if (src > dest) {
-        for (int i = 0; i < nbytes; ++i) {
-            *((uint8_t*)dest + i) = *((uint8_t*)src + i);
+    if (dest <= src || (uint8_t*)dest >= (uint8_t*)src + nbytes) {
+        return memcpy(dest, src, nbytes);
+    }
+
+    uint8_t* d = (uint8_t*)dest + nbytes;
+    const uint8_t* s = (const uint8_t*)src + nbytes;
+    if ((((uint32_t)d ^ (uint32_t)s) & WORD_MASK) == 0) {
+        while (nbytes && ((uint32_t)d & WORD_MASK)) {
+            *--d = *--s;
+            nbytes--;
         }
-    } else {
-        for (int i = nbytes - 1; i >= 0; --i) {
-            *((uint8_t*)dest + i) = *((uint8_t*)src + i);
+        for (; nbytes >= sizeof(word_t); nbytes -= sizeof(word_t)) {
+            d -= sizeof(word_t), s -= sizeof(word_t);
+            *(word_t*)d = *(const word_t*)s;
         }
     }
+
+    while (nbytes--) {
+        *--d = *--s;
+    }
     return dest;
 }
 
@@ -52,11 +107,26 @@ void* memccpy(void* dest, const void* src, uint8_t stop, uint32_t nbytes)
 
 int memcmp(const void* src1, const void* src2, uint32_t nbytes)
 {
-    for (int i = 0; i < nbytes; ++i) {
-        if (*(uint8_t*)(src1 + i) < *((uint8_t*)src2 + i)) {
+    const uint8_t* first = src1;
+    const uint8_t* second = src2;
+
+    // Equal words are skipped, the first different one is compared by bytes.
+    if ((((uint32_t)first ^ (uint32_t)second) & WORD_MASK) == 0) {
+        while (nbytes && ((uint32_t)first & WORD_MASK) && *first == *second) {
+            first++, second++, nbytes--;
+        }
+        if (!((uint32_t)first & WORD_MASK)) {
+            while (nbytes >= sizeof(word_t) && *(const word_t*)first == *(const word_t*)second) {
+                first += sizeof(word_t), second += sizeof(word_t), nbytes -= sizeof(word_t);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < nbytes; ++i) {
+        if (first[i] < second[i]) {
             return -1;
         }
-        if (*(uint8_t*)(src1 + i) > *(uint8_t*)(src2 + i)) {
+        if (first[i] > second[i]) {
             return 1;
         }
     }
@@ -69,12 +69,31 @@ void reverse(char s[])
     }
 }
 
+/**
+ * Aligned words never cross a page, so the word with the terminator is read
+ * as a whole.
+ */
 uint32_t strlen(const char* s)
 {
-    uint32_t i = 0;
-    while (s[i] != '\0')
-        ++i;
-    return i;
+    typedef uint32_t __attribute__((__may_alias__)) word_t;
+    const char* ptr = s;
+    while ((uint32_t)ptr & (sizeof(word_t) - 1)) {
+        if (*ptr == '\0') {
+            return ptr - s;
+        }
+        ptr++;
+    }
+
+    const word_t* word = (const word_t*)ptr;
+    while (!((*word - 0x01010101u) & ~*word & 0x80808080u)) {
+        word++;
+    }
+
+    ptr = (const char*)word;
+    while (*ptr != '\0') {
+        ptr++;
+    }
+    return ptr - s;
 }
 
 int strcmp(const char* a, const char* b)
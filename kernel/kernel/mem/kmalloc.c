@@ -5,73 +5,363 @@
  */
 
 #include <algo/bitmap.h>
+#include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
 #include <mem/vmm/zoner.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
 
-struct kmalloc_header {
-    uint32_t len;
+/**
+ * The kmalloc space is split into pages. Small objects live in slabs of
+ * object caches: every cache cuts its slabs into objects of one size and
+ * keeps a magazine of free objects per cpu, so most allocations and frees
+ * never touch the cache lock. Sizes above KMALLOC_MAX_CACHED_SIZE get a run
+ * of pages. The owner of every page is kept in a page descriptor, so kfree
+ * finds the slab of an object without any headers.
+ */
+
+struct kmem_slab {
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+    kmem_cache_t* cache;
+    void* free_objects;
+    uint8_t* untouched; // Objects from here to the end of the slab were never given out.
+    uint32_t used;
+};
+typedef struct kmem_slab kmem_slab_t;
+
+#define KMEM_SLAB_HEADER_SIZE ((sizeof(kmem_slab_t) + 15) & ~15)
+
+struct kmem_magazine {
+    uint32_t count;
+    void* objects[KMEM_MAGAZINE_SIZE];
 };
-typedef struct kmalloc_header kmalloc_header_t;
+typedef struct kmem_magazine kmem_magazine_t;
+
+struct kmem_cache {
+    const char* name;
+    uint32_t object_size;
+    uint32_t slab_pages;
+    uint32_t objects_per_slab;
+
+    lock_t lock;
+    kmem_slab_t* partial_slabs;
+    uint32_t slabs;
+    uint32_t objects_out; // Taken from slabs, including ones held by magazines.
+    kmem_magazine_t magazines[CPU_CNT];
+
+    struct kmem_cache* next;
+};
+
+struct kmalloc_page {
+    kmem_slab_t* slab;
+    uint32_t run_len; // Set on the first page of a run which is not a slab.
+};
+typedef struct kmalloc_page kmalloc_page_t;
 
 static lock_t _kmalloc_lock;
 static zone_t _kmalloc_zone;
-static uint32_t _kmalloc_bitmap_len = 0;
-static uint8_t* _kmalloc_bitmap;
+static uint32_t _kmalloc_bitmap[BITMAP_SIZE(KMALLOC_PAGES) / sizeof(uint32_t)];
 static bitmap_t bitmap;
+static kmalloc_page_t _kmalloc_pages[KMALLOC_PAGES];
+static uint32_t _kmalloc_large_pages = 0;
 
-static inline uint32_t kmalloc_to_vaddr(int start)
+static lock_t _kmem_caches_lock;
+static kmem_cache_t* _kmem_caches;
+static kmem_cache_t _kmalloc_generic_caches[KMALLOC_GENERIC_CACHES];
+static const char* _kmalloc_generic_names[KMALLOC_GENERIC_CACHES] = {
+    "kmalloc-16",
+    "kmalloc-32",
+    "kmalloc-64",
+    "kmalloc-128",
+    "kmalloc-256",
+    "kmalloc-512",
+    "kmalloc-1024",
+    "kmalloc-2048",
+};
+
+static inline uint32_t kmalloc_to_vaddr(int page)
 {
-    uint32_t vaddr = (uint32_t)_kmalloc_zone.start + start * KMALLOC_BLOCK_SIZE;
-    return (uint32_t)_kmalloc_zone.start + start * KMALLOC_BLOCK_SIZE;
+    return (uint32_t)_kmalloc_zone.start + page * VMM_PAGE_SIZE;
 }
 
 static inline int kmalloc_to_index(uint32_t vaddr)
 {
-    return (vaddr - (uint32_t)_kmalloc_zone.start) / KMALLOC_BLOCK_SIZE;
+    return (vaddr - (uint32_t)_kmalloc_zone.start) / VMM_PAGE_SIZE;
+}
+
+/**
+ * PAGES
+ */
+
+static int _kmalloc_alloc_pages(uint32_t count)
+{
+    lock_acquire(&_kmalloc_lock);
+    int start = bitmap_find_space(bitmap, count);
+    if (start < 0) {
+        log_error("[Err] NO SPACE AT KMALLOC");
+        system_stop();
+    }
+    bitmap_set_range(bitmap, start, count);
+    lock_release(&_kmalloc_lock);
+    return start;
 }
 
-static void _kmalloc_init_bitmap()
+static void _kmalloc_free_pages(int start, uint32_t count)
 {
-    _kmalloc_bitmap = (uint8_t*)_kmalloc_zone.start;
-    _kmalloc_bitmap_len = (KMALLOC_SPACE_SIZE / KMALLOC_BLOCK_SIZE / 8);
+    lock_acquire(&_kmalloc_lock);
+    for (uint32_t i = 0; i < count; i++) {
+        _kmalloc_pages[start + i].slab = NULL;
+        _kmalloc_pages[start + i].run_len = 0;
+    }
+    bitmap_unset_range(bitmap, start, count);
+    lock_release(&_kmalloc_lock);
+}
 
-    bitmap = bitmap_wrap(_kmalloc_bitmap, _kmalloc_bitmap_len);
-    memset(_kmalloc_bitmap, 0, _kmalloc_bitmap_len);
+/**
+ * SLABS
+ */
 
-    /* Setting bitmap as a busy region. */
-    int blocks_needed = (_kmalloc_bitmap_len + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
-    bitmap_set_range(bitmap, kmalloc_to_index((uint32_t)_kmalloc_bitmap), blocks_needed);
+static inline void _kmem_slab_link(kmem_cache_t* cache, kmem_slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = cache->partial_slabs;
+    if (cache->partial_slabs) {
+        cache->partial_slabs->prev = slab;
+    }
+    cache->partial_slabs = slab;
+}
+
+static inline void _kmem_slab_unlink(kmem_cache_t* cache, kmem_slab_t* slab)
+{
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        cache->partial_slabs = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static kmem_slab_t* _kmem_slab_create_lockless(kmem_cache_t* cache)
+{
+    int start = _kmalloc_alloc_pages(cache->slab_pages);
+    kmem_slab_t* slab = (kmem_slab_t*)kmalloc_to_vaddr(start);
+    for (uint32_t i = 0; i < cache->slab_pages; i++) {
+        _kmalloc_pages[start + i].slab = slab;
+    }
+
+    slab->cache = cache;
+    slab->free_objects = NULL;
+    slab->untouched = (uint8_t*)slab + KMEM_SLAB_HEADER_SIZE;
+    slab->used = 0;
+    cache->slabs++;
+    _kmem_slab_link(cache, slab);
+    return slab;
+}
+
+static void* _kmem_slab_take_lockless(kmem_cache_t* cache)
+{
+    kmem_slab_t* slab = cache->partial_slabs;
+    if (!slab) {
+        slab = _kmem_slab_create_lockless(cache);
+    }
+
+    void* obj = slab->free_objects;
+    if (obj) {
+        slab->free_objects = *(void**)obj;
+    } else {
+        obj = slab->untouched;
+        slab->untouched += cache->object_size;
+    }
+
+    slab->used++;
+    cache->objects_out++;
+    if (slab->used == cache->objects_per_slab) {
+        _kmem_slab_unlink(cache, slab);
+    }
+    return obj;
+}
+
+/**
+ * Returns the object to its slab. An empty slab gives its pages back,
+ * unless it is the last slab with free objects in the cache.
+ */
+static void _kmem_slab_put_lockless(kmem_cache_t* cache, void* obj)
+{
+    kmem_slab_t* slab = _kmalloc_pages[kmalloc_to_index((uint32_t)obj)].slab;
+    if (slab->used == cache->objects_per_slab) {
+        _kmem_slab_link(cache, slab);
+    }
+
+    *(void**)obj = slab->free_objects;
+    slab->free_objects = obj;
+    slab->used--;
+    cache->objects_out--;
+
+    if (!slab->used && (slab->prev || slab->next)) {
+        _kmem_slab_unlink(cache, slab);
+        cache->slabs--;
+        _kmalloc_free_pages(kmalloc_to_index((uint32_t)slab), cache->slab_pages);
+    }
+}
+
+/**
+ * CACHES
+ */
+
+static void _kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size)
+{
+    memset(cache, 0, sizeof(kmem_cache_t));
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+
+    uint32_t slab_size = KMEM_SLAB_HEADER_SIZE + KMEM_MIN_OBJECTS_PER_SLAB * size;
+    cache->name = name;
+    cache->object_size = size;
+    cache->slab_pages = (slab_size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    cache->objects_per_slab = (cache->slab_pages * VMM_PAGE_SIZE - KMEM_SLAB_HEADER_SIZE) / size;
+    lock_init(&cache->lock);
+
+    lock_acquire(&_kmem_caches_lock);
+    cache->next = _kmem_caches;
+    _kmem_caches = cache;
+    lock_release(&_kmem_caches_lock);
+}
+
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size)
+{
+    kmem_cache_t* cache = kmalloc(sizeof(kmem_cache_t));
+    _kmem_cache_init(cache, name, size);
+    return cache;
+}
+
+/**
+ * Magazines are per cpu and are touched only with interrupts disabled.
+ * An empty magazine is refilled with a half of its size from slabs, a full
+ * one gives a half back, so the cache lock is taken once per several calls.
+ */
+void* kmem_cache_alloc(kmem_cache_t* cache)
+{
+    system_disable_interrupts();
+    kmem_magazine_t* magazine = &cache->magazines[system_cpu_id()];
+    if (!magazine->count) {
+        lock_acquire(&cache->lock);
+        while (magazine->count < KMEM_MAGAZINE_SIZE / 2) {
+            magazine->objects[magazine->count++] = _kmem_slab_take_lockless(cache);
+        }
+        lock_release(&cache->lock);
+    }
+
+    void* obj = magazine->objects[--magazine->count];
+    system_enable_interrupts();
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* ptr)
+{
+    system_disable_interrupts();
+    kmem_magazine_t* magazine = &cache->magazines[system_cpu_id()];
+    if (magazine->count == KMEM_MAGAZINE_SIZE) {
+        lock_acquire(&cache->lock);
+        while (magazine->count > KMEM_MAGAZINE_SIZE / 2) {
+            _kmem_slab_put_lockless(cache, magazine->objects[--magazine->count]);
+        }
+        lock_release(&cache->lock);
+    }
+
+    magazine->objects[magazine->count++] = ptr;
+    system_enable_interrupts();
+}
+
+int kmem_cache_get_stat(int index, kmem_cache_stat_t* stat)
+{
+    lock_acquire(&_kmem_caches_lock);
+    kmem_cache_t* cache = _kmem_caches;
+    for (int i = 0; cache && i < index; i++) {
+        cache = cache->next;
+    }
+    if (!cache) {
+        lock_release(&_kmem_caches_lock);
+        return -ENOENT;
+    }
+
+    lock_acquire(&cache->lock);
+    uint32_t in_magazines = 0;
+    for (int i = 0; i < CPU_CNT; i++) {
+        in_magazines += cache->magazines[i].count;
+    }
+    stat->name = cache->name;
+    stat->object_size = cache->object_size;
+    stat->active_objects = cache->objects_out - in_magazines;
+    stat->total_objects = cache->slabs * cache->objects_per_slab;
+    stat->slabs = cache->slabs;
+    lock_release(&cache->lock);
+
+    lock_release(&_kmem_caches_lock);
+    return 0;
+}
+
+uint32_t kmalloc_large_pages()
+{
+    return _kmalloc_large_pages;
+}
+
+/**
+ * KMALLOC
+ */
+
+static inline kmem_cache_t* _kmalloc_generic_cache(uint32_t size)
+{
+    int index = 0;
+    if (size > (1 << KMALLOC_MIN_CACHE_SHIFT)) {
+        index = 32 - __builtin_clz(size - 1) - KMALLOC_MIN_CACHE_SHIFT;
+    }
+    return &_kmalloc_generic_caches[index];
+}
+
+static inline uint32_t _kmalloc_usable_size(void* ptr)
+{
+    kmalloc_page_t* page = &_kmalloc_pages[kmalloc_to_index((uint32_t)ptr)];
+    if (page->slab) {
+        return page->slab->cache->object_size;
+    }
+    return page->run_len * VMM_PAGE_SIZE;
 }
 
 void kmalloc_init()
 {
     lock_init(&_kmalloc_lock);
+    lock_init(&_kmem_caches_lock);
     _kmalloc_zone = zoner_new_zone(KMALLOC_SPACE_SIZE);
-    _kmalloc_init_bitmap();
+    memset(_kmalloc_bitmap, 0, sizeof(_kmalloc_bitmap));
+    bitmap = bitmap_wrap((uint8_t*)_kmalloc_bitmap, KMALLOC_PAGES);
+    memset(_kmalloc_pages, 0, sizeof(_kmalloc_pages));
+
+    for (int i = KMALLOC_GENERIC_CACHES - 1; i >= 0; i--) {
+        _kmem_cache_init(&_kmalloc_generic_caches[i], _kmalloc_generic_names[i], 1 << (KMALLOC_MIN_CACHE_SHIFT + i));
+    }
 }
 
 void* kmalloc(uint32_t size)
 {
-    lock_acquire(&_kmalloc_lock);
-    int act_size = size + sizeof(kmalloc_header_t);
-
-    int blocks_needed = (act_size + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
-
-    int start = bitmap_find_space(bitmap, blocks_needed);
-    if (start < 0) {
-        log_error("[Err] NO SPACE AT KMALLOC");
-        system_stop();
+    if (size <= KMALLOC_MAX_CACHED_SIZE) {
+        return kmem_cache_alloc(_kmalloc_generic_cache(size));
     }
 
-    kmalloc_header_t* space = (kmalloc_header_t*)kmalloc_to_vaddr(start);
-    space->len = act_size;
-    bitmap_set_range(bitmap, start, blocks_needed);
-
-    lock_release(&_kmalloc_lock);
-    return (void*)&space[1];
+    uint32_t pages = (size + VMM_PAGE_SIZE - 1) / VMM_PAGE_SIZE;
+    int start = _kmalloc_alloc_pages(pages);
+    _kmalloc_pages[start].run_len = pages;
+    __atomic_add_fetch(&_kmalloc_large_pages, pages, __ATOMIC_RELAXED);
+    return (void*)kmalloc_to_vaddr(start);
 }
 
 void* kmalloc_aligned(uint32_t size, uint32_t alignment)
@@ -90,11 +380,20 @@ void* kmalloc_page_aligned()
 
 void kfree(void* ptr)
 {
-    kmalloc_header_t* sptr = (kmalloc_header_t*)ptr;
-    int blocks_to_delete = (sptr[-1].len + KMALLOC_BLOCK_SIZE - 1) / KMALLOC_BLOCK_SIZE;
-    lock_acquire(&_kmalloc_lock);
-    bitmap_unset_range(bitmap, kmalloc_to_index((uint32_t)&sptr[-1]), blocks_to_delete);
-    lock_release(&_kmalloc_lock);
+    if (!ptr) {
+        return;
+    }
+
+    int index = kmalloc_to_index((uint32_t)ptr);
+    kmem_slab_t* slab = _kmalloc_pages[index].slab;
+    if (slab) {
+        kmem_cache_free(slab->cache, ptr);
+        return;
+    }
+
+    uint32_t pages = _kmalloc_pages[index].run_len;
+    __atomic_sub_fetch(&_kmalloc_large_pages, pages, __ATOMIC_RELAXED);
+    _kmalloc_free_pages(index, pages);
 }
 
 void kfree_aligned(void* ptr)
@@ -104,8 +403,8 @@ void kfree_aligned(void* ptr)
 
 void* krealloc(void* ptr, uint32_t new_size)
 {
-    uint32_t old_size = ((kmalloc_header_t*)ptr)[-1].len;
-    if (old_size == new_size) {
+    uint32_t old_size = _kmalloc_usable_size(ptr);
+    if (new_size <= old_size && (new_size > old_size / 2 || old_size <= (1 << KMALLOC_MIN_CACHE_SHIFT))) {
         return ptr;
     }
 
@@ -114,8 +413,8 @@ void* krealloc(void* ptr, uint32_t new_size)
         return 0;
     }
 
-    memcpy(new_area, ptr, new_size > old_size ? new_size : old_size);
+    memcpy(new_area, ptr, new_size < old_size ? new_size : old_size);
     kfree(ptr);
 
     return new_area;
-}
\ No newline at end of file
+}
@@ -1,5 +1,23 @@
+#include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/pmm.h>
+#include <platform/generic/cpu.h>
+#include <platform/generic/system.h>
+
+// Physical memory is handed out by a buddy allocator. Free memory is kept
+// in chunks of 2^order blocks, naturally aligned, one free list per order.
+// A chunk is split in halves to serve smaller requests and is merged back
+// with its buddy once both are free, so allocations and frees touch at most
+// PMM_MAX_ORDER lists. Single pages are cached per cpu in hot lists, which
+// serve page faults and page tables without taking the lock.
+//
+// The free lists need a table of links per block, which is mapped by the VMM
+// once the kernel address space is ready. Till then blocks are found with a
+// next-fit scan of the MAT (Memory allocation table), which still marks
+// every block that is not in the free lists.
+
+#define PMM_NO_BLOCK 0xffffffff
+#define PMM_HOT_BLOCKS_COUNT (1 << PMM_HOT_ORDER)
 
 // [Privates Prototypes]
 static inline uint32_t _pmm_round_ceil(uint32_t value);
@@ -7,14 +25,36 @@ static inline uint32_t _pmm_round_floor(uint32_t value);
 static inline void _pmm_mat_alloc_block(uint32_t block_id);
 static inline void _pmm_mat_free_block(uint32_t block_id);
 static inline bool _pmm_mat_tesblock(uint32_t block_id);
-uint32_t _pmm_first_free_block();
-uint32_t _pmm_first_free_block_n(uint32_t t_size);
+static void _pmm_mat_fill(uint32_t block_id, uint32_t t_size, bool used);
 void _pmm_init_region(uint32_t t_region_start, uint32_t t_region_length);
 void _pmm_deinit_region(uint32_t t_region_start, uint32_t t_region_length);
 void _pmm_deinit_mat();
 void _pmm_calc_ram_size(mem_desc_t* mem_desc);
 void _pmm_allocate_mat(void* t_mat_base);
-static int last_i = 0;
+static inline void _pmm_frame_refs_fill(uint32_t block_id, uint32_t t_size, pmm_frame_ref_t val);
+
+struct pmm_hot_list {
+    uint32_t count;
+    uint32_t blocks[PMM_HOT_LIST_SIZE];
+};
+typedef struct pmm_hot_list pmm_hot_list_t;
+
+static lock_t _pmm_lock;
+static uint32_t _pmm_boot_hint = 0;
+
+// The buddy table: links of the free lists and order + 1 of the chunk
+// which starts at the block, 0 if the block does not start a free chunk.
+static bool _pmm_buddy_ready = false;
+static uint32_t* _pmm_buddy_next;
+static uint32_t* _pmm_buddy_prev;
+static uint8_t* _pmm_buddy_order;
+static uint32_t _pmm_free_lists[PMM_MAX_ORDER + 1];
+static pmm_hot_list_t _pmm_hot_lists[CPU_CNT];
+
+// pmm_frame_refs holds a reference counter per block. It is set up by
+// the VMM once the kernel address space is ready, blocks allocated before
+// that have a zero counter, which is treated as a single owner.
+static pmm_frame_ref_t* pmm_frame_refs = NULL;
 
 static inline uint32_t _pmm_round_ceil(uint32_t value)
 {
@@ -42,81 +82,320 @@ static inline void _pmm_mat_free_block(uint32_t block_id)
     pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] &= ~(1 << (block_id % PMM_BLOCKS_PER_BYTE));
 }
 
-// _pmm_mat_tesblock returns if the block is free
+// _pmm_mat_tesblock returns if the block is taken
 static inline bool _pmm_mat_tesblock(uint32_t block_id)
 {
     return (pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] >> (block_id % PMM_BLOCKS_PER_BYTE)) & 1;
 }
 
-// _pmm_first_free_block returns block_id
-uint32_t _pmm_first_free_block()
+// _pmm_mat_fill marks @t_size blocks in the MAT, whole bytes at once
+static void _pmm_mat_fill(uint32_t block_id, uint32_t t_size, bool used)
 {
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        // log("W %x", &mat_big[i]);
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                if (!_pmm_mat_tesblock(currenblock)) {
-                    // last_i = pmm_mat_size / 8;
-                    return currenblock;
-                }
+    while (t_size) {
+        if (t_size >= PMM_BLOCKS_PER_BYTE && block_id % PMM_BLOCKS_PER_BYTE == 0) {
+            pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] = used ? 0xff : 0;
+            t_size -= PMM_BLOCKS_PER_BYTE;
+            block_id += PMM_BLOCKS_PER_BYTE;
+        } else {
+            if (used) {
+                _pmm_mat_alloc_block(block_id);
+            } else {
+                _pmm_mat_free_block(block_id);
             }
+            t_size -= 1;
+            block_id += 1;
         }
     }
-    return 0x0;
 }
 
-// _pmm_first_free_block_n returns block_id of block sequence
-uint32_t _pmm_first_free_block_n(uint32_t t_size)
-{
-    if (t_size == 1) {
-        return _pmm_first_free_block();
-    }
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                uint32_t free = 0;
-                for (uint32_t x = 0; x < t_size; x++) {
-                    if (!_pmm_mat_tesblock(currenblock + x)) {
-                        free++;
-                    }
-                }
-                if (free == t_size) {
-                    // last_i = pmm_mat_size / 8;
-                    return currenblock;
-                }
+static inline void _pmm_frame_refs_fill(uint32_t block_id, uint32_t t_size, pmm_frame_ref_t val)
+{
+    if (!pmm_frame_refs) {
+        return;
+    }
+    for (uint32_t i = 0; i < t_size; i++) {
+        pmm_frame_refs[block_id + i] = val;
+    }
+}
+
+static inline uint32_t _pmm_order_of(uint32_t t_size)
+{
+    if (t_size <= 1) {
+        return 0;
+    }
+    return 32 - __builtin_clz(t_size - 1);
+}
+
+/**
+ * BOOT ALLOCATION
+ */
+
+// _pmm_boot_alloc_blocks returns block_id of a free sequence found with a
+// next-fit scan. Used only till the free lists are set up.
+static uint32_t _pmm_boot_alloc_blocks(uint32_t t_size, uint32_t alignment)
+{
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t block_id = pass ? 0 : _pmm_boot_hint;
+        block_id = (block_id + alignment - 1) & ~(alignment - 1);
+        while (block_id + t_size <= pmm_max_blocks) {
+            uint32_t x = 0;
+            while (x < t_size && !_pmm_mat_tesblock(block_id + x)) {
+                x++;
+            }
+            if (x == t_size) {
+                _pmm_mat_fill(block_id, t_size, true);
+                _pmm_boot_hint = block_id + t_size;
+                return block_id;
             }
+            // Blocks before the taken one could not start the sequence.
+            block_id = (block_id + x + 1 + alignment - 1) & ~(alignment - 1);
         }
     }
     return 0x0;
 }
 
-uint32_t _pmm_first_free_block_n_aligned(uint32_t t_size, uint32_t alignment)
-{
-    uint32_t* mat_big = (uint32_t*)pmm_mat;
-    for (uint32_t i = last_i; i < pmm_mat_size / 4; i++) {
-        if (mat_big[i] != 0xffffffff) {
-            for (uint8_t j = 0; j < 32; j++) {
-                uint32_t currenblock = i * 32 + j;
-                uint32_t free = 0;
-                if (currenblock % alignment == 0) {
-                    for (uint32_t x = 0; x < t_size; x++) {
-                        if (!_pmm_mat_tesblock(currenblock + x)) {
-                            free++;
-                        }
-                    }
-                    if (free == t_size) {
-                        // last_i = pmm_mat_size / 8;
-                        return currenblock;
-                    }
-                }
+static void _pmm_boot_free_blocks(uint32_t block_id, uint32_t t_size)
+{
+    _pmm_mat_fill(block_id, t_size, false);
+    if (block_id < _pmm_boot_hint) {
+        _pmm_boot_hint = block_id;
+    }
+}
+
+/**
+ * BUDDY ALLOCATION
+ */
+
+static inline void _pmm_buddy_link(uint32_t block_id, uint32_t order)
+{
+    uint32_t head = _pmm_free_lists[order];
+    _pmm_buddy_prev[block_id] = PMM_NO_BLOCK;
+    _pmm_buddy_next[block_id] = head;
+    if (head != PMM_NO_BLOCK) {
+        _pmm_buddy_prev[head] = block_id;
+    }
+    _pmm_free_lists[order] = block_id;
+    _pmm_buddy_order[block_id] = order + 1;
+}
+
+static inline void _pmm_buddy_unlink(uint32_t block_id, uint32_t order)
+{
+    uint32_t prev = _pmm_buddy_prev[block_id];
+    uint32_t next = _pmm_buddy_next[block_id];
+    if (prev != PMM_NO_BLOCK) {
+        _pmm_buddy_next[prev] = next;
+    } else {
+        _pmm_free_lists[order] = next;
+    }
+    if (next != PMM_NO_BLOCK) {
+        _pmm_buddy_prev[next] = prev;
+    }
+    _pmm_buddy_order[block_id] = 0;
+}
+
+// _pmm_buddy_put_chunk returns a chunk to the free lists merging it with
+// its free buddies. The MAT should be already updated by the caller.
+static void _pmm_buddy_put_chunk(uint32_t block_id, uint32_t order)
+{
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy_id = block_id ^ (1 << order);
+        if (buddy_id >= pmm_max_blocks || _pmm_buddy_order[buddy_id] != order + 1) {
+            break;
+        }
+        _pmm_buddy_unlink(buddy_id, order);
+        block_id &= ~(1 << order);
+        order++;
+    }
+    _pmm_buddy_link(block_id, order);
+}
+
+// _pmm_buddy_put_blocks returns a sequence of any length, it is cut into
+// the biggest aligned chunks.
+static void _pmm_buddy_put_blocks(uint32_t block_id, uint32_t t_size)
+{
+    while (t_size) {
+        uint32_t order = block_id ? __builtin_ctz(block_id) : PMM_MAX_ORDER;
+        if (order > PMM_MAX_ORDER) {
+            order = PMM_MAX_ORDER;
+        }
+        while ((1U << order) > t_size) {
+            order--;
+        }
+        _pmm_buddy_put_chunk(block_id, order);
+        block_id += (1 << order);
+        t_size -= (1 << order);
+    }
+}
+
+// _pmm_buddy_take_chunk returns block_id of a chunk of 2^@order blocks,
+// splitting a bigger chunk if needed.
+static uint32_t _pmm_buddy_take_chunk(uint32_t order)
+{
+    uint32_t cur_order = order;
+    while (cur_order <= PMM_MAX_ORDER && _pmm_free_lists[cur_order] == PMM_NO_BLOCK) {
+        cur_order++;
+    }
+    if (cur_order > PMM_MAX_ORDER) {
+        return PMM_NO_BLOCK;
+    }
+
+    uint32_t block_id = _pmm_free_lists[cur_order];
+    _pmm_buddy_unlink(block_id, cur_order);
+    while (cur_order > order) {
+        cur_order--;
+        _pmm_buddy_link(block_id + (1 << cur_order), cur_order);
+    }
+    return block_id;
+}
+
+static uint32_t _pmm_buddy_alloc_blocks(uint32_t t_size, uint32_t alignment)
+{
+    uint32_t order = _pmm_order_of(t_size);
+    uint32_t align_order = _pmm_order_of(alignment);
+    if (align_order > order) {
+        order = align_order;
+    }
+    if (order > PMM_MAX_ORDER) {
+        return 0x0;
+    }
+
+    uint32_t block_id = _pmm_buddy_take_chunk(order);
+    if (block_id == PMM_NO_BLOCK) {
+        return 0x0;
+    }
+
+    // The tail of the chunk is not needed, so it goes back.
+    uint32_t chunk_size = 1 << order;
+    _pmm_mat_fill(block_id, t_size, true);
+    if (chunk_size > t_size) {
+        _pmm_buddy_put_blocks(block_id + t_size, chunk_size - t_size);
+    }
+    return block_id;
+}
+
+static void _pmm_buddy_free_blocks(uint32_t block_id, uint32_t t_size)
+{
+    _pmm_mat_fill(block_id, t_size, false);
+    _pmm_buddy_put_blocks(block_id, t_size);
+}
+
+/**
+ * HOT LISTS
+ *
+ * Every cpu caches chunks of 2^PMM_HOT_ORDER blocks, the size of a VMM page.
+ * Hot lists are touched only with interrupts disabled. An empty list takes
+ * a half of PMM_HOT_LIST_SIZE chunks and a full one gives a half back, so the
+ * lock is taken once per several calls. Cached chunks are marked as taken
+ * in the MAT, but are counted as free ones.
+ */
+
+static uint32_t _pmm_hot_alloc()
+{
+    uint32_t block_id = 0x0;
+    system_disable_interrupts();
+    pmm_hot_list_t* hot_list = &_pmm_hot_lists[system_cpu_id()];
+    if (!hot_list->count) {
+        lock_acquire(&_pmm_lock);
+        while (hot_list->count < PMM_HOT_LIST_SIZE / 2) {
+            uint32_t chunk_id = _pmm_buddy_take_chunk(PMM_HOT_ORDER);
+            if (chunk_id == PMM_NO_BLOCK) {
+                break;
             }
+            _pmm_mat_fill(chunk_id, PMM_HOT_BLOCKS_COUNT, true);
+            hot_list->blocks[hot_list->count++] = chunk_id;
         }
+        lock_release(&_pmm_lock);
     }
-    return 0x0;
+    if (hot_list->count) {
+        block_id = hot_list->blocks[--hot_list->count];
+    }
+    system_enable_interrupts();
+    return block_id;
+}
+
+static void _pmm_hot_free(uint32_t block_id)
+{
+    system_disable_interrupts();
+    pmm_hot_list_t* hot_list = &_pmm_hot_lists[system_cpu_id()];
+    if (hot_list->count == PMM_HOT_LIST_SIZE) {
+        lock_acquire(&_pmm_lock);
+        while (hot_list->count > PMM_HOT_LIST_SIZE / 2) {
+            _pmm_buddy_free_blocks(hot_list->blocks[--hot_list->count], PMM_HOT_BLOCKS_COUNT);
+        }
+        lock_release(&_pmm_lock);
+    }
+    hot_list->blocks[hot_list->count++] = block_id;
+    system_enable_interrupts();
+}
+
+// _pmm_hot_drain_lockless gives back chunks cached by this cpu, they could
+// be holding buddies of a big free chunk.
+static void _pmm_hot_drain_lockless()
+{
+    system_disable_interrupts();
+    pmm_hot_list_t* hot_list = &_pmm_hot_lists[system_cpu_id()];
+    while (hot_list->count) {
+        _pmm_buddy_free_blocks(hot_list->blocks[--hot_list->count], PMM_HOT_BLOCKS_COUNT);
+    }
+    system_enable_interrupts();
+}
+
+// _pmm_alloc_blocks returns block_id of a sequence aligned to @alignment
+// blocks, the alignment is rounded up to a power of 2.
+static uint32_t _pmm_alloc_blocks(uint32_t t_size, uint32_t alignment)
+{
+    if (!t_size) {
+        return 0x0;
+    }
+    if (!alignment) {
+        alignment = 1;
+    }
+    alignment = 1 << _pmm_order_of(alignment);
+
+    uint32_t block_id;
+    if (_pmm_buddy_ready && t_size == PMM_HOT_BLOCKS_COUNT && alignment <= PMM_HOT_BLOCKS_COUNT) {
+        block_id = _pmm_hot_alloc();
+    } else {
+        lock_acquire(&_pmm_lock);
+        if (_pmm_buddy_ready) {
+            block_id = _pmm_buddy_alloc_blocks(t_size, alignment);
+            if (!block_id) {
+                _pmm_hot_drain_lockless();
+                block_id = _pmm_buddy_alloc_blocks(t_size, alignment);
+            }
+        } else {
+            block_id = _pmm_boot_alloc_blocks(t_size, alignment);
+        }
+        lock_release(&_pmm_lock);
+    }
+
+    if (block_id) {
+        __atomic_add_fetch(&pmm_used_blocks, t_size, __ATOMIC_RELAXED);
+        _pmm_frame_refs_fill(block_id, t_size, 1);
+    }
+    return block_id;
+}
+
+static void _pmm_free_blocks(uint32_t block_id, uint32_t t_size)
+{
+    if (!t_size) {
+        return;
+    }
+    _pmm_frame_refs_fill(block_id, t_size, 0);
+    __atomic_sub_fetch(&pmm_used_blocks, t_size, __ATOMIC_RELAXED);
+
+    if (_pmm_buddy_ready && t_size == PMM_HOT_BLOCKS_COUNT && (block_id & (PMM_HOT_BLOCKS_COUNT - 1)) == 0) {
+        _pmm_hot_free(block_id);
+        return;
+    }
+
+    lock_acquire(&_pmm_lock);
+    if (_pmm_buddy_ready) {
+        _pmm_buddy_free_blocks(block_id, t_size);
+    } else {
+        _pmm_boot_free_blocks(block_id, t_size);
+    }
+    lock_release(&_pmm_lock);
 }
 
 // _pmm_init_region marks the region as writable
@@ -127,17 +406,7 @@ void _pmm_init_region(uint32_t t_region_start, uint32_t t_region_length)
     uint32_t block_id = t_region_start / PMM_BLOCK_SIZE;
     uint32_t blocks_count = t_region_length / PMM_BLOCK_SIZE;
     pmm_used_blocks -= blocks_count;
-    while (blocks_count) {
-        if (blocks_count >= PMM_BLOCKS_PER_BYTE && block_id % PMM_BLOCKS_PER_BYTE == 0) {
-            pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] = 0;
-            blocks_count -= PMM_BLOCKS_PER_BYTE;
-            block_id += PMM_BLOCKS_PER_BYTE;
-        } else {
-            _pmm_mat_free_block(block_id);
-            blocks_count -= 1;
-            block_id += 1;
-        }
-    }
+    _pmm_mat_fill(block_id, blocks_count, false);
 }
 
 // _pmm_deinit_region marks the region as NOT writable
@@ -148,23 +417,15 @@ void _pmm_deinit_region(uint32_t t_region_start, uint32_t t_region_length)
     uint32_t block_id = t_region_start / PMM_BLOCK_SIZE;
     uint32_t blocks_count = t_region_length / PMM_BLOCK_SIZE;
     pmm_used_blocks += blocks_count;
-    while (blocks_count) {
-        if (blocks_count >= PMM_BLOCKS_PER_BYTE && block_id % PMM_BLOCKS_PER_BYTE == 0) {
-            pmm_mat[block_id / PMM_BLOCKS_PER_BYTE] = 0xff;
-            blocks_count -= PMM_BLOCKS_PER_BYTE;
-            block_id += PMM_BLOCKS_PER_BYTE;
-        } else {
-            _pmm_mat_alloc_block(block_id);
-            blocks_count -= 1;
-            block_id += 1;
-        }
-    }
+    _pmm_mat_fill(block_id, blocks_count, true);
 }
 
-// _pmm_deinit_mat marks the region where MAT is placed as NOT writable
+// _pmm_deinit_mat marks the region where MAT is placed as NOT writable.
+// The MAT is accessed through the kernel mapping, so its physical address
+// is found with the kernel base.
 void _pmm_deinit_mat()
 {
-    _pmm_deinit_region((uint32_t)pmm_mat, pmm_mat_size);
+    _pmm_deinit_region((uint32_t)pmm_mat - KERNEL_BASE + KERNEL_PM_BASE, pmm_mat_size);
 }
 
 // _pmm_calc_ram_size calculates ram size depends on the memory map
@@ -194,6 +455,7 @@ void _pmm_allocate_mat(void* t_mat_base)
 
 void pmm_setup(mem_desc_t* mem_desc)
 {
+    lock_init(&_pmm_lock);
     uint32_t kernel_base_c = _pmm_round_ceil(KERNEL_BASE);
     uint32_t kernel_size = _pmm_round_ceil(mem_desc->kernel_size * 1024);
     _pmm_calc_ram_size(mem_desc);
@@ -215,38 +477,63 @@ void pmm_setup(mem_desc_t* mem_desc)
 #elif __arm__
     _pmm_deinit_region(0x0, 0x80200000);
 #endif
-    // FIXME: DEINIT MAT DOES NOT WORK;
     _pmm_deinit_mat(); // mat deinit
     _pmm_deinit_region(0x0, KERNEL_PM_BASE); // kernel stack deinit
     _pmm_deinit_region(KERNEL_PM_BASE, mem_desc->kernel_size * 1024); // kernel deinit
 }
 
+// pmm_buddy_table_size returns the size of the table which pmm_setup_buddy
+// needs, in bytes.
+uint32_t pmm_buddy_table_size()
+{
+    return pmm_max_blocks * (2 * sizeof(uint32_t) + sizeof(uint8_t));
+}
+
+// pmm_setup_buddy moves free blocks from the MAT to the free lists, @table
+// should be mapped and hold pmm_buddy_table_size() bytes.
+void pmm_setup_buddy(void* table)
+{
+    lock_acquire(&_pmm_lock);
+    _pmm_buddy_next = (uint32_t*)table;
+    _pmm_buddy_prev = &_pmm_buddy_next[pmm_max_blocks];
+    _pmm_buddy_order = (uint8_t*)&_pmm_buddy_prev[pmm_max_blocks];
+    for (uint32_t i = 0; i < pmm_max_blocks; i++) {
+        _pmm_buddy_order[i] = 0;
+    }
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        _pmm_free_lists[order] = PMM_NO_BLOCK;
+    }
+
+    // Every run of free blocks is put at once, it is cut into aligned
+    // chunks of the biggest possible orders.
+    uint32_t block_id = 0;
+    while (block_id < pmm_max_blocks) {
+        if (_pmm_mat_tesblock(block_id)) {
+            block_id++;
+            continue;
+        }
+        uint32_t run_end = block_id;
+        while (run_end < pmm_max_blocks && !_pmm_mat_tesblock(run_end)) {
+            run_end++;
+        }
+        _pmm_buddy_put_blocks(block_id, run_end - block_id);
+        block_id = run_end;
+    }
+
+    _pmm_buddy_ready = true;
+    lock_release(&_pmm_lock);
+}
+
 // pmm_alloc_blocks allocates blocks
 // will return 0x0 if unsuccesfully
 void* pmm_alloc_blocks(uint32_t t_size)
 {
-    uint32_t block_id = _pmm_first_free_block_n(t_size);
-    if (block_id == 0) {
-        return 0x0;
-    }
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_alloc_block(block_id + i);
-        pmm_used_blocks++;
-    }
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+    return (void*)(_pmm_alloc_blocks(t_size, 1) * PMM_BLOCK_SIZE);
 }
 
 void* pmm_alloc_blocks_aligned(uint32_t t_size, uint32_t al)
 {
-    uint32_t block_id = _pmm_first_free_block_n_aligned(t_size, al);
-    if (block_id == 0) {
-        return 0x0;
-    }
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_alloc_block(block_id + i);
-        pmm_used_blocks++;
-    }
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+    return (void*)(_pmm_alloc_blocks(t_size, al) * PMM_BLOCK_SIZE);
 }
 
 // pmm_free_blocks frees the blocks
@@ -257,11 +544,7 @@ bool pmm_free_blocks(void* block, uint32_t t_size)
     if (((uint32_t)block & (PMM_BLOCK_SIZE - 1)) != 0) {
         return false;
     }
-    uint32_t block_id = (uint32_t)block / PMM_BLOCK_SIZE;
-    for (uint32_t i = 0; i < t_size; i++) {
-        _pmm_mat_free_block(block_id + i);
-        pmm_used_blocks--;
-    }
+    _pmm_free_blocks((uint32_t)block / PMM_BLOCK_SIZE, t_size);
     return true;
 }
 
@@ -269,26 +552,18 @@ bool pmm_free_blocks(void* block, uint32_t t_size)
 // will return 0x0 if unsuccesfully
 void* pmm_alloc_block()
 {
-    uint32_t block_id = _pmm_first_free_block();
-    if (block_id == 0) {
-        return 0x0;
-    }
-    _pmm_mat_alloc_block(block_id);
-    pmm_used_blocks++;
-    return (void*)(block_id * PMM_BLOCK_SIZE);
+    return pmm_alloc_blocks(1);
 }
 
 // pmm_alloc allocates space of @size bytes
 void* pmm_alloc(uint32_t act_size)
 {
-    // log("MAT LOC %x", pmm_mat);
     uint32_t n = (act_size + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     return pmm_alloc_blocks(n);
 }
 
 void* pmm_alloc_aligned(uint32_t act_size, uint32_t alignment)
 {
-    // log("MAT LOC %x", pmm_mat);
     uint32_t n = (act_size + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     uint32_t al = (alignment + PMM_BLOCK_SIZE - 1) / PMM_BLOCK_SIZE;
     return pmm_alloc_blocks_aligned(n, al);
@@ -305,13 +580,67 @@ bool pmm_free(void* block, uint32_t act_size)
 // will return false if unsuccesfully
 bool pmm_free_block(void* block)
 {
-    if (((uint32_t)block & (PMM_BLOCK_SIZE - 1)) != 0) {
-        return false;
+    return pmm_free_blocks(block, 1);
+}
+
+/**
+ * FRAME REFERENCES
+ */
+
+// pmm_setup_frame_refs installs the reference counters table, @refs
+// should be mapped and hold pmm_get_max_blocks() zeroed counters.
+void pmm_setup_frame_refs(pmm_frame_ref_t* refs)
+{
+    pmm_frame_refs = refs;
+}
+
+// pmm_frame_ref adds a reference to the frame and returns the new counter.
+// Saturated counters stay pinned, such frames are never freed.
+// Counters are shared by address spaces with different locks, so they are
+// changed with atomics.
+uint32_t pmm_frame_ref(uint32_t paddr)
+{
+    if (!pmm_frame_refs) {
+        return 1;
     }
-    uint32_t block_id = (uint32_t)block / PMM_BLOCK_SIZE;
-    _pmm_mat_free_block(block_id);
-    pmm_used_blocks--;
-    return true;
+    pmm_frame_ref_t* ref = &pmm_frame_refs[paddr / PMM_BLOCK_SIZE];
+    pmm_frame_ref_t old = __atomic_load_n(ref, __ATOMIC_RELAXED);
+    pmm_frame_ref_t new;
+    do {
+        if (old == PMM_FRAME_REF_MAX) {
+            return PMM_FRAME_REF_MAX;
+        }
+        new = old ? old + 1 : 2;
+    } while (!__atomic_compare_exchange_n(ref, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return new;
+}
+
+// pmm_frame_unref drops a reference and returns the remaining counter.
+// The frame is not freed, the caller frees it once 0 is returned.
+uint32_t pmm_frame_unref(uint32_t paddr)
+{
+    if (!pmm_frame_refs) {
+        return 0;
+    }
+    pmm_frame_ref_t* ref = &pmm_frame_refs[paddr / PMM_BLOCK_SIZE];
+    pmm_frame_ref_t old = __atomic_load_n(ref, __ATOMIC_RELAXED);
+    pmm_frame_ref_t new;
+    do {
+        if (old == PMM_FRAME_REF_MAX) {
+            return PMM_FRAME_REF_MAX;
+        }
+        new = old > 1 ? old - 1 : 0;
+    } while (!__atomic_compare_exchange_n(ref, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return new;
+}
+
+uint32_t pmm_frame_refcount(uint32_t paddr)
+{
+    if (!pmm_frame_refs) {
+        return 1;
+    }
+    pmm_frame_ref_t ref = __atomic_load_n(&pmm_frame_refs[paddr / PMM_BLOCK_SIZE], __ATOMIC_ACQUIRE);
+    return ref ? ref : 1;
 }
 
 uint32_t pmm_get_ram_size()
@@ -337,4 +666,4 @@ uint32_t pmm_get_free_blocks()
 uint32_t pmm_geblock_size()
 {
     return PMM_BLOCK_SIZE;
-}
\ No newline at end of file
+}
@@ -4,11 +4,14 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <fs/page_cache.h>
+#include <fs/vfs.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/lock.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
+#include <mem/pmm.h>
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
 #include <platform/generic/cpu.h>
@@ -26,8 +29,32 @@
 #define PTABLE_SIZE sizeof(ptable_t)
 #define IS_INDIVIDUAL_PER_DIR(index) (index < VMM_KERNEL_TABLES_START || (index == VMM_OFFSET_IN_DIRECTORY(pspace_zone.start)))
 
+/**
+ * LOCKING
+ *
+ * Kernel tables are shared by all address spaces and are guarded by
+ * _vmm_kernel_lock. User tables (and the pspace which maps them) belong to
+ * a single address space, so they are guarded by a lock of their pdir.
+ * Locks are taken from a table by the pdir address, that way page faults in
+ * unrelated processes do not wait for each other.
+ * A pdir lock could be held while taking the kernel lock, never vice versa.
+ */
+#define VMM_PDIR_LOCKS 64
+#define VMM_TLB_BATCH_SIZE 32
+
+struct vmm_tlb_batch {
+    int depth;
+    bool shared;
+    bool whole;
+    uint32_t count;
+    uint32_t vaddrs[VMM_TLB_BATCH_SIZE];
+};
+typedef struct vmm_tlb_batch vmm_tlb_batch_t;
+
 static pdir_t* _vmm_kernel_pdir;
-static lock_t _vmm_lock;
+static lock_t _vmm_kernel_lock;
+static lock_t _vmm_pdir_locks[VMM_PDIR_LOCKS];
+static vmm_tlb_batch_t _vmm_tlb_batches[CPU_CNT];
 static zone_t pspace_zone;
 static uint32_t kernel_ptables_start_paddr = 0x0;
 
@@ -54,6 +81,7 @@ static bool _vmm_init_switch_to_kernel_pdir();
 static void _vmm_map_init_kernel_pages(uint32_t paddr, uint32_t vaddr);
 static bool _vmm_create_kernel_ptables();
 static bool _vmm_map_kernel();
+static void _vmm_setup_frame_refs();
 
 inline static uint32_t _vmm_round_ceil_to_page(uint32_t value);
 inline static uint32_t _vmm_round_floor_to_page(uint32_t value);
@@ -64,7 +92,8 @@ static bool _vmm_is_copy_on_write(uint32_t vaddr);
 static int _vmm_resolve_copy_on_write(proc_t* p, uint32_t vaddr);
 static void _vmm_ensure_cow_for_page(uint32_t vaddr);
 static void _vmm_ensure_cow_for_range(uint32_t vaddr, uint32_t length);
-static int _vmm_copy_page_to_resolve_cow(proc_t* p, uint32_t vaddr, ptable_t* src_ptable, int page_index);
+static bool _vmm_is_page_copy_on_write(proc_t* p, uint32_t vaddr);
+static int _vmm_resolve_page_copy_on_write(proc_t* p, uint32_t vaddr);
 
 static bool _vmm_is_zeroing_on_demand(uint32_t vaddr);
 static void _vmm_resolve_zeroing_on_demand(uint32_t vaddr);
@@ -77,8 +106,8 @@ static int _vmm_self_test();
 
 static int vmm_allocate_ptable_lockless(uint32_t vaddr);
 static ALWAYS_INLINE int vmm_force_allocate_ptable_lockless(uint32_t vaddr);
-static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_t* zones);
-static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, dynamic_array_t* zones);
+static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, rbtree_t* zones);
+static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, rbtree_t* zones);
 
 static ALWAYS_INLINE int vmm_map_page_lockless(uint32_t vaddr, uint32_t paddr, uint32_t settings);
 static ALWAYS_INLINE int vmm_map_pages_lockless(uint32_t vaddr, uint32_t paddr, uint32_t n_pages, uint32_t settings);
@@ -90,15 +119,119 @@ static ALWAYS_INLINE pdirectory_t* vmm_new_user_pdir_lockless();
 static ALWAYS_INLINE pdirectory_t* vmm_new_forked_user_pdir_lockless();
 static ALWAYS_INLINE void vmm_prepare_active_pdir_for_copying_at_lockless(uint32_t dest_vaddr, uint32_t length);
 static ALWAYS_INLINE void vmm_copy_to_user_lockless(void* dest, void* src, uint32_t length);
-static ALWAYS_INLINE void vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
+static ALWAYS_INLINE int vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length);
 
 static ALWAYS_INLINE int vmm_load_page_lockless(uint32_t vaddr, uint32_t settings);
 static ALWAYS_INLINE int vmm_tune_page_lockless(uint32_t vaddr, uint32_t settings);
 static ALWAYS_INLINE int vmm_tune_pages_lockless(uint32_t vaddr, uint32_t length, uint32_t settings);
-static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* page, dynamic_array_t* zones);
+static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* page, rbtree_t* zones);
+static ALWAYS_INLINE int vmm_free_user_pages_lockless(uint32_t vaddr, uint32_t length, rbtree_t* zones);
 
 static ALWAYS_INLINE int vmm_switch_pdir_lockless(pdirectory_t* pdir);
 
+/**
+ * LOCK FUNCTIONS
+ */
+
+static inline lock_t* _vmm_pdir_lock(pdirectory_t* pdir)
+{
+    return &_vmm_pdir_locks[((uint32_t)pdir / PDIR_SIZE) % VMM_PDIR_LOCKS];
+}
+
+/**
+ * The function returns the lock which guards the table of @vaddr in the
+ * active address space.
+ */
+static inline lock_t* _vmm_lock_for(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return &_vmm_kernel_lock;
+    }
+    return _vmm_pdir_lock(THIS_CPU->pdir);
+}
+
+/**
+ * TLB FUNCTIONS
+ *
+ * Kernel pages are seen by all cpus, user pages only by cpus which run the
+ * same address space, only then a flush has to reach other cpus. Functions
+ * which change many pages open a batch, so flushes are done once at the end
+ * and a big batch turns into a flush of the whole TLB.
+ */
+
+static bool _vmm_is_seen_by_other_cpus(uint32_t vaddr)
+{
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return true;
+    }
+
+    pdirectory_t* pdir = THIS_CPU->pdir;
+    int this_cpu = system_cpu_id();
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (i != this_cpu && cpus[i].pdir == pdir) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void _vmm_flush_tlb_entry(uint32_t vaddr)
+{
+    vmm_tlb_batch_t* batch = &_vmm_tlb_batches[system_cpu_id()];
+    bool shared = _vmm_is_seen_by_other_cpus(vaddr);
+    if (batch->depth) {
+        batch->shared |= shared;
+        if (batch->count < VMM_TLB_BATCH_SIZE) {
+            batch->vaddrs[batch->count++] = vaddr;
+        } else {
+            batch->whole = true;
+        }
+        return;
+    }
+
+    if (shared) {
+        system_flush_tlb_entry_all_cpus(vaddr);
+    } else {
+        system_flush_tlb_entry(vaddr);
+    }
+}
+
+/**
+ * The function flushes all user pages of the active address space.
+ */
+static void _vmm_flush_user_tlb()
+{
+    if (_vmm_is_seen_by_other_cpus(0)) {
+        system_flush_whole_tlb_all_cpus();
+    } else {
+        system_flush_whole_tlb();
+    }
+}
+
+static inline void _vmm_tlb_batch_begin()
+{
+    _vmm_tlb_batches[system_cpu_id()].depth++;
+}
+
+static void _vmm_tlb_batch_end()
+{
+    vmm_tlb_batch_t* batch = &_vmm_tlb_batches[system_cpu_id()];
+    if (--batch->depth) {
+        return;
+    }
+
+    if (batch->whole) {
+        batch->shared ? system_flush_whole_tlb_all_cpus() : system_flush_whole_tlb();
+    } else {
+        for (uint32_t i = 0; i < batch->count; i++) {
+            batch->shared ? system_flush_tlb_entry_all_cpus(batch->vaddrs[i]) : system_flush_tlb_entry(batch->vaddrs[i]);
+        }
+    }
+    batch->shared = false;
+    batch->whole = false;
+    batch->count = 0;
+}
+
 /**
  * VM INITIALIZATION FUNCTIONS
  */
@@ -151,16 +284,20 @@ static zone_t _vmm_alloc_mapped_zone(uint32_t size, uint32_t alignment)
     // TODO: Currently only sequence allocation is implemented.
     zone_t zone = zoner_new_zone_aligned(size, alignment);
     uint32_t paddr = (uint32_t)pmm_alloc_aligned(size, alignment);
-    vmm_map_pages_lockless(zone.start, paddr, size / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
+    vmm_map_pages(zone.start, paddr, size / VMM_PAGE_SIZE, PAGE_READABLE | PAGE_WRITABLE);
     return zone;
 }
 
 static int _vmm_free_mapped_zone(zone_t zone)
 {
+    lock_acquire(&_vmm_kernel_lock);
     ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(zone.start);
     page_desc_t* page = _vmm_ptable_lookup(ptable, zone.start);
     pmm_free((void*)page_desc_get_frame(*page), zone.len);
+    _vmm_tlb_batch_begin();
     vmm_unmap_pages_lockless(zone.start, zone.len / VMM_PAGE_SIZE);
+    _vmm_tlb_batch_end();
+    lock_release(&_vmm_kernel_lock);
     zoner_free_zone(zone);
     return 0;
 }
@@ -264,7 +401,7 @@ static void _vmm_pspace_gen(pdirectory_t* pdir)
     zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
     ptable_t* new_ptable = (ptable_t*)tmp_zone.start;
 
-    vmm_map_page_lockless((uint32_t)new_ptable, ptable_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    vmm_map_page((uint32_t)new_ptable, ptable_paddr, PAGE_READABLE | PAGE_WRITABLE);
 
     /* The code assumes that the length of tables which cover pspace
        is 4KB and that the tables are fit in a single page and are continuous. */
@@ -288,7 +425,7 @@ static void _vmm_pspace_gen(pdirectory_t* pdir)
         table_desc_set_frame(&pspace_table, ptable_paddr_for);
         pdir->entities[VMM_OFFSET_IN_DIRECTORY(ptable_vaddr_for)] = pspace_table;
     }
-    vmm_unmap_page_lockless((uint32_t)new_ptable);
+    vmm_unmap_page((uint32_t)new_ptable);
     zoner_free_zone(tmp_zone);
 }
 
@@ -409,12 +546,39 @@ static bool _vmm_map_kernel()
     return true;
 }
 
+/**
+ * The function allocates reference counters of physical frames, they are
+ * used to share pages between address spaces. The table is mapped at once,
+ * since page faults need it.
+ * Used only in the first stage of VM init
+ */
+static void _vmm_setup_frame_refs()
+{
+    zone_t zone = _vmm_alloc_mapped_zone(pmm_get_max_blocks() * sizeof(pmm_frame_ref_t), VMM_PAGE_SIZE);
+    memset(zone.ptr, 0, zone.len);
+    pmm_setup_frame_refs((pmm_frame_ref_t*)zone.ptr);
+}
+
+/**
+ * The function allocates the table of the PMM free lists. Physical memory
+ * is taken with a slow scan till the table is set up.
+ * Used only in the first stage of VM init
+ */
+static void _vmm_setup_pmm_buddy()
+{
+    zone_t zone = _vmm_alloc_mapped_zone(pmm_buddy_table_size(), VMM_PAGE_SIZE);
+    pmm_setup_buddy(zone.ptr);
+}
+
 /**
  * The setup function should run only by one thread.
  */
 int vmm_setup()
 {
-    lock_init(&_vmm_lock);
+    lock_init(&_vmm_kernel_lock);
+    for (int i = 0; i < VMM_PDIR_LOCKS; i++) {
+        lock_init(&_vmm_pdir_locks[i]);
+    }
     zoner_init(0xc0400000);
     _vmm_split_pspace();
     _vmm_create_kernel_ptables();
@@ -423,12 +587,20 @@ int vmm_setup()
     _vmm_map_kernel();
     zoner_place_bitmap();
     kmalloc_init();
+    _vmm_setup_frame_refs();
+    _vmm_setup_pmm_buddy();
+
+    // Kernel writes to read-only user pages have to fault, so they go through
+    // the copy-on-write paths like user writes do, instead of changing frames
+    // which are shared with other address spaces or the page cache.
+    system_enable_write_protect();
     return 0;
 }
 
 int vmm_setup_secondary_cpu()
 {
     _vmm_init_switch_to_kernel_pdir();
+    system_enable_write_protect();
     return 0;
 }
 
@@ -522,9 +694,10 @@ skip_allocation:
 
 int vmm_allocate_ptable(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_allocate_ptable_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -542,16 +715,17 @@ static ALWAYS_INLINE int vmm_force_allocate_ptable_lockless(uint32_t vaddr)
 
 int vmm_force_allocate_ptable(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_force_allocate_ptable_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
 /**
  * The function deletes ptable(s) and rebuilds pspace to match the new setup.
  */
-static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_t* zones)
+static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, rbtree_t* zones)
 {
     if (!THIS_CPU->pdir) {
         return -VMM_ERR_PDIR;
@@ -563,8 +737,22 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
         return -EFAULT;
     }
 
+    uint32_t ptable_vaddr_start = PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(vaddr));
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
+
     if (table_desc_has_attrs(*ptable_desc, TABLE_DESC_COPY_ON_WRITE)) {
-        return -EFAULT;
+        uint32_t ptables_frame = PAGE_START(table_desc_get_frame(*ptable_desc));
+        if (pmm_frame_unref(ptables_frame) > 0) {
+            // Tables are still used by other address spaces, our reference is dropped.
+            for (uint32_t i = 0, pvaddr = ptable_serve_vaddr_start; i < ptables_per_page; i++, pvaddr += table_coverage) {
+                table_desc_clear(_vmm_pdirectory_lookup(THIS_CPU->pdir, pvaddr));
+            }
+            vmm_unmap_page_lockless(ptable_vaddr_start);
+            return 0;
+        }
+        table_desc_del_attrs(ptable_desc, TABLE_DESC_COPY_ON_WRITE);
     }
 
     // Entering allocated state, since table is alloacted but not valid.
@@ -580,11 +768,6 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
         vmm_free_page_lockless(pages_vstart + pages_voffset, page, zones);
     }
 
-    uint32_t ptable_vaddr_start = PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(vaddr));
-    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
-    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
-    uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
-
     // Chechking if we can delete thw whole page of tables.
     for (uint32_t i = 0, pvaddr = ptable_serve_vaddr_start; i < ptables_per_page; i++, pvaddr += table_coverage) {
         table_desc_t* ptable_desc_c = _vmm_pdirectory_lookup(THIS_CPU->pdir, pvaddr);
@@ -607,11 +790,12 @@ static ALWAYS_INLINE int vmm_free_ptable_lockless(uint32_t vaddr, dynamic_array_
     return 0;
 }
 
-int vmm_free_ptable(uint32_t vaddr, dynamic_array_t* zones)
+int vmm_free_ptable(uint32_t vaddr, rbtree_t* zones)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_free_ptable_lockless(vaddr, zones);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -673,16 +857,17 @@ static ALWAYS_INLINE int vmm_map_page_lockless(uint32_t vaddr, uint32_t paddr, u
     log("Page mapped %x in pdir: %x", vaddr, vmm_get_active_pdir());
 #endif
 
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
 
     return 0;
 }
 
 int vmm_map_page(uint32_t vaddr, uint32_t paddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_map_page_lockless(vaddr, paddr, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -702,16 +887,17 @@ static ALWAYS_INLINE int vmm_unmap_page_lockless(uint32_t vaddr)
     page_desc_del_attrs(page, PAGE_DESC_PRESENT);
     page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
     page_desc_del_frame(page);
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
 
     return 0;
 }
 
 int vmm_unmap_page(uint32_t vaddr)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_unmap_page_lockless(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -736,9 +922,12 @@ static ALWAYS_INLINE int vmm_map_pages_lockless(uint32_t vaddr, uint32_t paddr,
 
 int vmm_map_pages(uint32_t vaddr, uint32_t paddr, uint32_t n_pages, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    _vmm_tlb_batch_begin();
     int res = vmm_map_pages_lockless(vaddr, paddr, n_pages, settings);
-    lock_release(&_vmm_lock);
+    _vmm_tlb_batch_end();
+    lock_release(lock);
     return res;
 }
 
@@ -760,14 +949,23 @@ static ALWAYS_INLINE int vmm_unmap_pages_lockless(uint32_t vaddr, uint32_t n_pag
 
 int vmm_unmap_pages(uint32_t vaddr, uint32_t n_pages)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    _vmm_tlb_batch_begin();
     int res = vmm_unmap_pages_lockless(vaddr, n_pages);
-    lock_release(&_vmm_lock);
+    _vmm_tlb_batch_end();
+    lock_release(lock);
     return res;
 }
 
 /**
  * COPY ON WRITE FUNCTIONS
+ * 
+ * Fork shares the pages of ptables between both address spaces and marks the
+ * tables as COW. The first write into such tables gives the writer its own
+ * copy of the descriptors, while pages are still shared and marked read-only.
+ * Physical pages are copied lazily one by one, when a write reaches a page
+ * which frame is referenced by several address spaces.
  */
 
 /**
@@ -793,66 +991,283 @@ static inline void _vmm_tables_set_cow(uint32_t table_index, table_desc_t* cur,
 #endif
 }
 
+/**
+ * Returns the frame of the page which holds the group of ptables serving @vaddr.
+ * Returns 0 if no table of the group is present.
+ */
+static uint32_t _vmm_ptables_group_frame(pdirectory_t* pdir, uint32_t vaddr)
+{
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t first_table = (VMM_OFFSET_IN_DIRECTORY(vaddr) / ptables_per_page) * ptables_per_page;
+    for (uint32_t i = 0; i < ptables_per_page; i++) {
+        table_desc_t ptable_desc = pdir->entities[first_table + i];
+        if (table_desc_is_present(ptable_desc)) {
+            return PAGE_START(table_desc_get_frame(ptable_desc));
+        }
+    }
+    return 0;
+}
+
+static inline bool _vmm_is_zone_private(proc_zone_t* zone)
+{
+    return !(zone->type & (ZONE_TYPE_DEVICE | ZONE_TYPE_MAPPED_FILE_SHAREDLY));
+}
+
 static bool _vmm_is_copy_on_write(uint32_t vaddr)
 {
     table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, vaddr);
     return table_desc_is_copy_on_write(*ptable_desc);
 }
 
+/**
+ * Restores permissions of a page which table was COW. Private pages which
+ * frame is still shared stay read-only, so the first write copies them.
+ */
+static void _vmm_restore_page_after_cow(proc_t* p, uint32_t vaddr, page_desc_t* page, bool take_ref)
+{
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    uint32_t frame = page_desc_get_frame(*page);
+    if (take_ref && !(zone && (zone->type & ZONE_TYPE_DEVICE))) {
+        pmm_frame_ref(frame);
+    }
+
+    if (!zone) {
+        return;
+    }
+
+    if (!(zone->flags & ZONE_WRITABLE)) {
+        page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
+        return;
+    }
+
+    // Clean pages of shared files stay read-only, see _vmm_resolve_shared_file_page_write.
+    if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+        return;
+    }
+
+    if (_vmm_is_zone_private(zone) && pmm_frame_refcount(frame) > 1) {
+        page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
+    } else {
+        page_desc_set_attrs(page, PAGE_DESC_WRITABLE);
+    }
+}
+
 static int _vmm_resolve_copy_on_write(proc_t* p, uint32_t vaddr)
 {
     table_desc_t orig_table_desc[VMM_PAGE_SIZE / PTABLE_SIZE];
     uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
     uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
     uint32_t ptable_serve_vaddr_start = (vaddr / (table_coverage * ptables_per_page)) * (table_coverage * ptables_per_page);
-
-    /* Copying old ptables which cover the full page. See a comment above vmm_allocate_ptable. */
-    zone_t src_ptable_zone = _vmm_alloc_mapped_zone(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
-    ptable_t* src_ptable = (ptable_t*)src_ptable_zone.ptr;
-    ptable_t* root_ptable = (ptable_t*)PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(ptable_serve_vaddr_start));
-    memcpy(src_ptable, root_ptable, VMM_PAGE_SIZE);
+    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    uint32_t ptables_frame = _vmm_ptables_group_frame(THIS_CPU->pdir, vaddr);
+    bool shared = (pmm_frame_refcount(ptables_frame) > 1);
 
     // Saving descriptors of original ptables
     for (int it = 0; it < ptables_per_page; it++) {
-        table_desc_t* tmp_table_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
-        orig_table_desc[it] = tmp_table_desc[it];
+        orig_table_desc[it] = start_ptable_desc[it];
     }
 
-    /* Setting up new ptables. */
-    int err = vmm_force_allocate_ptable_lockless(vaddr);
-    if (err) {
-        return err;
+    if (shared) {
+        /* Copying descriptors of old ptables which cover the full page. See a comment above vmm_allocate_ptable. */
+        zone_t src_ptable_zone = _vmm_alloc_mapped_zone(VMM_PAGE_SIZE, VMM_PAGE_SIZE);
+        ptable_t* src_ptable = (ptable_t*)src_ptable_zone.ptr;
+        ptable_t* root_ptable = (ptable_t*)PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(ptable_serve_vaddr_start));
+        memcpy(src_ptable, root_ptable, VMM_PAGE_SIZE);
+
+        /* Setting up new ptables. */
+        int err = vmm_force_allocate_ptable_lockless(vaddr);
+        if (err) {
+            _vmm_free_mapped_zone(src_ptable_zone);
+            return err;
+        }
+
+        /* The new ptables page sits at the same place in pspace. */
+        memcpy(root_ptable, src_ptable, VMM_PAGE_SIZE);
+        _vmm_free_mapped_zone(src_ptable_zone);
+
+        // Other address space could have dropped the tables meanwhile, then the
+        // old page is ours to free and the references of pages move to the copy.
+        if (pmm_frame_unref(ptables_frame) == 0) {
+            _vmm_free_ptables_to_cover_page(ptables_frame);
+            shared = false;
+        }
     }
 
-    /* Copying all pages from this tables to newly allocated. */
     uint32_t table_start = TABLE_START(ptable_serve_vaddr_start);
-    table_desc_t* start_ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, ptable_serve_vaddr_start);
+    ptable_t* root_ptable = (ptable_t*)PAGE_START((uint32_t)_vmm_pspace_get_vaddr_of_active_ptable(ptable_serve_vaddr_start));
     for (int ptable_idx = 0; ptable_idx < ptables_per_page; ptable_idx++) {
-        if (table_desc_is_present(orig_table_desc[ptable_idx])) {
-            _vmm_table_desc_init_from_allocated_state(&start_ptable_desc[ptable_idx]);
-            for (int page_idx = 0; page_idx < VMM_TOTAL_PAGES_PER_TABLE; page_idx++) {
-                uint32_t offset_in_table_set = ptable_idx * VMM_TOTAL_PAGES_PER_TABLE + page_idx;
-                uint32_t page_vaddr = table_start + (offset_in_table_set * VMM_PAGE_SIZE);
-                page_desc_t* page_desc = &src_ptable->entities[offset_in_table_set];
-                if (page_desc_is_present(*page_desc)) {
-                    _vmm_copy_page_to_resolve_cow(p, page_vaddr, src_ptable, offset_in_table_set);
-                }
+        if (!table_desc_is_present(orig_table_desc[ptable_idx])) {
+            continue;
+        }
+
+        // Drops COW flag, the frame is kept: either a new one or the old which we own alone now.
+        _vmm_table_desc_init_from_allocated_state(&start_ptable_desc[ptable_idx]);
+
+        for (int page_idx = 0; page_idx < VMM_TOTAL_PAGES_PER_TABLE; page_idx++) {
+            uint32_t offset_in_table_set = ptable_idx * VMM_TOTAL_PAGES_PER_TABLE + page_idx;
+            uint32_t page_vaddr = table_start + (offset_in_table_set * VMM_PAGE_SIZE);
+            page_desc_t* page_desc = &root_ptable->entities[offset_in_table_set];
+            if (page_desc_is_present(*page_desc)) {
+                _vmm_restore_page_after_cow(p, page_vaddr, page_desc, shared);
             }
         }
     }
 
-    return _vmm_free_mapped_zone(src_ptable_zone);
+    _vmm_flush_user_tlb();
+    return 0;
+}
+
+/**
+ * A page is COW if its table is private, but the page is read-only
+ * while the zone is a private writable one.
+ */
+static bool _vmm_is_page_copy_on_write(proc_t* p, uint32_t vaddr)
+{
+    if (_vmm_is_copy_on_write(vaddr) || !_vmm_is_page_present(vaddr)) {
+        return false;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    if (page_desc_is_writable(*page)) {
+        return false;
+    }
+
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    if (!zone) {
+        return false;
+    }
+    return (zone->flags & ZONE_WRITABLE) && _vmm_is_zone_private(zone);
+}
+
+/**
+ * The function moves page @vaddr to a new frame with a copy of its content
+ * and maps it with @settings. The old frame loses the reference.
+ */
+static void _vmm_copy_page_to_new_frame(uint32_t vaddr, uint32_t settings)
+{
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    uint32_t old_page_paddr = page_desc_get_frame(*page);
+
+    uint32_t new_page_paddr = _vmm_alloc_page_paddr();
+    if (!new_page_paddr) {
+        /* TODO: Swap pages to make it able to allocate. */
+        kpanic("NO PHYSICAL SPACE");
+    }
+
+    /* Mapping the new page to do a copy, the old one is still readable at @vaddr. */
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    uint32_t new_page_vaddr = (uint32_t)tmp_zone.start;
+    vmm_map_page(new_page_vaddr, new_page_paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memcpy((uint8_t*)new_page_vaddr, (uint8_t*)vaddr, VMM_PAGE_SIZE);
+    vmm_unmap_page(new_page_vaddr);
+    zoner_free_zone(tmp_zone);
+
+    vmm_map_page_lockless(vaddr, new_page_paddr, settings);
+
+    // The other holder could have copied the page as well, the last one frees it.
+    if (pmm_frame_unref(old_page_paddr) == 0) {
+        _vmm_free_page_paddr(old_page_paddr);
+    }
+}
+
+static int _vmm_resolve_page_copy_on_write(proc_t* p, uint32_t vaddr)
+{
+    vaddr = PAGE_START(vaddr);
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    uint32_t old_page_paddr = page_desc_get_frame(*page);
+
+    // The last holder of the frame takes it as is.
+    if (pmm_frame_refcount(old_page_paddr) <= 1) {
+        page_desc_set_attrs(page, PAGE_DESC_WRITABLE);
+        _vmm_flush_tlb_entry(vaddr);
+        return 0;
+    }
+
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    if (!zone) {
+        log_error("Cow: No page in zone");
+        return SHOULD_CRASH;
+    }
+
+    _vmm_copy_page_to_new_frame(vaddr, zone->flags);
+    return 0;
+}
+
+/**
+ * Pages of shared files are mapped read-only until they are written, so
+ * the page cache writes back only pages which were changed.
+ */
+static bool _vmm_is_shared_file_page_clean(proc_t* p, uint32_t vaddr)
+{
+    if (_vmm_is_copy_on_write(vaddr) || !_vmm_is_page_present(vaddr)) {
+        return false;
+    }
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    if (page_desc_is_writable(*page)) {
+        return false;
+    }
+
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    if (!zone) {
+        return false;
+    }
+    return (zone->flags & ZONE_WRITABLE) && (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY);
+}
+
+static int _vmm_resolve_shared_file_page_write(proc_t* p, uint32_t vaddr)
+{
+    vaddr = PAGE_START(vaddr);
+    proc_zone_t* zone = proc_find_zone(p, vaddr);
+    page_cache_mark_dirty(zone->file, zone->offset + (vaddr - zone->start));
+
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    page_desc_set_attrs(page, PAGE_DESC_WRITABLE);
+    _vmm_flush_tlb_entry(vaddr);
+    return 0;
 }
 
 static void _vmm_ensure_cow_for_page(uint32_t vaddr)
 {
+    if (PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER || vmm_get_active_pdir() == vmm_get_kernel_pdir()) {
+        return;
+    }
+
+    proc_t* holder_proc = NULL;
     if (_vmm_is_copy_on_write(vaddr)) {
-        proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+        holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
         if (!holder_proc) {
             kpanic("No proc with the pdir\n");
         }
         _vmm_resolve_copy_on_write(holder_proc, vaddr);
     }
+
+    // Looking up the process only if the page is read-only, the check is on every kernel write.
+    if (!_vmm_is_page_present(vaddr)) {
+        return;
+    }
+    ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(vaddr);
+    page_desc_t* page = _vmm_ptable_lookup(ptable, vaddr);
+    if (page_desc_is_writable(*page)) {
+        return;
+    }
+
+    if (!holder_proc) {
+        holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+        if (!holder_proc) {
+            kpanic("No proc with the pdir\n");
+        }
+    }
+    if (_vmm_is_page_copy_on_write(holder_proc, vaddr)) {
+        _vmm_resolve_page_copy_on_write(holder_proc, vaddr);
+    } else if (_vmm_is_shared_file_page_clean(holder_proc, vaddr)) {
+        _vmm_resolve_shared_file_page_write(holder_proc, vaddr);
+    }
 }
 
 static void _vmm_ensure_cow_for_range(uint32_t vaddr, uint32_t length)
@@ -864,6 +1279,65 @@ static void _vmm_ensure_cow_for_range(uint32_t vaddr, uint32_t length)
     }
 }
 
+/**
+ * The function allocates a frame and fills it with the content of the
+ * file of @zone at page @vaddr. Bytes beyond zone->file_size are zeros.
+ */
+static uint32_t _vmm_alloc_file_page_paddr(proc_zone_t* zone, uint32_t vaddr)
+{
+    uint32_t paddr = _vmm_alloc_page_paddr();
+    if (!paddr) {
+        /* TODO: Swap pages to make it able to allocate. */
+        kpanic("NO PHYSICAL SPACE");
+    }
+
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(tmp_zone.start, paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memset(tmp_zone.ptr, 0, VMM_PAGE_SIZE);
+    uint32_t offset_in_zone = vaddr - zone->start;
+    if (offset_in_zone < zone->file_size) {
+        uint32_t len = min(zone->file_size - offset_in_zone, VMM_PAGE_SIZE);
+        lock_acquire(&zone->file->lock);
+        zone->file->ops->file.read(zone->file, tmp_zone.ptr, zone->offset + offset_in_zone, len);
+        lock_release(&zone->file->lock);
+    }
+    vmm_unmap_page(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+    return paddr;
+}
+
+/**
+ * The function returns a frame for page @vaddr of a file zone and the
+ * settings to map it with. Shared zones and whole pages of private zones
+ * use frames of the page cache, so processes which map the same file share
+ * them. Such private pages are read-only, the first write copies them, so
+ * a page which is loaded to be written is copied at once. A shared page is
+ * mapped writable only when it's written, then it's marked dirty.
+ */
+static uint32_t _vmm_get_file_page_paddr(proc_zone_t* zone, uint32_t vaddr, bool for_write, uint32_t* settings)
+{
+    uint32_t offset_in_zone = vaddr - zone->start;
+    uint32_t file_offset = zone->offset + offset_in_zone;
+    *settings = zone->flags;
+
+    if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+        uint32_t paddr = page_cache_get_frame(zone->file, file_offset);
+        if (for_write && (zone->flags & ZONE_WRITABLE)) {
+            page_cache_mark_dirty(zone->file, file_offset);
+        } else {
+            *settings &= ~PAGE_WRITABLE;
+        }
+        return paddr;
+    }
+
+    bool whole_page = !(file_offset % VMM_PAGE_SIZE) && offset_in_zone + VMM_PAGE_SIZE <= zone->file_size;
+    if (for_write || !whole_page) {
+        return _vmm_alloc_file_page_paddr(zone, vaddr);
+    }
+    *settings &= ~PAGE_WRITABLE;
+    return page_cache_get_frame(zone->file, file_offset);
+}
+
 static int _vmm_load_page_with_perm(uint32_t vaddr)
 {
     if (PAGE_CHOOSE_OWNER(vaddr) == PAGE_USER && vmm_get_active_pdir() != vmm_get_kernel_pdir()) {
@@ -880,6 +1354,15 @@ static int _vmm_load_page_with_perm(uint32_t vaddr)
 #ifdef VMM_DEBUG
         log("Mmap[ensure_write_to] page %x for %d pid: %x", vaddr, RUNNING_THREAD->process->pid, zone->flags);
 #endif
+        if (zone->type & (ZONE_TYPE_MAPPED_FILE_PRIVATLY | ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+            uint32_t settings;
+            uint32_t paddr = _vmm_get_file_page_paddr(zone, PAGE_START(vaddr), true, &settings);
+            if (!paddr) {
+                kpanic("NO PHYSICAL SPACE");
+            }
+            vmm_map_page_lockless(vaddr, paddr, settings);
+            return OK;
+        }
         vmm_load_page_lockless(vaddr, zone->flags);
     } else {
         /* FIXME: Now we have a standard zone for kernel, but it's better to do the same thing as for user's pages */
@@ -910,44 +1393,6 @@ static void _vmm_ensure_write_to_range(uint32_t vaddr, uint32_t length)
     }
 }
 
-/**
- * The function is supposed to copy a page from @src_ptable to active
- * ptable. The page which is copied has address @vaddr. ONLY TO RESOLVE COW!
- */
-static int _vmm_copy_page_to_resolve_cow(proc_t* p, uint32_t vaddr, ptable_t* src_ptable, int page_index)
-{
-    page_desc_t* old_page_desc = &src_ptable->entities[page_index];
-
-    proc_zone_t* zone = proc_find_zone(p, vaddr);
-    if (!zone) {
-        log_error("Cow: No page in zone");
-        return SHOULD_CRASH;
-    }
-
-    if ((zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
-        uint32_t old_page_paddr = page_desc_get_frame(*old_page_desc);
-        return vmm_map_page_lockless(vaddr, old_page_paddr, zone->flags);
-    }
-
-    vmm_load_page_lockless(vaddr, zone->flags);
-
-    /* Mapping the old page to do a copy */
-    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
-    uint32_t old_page_vaddr = (uint32_t)tmp_zone.start;
-    uint32_t old_page_paddr = page_desc_get_frame(*old_page_desc);
-    vmm_map_page_lockless(old_page_vaddr, old_page_paddr, PAGE_READABLE);
-
-    /*  We don't need to check if there is a problem with cow, since this is a special copy function
-        to resolve cow. So, we know that pages were created recently. Checking cow here would cause an
-        ub, since table has not been setup correctly yet. */
-    memcpy((uint8_t*)vaddr, (uint8_t*)old_page_vaddr, VMM_PAGE_SIZE);
-
-    /* Freeing */
-    vmm_unmap_page_lockless(old_page_vaddr);
-    zoner_free_zone(tmp_zone);
-    return 0;
-}
-
 /**
  * ZEROING ON DEMAND FUNCTIONS
  */
@@ -1012,9 +1457,11 @@ static ALWAYS_INLINE pdirectory_t* vmm_new_user_pdir_lockless()
 
 pdirectory_t* vmm_new_user_pdir()
 {
-    lock_acquire(&_vmm_lock);
+    // The active pspace is the template of the new one.
+    lock_t* lock = _vmm_pdir_lock(THIS_CPU->pdir);
+    lock_acquire(lock);
     pdirectory_t* res = vmm_new_user_pdir_lockless();
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -1040,19 +1487,36 @@ static ALWAYS_INLINE pdirectory_t* vmm_new_forked_user_pdir_lockless()
         }
     }
 
-    system_flush_whole_tlb();
+    // Both address spaces hold a reference to each shared page of ptables.
+    uint32_t ptables_per_page = VMM_PAGE_SIZE / PTABLE_SIZE;
+    uint32_t table_coverage = VMM_PAGE_SIZE * VMM_TOTAL_PAGES_PER_TABLE;
+    for (int i = 0; i < VMM_KERNEL_TABLES_START; i += ptables_per_page) {
+        uint32_t ptables_frame = _vmm_ptables_group_frame(THIS_CPU->pdir, i * table_coverage);
+        if (ptables_frame) {
+            pmm_frame_ref(ptables_frame);
+            continue;
+        }
+
+        // Nothing is in use, so the new pdir should not restore these tables from allocated state.
+        for (int j = 0; j < ptables_per_page; j++) {
+            table_desc_clear(&new_pdir->entities[i + j]);
+        }
+    }
+
+    _vmm_flush_user_tlb();
     return new_pdir;
 }
 
 pdirectory_t* vmm_new_forked_user_pdir()
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_pdir_lock(THIS_CPU->pdir);
+    lock_acquire(lock);
     pdirectory_t* res = vmm_new_forked_user_pdir_lockless();
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
-static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, dynamic_array_t* zones)
+static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, rbtree_t* zones)
 {
     if (!pdir) {
         return -EINVAL;
@@ -1080,11 +1544,16 @@ static ALWAYS_INLINE int vmm_free_pdir_lockless(pdirectory_t* pdir, dynamic_arra
     return 0;
 }
 
-int vmm_free_pdir(pdirectory_t* pdir, dynamic_array_t* zones)
+int vmm_free_pdir(pdirectory_t* pdir, rbtree_t* zones)
 {
-    lock_acquire(&_vmm_lock);
+    if (!pdir) {
+        return -EINVAL;
+    }
+
+    lock_t* lock = _vmm_pdir_lock(pdir);
+    lock_acquire(lock);
     int res = vmm_free_pdir_lockless(pdir, zones);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -1094,7 +1563,9 @@ void* vmm_bring_to_kernel(uint8_t* src, uint32_t length)
         return src;
     }
     uint8_t* kaddr = kmalloc(length);
+    lock_acquire(&_vmm_kernel_lock);
     _vmm_ensure_write_to_range((uint32_t)kaddr, length);
+    lock_release(&_vmm_kernel_lock);
     memcpy(kaddr, src, length);
     return (void*)kaddr;
 }
@@ -1106,9 +1577,29 @@ static ALWAYS_INLINE void vmm_prepare_active_pdir_for_copying_at_lockless(uint32
 
 void vmm_prepare_active_pdir_for_copying_at(uint32_t dest_vaddr, uint32_t length)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(dest_vaddr);
+    lock_acquire(lock);
     vmm_prepare_active_pdir_for_copying_at_lockless(dest_vaddr, length);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
+}
+
+/**
+ * The function returns the physical address of user @vaddr in the active
+ * address space. The page is prepared for writing first, so its frame is
+ * not a copy-on-write one which is about to be replaced. Returns 0 if
+ * @vaddr is not in a zone.
+ */
+uint32_t vmm_get_user_frame_for_writing(uint32_t vaddr)
+{
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    _vmm_ensure_write_to_page(vaddr);
+    uint32_t paddr = 0;
+    if (_vmm_is_page_present(vaddr)) {
+        paddr = (uint32_t)_vmm_convert_vaddr2paddr(vaddr);
+    }
+    lock_release(lock);
+    return paddr;
 }
 
 static ALWAYS_INLINE void vmm_copy_to_user_lockless(void* dest, void* src, uint32_t length)
@@ -1119,14 +1610,38 @@ static ALWAYS_INLINE void vmm_copy_to_user_lockless(void* dest, void* src, uint3
 
 void vmm_copy_to_user(void* dest, void* src, uint32_t length)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for((uint32_t)dest);
+    lock_acquire(lock);
     vmm_prepare_active_pdir_for_copying_at_lockless((uint32_t)dest, length);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     memcpy(dest, src, length);
 }
 
-static ALWAYS_INLINE void vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+/**
+ * Data is copied to user pages of other address spaces only if they are
+ * in writable zones of their process, since the destination could come
+ * from user space. Returns -EFAULT otherwise.
+ */
+static int _vmm_check_copy_to_pdir(pdirectory_t* pdir, uint32_t dest_vaddr, uint32_t length)
 {
+    if (PAGE_CHOOSE_OWNER(dest_vaddr) != PAGE_USER) {
+        return 0;
+    }
+
+    proc_t* holder_proc = tasking_get_proc_by_pdir(pdir);
+    if (!holder_proc || !proc_is_range_writable(holder_proc, dest_vaddr, length)) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static ALWAYS_INLINE int vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+{
+    int err = _vmm_check_copy_to_pdir(pdir, dest_vaddr, length);
+    if (err) {
+        return err;
+    }
+
     pdirectory_t* prev_pdir = vmm_get_active_pdir();
     uint8_t* ksrc;
     if ((uint32_t)src < KERNEL_BASE) {
@@ -1147,10 +1662,16 @@ static ALWAYS_INLINE void vmm_copy_to_pdir_lockless(pdirectory_t* pdir, void* sr
     }
 
     vmm_switch_pdir_lockless(prev_pdir);
+    return 0;
 }
 
-void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+int vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
 {
+    int err = _vmm_check_copy_to_pdir(pdir, dest_vaddr, length);
+    if (err) {
+        return err;
+    }
+
     pdirectory_t* prev_pdir = vmm_get_active_pdir();
     uint8_t* ksrc;
     if ((uint32_t)src < KERNEL_BASE) {
@@ -1160,10 +1681,11 @@ void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32
         ksrc = src;
     }
 
-    lock_acquire(&_vmm_lock);
     vmm_switch_pdir_lockless(pdir);
+    lock_t* lock = _vmm_lock_for(dest_vaddr);
+    lock_acquire(lock);
     vmm_prepare_active_pdir_for_copying_at_lockless(dest_vaddr, length);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
 
     uint8_t* dest = (uint8_t*)dest_vaddr;
     memcpy(dest, ksrc, length);
@@ -1173,17 +1695,74 @@ void vmm_copy_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32
     }
 
     vmm_switch_pdir_lockless(prev_pdir);
+    return 0;
+}
+
+/**
+ * The function writes to frame @paddr through a temporary kernel mapping,
+ * so the protection of the user mapping of the frame doesn't matter.
+ */
+static void _vmm_write_to_frame(uint32_t paddr, uint32_t offset, uint8_t* src, uint32_t length)
+{
+    zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
+    vmm_map_page(tmp_zone.start, paddr, PAGE_READABLE | PAGE_WRITABLE);
+    memcpy((uint8_t*)tmp_zone.ptr + offset, src, length);
+    vmm_unmap_page(tmp_zone.start);
+    zoner_free_zone(tmp_zone);
+}
+
+/**
+ * The function copies a part of an executable image to @pdir of a process
+ * which is being loaded. Read-only zones are filled as well, so every page
+ * of the range first gets a frame which no one else holds, e.g. the page
+ * cache, and is then written through a kernel mapping.
+ */
+void vmm_copy_image_to_pdir(pdirectory_t* pdir, void* src, uint32_t dest_vaddr, uint32_t length)
+{
+    pdirectory_t* prev_pdir = vmm_get_active_pdir();
+    vmm_switch_pdir_lockless(pdir);
+    proc_t* holder_proc = tasking_get_proc_by_pdir(pdir);
+    if (!holder_proc) {
+        kpanic("No proc with the pdir\n");
+    }
+
+    lock_t* lock = _vmm_lock_for(dest_vaddr);
+    lock_acquire(lock);
+    vmm_prepare_active_pdir_for_copying_at_lockless(dest_vaddr, length);
+
+    uint8_t* data = (uint8_t*)src;
+    uint32_t vaddr = dest_vaddr;
+    uint32_t end = dest_vaddr + length;
+    while (vaddr < end) {
+        uint32_t page_vaddr = PAGE_START(vaddr);
+        uint32_t len = min(end - vaddr, page_vaddr + VMM_PAGE_SIZE - vaddr);
+        proc_zone_t* zone = proc_find_zone(holder_proc, page_vaddr);
+        if (zone && _vmm_is_page_present(page_vaddr)) {
+            ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(page_vaddr);
+            page_desc_t* page = _vmm_ptable_lookup(ptable, page_vaddr);
+            if (pmm_frame_refcount(page_desc_get_frame(*page)) > 1) {
+                _vmm_copy_page_to_new_frame(page_vaddr, zone->flags);
+            }
+            _vmm_write_to_frame(page_desc_get_frame(*page), vaddr - page_vaddr, data, len);
+        }
+        data += len;
+        vaddr += len;
+    }
+
+    lock_release(lock);
+    vmm_switch_pdir_lockless(prev_pdir);
 }
 
 void vmm_zero_user_pages(pdirectory_t* pdir)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_pdir_lock(pdir);
+    lock_acquire(lock);
     for (int i = 0; i < VMM_KERNEL_TABLES_START; i++) {
         table_desc_t* ptable_desc = &pdir->entities[i];
         table_desc_del_attrs(ptable_desc, TABLE_DESC_WRITABLE);
         table_desc_set_attrs(ptable_desc, TABLE_DESC_ZEROING_ON_DEMAND);
     }
-    lock_release(&_vmm_lock);
+    lock_release(lock);
 }
 
 pdirectory_t* vmm_get_active_pdir()
@@ -1221,15 +1800,16 @@ static ALWAYS_INLINE int vmm_tune_page_lockless(uint32_t vaddr, uint32_t setting
         vmm_load_page_lockless(vaddr, settings);
     }
 
-    system_flush_tlb_entry(vaddr);
+    _vmm_flush_tlb_entry(vaddr);
     return 0;
 }
 
 int vmm_tune_page(uint32_t vaddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_tune_page_lockless(vaddr, settings);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
@@ -1245,9 +1825,12 @@ static ALWAYS_INLINE int vmm_tune_pages_lockless(uint32_t vaddr, uint32_t length
 
 int vmm_tune_pages(uint32_t vaddr, uint32_t length, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    _vmm_tlb_batch_begin();
     int res = vmm_tune_pages_lockless(vaddr, length, settings);
-    lock_release(&_vmm_lock);
+    _vmm_tlb_batch_end();
+    lock_release(lock);
     return res;
 }
 
@@ -1266,9 +1849,10 @@ static ALWAYS_INLINE int vmm_load_page_lockless(uint32_t vaddr, uint32_t setting
 
 int vmm_load_page(uint32_t vaddr, uint32_t settings)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     if (_vmm_is_page_present(vaddr)) {
-        lock_release(&_vmm_lock);
+        lock_release(lock);
         return -EALREADY;
     }
 
@@ -1279,7 +1863,7 @@ int vmm_load_page(uint32_t vaddr, uint32_t settings)
     }
     int res = vmm_map_page_lockless(vaddr, paddr, settings);
     uint8_t* dest = (uint8_t*)_vmm_round_floor_to_page(vaddr);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     memset(dest, 0, VMM_PAGE_SIZE);
     return res;
 }
@@ -1306,25 +1890,26 @@ static ALWAYS_INLINE int vmm_copy_page_lockless(uint32_t to_vaddr, uint32_t src_
     zone_t tmp_zone = zoner_new_zone(VMM_PAGE_SIZE);
     uint32_t old_page_vaddr = (uint32_t)tmp_zone.start;
     uint32_t old_page_paddr = page_desc_get_frame(*old_page_desc);
-    vmm_map_page_lockless(old_page_vaddr, old_page_paddr, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE);
+    vmm_map_page(old_page_vaddr, old_page_paddr, PAGE_READABLE | PAGE_WRITABLE | PAGE_EXECUTABLE);
 
     memcpy((uint8_t*)to_vaddr, (uint8_t*)old_page_vaddr, VMM_PAGE_SIZE);
 
     /* Freeing */
-    vmm_unmap_page_lockless(old_page_vaddr);
+    vmm_unmap_page(old_page_vaddr);
     zoner_free_zone(tmp_zone);
     return 0;
 }
 
 int vmm_copy_page(uint32_t to_vaddr, uint32_t src_vaddr, ptable_t* src_ptable)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(to_vaddr);
+    lock_acquire(lock);
     int res = vmm_copy_page_lockless(to_vaddr, src_vaddr, src_ptable);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
-static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* page, dynamic_array_t* zones)
+static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* page, rbtree_t* zones)
 {
     if (!page_desc_has_attrs(*page, PAGE_DESC_PRESENT)) {
         return 0;
@@ -1337,30 +1922,106 @@ static ALWAYS_INLINE int vmm_free_page_lockless(uint32_t vaddr, page_desc_t* pag
             return 0;
         }
     }
-    _vmm_free_page_paddr(page_desc_get_frame(*page));
+
+    // The frame could be still used by forked address spaces.
+    uint32_t frame = page_desc_get_frame(*page);
+    if (pmm_frame_unref(frame) == 0) {
+        _vmm_free_page_paddr(frame);
+    }
     return 0;
 }
 
-int vmm_free_page(uint32_t vaddr, page_desc_t* page, dynamic_array_t* zones)
+int vmm_free_page(uint32_t vaddr, page_desc_t* page, rbtree_t* zones)
 {
-    lock_acquire(&_vmm_lock);
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     int res = vmm_free_page_lockless(vaddr, page, zones);
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return res;
 }
 
-int vmm_page_fault_handler(uint32_t info, uint32_t vaddr)
+/**
+ * The function is supposed to give frames of user pages back, while the
+ * zone which covers them is still alive. Tables which are shared after
+ * fork are copied first, so the other address space keeps its pages.
+ */
+static ALWAYS_INLINE int vmm_free_user_pages_lockless(uint32_t vaddr, uint32_t length, rbtree_t* zones)
 {
-    lock_acquire(&_vmm_lock);
-    if (_vmm_is_table_not_present(info) || _vmm_is_page_not_present(info)) {
-        // Check again with locks, since other cpu could already load this page.
-        if (_vmm_is_page_present(vaddr)) {
-            lock_release(&_vmm_lock);
-            return OK;
+    if ((vaddr & 0xfff) || PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return -VMM_ERR_BAD_ADDR;
+    }
+
+    for (uint32_t page_vaddr = vaddr; page_vaddr < vaddr + length; page_vaddr += VMM_PAGE_SIZE) {
+        table_desc_t* ptable_desc = _vmm_pdirectory_lookup(THIS_CPU->pdir, page_vaddr);
+        if (!table_desc_is_present(*ptable_desc)) {
+            continue;
         }
 
-        int res = _vmm_load_page_with_perm(vaddr);
-        lock_release(&_vmm_lock);
+        if (table_desc_is_copy_on_write(*ptable_desc)) {
+            proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+            if (!holder_proc) {
+                kpanic("No proc with the pdir\n");
+            }
+            _vmm_resolve_copy_on_write(holder_proc, page_vaddr);
+        }
+
+        ptable_t* ptable = (ptable_t*)_vmm_pspace_get_vaddr_of_active_ptable(page_vaddr);
+        page_desc_t* page = _vmm_ptable_lookup(ptable, page_vaddr);
+        if (page_desc_is_present(*page)) {
+            vmm_free_page_lockless(page_vaddr, page, zones);
+            page_desc_del_attrs(page, PAGE_DESC_WRITABLE);
+            page_desc_del_frame(page);
+            _vmm_flush_tlb_entry(page_vaddr);
+        }
+    }
+
+    return 0;
+}
+
+int vmm_free_user_pages(uint32_t vaddr, uint32_t length, rbtree_t* zones)
+{
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
+    _vmm_tlb_batch_begin();
+    int res = vmm_free_user_pages_lockless(vaddr, length, zones);
+    _vmm_tlb_batch_end();
+    lock_release(lock);
+    return res;
+}
+
+/**
+ * The function loads a page of a mapped file. Reading could take a while,
+ * so it's done without holding the lock of the address space and the page
+ * is mapped only when it's ready.
+ */
+static int _vmm_load_file_page(proc_zone_t* zone, uint32_t vaddr, bool for_write)
+{
+    vaddr = PAGE_START(vaddr);
+    uint32_t settings;
+    uint32_t paddr = _vmm_get_file_page_paddr(zone, vaddr, for_write, &settings);
+    if (!paddr) {
+        /* TODO: Swap pages to make it able to allocate. */
+        kpanic("NO PHYSICAL SPACE");
+    }
+
+    lock_t* lock = _vmm_pdir_lock(THIS_CPU->pdir);
+    lock_acquire(lock);
+    // Other thread of the process could load this page meanwhile.
+    if (_vmm_is_page_present(vaddr)) {
+        lock_release(lock);
+        if (pmm_frame_unref(paddr) == 0) {
+            _vmm_free_page_paddr(paddr);
+        }
+        return OK;
+    }
+    vmm_map_page_lockless(vaddr, paddr, settings);
+    lock_release(lock);
+    return OK;
+}
+
+int vmm_page_fault_handler(uint32_t info, uint32_t vaddr)
+{
+    if (_vmm_is_table_not_present(info) || _vmm_is_page_not_present(info)) {
         if (PAGE_CHOOSE_OWNER(vaddr) == PAGE_USER && vmm_get_active_pdir() != vmm_get_kernel_pdir()) {
             proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
             if (!holder_proc) {
@@ -1372,37 +2033,57 @@ int vmm_page_fault_handler(uint32_t info, uint32_t vaddr)
                 return SHOULD_CRASH;
             }
 
-            if (zone->type & ZONE_TYPE_MAPPED_FILE_PRIVATLY) {
-                uint32_t offset = zone->offset + (PAGE_START(vaddr) - zone->start);
-                lock_acquire(&zone->file->lock);
-                zone->file->ops->file.read(zone->file, (void*)PAGE_START(vaddr), offset, VMM_PAGE_SIZE);
-                lock_release(&zone->file->lock);
+            if (zone->type & (ZONE_TYPE_MAPPED_FILE_PRIVATLY | ZONE_TYPE_MAPPED_FILE_SHAREDLY)) {
+                return _vmm_load_file_page(zone, vaddr, _vmm_is_caused_writing(info));
             }
         }
+
+        lock_t* lock = _vmm_lock_for(vaddr);
+        lock_acquire(lock);
+        // Check again with locks, since other cpu could already load this page.
+        if (_vmm_is_page_present(vaddr)) {
+            lock_release(lock);
+            return OK;
+        }
+
+        int res = _vmm_load_page_with_perm(vaddr);
+        lock_release(lock);
         return res;
     }
 
+    lock_t* lock = _vmm_lock_for(vaddr);
+    lock_acquire(lock);
     if (_vmm_is_caused_writing(info)) {
         int visited = 0;
+        proc_t* holder_proc = NULL;
+        if (PAGE_CHOOSE_OWNER(vaddr) == PAGE_USER && vmm_get_active_pdir() != vmm_get_kernel_pdir()) {
+            holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
+        }
         if (_vmm_is_copy_on_write(vaddr)) {
-            proc_t* holder_proc = tasking_get_proc_by_pdir(vmm_get_active_pdir());
             if (!holder_proc) {
                 kpanic("No proc with the pdir\n");
             }
             _vmm_resolve_copy_on_write(holder_proc, vaddr);
             visited++;
         }
+        if (holder_proc && _vmm_is_page_copy_on_write(holder_proc, vaddr)) {
+            _vmm_resolve_page_copy_on_write(holder_proc, vaddr);
+            visited++;
+        } else if (holder_proc && _vmm_is_shared_file_page_clean(holder_proc, vaddr)) {
+            _vmm_resolve_shared_file_page_write(holder_proc, vaddr);
+            visited++;
+        }
         // if (_vmm_is_zeroing_on_demand(vaddr)) {
         //     _vmm_resolve_zeroing_on_demand(vaddr);
         //     visited++;
         // }
         if (!visited) {
-            lock_release(&_vmm_lock);
+            lock_release(lock);
             return SHOULD_CRASH;
         }
     }
 
-    lock_release(&_vmm_lock);
+    lock_release(lock);
     return OK;
 }
 
@@ -1433,10 +2114,8 @@ static ALWAYS_INLINE int vmm_switch_pdir_lockless(pdirectory_t* pdir)
 
 int vmm_switch_pdir(pdirectory_t* pdir)
 {
-    lock_acquire(&_vmm_lock);
-    int res = vmm_switch_pdir_lockless(pdir);
-    lock_release(&_vmm_lock);
-    return res;
+    // Only the state of this cpu is changed.
+    return vmm_switch_pdir_lockless(pdir);
 }
 
 void vmm_enable_paging()
@@ -12,8 +12,8 @@
  * Current distribution:
  *  Kernel      	4 MB
  *  Pspace      	4 MB
- *  Zoner Bitmap	32 KB
- *  Kmalloc Space	32Kb + 4 MB
+ *  Zoner Bitmap	33 KB
+ *  Kmalloc Space	8 MB
  *  Syscall Jumper	4 KB
  *  Other data
  */
@@ -25,7 +25,7 @@
 #include <mem/vmm/vmm.h>
 #include <mem/vmm/zoner.h>
 
-#define ZONER_BITMAP_SIZE (4 * 1024 * 8)
+#define ZONER_BITMAP_BITS (4 * 1024 * 8 * 8)
 #define ZONER_TO_BITMAP_INDEX(x) ((x - KERNEL_BASE) >> 12)
 #define ZONER_FROM_BITMAP_INDEX(x) ((x << 12) + KERNEL_BASE)
 
@@ -60,11 +60,11 @@ static uint32_t _zoner_new_vzone_aligned_lockless(uint32_t size, uint32_t alignm
 void zoner_place_bitmap()
 {
     lock_acquire(&_zoner_lock);
-    _zoner_bitmap = (uint8_t*)_zoner_new_vzone_lockless(ZONER_BITMAP_SIZE);
-    bitmap = bitmap_wrap(_zoner_bitmap, ZONER_BITMAP_SIZE * 8);
-    memset(_zoner_bitmap, 0, ZONER_BITMAP_SIZE);
+    _zoner_bitmap = (uint8_t*)_zoner_new_vzone_lockless(BITMAP_SIZE(ZONER_BITMAP_BITS));
+    memset(_zoner_bitmap, 0, BITMAP_SIZE(ZONER_BITMAP_BITS));
+    bitmap = bitmap_wrap(_zoner_bitmap, ZONER_BITMAP_BITS);
     _zoner_bitmap_set = true;
-    bitmap_set_range(bitmap, 0, ZONER_TO_BITMAP_INDEX(_zoner_next_vaddr));
+    bitmap_set_range(bitmap, 0, ZONER_TO_BITMAP_INDEX(_zoner_next_vaddr + VMM_PAGE_SIZE - 1));
     lock_release(&_zoner_lock);
 }
 
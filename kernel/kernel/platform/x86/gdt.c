@@ -6,6 +6,7 @@
 
 #include <mem/kmalloc.h>
 #include <mem/vmm/vmm.h>
+#include <platform/generic/cpu.h>
 #include <platform/x86/gdt.h>
 #include <platform/x86/tasking/tss.h>
 
@@ -28,5 +29,10 @@ void gdt_setup()
     gdt[SEG_KDATA] = SEG_PG(SEGF_W, 0, 0xffffffff, 0);
     gdt[SEG_UCODE] = SEG_PG(SEGF_X | SEGF_R, 0, 0xffffffff, DPL_USER);
     gdt[SEG_UDATA] = SEG_PG(SEGF_W, 0, 0xffffffff, DPL_USER);
+    gdt_load();
+}
+
+void gdt_load()
+{
     lgdt(gdt, sizeof(gdt));
 }
\ No newline at end of file
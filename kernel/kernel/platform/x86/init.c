@@ -16,22 +16,30 @@
 #include <platform/x86/gdt.h>
 #include <platform/x86/idt.h>
 #include <platform/x86/init.h>
+#include <platform/x86/smp.h>
+#include <platform/x86/tasking/tss.h>
 
 void platform_init_boot_cpu()
 {
     gdt_setup();
+    tss_load(0);
     interrupts_setup();
 }
 
 void platform_setup_boot_cpu()
 {
     clean_screen();
-    pit_setup();
     fpu_init();
+
+    // Without APICs the boot cpu runs alone, ticked by the PIT.
+    if (smp_install() < 0) {
+        pit_setup();
+    }
 }
 
 void platform_setup_secondary_cpu()
 {
+    smp_setup_secondary_cpu();
 }
 
 void platform_drivers_setup()
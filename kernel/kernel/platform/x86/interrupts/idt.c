@@ -29,7 +29,7 @@ void interrupts_setup()
 {
     idt_element_setup(0, (void*)isr0, SYS);
     idt_element_setup(1, (void*)isr1, SYS);
-    idt_element_setup(2, (void*)isr2, SYS);
+    idt_element_setup(2, (void*)isr_nmi, SYS);
     idt_element_setup(3, (void*)isr3, SYS);
     idt_element_setup(4, (void*)isr4, SYS);
     idt_element_setup(5, (void*)isr5, SYS);
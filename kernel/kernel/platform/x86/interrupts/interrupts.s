@@ -47,12 +47,17 @@ global irq12
 global irq13
 global irq14
 global irq15
+global irq_lapic_timer
+global irq_ipi_resched
+global irq_lapic_spurious
+global isr_nmi
 
 global syscall
 
 extern isr_handler
 extern irq_handler
 extern sys_handler
+extern smp_nmi_handler
 
 global trap_return
 
@@ -62,6 +67,7 @@ cr2_ch: db 0
 
 isr_common:
     cli
+    cld ; the user could leave DF set, C code expects it clear
     
     push ds
     push es
@@ -82,6 +88,7 @@ isr_common:
 
 irq_common:
     cli
+    cld
     
     push ds
     push es
@@ -102,6 +109,7 @@ irq_common:
 
 sys_common:
     cli
+    cld
     
     push ds
     push es
@@ -415,6 +423,48 @@ irq15:
     push 47
     jmp  irq_common
 
+
+irq_lapic_timer:
+    push 0
+    push 48
+    jmp  irq_common
+
+
+irq_ipi_resched:
+    push 0
+    push 49
+    jmp  irq_common
+
+
+; Spurious interrupts of the LAPIC must not be acknowledged.
+irq_lapic_spurious:
+    iret
+
+
+; NMIs come even when interrupts are disabled and could interrupt any
+; kernel code, so the handler doesn't touch the state of the cpu and
+; interrupts are left as they were.
+isr_nmi:
+    cld ; iret restores the flag of the interrupted code
+    push ds
+    push es
+    push fs
+    push gs
+    pushad
+
+    mov ax, 0x10 ; SEG_KDATA
+    mov ds, ax
+    mov es, ax
+
+    call smp_nmi_handler
+
+    popad
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    iret
+
 syscall:
     push 0
     push 0x80
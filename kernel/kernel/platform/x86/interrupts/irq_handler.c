@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <drivers/x86/lapic.h>
 #include <platform/generic/system.h>
 #include <platform/x86/irq_handler.h>
 #include <tasking/cpu.h>
@@ -20,10 +21,14 @@ void irq_handler(trapframe_t* tf)
     system_disable_interrupts();
     cpu_enter_kernel_space();
 
-    if (tf->int_no >= IRQ_SLAVE_OFFSET) {
-        port_byte_out(0xA0, 0x20);
+    if (lapic_is_enabled()) {
+        lapic_eoi();
+    } else {
+        if (tf->int_no >= IRQ_SLAVE_OFFSET) {
+            port_byte_out(0xA0, 0x20);
+        }
+        port_byte_out(0x20, 0x20);
     }
-    port_byte_out(0x20, 0x20);
 
     if (likely(RUNNING_THREAD)) {
         if (RUNNING_THREAD->process->is_kthread) {
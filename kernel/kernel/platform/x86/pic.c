@@ -31,4 +31,11 @@ void pic_remap(unsigned int offset1, unsigned int offset2)
     io_wait();
     port_byte_out(MASTER_PIC_DATA, 0x00);
     port_byte_out(SLAVE_PIC_DATA, 0x00);
-}
\ No newline at end of file
+}
+
+/* Masks all lines, interrupts are delivered by the IOAPIC then. */
+void pic_disable()
+{
+    port_byte_out(MASTER_PIC_DATA, 0xff);
+    port_byte_out(SLAVE_PIC_DATA, 0xff);
+}
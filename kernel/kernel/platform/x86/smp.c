@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <drivers/x86/acpi.h>
+#include <drivers/x86/fpu.h>
+#include <drivers/x86/ioapic.h>
+#include <drivers/x86/lapic.h>
+#include <drivers/x86/pit.h>
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/lock.h>
+#include <libkern/log.h>
+#include <mem/kmalloc.h>
+#include <platform/generic/registers.h>
+#include <platform/generic/system.h>
+#include <platform/x86/gdt.h>
+#include <platform/x86/idt.h>
+#include <platform/x86/memmap.h>
+#include <platform/x86/pic.h>
+#include <platform/x86/smp.h>
+#include <platform/x86/tasking/tss.h>
+#include <tasking/cpu.h>
+#include <tasking/sched.h>
+
+// #define SMP_DEBUG
+
+/**
+ * Application processors are found in the MADT and started one by one
+ * with INIT and startup IPIs. Each of them goes through the trampoline to
+ * _smp_ap_entry() and then joins the boot flow in boot_secondary_cpu().
+ *
+ * TLB shootdowns are sent as NMIs. A cpu could spin on a lock with
+ * interrupts disabled while the holder of the lock waits for the flush,
+ * NMIs are delivered anyway, so the wait always ends.
+ */
+
+extern void smp_trampoline_start();
+extern void smp_trampoline_end();
+extern uint32_t smp_trampoline_pdir;
+extern uint32_t smp_trampoline_stack;
+extern uint32_t smp_trampoline_entry;
+extern void boot_secondary_cpu();
+
+static acpi_apic_info_t _smp_info;
+static uint8_t _smp_lapic_ids[CPU_CNT];
+static bool _smp_online[CPU_CNT];
+static int _smp_booting_cpu;
+
+static lock_t _smp_tlb_lock;
+static uint32_t _smp_tlb_requests[CPU_CNT];
+static int _smp_tlb_acks;
+
+static inline uint32_t* _smp_trampoline_var(uint32_t* var)
+{
+    uint32_t offset = (uint32_t)var - (uint32_t)smp_trampoline_start;
+    return (uint32_t*)(BIOS_SETTING_BASE + SMP_TRAMPOLINE_PADDR + offset);
+}
+
+static void _smp_resched_handler()
+{
+    if (RUNNING_THREAD == THIS_CPU->idle_thread) {
+        resched();
+    }
+}
+
+/**
+ * The function is the first C code run by an application processor. It
+ * runs on the boot stack with the kernel pdir.
+ */
+static void _smp_ap_entry()
+{
+    int cpu_id = __atomic_load_n(&_smp_booting_cpu, __ATOMIC_ACQUIRE);
+    gdt_load();
+    tss_load(cpu_id);
+    lidt(idt, sizeof(idt));
+    __atomic_store_n(&_smp_online[cpu_id], true, __ATOMIC_RELEASE);
+    boot_secondary_cpu();
+}
+
+static bool _smp_wait_for_cpu(int cpu_id)
+{
+    for (int ms = 0; ms < SMP_AP_START_TIMEOUT_MS; ms++) {
+        if (__atomic_load_n(&_smp_online[cpu_id], __ATOMIC_ACQUIRE)) {
+            return true;
+        }
+        pit_wait_us(1000);
+    }
+    return false;
+}
+
+static void _smp_boot_cpu(int cpu_id)
+{
+    uint8_t apic_id = _smp_lapic_ids[cpu_id];
+    char* stack = kmalloc(SMP_AP_BOOT_STACK_SIZE);
+    *_smp_trampoline_var(&smp_trampoline_stack) = (uint32_t)stack + SMP_AP_BOOT_STACK_SIZE;
+    __atomic_store_n(&_smp_booting_cpu, cpu_id, __ATOMIC_RELEASE);
+
+    lapic_send_init(apic_id);
+    pit_wait_us(10000);
+    lapic_send_startup(apic_id, SMP_TRAMPOLINE_PADDR);
+    pit_wait_us(200);
+    if (!__atomic_load_n(&_smp_online[cpu_id], __ATOMIC_ACQUIRE)) {
+        lapic_send_startup(apic_id, SMP_TRAMPOLINE_PADDR);
+    }
+
+    if (!_smp_wait_for_cpu(cpu_id)) {
+        log_warn("SMP: cpu %d (LAPIC %d) didn't start", cpu_id, apic_id);
+        kfree(stack);
+    }
+}
+
+static void _smp_boot_secondary_cpus()
+{
+    uint32_t trampoline_size = (uint32_t)smp_trampoline_end - (uint32_t)smp_trampoline_start;
+    memcpy((void*)(BIOS_SETTING_BASE + SMP_TRAMPOLINE_PADDR), (void*)smp_trampoline_start, trampoline_size);
+    *_smp_trampoline_var(&smp_trampoline_pdir) = read_cr3();
+    *_smp_trampoline_var(&smp_trampoline_entry) = (uint32_t)_smp_ap_entry;
+
+    // Cpus get ids in the order of the MADT, the boot cpu is always 0.
+    // The MADT list is cut at CPU_CNT and may miss the boot cpu, so the
+    // others are cut again to leave a slot for it.
+    uint8_t boot_apic_id = lapic_id();
+    int cpus = 1;
+    _smp_lapic_ids[0] = boot_apic_id;
+    for (int i = 0; i < _smp_info.cpus_count && cpus < CPU_CNT; i++) {
+        if (_smp_info.lapic_ids[i] != boot_apic_id) {
+            _smp_lapic_ids[cpus++] = _smp_info.lapic_ids[i];
+        }
+    }
+
+    for (int cpu_id = 1; cpu_id < cpus; cpu_id++) {
+        _smp_boot_cpu(cpu_id);
+    }
+}
+
+/**
+ * The function moves interrupts from the PIC to the APICs and starts other
+ * cpus. Returns -ENODEV if the machine has no APICs, the boot cpu keeps the
+ * PIC and the PIT then.
+ */
+int smp_install()
+{
+    lock_init(&_smp_tlb_lock);
+    _smp_online[0] = true;
+
+    int err = acpi_find_apic_info(&_smp_info);
+    if (err) {
+        return err;
+    }
+
+    pic_disable();
+    lapic_install(_smp_info.lapic_paddr);
+    ioapic_install(&_smp_info, lapic_id());
+    ioapic_mask_irq(0); // The LAPIC timer ticks instead of the PIT.
+
+    idt_element_setup(IRQ_IPI_RESCHED, (void*)irq_ipi_resched, false);
+    set_irq_handler(IRQ_IPI_RESCHED, _smp_resched_handler);
+    lapic_setup_cpu();
+
+    _smp_boot_secondary_cpus();
+#ifdef SMP_DEBUG
+    log("SMP: %d cpus are online", active_cpu_count());
+#endif
+    return 0;
+}
+
+void smp_setup_secondary_cpu()
+{
+    lapic_setup_cpu();
+    fpu_init();
+}
+
+/**
+ * The function makes other online cpus flush @vaddr (or the whole TLB with
+ * SMP_TLB_FLUSH_ALL) and waits till they are done.
+ */
+void smp_tlb_shootdown(uint32_t vaddr)
+{
+    if (!lapic_is_enabled()) {
+        return;
+    }
+
+    int this_cpu = system_cpu_id();
+    lock_acquire(&_smp_tlb_lock);
+    int targets = 0;
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (i != this_cpu && __atomic_load_n(&_smp_online[i], __ATOMIC_ACQUIRE)) {
+            targets++;
+        }
+    }
+    if (!targets) {
+        lock_release(&_smp_tlb_lock);
+        return;
+    }
+
+    __atomic_store_n(&_smp_tlb_acks, targets, __ATOMIC_RELEASE);
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (i != this_cpu && __atomic_load_n(&_smp_online[i], __ATOMIC_ACQUIRE)) {
+            __atomic_store_n(&_smp_tlb_requests[i], vaddr | SMP_TLB_PENDING, __ATOMIC_RELEASE);
+            lapic_send_nmi(_smp_lapic_ids[i]);
+        }
+    }
+
+    while (__atomic_load_n(&_smp_tlb_acks, __ATOMIC_ACQUIRE)) { }
+    lock_release(&_smp_tlb_lock);
+}
+
+void smp_nmi_handler()
+{
+    int cpu_id = system_cpu_id();
+    uint32_t request = __atomic_exchange_n(&_smp_tlb_requests[cpu_id], 0, __ATOMIC_ACQ_REL);
+    if (!(request & SMP_TLB_PENDING)) {
+        return;
+    }
+
+    if (request & SMP_TLB_FLUSH_ALL) {
+        system_flush_whole_tlb();
+    } else {
+        system_flush_tlb_entry(request & ~(VMM_PAGE_SIZE - 1));
+    }
+    __atomic_sub_fetch(&_smp_tlb_acks, 1, __ATOMIC_RELEASE);
+}
+
+void smp_send_resched(int cpu_id)
+{
+    if (lapic_is_enabled() && __atomic_load_n(&_smp_online[cpu_id], __ATOMIC_ACQUIRE)) {
+        lapic_send_ipi(_smp_lapic_ids[cpu_id], IRQ_IPI_RESCHED);
+    }
+}
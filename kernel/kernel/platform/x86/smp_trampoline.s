@@ -0,0 +1,69 @@
+; Application processors start here in real mode. The code is copied to
+; SMP_TRAMPOLINE_PADDR, so addresses are computed from the start of the
+; trampoline. The boot cpu fills the variables at the end before sending
+; a startup IPI. The first 4mb are identity mapped in the kernel pdir, so
+; the code keeps running after paging is turned on.
+
+global smp_trampoline_start
+global smp_trampoline_end
+global smp_trampoline_pdir
+global smp_trampoline_stack
+global smp_trampoline_entry
+
+SMP_TRAMPOLINE_PADDR equ 0x70000
+%define TRAMPOLINE_ADDR(x) (SMP_TRAMPOLINE_PADDR + (x) - smp_trampoline_start)
+
+[bits 16]
+smp_trampoline_start:
+    cli
+    cld
+    mov ax, cs
+    mov ds, ax
+    lgdt [smp_trampoline_gdt_ptr - smp_trampoline_start]
+
+    ; Caches are disabled after INIT, turning them on with protected mode.
+    mov eax, cr0
+    and eax, 0x9fffffff
+    or eax, 0x1
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE_ADDR(smp_trampoline_pm)
+
+[bits 32]
+smp_trampoline_pm:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov eax, [TRAMPOLINE_ADDR(smp_trampoline_pdir)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE_ADDR(smp_trampoline_stack)]
+    mov eax, [TRAMPOLINE_ADDR(smp_trampoline_entry)]
+    call eax
+.halt:
+    hlt
+    jmp .halt
+
+align 8
+smp_trampoline_gdt:
+    dq 0x0000000000000000
+    dq 0x00cf9a000000ffff ; code
+    dq 0x00cf92000000ffff ; data
+smp_trampoline_gdt_ptr:
+    dw smp_trampoline_gdt_ptr - smp_trampoline_gdt - 1
+    dd TRAMPOLINE_ADDR(smp_trampoline_gdt)
+
+align 4
+smp_trampoline_pdir:
+    dd 0
+smp_trampoline_stack:
+    dd 0
+smp_trampoline_entry:
+    dd 0
+smp_trampoline_end:
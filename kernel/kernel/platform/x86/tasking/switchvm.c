@@ -15,14 +15,15 @@
 void switchuvm(thread_t* thread)
 {
     system_disable_interrupts();
-    gdt[SEG_TSS] = SEG_BG(SEGTSS_TYPE, &tss, sizeof(tss) - 1, 0);
+    int cpu_id = system_cpu_id();
+    gdt[SEG_TSS + cpu_id] = SEG_BG(SEGTSS_TYPE, &tss[cpu_id], sizeof(tss_t) - 1, 0);
     uint32_t esp0 = ((uint32_t)thread->tf + sizeof(trapframe_t));
-    tss.esp0 = esp0;
-    tss.ss0 = (SEG_KDATA << 3);
+    tss[cpu_id].esp0 = esp0;
+    tss[cpu_id].ss0 = (SEG_KDATA << 3);
     // tss.iomap_offset = 0xffff;
     RUNNING_THREAD = thread;
     fpu_make_unavail();
-    ltr(SEG_TSS << 3);
+    ltr((SEG_TSS + cpu_id) << 3);
     vmm_switch_pdir(thread->process->pdir);
     system_enable_interrupts();
 }
\ No newline at end of file
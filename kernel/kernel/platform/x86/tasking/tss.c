@@ -6,10 +6,11 @@
 
 #include <mem/kmalloc.h>
 #include <mem/vmm/vmm.h>
+#include <platform/generic/cpu.h>
 #include <platform/x86/gdt.h>
 #include <platform/x86/tasking/tss.h>
 
-tss_t tss;
+tss_t tss[CPU_CNT];
 
 void ltr(uint16_t seg)
 {
@@ -17,3 +18,14 @@ void ltr(uint16_t seg)
                  :
                  : "r"(seg));
 }
+
+/**
+ * Every cpu has its own TSS, the task register tells which cpu the code
+ * runs on (see system_cpu_id()), so it's loaded first when a cpu starts.
+ */
+void tss_load(int cpu_id)
+{
+    gdt[SEG_TSS + cpu_id] = SEG_BG(SEGTSS_TYPE, &tss[cpu_id], sizeof(tss_t) - 1, 0);
+    tss[cpu_id].ss0 = (SEG_KDATA << 3);
+    ltr((SEG_TSS + cpu_id) << 3);
+}
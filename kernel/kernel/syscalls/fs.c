@@ -85,7 +85,13 @@ void sys_read(trapframe_t* tf)
         return_with_val(-EBADF);
     }
 
-    init_read_blocker(RUNNING_THREAD, fd);
+    if (fd->flags & O_NONBLOCK) {
+        if (fd->ops->can_read && !fd->ops->can_read(fd->dentry, fd->offset)) {
+            return_with_val(-EAGAIN);
+        }
+    } else {
+        init_read_blocker(RUNNING_THREAD, fd);
+    }
 
     int res = vfs_read(fd, (uint8_t*)param2, (uint32_t)param3);
     return_with_val(res);
@@ -99,7 +105,13 @@ void sys_write(trapframe_t* tf)
         return_with_val(-EBADF);
     }
 
-    init_write_blocker(RUNNING_THREAD, fd);
+    if (fd->flags & O_NONBLOCK) {
+        if (fd->ops->can_write && !fd->ops->can_write(fd->dentry, fd->offset)) {
+            return_with_val(-EAGAIN);
+        }
+    } else {
+        init_write_blocker(RUNNING_THREAD, fd);
+    }
 
     int res = vfs_write(fd, (uint8_t*)param2, (uint32_t)param3);
     return_with_val(res);
@@ -330,6 +342,17 @@ void sys_mmap(trapframe_t* tf)
 
     if (map_stack) {
         zone = proc_new_random_zone_backward(p, params->size);
+    } else if (map_anonymous && map_fixed) {
+        uint32_t start = (uint32_t)params->addr;
+        uint32_t end = start + params->size;
+        if (!start || (start & (VMM_PAGE_SIZE - 1)) || !params->size) {
+            return_with_val(-EINVAL);
+        }
+        if (end < start || end > KERNEL_BASE) {
+            return_with_val(-EINVAL);
+        }
+        // Existing mappings are never replaced, so the call fails if the range is busy.
+        zone = proc_new_zone(p, start, params->size);
     } else if (map_anonymous) {
         zone = proc_new_random_zone(p, params->size);
     } else {
@@ -377,6 +400,35 @@ void sys_munmap(trapframe_t* tf)
         return_with_val(vfs_munmap(p, zone));
     }
 
-    // TODO: Split or remove zone
+    // Anonymous zones in the range are removed and their pages are freed,
+    // zones which stick out of it are split first. The range could span
+    // several adjacent zones.
+    uint32_t start = (uint32_t)ptr;
+    uint32_t end = (start + (uint32_t)param2 + VMM_PAGE_SIZE - 1) & ~(VMM_PAGE_SIZE - 1);
+    if ((start & (VMM_PAGE_SIZE - 1)) || end <= start) {
+        return_with_val(-EINVAL);
+    }
+
+    while (zone && zone->type == ZONE_TYPE_MAPPED && zone->start < end) {
+        if (zone->start < start) {
+            zone = proc_split_zone(p, zone, start);
+            if (!zone) {
+                return_with_val(-ENOMEM);
+            }
+        }
+
+        uint32_t zone_end = zone->start + zone->len;
+        if (zone_end > end) {
+            if (!proc_split_zone(p, zone, end)) {
+                return_with_val(-ENOMEM);
+            }
+            zone_end = end;
+        }
+
+        vmm_free_user_pages(zone->start, zone->len, &p->zones);
+        proc_delete_zone(p, zone);
+        zone = proc_find_zone(p, zone_end);
+    }
+
     return_with_val(0);
 }
\ No newline at end of file
@@ -62,6 +62,18 @@ static const void* syscalls[] = {
     [SYS_SHBUF_CREATE] = sys_shbuf_create,
     [SYS_SHBUF_GET] = sys_shbuf_get,
     [SYS_SHBUF_FREE] = sys_shbuf_free,
+    [SYS_NANOSLEEP] = sys_nanosleep,
+    [SYS_CLOCK_NANOSLEEP] = sys_clock_nanosleep,
+    [SYS_EPOLL_CREATE] = sys_epoll_create,
+    [SYS_EPOLL_CTL] = sys_epoll_ctl,
+    [SYS_EPOLL_WAIT] = sys_epoll_wait,
+    [SYS_ACCEPT] = sys_accept,
+    [SYS_SHBUF_PUBLISH] = sys_shbuf_publish,
+    [SYS_SHBUF_FIND] = sys_shbuf_find,
+    [SYS_FUTEX] = sys_futex,
+    [SYS_THREAD_EXIT] = sys_thread_exit,
+    [SYS_SCHED_SETAFFINITY] = sys_sched_setaffinity,
+    [SYS_SCHED_GETAFFINITY] = sys_sched_getaffinity,
 };
 
 #ifdef __i386__
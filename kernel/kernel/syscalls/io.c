@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <io/epoll/epoll.h>
 #include <io/shared_buffer/shared_buffer.h>
 #include <io/sockets/local_socket.h>
 #include <libkern/bits/errno.h>
@@ -12,6 +13,7 @@
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
 #include <tasking/tasking.h>
+#include <time/time_manager.h>
 
 void sys_socket(trapframe_t* tf)
 {
@@ -73,6 +75,49 @@ void sys_connect(trapframe_t* tf)
     return_with_val(-EFAULT);
 }
 
+void sys_accept(trapframe_t* tf)
+{
+    thread_t* thread = RUNNING_THREAD;
+    proc_t* p = thread->process;
+    int sockfd = param1;
+    uint32_t flags = param2;
+
+    file_descriptor_t* sfd = proc_get_fd(p, sockfd);
+    if (!sfd || sfd->type != FD_TYPE_SOCKET || !sfd->sock_entry) {
+        return_with_val(-EBADF);
+    }
+    if (sfd->sock_entry->domain != PF_LOCAL) {
+        return_with_val(-EINVAL);
+    }
+
+    for (;;) {
+        if (!sfd->ops->can_read(sfd->dentry, sfd->offset)) {
+            if (sfd->flags & O_NONBLOCK) {
+                return_with_val(-EAGAIN);
+            }
+            if (thread->pending_signals_mask & thread->signals_mask) {
+                return_with_val(-EINTR);
+            }
+            init_read_blocker(thread, sfd);
+            continue;
+        }
+
+        file_descriptor_t* fd = proc_get_free_fd(p);
+        if (!fd) {
+            return_with_val(-EMFILE);
+        }
+
+        int res = local_socket_accept(sfd, fd, flags);
+        if (res == -EAGAIN) {
+            continue;
+        }
+        if (res < 0) {
+            return_with_val(res);
+        }
+        return_with_val(proc_get_fd_id(p, fd));
+    }
+}
+
 void sys_ioctl(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
@@ -106,4 +151,88 @@ void sys_shbuf_free(trapframe_t* tf)
 {
     int id = param1;
     return_with_val(shared_buffer_free(id));
-}
\ No newline at end of file
+}
+
+void sys_shbuf_publish(trapframe_t* tf)
+{
+    int id = param1;
+    uint32_t key = param2;
+    return_with_val(shared_buffer_publish(id, key));
+}
+
+void sys_shbuf_find(trapframe_t* tf)
+{
+    uint32_t key = param1;
+    return_with_val(shared_buffer_find(key));
+}
+
+void sys_epoll_create(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    file_descriptor_t* fd = proc_get_free_fd(p);
+    if (!fd) {
+        return_with_val(-EMFILE);
+    }
+
+    int res = epoll_create(fd);
+    if (res) {
+        return_with_val(res);
+    }
+    return_with_val(proc_get_fd_id(p, fd));
+}
+
+void sys_epoll_ctl(trapframe_t* tf)
+{
+    proc_t* p = RUNNING_THREAD->process;
+    file_descriptor_t* epfd = proc_get_fd(p, param1);
+    int op = param2;
+    int fd_id = param3;
+    epoll_event_t* event = (epoll_event_t*)param4;
+
+    file_descriptor_t* fd = proc_get_fd(p, fd_id);
+    if (!epfd || !fd) {
+        return_with_val(-EBADF);
+    }
+    if (epfd->type != FD_TYPE_EPOLL) {
+        return_with_val(-EINVAL);
+    }
+
+    return_with_val(epoll_ctl(epfd->epoll_entry, op, fd_id, fd, event));
+}
+
+void sys_epoll_wait(trapframe_t* tf)
+{
+    thread_t* thread = RUNNING_THREAD;
+    file_descriptor_t* epfd = proc_get_fd(thread->process, param1);
+    epoll_event_t* events = (epoll_event_t*)param2;
+    int maxevents = param3;
+    int timeout = param4; // In ms, -1 to wait forever.
+
+    if (!epfd) {
+        return_with_val(-EBADF);
+    }
+    if (epfd->type != FD_TYPE_EPOLL || maxevents <= 0 || !events) {
+        return_with_val(-EINVAL);
+    }
+
+    uint64_t deadline = 0;
+    if (timeout > 0) {
+        deadline = timeman_monotonic_ns() + (uint64_t)timeout * (NSEC_PER_SEC / 1000);
+    }
+
+    for (;;) {
+        int res = epoll_collect(epfd->epoll_entry, events, maxevents);
+        if (res > 0 || timeout == 0) {
+            return_with_val(res);
+        }
+        if (deadline && deadline <= timeman_monotonic_ns()) {
+            return_with_val(0);
+        }
+        if (thread->pending_signals_mask & thread->signals_mask) {
+            return_with_val(-EINTR);
+        }
+
+        /* The item could be consumed by another thread, so wait again if nothing is reported. */
+        init_epoll_blocker(thread, epfd, deadline);
+    }
+}
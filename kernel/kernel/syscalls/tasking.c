@@ -9,6 +9,7 @@
 #include <libkern/log.h>
 #include <platform/generic/syscalls/params.h>
 #include <syscalls/handlers.h>
+#include <tasking/futex.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 
@@ -99,26 +100,93 @@ void sys_getpgid(trapframe_t* tf)
 void sys_create_thread(trapframe_t* tf)
 {
     proc_t* p = RUNNING_THREAD->process;
+    thread_create_params_t* params = (thread_create_params_t*)param1;
+    uint32_t esp = params->stack_start + params->stack_size;
+
+    // The entry point gets the argument as a function does: after the return address on x86, in r0 on arm.
+    // The frame goes first, since the stack comes from the user and could be not writable.
+    uint32_t frame[2] = { 0, params->arg };
+    esp -= sizeof(frame);
+    int err = vmm_copy_to_pdir(p->pdir, (uint8_t*)frame, esp, sizeof(frame));
+    if (err) {
+        return_with_val(err);
+    }
+
     thread_t* thread = proc_create_thread(p);
     if (!thread) {
         return_with_val(-EFAULT);
     }
 
-    thread_create_params_t* params = (thread_create_params_t*)param1;
+    thread->cpu_mask = RUNNING_THREAD->cpu_mask;
     set_instruction_pointer(thread->tf, params->entry_point);
-    uint32_t esp = params->stack_start + params->stack_size;
+#ifdef __arm__
+    thread->tf->r[0] = params->arg;
+#endif
     set_stack_pointer(thread->tf, esp);
     set_base_pointer(thread->tf, esp);
 
     return_with_val(thread->tid);
 }
 
+/**
+ * The thread stops, its stack could be freed by other threads, so if
+ * @param1 is set, the kernel stores 1 there and wakes its futex, when the
+ * stack is not used anymore.
+ */
+void sys_thread_exit(trapframe_t* tf)
+{
+    thread_t* thread = RUNNING_THREAD;
+    uint32_t* done = (uint32_t*)param1;
+    if (thread == thread->process->main_thread) {
+        tasking_exit(0);
+        return;
+    }
+
+    if (done) {
+        uint32_t val = 1;
+        vmm_copy_to_user(done, &val, sizeof(val));
+        futex_wake(thread, done, FUTEX_WAKE_ALL, true);
+    }
+
+    lock_acquire(&thread->process->lock);
+    thread_die(thread);
+    lock_release(&thread->process->lock);
+    resched();
+}
+
+void sys_futex(trapframe_t* tf)
+{
+    uint32_t* uaddr = (uint32_t*)param1;
+    int op = param2;
+    uint32_t val = param3;
+    const timespec_t* timeout = (const timespec_t*)param4;
+    bool private = (op & FUTEX_PRIVATE_FLAG);
+
+    switch (op & ~FUTEX_PRIVATE_FLAG) {
+    case FUTEX_WAIT: {
+        uint64_t unblock_time = 0;
+        if (timeout) {
+            // Negative values come as huge ones, since the fields are unsigned.
+            if ((int32_t)timeout->tv_sec < 0 || (int32_t)timeout->tv_nsec < 0 || timeout->tv_nsec >= NSEC_PER_SEC) {
+                return_with_val(-EINVAL);
+            }
+            unblock_time = timeman_monotonic_ns() + (uint64_t)timeout->tv_sec * NSEC_PER_SEC + timeout->tv_nsec;
+        }
+        return_with_val(futex_wait(RUNNING_THREAD, uaddr, val, unblock_time, private));
+    }
+    case FUTEX_WAKE:
+        return_with_val(futex_wake(RUNNING_THREAD, uaddr, (int)val, private));
+    default:
+        return_with_val(-EINVAL);
+    }
+}
+
 void sys_sleep(trapframe_t* tf)
 {
     thread_t* p = RUNNING_THREAD;
     time_t time = param1;
 
-    init_sleep_blocker(p, time);
+    init_sleep_blocker(p, timeman_monotonic_ns() + (uint64_t)time * NSEC_PER_SEC);
 
     return_with_val(0);
 }
@@ -128,6 +196,55 @@ void sys_sched_yield(trapframe_t* tf)
     resched();
 }
 
+static thread_t* _sys_affinity_thread(uint32_t tid)
+{
+    if (!tid) {
+        return RUNNING_THREAD;
+    }
+
+    thread_t* thread = tasking_get_thread(tid);
+    if (!thread || thread_is_free(thread)) {
+        return NULL;
+    }
+    return thread;
+}
+
+void sys_sched_setaffinity(trapframe_t* tf)
+{
+    uint32_t size = param2;
+    uint32_t* mask = (uint32_t*)param3;
+    if (size < sizeof(uint32_t)) {
+        return_with_val(-EINVAL);
+    }
+
+    thread_t* thread = _sys_affinity_thread(param1);
+    if (!thread) {
+        return_with_val(-ESRCH);
+    }
+    // Idle threads have to stay on their cpus.
+    if (thread->process->is_kthread) {
+        return_with_val(-EPERM);
+    }
+    return_with_val(sched_set_affinity(thread, *mask));
+}
+
+void sys_sched_getaffinity(trapframe_t* tf)
+{
+    uint32_t size = param2;
+    uint32_t* mask = (uint32_t*)param3;
+    if (size < sizeof(uint32_t)) {
+        return_with_val(-EINVAL);
+    }
+
+    thread_t* thread = _sys_affinity_thread(param1);
+    if (!thread) {
+        return_with_val(-ESRCH);
+    }
+    uint32_t cpu_mask = thread->cpu_mask;
+    vmm_copy_to_user(mask, &cpu_mask, sizeof(cpu_mask));
+    return_with_val(0);
+}
+
 void sys_nice(trapframe_t* tf)
 {
     int inc = param1;
@@ -10,6 +10,8 @@
 #include <platform/generic/syscalls/params.h>
 #include <platform/generic/tasking/trapframe.h>
 #include <syscalls/handlers.h>
+#include <tasking/cpu.h>
+#include <tasking/thread.h>
 #include <time/time_manager.h>
 
 void sys_clock_gettime(trapframe_t* tf)
@@ -19,12 +21,10 @@ void sys_clock_gettime(trapframe_t* tf)
 
     switch (clk_id) {
     case CLOCK_MONOTONIC:
-        u_ts->tv_sec = timeman_seconds_since_boot();
-        u_ts->tv_nsec = timeman_get_ticks_from_last_second() * (1000000000 / timeman_ticks_per_second());
+        timeman_monotonic(u_ts);
         break;
     case CLOCK_REALTIME:
-        u_ts->tv_sec = timeman_now();
-        u_ts->tv_nsec = timeman_get_ticks_from_last_second() * (1000000000 / timeman_ticks_per_second());
+        timeman_realtime(u_ts);
         break;
     default:
         return_with_val(-EINVAL);
@@ -41,11 +41,85 @@ void sys_gettimeofday(trapframe_t* tf)
         return_with_val(-EINVAL);
     }
 
-    tv->tv_sec = timeman_now();
-    tv->tv_usec = timeman_get_ticks_from_last_second() * (1000000 / timeman_ticks_per_second());
+    timespec_t ts;
+    timeman_realtime(&ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
 
     tz->tz_dsttime = DST_NONE;
     tz->tz_minuteswest = 0;
 
     return_with_val(0);
-}
\ No newline at end of file
+}
+
+static inline uint64_t _timespec_to_ns(const timespec_t* ts)
+{
+    return (uint64_t)ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+/* The fields are unsigned, so negative values from userspace come as huge ones. */
+static inline bool _timespec_is_valid(const timespec_t* ts)
+{
+    return (int32_t)ts->tv_sec >= 0 && (int32_t)ts->tv_nsec >= 0 && ts->tv_nsec < NSEC_PER_SEC;
+}
+
+/* Signals do not interrupt sleeps, so the remaining time is always zero. */
+static inline void _nanosleep_set_remaining(timespec_t* rem)
+{
+    if (rem) {
+        rem->tv_sec = 0;
+        rem->tv_nsec = 0;
+    }
+}
+
+void sys_nanosleep(trapframe_t* tf)
+{
+    const timespec_t* req = (const timespec_t*)param1;
+    timespec_t* rem = (timespec_t*)param2;
+
+    if (!req || !_timespec_is_valid(req)) {
+        return_with_val(-EINVAL);
+    }
+
+    init_sleep_blocker(RUNNING_THREAD, timeman_monotonic_ns() + _timespec_to_ns(req));
+    _nanosleep_set_remaining(rem);
+    return_with_val(0);
+}
+
+void sys_clock_nanosleep(trapframe_t* tf)
+{
+    clockid_t clk_id = param1;
+    int flags = param2;
+    const timespec_t* req = (const timespec_t*)param3;
+    timespec_t* rem = (timespec_t*)param4;
+
+    if (!req || !_timespec_is_valid(req)) {
+        return_with_val(-EINVAL);
+    }
+
+    uint64_t unblock_time;
+    switch (clk_id) {
+    case CLOCK_MONOTONIC:
+        if (flags & TIMER_ABSTIME) {
+            unblock_time = _timespec_to_ns(req);
+        } else {
+            unblock_time = timeman_monotonic_ns() + _timespec_to_ns(req);
+        }
+        break;
+    case CLOCK_REALTIME:
+        if (flags & TIMER_ABSTIME) {
+            unblock_time = timeman_realtime_to_monotonic_ns(req);
+        } else {
+            unblock_time = timeman_monotonic_ns() + _timespec_to_ns(req);
+        }
+        break;
+    default:
+        return_with_val(-EINVAL);
+    }
+
+    init_sleep_blocker(RUNNING_THREAD, unblock_time);
+    if (!(flags & TIMER_ABSTIME)) {
+        _nanosleep_set_remaining(rem);
+    }
+    return_with_val(0);
+}
@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <io/epoll/epoll.h>
+#include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <libkern/syscall_structs.h>
@@ -11,6 +13,183 @@
 #include <tasking/thread.h>
 #include <time/time_manager.h>
 
+// #define BLOCKER_DEBUG
+
+/**
+ * Threads with a deadline are put into the timer wheel of the cpu they
+ * block on, so only expired timers are touched. Threads blocked on objects
+ * which do not provide a wait queue are put into the poll queue, which is
+ * rechecked by the scheduler.
+ */
+static wait_queue_t _blocker_poll_queue;
+
+/**
+ * TIMERS
+ */
+
+static void _blocker_timer_fired(void* data)
+{
+    blocker_try_wake((thread_t*)data);
+}
+
+static inline void _blocker_timer_add(thread_t* thread)
+{
+    timer_wheel_add(&THIS_CPU->timer_wheel, &thread->timer, thread->unblock_time, _blocker_timer_fired, thread);
+}
+
+/**
+ * WAIT QUEUES
+ */
+
+static void _blocker_wait_on(thread_t* thread, wait_queue_t* wq)
+{
+    if (!wq) {
+        wq = &_blocker_poll_queue;
+    }
+
+    for (int i = 0; i < thread->wait_entries_cnt; i++) {
+        if (thread->wait_entries[i].queue == wq) {
+            return;
+        }
+    }
+
+    ASSERT(thread->wait_entries_cnt < BLOCKER_MAX_WAIT_QUEUES);
+    wait_queue_add(wq, &thread->wait_entries[thread->wait_entries_cnt++], thread);
+}
+
+/**
+ * A wakeup is claimed by clearing the blocker reason with a cmpxchg, so
+ * only one of the wakers (or the thread itself) owns it. The owner may not
+ * enqueue a thread which is still on its cpu, then the scheduler does it
+ * once the thread's context is saved, see blocker_switched_out().
+ */
+static inline bool _blocker_claim(thread_t* thread, int reason)
+{
+    return __atomic_compare_exchange_n(&thread->blocker.reason, &reason, BLOCKER_INVALID, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+static bool _blocker_resume(thread_t* thread)
+{
+    uint32_t status = THREAD_BLOCKED;
+    if (!__atomic_compare_exchange_n(&thread->status, &status, THREAD_RUNNING, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        return false;
+    }
+    sched_enqueue(thread);
+    return true;
+}
+
+/**
+ * The thread is put to wait queues and its reason is published before the
+ * last check of its blocker, so a wakeup which comes in between is not lost.
+ */
+static int _blocker_block(thread_t* thread, int reason, int (*should_unblock)(thread_t*))
+{
+    thread->blocker.should_unblock = should_unblock;
+    thread->blocker.should_unblock_for_signal = true;
+    __atomic_store_n(&thread->blocker.reason, reason, __ATOMIC_SEQ_CST);
+
+    if (should_unblock(thread)) {
+        // Either we or a waker own the wakeup, the thread is not queued anyway.
+        _blocker_claim(thread, reason);
+        blocker_detach(thread);
+        return 0;
+    }
+
+    thread->status = THREAD_BLOCKED;
+    sched_dequeue(thread);
+    resched();
+    blocker_detach(thread);
+    return 0;
+}
+
+void blocker_init_thread(thread_t* thread)
+{
+    thread->blocker.reason = BLOCKER_INVALID;
+    thread->blocker.should_unblock = NULL;
+    thread->wait_entries_cnt = 0;
+    thread->timer.wheel = NULL;
+    thread->on_cpu = false;
+    wait_queue_init(&thread->join_queue);
+}
+
+/**
+ * The function is called by wakers. Returns true if the caller claimed the
+ * wakeup of the thread, which blocker is satisfied now.
+ */
+bool blocker_try_wake(thread_t* thread)
+{
+    int reason = __atomic_load_n(&thread->blocker.reason, __ATOMIC_ACQUIRE);
+    if (reason == BLOCKER_INVALID) {
+        return false;
+    }
+
+    if (!thread->blocker.should_unblock || !thread->blocker.should_unblock(thread)) {
+        return false;
+    }
+
+    if (!_blocker_claim(thread, reason)) {
+        return false;
+    }
+
+#ifdef BLOCKER_DEBUG
+    log("Blocker: wake %d, reason %d", thread->tid, reason);
+#endif
+    if (!__atomic_load_n(&thread->on_cpu, __ATOMIC_SEQ_CST)) {
+        _blocker_resume(thread);
+    }
+    return true;
+}
+
+/**
+ * Wakes a blocked thread to run a signal handler, its blocker is kept and
+ * checked again once the handler returns.
+ */
+bool blocker_wake_for_signal(thread_t* thread)
+{
+    if (!thread->blocker.should_unblock_for_signal || __atomic_load_n(&thread->on_cpu, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+    return _blocker_resume(thread);
+}
+
+/**
+ * Called by the scheduler once the context of the thread is saved. A wakeup
+ * claimed while the thread was on its cpu is finished here.
+ */
+void blocker_switched_out(thread_t* thread)
+{
+    __atomic_store_n(&thread->on_cpu, false, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&thread->blocker.reason, __ATOMIC_SEQ_CST) == BLOCKER_INVALID) {
+        _blocker_resume(thread);
+    }
+}
+
+/**
+ * Removes the thread from all wait queues and timers.
+ */
+void blocker_detach(thread_t* thread)
+{
+    for (int i = 0; i < thread->wait_entries_cnt; i++) {
+        wait_queue_remove(&thread->wait_entries[i]);
+    }
+    thread->wait_entries_cnt = 0;
+
+    timer_wheel_remove(&thread->timer);
+}
+
+/**
+ * Timers are fired by the timer wheel, so only threads blocked on objects
+ * without wait queues are rechecked here.
+ */
+void blocker_wake_expired()
+{
+    wait_queue_wake_all(&_blocker_poll_queue);
+}
+
+/**
+ * BLOCKERS
+ */
+
 int should_unblock_join_block(thread_t* thread)
 {
     // TODO: Add more checks here.
@@ -26,18 +205,15 @@ int init_join_blocker(thread_t* thread)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_JOIN;
-    thread->blocker.should_unblock = should_unblock_join_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    _blocker_wait_on(thread, &thread->joinee->join_queue);
+    return _blocker_block(thread, BLOCKER_JOIN, should_unblock_join_block);
 }
 
 int should_unblock_read_block(thread_t* thread)
 {
-    return thread->blocker_fd->ops->can_read(thread->blocker_fd->dentry, thread->blocker_fd->offset);
+    // Files which don't report readiness never block.
+    file_descriptor_t* fd = thread->blocker_fd;
+    return !fd->ops->can_read || fd->ops->can_read(fd->dentry, fd->offset);
 }
 
 int init_read_blocker(thread_t* thread, file_descriptor_t* bfd)
@@ -48,18 +224,15 @@ int init_read_blocker(thread_t* thread, file_descriptor_t* bfd)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_READ;
-    thread->blocker.should_unblock = should_unblock_read_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    _blocker_wait_on(thread, vfs_wait_queue(bfd));
+    return _blocker_block(thread, BLOCKER_READ, should_unblock_read_block);
 }
 
 int should_unblock_write_block(thread_t* thread)
 {
-    return thread->blocker_fd->ops->can_write(thread->blocker_fd->dentry, thread->blocker_fd->offset);
+    // Files which don't report readiness never block.
+    file_descriptor_t* fd = thread->blocker_fd;
+    return !fd->ops->can_write || fd->ops->can_write(fd->dentry, fd->offset);
 }
 
 int init_write_blocker(thread_t* thread, file_descriptor_t* bfd)
@@ -70,40 +243,30 @@ int init_write_blocker(thread_t* thread, file_descriptor_t* bfd)
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_WRITE;
-    thread->blocker.should_unblock = should_unblock_write_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    _blocker_wait_on(thread, vfs_wait_queue(bfd));
+    return _blocker_block(thread, BLOCKER_WRITE, should_unblock_write_block);
 }
 
 int should_unblock_sleep_block(thread_t* thread)
 {
-    return thread->unblock_time <= timeman_now();
+    return thread->unblock_time <= timeman_monotonic_ns();
 }
 
-int init_sleep_blocker(thread_t* thread, uint32_t time)
+int init_sleep_blocker(thread_t* thread, uint64_t unblock_time)
 {
-    thread->unblock_time = timeman_now() + time;
+    thread->unblock_time = unblock_time;
 
     if (should_unblock_sleep_block(thread)) {
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_SLEEP;
-    thread->blocker.should_unblock = should_unblock_sleep_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    _blocker_timer_add(thread);
+    return _blocker_block(thread, BLOCKER_SLEEP, should_unblock_sleep_block);
 }
 
 int should_unblock_select_block(thread_t* thread)
 {
-    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_now()) {
+    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_monotonic_ns()) {
         return true;
     }
 
@@ -145,7 +308,7 @@ int init_select_blocker(thread_t* thread, int nfds, fd_set_t* readfds, fd_set_t*
         thread->exceptfds = *exceptfds;
     }
     if (timeout) {
-        thread->unblock_time = timeman_now() + timeout->tv_sec;
+        thread->unblock_time = timeman_monotonic_ns() + (uint64_t)timeout->tv_sec * NSEC_PER_SEC + (uint64_t)timeout->tv_usec * 1000;
     }
     thread->nfds = nfds;
 
@@ -153,11 +316,84 @@ int init_select_blocker(thread_t* thread, int nfds, fd_set_t* readfds, fd_set_t*
         return 0;
     }
 
-    thread->status = THREAD_BLOCKED;
-    thread->blocker.reason = BLOCKER_SELECT;
-    thread->blocker.should_unblock = should_unblock_select_block;
-    thread->blocker.should_unblock_for_signal = true;
-    sched_dequeue(thread);
-    resched();
-    return 0;
+    for (int i = 0; i < thread->nfds; i++) {
+        if (FD_ISSET(i, &thread->readfds) || FD_ISSET(i, &thread->writefds)) {
+            _blocker_wait_on(thread, vfs_wait_queue(proc_get_fd(thread->process, i)));
+        }
+    }
+
+    if (timeout) {
+        _blocker_timer_add(thread);
+    }
+    return _blocker_block(thread, BLOCKER_SELECT, should_unblock_select_block);
+}
+
+int should_unblock_epoll_block(thread_t* thread)
+{
+    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_monotonic_ns()) {
+        return true;
+    }
+    return epoll_has_ready(thread->blocker_fd->epoll_entry);
+}
+
+/**
+ * The thread waits only on the queue of the epoll instance, which is woken
+ * by the watched files. Files without a wait queue are polled, so the thread
+ * is put into the poll queue if there are any.
+ */
+int init_epoll_blocker(thread_t* thread, file_descriptor_t* epfd, uint64_t unblock_time)
+{
+    thread->blocker_fd = epfd;
+    thread->unblock_time = unblock_time;
+
+    if (should_unblock_epoll_block(thread)) {
+        return 0;
+    }
+
+    _blocker_wait_on(thread, vfs_wait_queue(epfd));
+    if (epfd->epoll_entry->items_without_wait_queue) {
+        _blocker_wait_on(thread, NULL);
+    }
+
+    if (unblock_time) {
+        _blocker_timer_add(thread);
+    }
+    return _blocker_block(thread, BLOCKER_EPOLL, should_unblock_epoll_block);
+}
+
+int should_unblock_futex_block(thread_t* thread)
+{
+    if (thread->unblock_time != 0 && thread->unblock_time <= timeman_monotonic_ns()) {
+        return true;
+    }
+    return thread->futex_woken;
+}
+
+/**
+ * The thread is put into the queue of the futex bucket before the value is
+ * checked, so a waker which changed the value before it could not miss it.
+ * Returns -EAGAIN if the value differs from @val.
+ */
+int init_futex_blocker(thread_t* thread, wait_queue_t* wq, uint32_t* uaddr, uint32_t val, uint64_t unblock_time)
+{
+    thread->unblock_time = unblock_time;
+    _blocker_wait_on(thread, wq);
+
+    if (*(volatile uint32_t*)uaddr != val) {
+        blocker_detach(thread);
+        return -EAGAIN;
+    }
+
+    if (unblock_time) {
+        _blocker_timer_add(thread);
+    }
+    _blocker_block(thread, BLOCKER_FUTEX, should_unblock_futex_block);
+
+    if (thread->futex_woken) {
+        return 0;
+    }
+    if (unblock_time && unblock_time <= timeman_monotonic_ns()) {
+        return -ETIMEDOUT;
+    }
+    return -EINTR;
 }
@@ -21,125 +21,81 @@
 #define MACHINE_ARCH EM_ARM
 #endif
 
-#define PAGES_PER_COPING_BUFFER 8
-#define COPING_BUFFER_LEN (PAGES_PER_COPING_BUFFER * VMM_PAGE_SIZE)
 #define USER_STACK_SIZE VMM_PAGE_SIZE
 
-static int _elf_load_do_copy_to_ram(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* ph)
+/**
+ * The function copies a part of a segment at exec time. Used only for pages
+ * which the segment shares with another zone, so they can't be backed by
+ * the file of the segment.
+ */
+static void _elf_load_copy_to_ram(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* ph, uint32_t vaddr, uint32_t len)
 {
-    pdirectory_t* prev_pdir = vmm_get_active_pdir();
-    vmm_switch_pdir(p->pdir);
-
-    uint32_t zones_count = proc->zones.size;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (zone->type == ZONE_TYPE_BSS) {
-            memset((void*)zone->start, 0, zone->len);
-        }
+    uint8_t* buf = kmalloc(len);
+    if (!buf) {
+        return;
     }
 
-    zone_t coping_zone = zoner_new_zone(COPING_BUFFER_LEN);
-    uint32_t mem_remaining = ph->p_memsz;
-    uint32_t file_remaining = ph->p_filesz;
-    uint32_t mem_offset = ph->p_vaddr;
-    uint32_t file_offset = ph->p_offset;
-
-    while (mem_remaining) {
-        memset(coping_zone.ptr, 0, COPING_BUFFER_LEN);
-        if (file_remaining) {
-            uint32_t file_read_len = min(file_remaining, COPING_BUFFER_LEN);
-            fd->ops->read(fd->dentry, coping_zone.ptr, file_offset, file_read_len);
-            file_offset += file_read_len;
-            file_remaining -= file_read_len;
-        }
-
-        void* write_ptr = coping_zone.ptr;
-        for (int i = 0; i < PAGES_PER_COPING_BUFFER && mem_remaining; i++) {
-            uint32_t mem_write_len = min(mem_remaining, VMM_PAGE_SIZE);
-            if (proc_find_zone(p, mem_offset)) {
-                vmm_copy_to_user((void*)mem_offset, write_ptr, mem_write_len);
-            }
-            mem_offset += mem_write_len;
-            mem_remaining -= mem_write_len;
-            write_ptr += VMM_PAGE_SIZE;
-        }
+    memset(buf, 0, len);
+    uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+    if (vaddr < file_end) {
+        fd->ops->read(fd->dentry, buf, ph->p_offset + (vaddr - ph->p_vaddr), min(len, file_end - vaddr));
     }
-
-    zoner_free_zone(coping_zone);
-    return vmm_switch_pdir(prev_pdir);
+    vmm_copy_image_to_pdir(p->pdir, buf, vaddr, len);
+    kfree(buf);
 }
 
-static int _elf_load_interpret_program_header_entry(proc_t* p, file_descriptor_t* fd)
+/**
+ * Segments are not copied at exec. The file part of a segment becomes a
+ * private file mapping, so pages are read on the first access and written
+ * pages are copied. The rest of the segment is an anonymous zone, which
+ * pages are zeroed when they are touched.
+ */
+static int _elf_load_map_segment(proc_t* p, file_descriptor_t* fd, elf_program_header_32_t* ph)
 {
-    elf_program_header_32_t ph;
-    int err = vfs_read(fd, &ph, sizeof(ph));
-    if (err != sizeof(ph)) {
-        return err;
+    uint32_t zone_flags = ZONE_READABLE;
+    if (ph->p_flags & PF_W) {
+        zone_flags |= ZONE_WRITABLE;
+    }
+    if (ph->p_flags & PF_X) {
+        zone_flags |= ZONE_EXECUTABLE;
+    }
+
+    uint32_t file_end = ph->p_vaddr + ph->p_filesz;
+    uint32_t mem_end = ph->p_vaddr + ph->p_memsz;
+    uint32_t mapped_start = mem_end;
+    uint32_t mapped_end = mem_end;
+
+    if (ph->p_filesz) {
+        proc_zone_t* zone = proc_extend_zone(p, ph->p_vaddr, ph->p_filesz);
+        if (zone) {
+            zone->type = ZONE_TYPE_MAPPED_FILE_PRIVATLY | ((ph->p_flags & PF_X) ? ZONE_TYPE_CODE : ZONE_TYPE_DATA);
+            zone->flags |= zone_flags;
+            zone->file = dentry_duplicate(fd->dentry);
+            zone->offset = ph->p_offset + zone->start - ph->p_vaddr;
+            zone->file_size = min(zone->len, file_end - zone->start);
+            mapped_start = max(zone->start, ph->p_vaddr);
+            mapped_end = min(zone->start + zone->len, mem_end);
+        }
     }
 
-#ifdef ELF_DEBUG
-    log("Header type %x %x - %x", ph.p_type, ph.p_vaddr, ph.p_memsz);
-#endif
-    switch (ph.p_type) {
-    case PT_LOAD:
-        _elf_load_do_copy_to_ram(p, fd, &ph);
-        break;
-    default:
-        break;
+    if (mem_end > file_end) {
+        proc_zone_t* zone = proc_extend_zone(p, file_end, mem_end - file_end);
+        if (zone) {
+            zone->type = ZONE_TYPE_BSS;
+            zone->flags |= zone_flags;
+            if (mapped_start == mem_end) {
+                mapped_start = max(zone->start, ph->p_vaddr);
+            }
+            mapped_end = min(zone->start + zone->len, mem_end);
+        }
     }
 
-    return 0;
-}
-
-static int _elf_load_interpret_section_header_entry(proc_t* p, file_descriptor_t* fd)
-{
-    elf_section_header_32_t sh;
-    int err = vfs_read(fd, &sh, sizeof(sh));
-    if (err != sizeof(sh)) {
-        return err;
+    // Parts of the segment in pages which are taken by other zones.
+    if (ph->p_vaddr < mapped_start) {
+        _elf_load_copy_to_ram(p, fd, ph, ph->p_vaddr, mapped_start - ph->p_vaddr);
     }
-
-#ifdef ELF_DEBUG
-    log("Section type %x %x - %x", sh.sh_type, sh.sh_addr, sh.sh_size);
-#endif
-    if (sh.sh_flags & SHF_ALLOC) {
-        uint32_t zone_flags = ZONE_READABLE;
-        uint32_t zone_type = ZONE_TYPE_NULL;
-        if (sh.sh_flags & SHF_WRITE) {
-            zone_flags |= ZONE_WRITABLE;
-        }
-        if (sh.sh_flags & SHF_EXECINSTR) {
-            zone_flags |= ZONE_EXECUTABLE;
-        }
-        // FIXME: Mapping of zone types is bad.
-        switch (sh.sh_type) {
-        case SHT_PROGBITS:
-            zone_type = ZONE_TYPE_CODE;
-            break;
-        case SHT_NOBITS:
-            zone_type = ZONE_TYPE_BSS;
-            break;
-        case SHT_INIT_ARRAY:
-            zone_type = ZONE_TYPE_DATA;
-            break;
-        case SHT_FINI_ARRAY:
-            zone_type = ZONE_TYPE_DATA;
-            break;
-        case SHT_PREINIT_ARRAY:
-            zone_type = ZONE_TYPE_DATA;
-            break;
-        default:
-            break;
-        }
-
-        if (zone_type) {
-            proc_zone_t* zone = proc_extend_zone(p, sh.sh_addr, sh.sh_size);
-            if (zone) {
-                zone->type = zone_type;
-                zone->flags |= zone_flags;
-            }
-        }
+    if (mapped_end < mem_end) {
+        _elf_load_copy_to_ram(p, fd, ph, mapped_end, mem_end - mapped_end);
     }
     return 0;
 }
@@ -156,17 +112,30 @@ static int _elf_load_alloc_stack(proc_t* p)
 
 static inline int _elf_do_load(proc_t* p, file_descriptor_t* fd, elf_header_32_t* header)
 {
-    fd->offset = header->e_shoff;
-    int sh_num = header->e_shnum;
-    for (int i = 0; i < sh_num; i++) {
-        _elf_load_interpret_section_header_entry(p, fd);
+    // Reading all program headers at once.
+    uint32_t ph_num = header->e_phnum;
+    uint32_t ph_size = ph_num * sizeof(elf_program_header_32_t);
+    elf_program_header_32_t* ph = kmalloc(ph_size);
+    if (!ph) {
+        return -ENOMEM;
     }
 
     fd->offset = header->e_phoff;
-    int ph_num = header->e_phnum;
-    for (int i = 0; i < ph_num; i++) {
-        _elf_load_interpret_program_header_entry(p, fd);
+    int err = vfs_read(fd, ph, ph_size);
+    if (err != (int)ph_size) {
+        kfree(ph);
+        return err < 0 ? err : -ENOEXEC;
+    }
+
+    for (uint32_t i = 0; i < ph_num; i++) {
+#ifdef ELF_DEBUG
+        log("Header type %x %x - %x", ph[i].p_type, ph[i].p_vaddr, ph[i].p_memsz);
+#endif
+        if (ph[i].p_type == PT_LOAD) {
+            _elf_load_map_segment(p, fd, &ph[i]);
+        }
     }
+    kfree(ph);
 
     proc_zone_t* stack_zone = proc_new_random_zone(p, VMM_PAGE_SIZE); // Forbid 0 allocations to make it work well
     _elf_load_alloc_stack(p);
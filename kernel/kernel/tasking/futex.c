@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <mem/vmm/vmm.h>
+#include <tasking/futex.h>
+#include <tasking/proc.h>
+
+// #define FUTEX_DEBUG
+
+/**
+ * A futex is a user word threads wait on. Waiters are kept in wait queues
+ * of buckets hashed by the key of the word, wakers mark the first waiters
+ * with the same key and wake the bucket.
+ * Shared futexes are keyed by the physical address of the word, so
+ * processes which map the same memory meet in one bucket. The page is
+ * prepared for writing first, so a copy-on-write page is not shared by
+ * the key. Private futexes are keyed by the process and the virtual
+ * address, they stay valid when a fork makes pages copy-on-write again.
+ */
+
+static wait_queue_t _futex_buckets[FUTEX_HASH_SIZE];
+
+static inline wait_queue_t* _futex_bucket(uint32_t space, uint32_t addr)
+{
+    uint32_t hash = (addr >> 2) ^ (addr >> 12) ^ (space >> 6);
+    return &_futex_buckets[hash & (FUTEX_HASH_SIZE - 1)];
+}
+
+static int _futex_key(thread_t* thread, uint32_t* uaddr, bool private, uint32_t* space, uint32_t* addr)
+{
+    uint32_t vaddr = (uint32_t)uaddr;
+    if ((vaddr & 0x3) || PAGE_CHOOSE_OWNER(vaddr) != PAGE_USER) {
+        return -EINVAL;
+    }
+
+    if (private) {
+        *space = (uint32_t)thread->process;
+        *addr = vaddr;
+        return 0;
+    }
+
+    uint32_t paddr = vmm_get_user_frame_for_writing(vaddr);
+    if (!paddr) {
+        return -EFAULT;
+    }
+    *space = 0;
+    *addr = paddr;
+    return 0;
+}
+
+void futex_init()
+{
+    for (int i = 0; i < FUTEX_HASH_SIZE; i++) {
+        wait_queue_init(&_futex_buckets[i]);
+    }
+}
+
+/**
+ * The function blocks @thread while the word at @uaddr holds @val. Returns
+ * 0 when woken, -EAGAIN if the value is different, -ETIMEDOUT when
+ * @unblock_time passes, and -EINTR if a signal came.
+ */
+int futex_wait(thread_t* thread, uint32_t* uaddr, uint32_t val, uint64_t unblock_time, bool private)
+{
+    uint32_t space, addr;
+    int err = _futex_key(thread, uaddr, private, &space, &addr);
+    if (err) {
+        return err;
+    }
+
+    thread->futex_space = space;
+    thread->futex_addr = addr;
+    thread->futex_woken = false;
+    return init_futex_blocker(thread, _futex_bucket(space, addr), uaddr, val, unblock_time);
+}
+
+/**
+ * The function wakes up to @count threads waiting on @uaddr and returns
+ * the number of woken threads.
+ */
+int futex_wake(thread_t* thread, uint32_t* uaddr, int count, bool private)
+{
+    uint32_t space, addr;
+    int err = _futex_key(thread, uaddr, private, &space, &addr);
+    if (err) {
+        return err;
+    }
+
+    // The queue is checked under its lock only. The waiter is queued before
+    // it reads the word, so the lock orders that read against the store to
+    // the word which came before this call.
+    wait_queue_t* wq = _futex_bucket(space, addr);
+    int woken = 0;
+    lock_acquire(&wq->lock);
+    for (wait_queue_entry_t* entry = wq->head; entry && woken < count; entry = entry->next) {
+        thread_t* waiter = entry->thread;
+        if (waiter->futex_space == space && waiter->futex_addr == addr && !waiter->futex_woken) {
+            waiter->futex_woken = true;
+            woken++;
+        }
+    }
+    lock_release(&wq->lock);
+
+    if (woken) {
+        wait_queue_wake_all(wq);
+    }
+
+#ifdef FUTEX_DEBUG
+    log("Futex %x:%x: woken %d", space, addr, woken);
+#endif
+    return woken;
+}
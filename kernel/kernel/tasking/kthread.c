@@ -9,6 +9,7 @@
 #include <libkern/libkern.h>
 #include <mem/kmalloc.h>
 #include <tasking/proc.h>
+#include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <tasking/thread.h>
 
@@ -47,6 +48,7 @@ int kthread_setup(proc_t* p)
     p->main_thread->tid = p->pid;
     p->main_thread->process = p;
     p->main_thread->last_cpu = LAST_CPU_NOT_SET;
+    p->main_thread->cpu_mask = SCHED_CPU_MASK_ALL;
 
     p->main_thread->kstack = zoner_new_zone(KSTACK_ZONE_SIZE);
     if (!p->main_thread->kstack.start) {
@@ -92,7 +94,7 @@ int kthread_fill_up_stack(thread_t* thread, void* data)
 
 #ifdef __i386__
     tf_move_stack_pointer(thread->tf, -sizeof(data));
-    vmm_copy_to_pdir(thread->process->pdir, &data, get_stack_pointer(thread->tf), sizeof(data));
+    return vmm_copy_to_pdir(thread->process->pdir, &data, get_stack_pointer(thread->tf), sizeof(data));
 #elif __arm__
     thread->tf->r[0] = (uint32_t)data;
 #endif
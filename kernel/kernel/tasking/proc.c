@@ -5,6 +5,7 @@
  */
 
 #include <fs/vfs.h>
+#include <io/shared_buffer/shared_buffer.h>
 #include <io/tty/tty.h>
 #include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
@@ -87,7 +88,9 @@ static thread_t* _proc_alloc_thread()
 
 thread_t* proc_alloc_thread()
 {
-    return _proc_alloc_thread();
+    thread_t* thread = _proc_alloc_thread();
+    blocker_init_thread(thread);
+    return thread;
 }
 
 thread_t* thread_by_pid(uint32_t pid)
@@ -118,6 +121,7 @@ int proc_init_storage()
     thread_list.tail = node;
     thread_list.next_empty_node = node;
     thread_list.next_empty_index = 0;
+    proc_zoner_init();
     return 0;
 }
 
@@ -156,9 +160,7 @@ static ALWAYS_INLINE int proc_setup_lockless(proc_t* p)
     memset((void*)p->fds, 0, MAX_OPENED_FILES * sizeof(file_descriptor_t));
 
     /* setting up zones */
-    if (dynamic_array_init_of_size(&p->zones, sizeof(proc_zone_t), 8) != 0) {
-        return -ENOMEM;
-    }
+    proc_zones_init(&p->zones);
 
     p->status = PROC_ALIVE;
     p->prio = DEFAULT_PRIO;
@@ -250,15 +252,7 @@ int proc_copy_of(proc_t* new_proc, thread_t* from_thread)
         }
     }
 
-    for (int i = 0; i < from_proc->zones.size; i++) {
-        proc_zone_t* zone_to_copy = (proc_zone_t*)dynamic_array_get(&from_proc->zones, i);
-        if (zone_to_copy->file) {
-            dentry_duplicate(zone_to_copy->file); // For the copied zone.
-        }
-        dynamic_array_push(&new_proc->zones, zone_to_copy);
-    }
-
-    return 0;
+    return proc_zones_copy(&new_proc->zones, &from_proc->zones);
 }
 
 /**
@@ -286,7 +280,7 @@ static int _proc_load_bin(proc_t* p, file_descriptor_t* fd)
     /* Copying an exec code */
     uint8_t* prog = kmalloc(fd->dentry->inode->size);
     fd->ops->read(fd->dentry, prog, 0, fd->dentry->inode->size);
-    vmm_copy_to_pdir(p->pdir, prog, code_zone->start, fd->dentry->inode->size);
+    vmm_copy_image_to_pdir(p->pdir, prog, code_zone->start, fd->dentry->inode->size);
 
     /* Setting registers */
     thread_t* main_thread = p->main_thread;
@@ -313,18 +307,13 @@ static ALWAYS_INLINE int proc_load_lockless(proc_t* p, thread_t* main_thread, co
 
     // Saving data to restore in case of error.
     pdirectory_t* old_pdir = p->pdir;
-    dynamic_array_t old_zones = p->zones;
+    rbtree_t old_zones = p->zones;
 
     // Reallocating proc.
     pdirectory_t* new_pdir = vmm_new_user_pdir();
     vmm_switch_pdir(new_pdir);
-    p->pdir = new_pdir;
-
-    if (dynamic_array_init_of_size(&p->zones, sizeof(proc_zone_t), 8) != 0) {
-        dentry_put(dentry);
-        vfs_close(&fd);
-        return -ENOMEM;
-    }
+    tasking_set_proc_pdir(p, new_pdir);
+    proc_zones_init(&p->zones);
 
     int err = elf_load(p, &fd);
     if (err) {
@@ -347,7 +336,7 @@ success:
     if (old_pdir) {
         vmm_free_pdir(old_pdir, &old_zones);
     }
-    dynamic_array_clear(&old_zones);
+    proc_zones_free(&old_zones);
 
     // Setting up proc
     p->proc_file = dentry; // dentry isn't put, but is transfered to the proc.
@@ -358,10 +347,10 @@ success:
     return 0;
 
 restore:
-    p->pdir = old_pdir;
+    tasking_set_proc_pdir(p, old_pdir);
     vmm_switch_pdir(old_pdir);
     vmm_free_pdir(new_pdir, &p->zones);
-    dynamic_array_clear(&p->zones);
+    proc_zones_free(&p->zones);
     p->zones = old_zones;
     vfs_close(&fd);
     dentry_put(dentry);
@@ -404,16 +393,18 @@ int proc_free_lockless(proc_t* p)
         dentry_put(p->cwd);
     }
 
+    shared_buffer_release_proc(p->pid);
+
     /* Key parts deletion. After that line you can't work with this process. */
     proc_kill_all_threads_lockless(p);
     p->pid = 0;
 
     if (!p->is_kthread) {
         vmm_free_pdir(p->pdir, &p->zones);
-        p->pdir = NULL;
+        tasking_set_proc_pdir(p, NULL);
     }
 
-    dynamic_array_free(&p->zones);
+    proc_zones_free(&p->zones);
     return 0;
 }
 
@@ -4,78 +4,255 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <fs/page_cache.h>
 #include <fs/vfs.h>
 #include <libkern/bits/errno.h>
+#include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
 #include <tasking/proc.h>
 
 /**
  * PROC ZONING
+ *
+ * Zones of a process are kept in a red-black tree sorted by start address.
+ * Every zone also keeps the span of its subtree and the largest free gap
+ * between zones inside it, so lookups and searches for free space are
+ * O(log n) and don't scan all zones on every page fault.
  */
 
-static inline bool _proc_zones_intersect(uint32_t start1, uint32_t size1, uint32_t start2, uint32_t size2)
+static kmem_cache_t* _proc_zone_cache;
+
+static inline uint32_t _proc_zone_end(proc_zone_t* zone)
 {
-    uint32_t end1 = start1 + size1 - 1;
-    uint32_t end2 = start2 + size2 - 1;
-    return (start1 <= start2 && start2 <= end1) || (start1 <= end2 && end2 <= end1) || (start2 <= start1 && start1 <= end2) || (start2 <= end1 && end1 <= end2);
+    return zone->start + zone->len;
 }
 
-static inline bool _proc_can_fixup_zone(proc_t* proc, uint32_t* start_ptr, int* len_ptr)
+static void _proc_zone_augment(rbtree_node_t* node)
 {
-    uint32_t zones_count = proc->zones.size;
+    proc_zone_t* zone = (proc_zone_t*)node;
+    proc_zone_t* left = (proc_zone_t*)node->left;
+    proc_zone_t* right = (proc_zone_t*)node->right;
+
+    zone->subtree_start = zone->start;
+    zone->subtree_end = _proc_zone_end(zone);
+    zone->subtree_gap = 0;
+    if (left) {
+        zone->subtree_start = left->subtree_start;
+        zone->subtree_gap = max(left->subtree_gap, zone->start - left->subtree_end);
+    }
+    if (right) {
+        zone->subtree_end = right->subtree_end;
+        zone->subtree_gap = max(zone->subtree_gap, max(right->subtree_gap, right->subtree_start - _proc_zone_end(zone)));
+    }
+}
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_zones_intersect(*start_ptr, *len_ptr, zone->start, zone->len)) {
-            if (*start_ptr >= zone->start) {
-                int move = (zone->start + zone->len) - (*start_ptr);
-                *start_ptr += move;
-                *len_ptr -= move;
-            } else {
-                int move = (*start_ptr + *len_ptr) - zone->start;
-                *len_ptr -= move;
-            }
+/**
+ * The function returns the first zone which ends after @addr.
+ */
+static proc_zone_t* _proc_zones_lower_bound(rbtree_t* zones, uint32_t addr)
+{
+    proc_zone_t* res = NULL;
+    rbtree_node_t* node = zones->root;
+    while (node) {
+        proc_zone_t* zone = (proc_zone_t*)node;
+        if (addr < _proc_zone_end(zone)) {
+            res = zone;
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    return res;
+}
 
-            if (*len_ptr <= 0) {
-                return false;
-            }
+static inline bool _proc_can_fixup_zone(proc_t* proc, uint32_t* start_ptr, int* len_ptr)
+{
+    uint32_t start = *start_ptr;
+    uint32_t end = start + *len_ptr;
+
+    proc_zone_t* zone = _proc_zones_lower_bound(&proc->zones, start);
+    while (zone && zone->start < end) {
+        if (zone->start <= start) {
+            start = _proc_zone_end(zone);
+        } else {
+            end = zone->start;
+        }
+
+        if (start >= end) {
+            return false;
         }
+        zone = (proc_zone_t*)rbtree_next(&zone->node);
     }
 
+    *start_ptr = start;
+    *len_ptr = end - start;
     return true;
 }
 
 static inline bool _proc_can_add_zone(proc_t* proc, uint32_t start, uint32_t len)
 {
-    uint32_t zones_count = proc->zones.size;
+    proc_zone_t* zone = _proc_zones_lower_bound(&proc->zones, start);
+    return !zone || zone->start >= start + len;
+}
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_zones_intersect(start, len, zone->start, zone->len)) {
-            return false;
+static void _proc_zones_link(rbtree_t* zones, proc_zone_t* zone)
+{
+    rbtree_node_t* parent = NULL;
+    rbtree_node_t** link = &zones->root;
+    while (*link) {
+        parent = *link;
+        if (zone->start < ((proc_zone_t*)parent)->start) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
         }
     }
+    rbtree_link(zones, &zone->node, parent, link);
+}
 
-    return true;
+static proc_zone_t* _proc_zones_insert(rbtree_t* zones, uint32_t start, uint32_t len)
+{
+    proc_zone_t* new_zone = kmem_cache_alloc(_proc_zone_cache);
+    if (!new_zone) {
+        return 0;
+    }
+
+    memset(new_zone, 0, sizeof(proc_zone_t));
+    new_zone->start = start;
+    new_zone->len = len;
+    new_zone->type = 0;
+    new_zone->flags = ZONE_USER;
+    _proc_zones_link(zones, new_zone);
+    return new_zone;
+}
+
+/**
+ * The function finds the lowest free space of @len bytes.
+ */
+static bool _proc_zones_find_lowest_gap(rbtree_t* zones, uint32_t len, uint32_t* res)
+{
+    proc_zone_t* zone = (proc_zone_t*)zones->root;
+    if (!zone || zone->subtree_start >= len) {
+        *res = 0;
+        return len <= KERNEL_BASE;
+    }
+
+    if (zone->subtree_gap >= len) {
+        for (;;) {
+            proc_zone_t* left = (proc_zone_t*)zone->node.left;
+            proc_zone_t* right = (proc_zone_t*)zone->node.right;
+            if (left && left->subtree_gap >= len) {
+                zone = left;
+            } else if (left && zone->start - left->subtree_end >= len) {
+                *res = left->subtree_end;
+                return true;
+            } else if (right && right->subtree_start - _proc_zone_end(zone) >= len) {
+                *res = _proc_zone_end(zone);
+                return true;
+            } else {
+                zone = right;
+            }
+        }
+    }
+
+    if (zone->subtree_end <= KERNEL_BASE && KERNEL_BASE - zone->subtree_end >= len) {
+        *res = zone->subtree_end;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * The function finds the highest free space of @len bytes below the kernel.
+ */
+static bool _proc_zones_find_highest_gap(rbtree_t* zones, uint32_t len, uint32_t* res)
+{
+    if (len > KERNEL_BASE) {
+        return false;
+    }
+
+    proc_zone_t* zone = (proc_zone_t*)zones->root;
+    if (!zone || zone->subtree_end <= KERNEL_BASE - len) {
+        *res = KERNEL_BASE - len;
+        return true;
+    }
+
+    if (zone->subtree_gap >= len) {
+        for (;;) {
+            proc_zone_t* left = (proc_zone_t*)zone->node.left;
+            proc_zone_t* right = (proc_zone_t*)zone->node.right;
+            if (right && right->subtree_gap >= len) {
+                zone = right;
+            } else if (right && right->subtree_start - _proc_zone_end(zone) >= len) {
+                *res = right->subtree_start - len;
+                return true;
+            } else if (left && zone->start - left->subtree_end >= len) {
+                *res = zone->start - len;
+                return true;
+            } else {
+                zone = left;
+            }
+        }
+    }
+
+    if (zone->subtree_start >= len) {
+        *res = zone->subtree_start - len;
+        return true;
+    }
+    return false;
+}
+
+void proc_zoner_init()
+{
+    _proc_zone_cache = kmem_cache_create("proc_zone", sizeof(proc_zone_t));
+}
+
+void proc_zones_init(rbtree_t* zones)
+{
+    rbtree_init(zones, _proc_zone_augment);
 }
 
-static inline void _proc_swap_zones(proc_zone_t* one, proc_zone_t* two)
+/**
+ * The function copies zones, files of the copies are duplicated.
+ */
+int proc_zones_copy(rbtree_t* to, rbtree_t* from)
 {
-    proc_zone_t tmp = *one;
-    one->file = two->file;
-    one->flags = two->flags;
-    one->len = two->len;
-    one->offset = two->offset;
-    one->start = two->start;
-    one->type = two->type;
+    for (rbtree_node_t* node = rbtree_first(from); node; node = rbtree_next(node)) {
+        proc_zone_t* zone_to_copy = (proc_zone_t*)node;
+        proc_zone_t* zone = _proc_zones_insert(to, zone_to_copy->start, zone_to_copy->len);
+        if (!zone) {
+            return -ENOMEM;
+        }
 
-    two->file = tmp.file;
-    two->flags = tmp.flags;
-    two->len = tmp.len;
-    two->offset = tmp.offset;
-    two->start = tmp.start;
-    two->type = tmp.type;
+        zone->type = zone_to_copy->type;
+        zone->flags = zone_to_copy->flags;
+        zone->offset = zone_to_copy->offset;
+        zone->file_size = zone_to_copy->file_size;
+        if (zone_to_copy->file) {
+            zone->file = dentry_duplicate(zone_to_copy->file); // For the copied zone.
+        }
+    }
+    return 0;
+}
+
+/**
+ * The function frees zones, references to files of zones are dropped.
+ * Changes of shared mappings are written back before.
+ */
+void proc_zones_free(rbtree_t* zones)
+{
+    while (zones->root) {
+        proc_zone_t* zone = (proc_zone_t*)zones->root;
+        if (zone->file) {
+            if (zone->type & ZONE_TYPE_MAPPED_FILE_SHAREDLY) {
+                page_cache_flush(zone->file);
+            }
+            dentry_put(zone->file);
+        }
+        rbtree_erase(zones, &zone->node);
+        kmem_cache_free(_proc_zone_cache, zone);
+    }
 }
 
 /**
@@ -89,17 +266,8 @@ proc_zone_t* proc_extend_zone(proc_t* proc, uint32_t start, uint32_t len)
         len += VMM_PAGE_SIZE - (len % VMM_PAGE_SIZE);
     }
 
-    proc_zone_t new_zone = { 0 };
-    new_zone.type = 0;
-    new_zone.flags = ZONE_USER;
-
     if (_proc_can_fixup_zone(proc, &start, (int*)&len)) {
-        new_zone.start = start;
-        new_zone.len = len;
-        if (dynamic_array_push(&proc->zones, &new_zone) != 0) {
-            return 0;
-        }
-        return (proc_zone_t*)dynamic_array_get(&proc->zones, proc->zones.size - 1);
+        return _proc_zones_insert(&proc->zones, start, len);
     }
 
     return 0;
@@ -113,97 +281,46 @@ proc_zone_t* proc_new_zone(proc_t* proc, uint32_t start, uint32_t len)
         len += VMM_PAGE_SIZE - (len % VMM_PAGE_SIZE);
     }
 
-    proc_zone_t new_zone = { 0 };
-    new_zone.start = start;
-    new_zone.len = len;
-    new_zone.type = 0;
-    new_zone.flags = ZONE_USER;
-
     if (_proc_can_add_zone(proc, start, len)) {
-        if (dynamic_array_push(&proc->zones, &new_zone) != 0) {
-            return 0;
-        }
-        return (proc_zone_t*)dynamic_array_get(&proc->zones, proc->zones.size - 1);
+        return _proc_zones_insert(&proc->zones, start, len);
     }
 
     return 0;
 }
 
-/* FIXME: Think of more efficient way */
 proc_zone_t* proc_new_random_zone(proc_t* proc, uint32_t len)
 {
     if (len % VMM_PAGE_SIZE) {
         len += VMM_PAGE_SIZE - (len % VMM_PAGE_SIZE);
     }
 
-    uint32_t zones_count = proc->zones.size;
-
-    /* Check if we can put it at the beginning */
-    proc_zone_t* ret = proc_new_zone(proc, 0, len);
-    if (ret) {
-        return ret;
-    }
-
-    uint32_t min_start = 0xffffffff;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_can_add_zone(proc, zone->start + zone->len, len)) {
-            if (min_start > zone->start + zone->len) {
-                min_start = zone->start + zone->len;
-            }
-        }
-    }
-
-    if (min_start == 0xffffffff) {
+    uint32_t start;
+    if (!_proc_zones_find_lowest_gap(&proc->zones, len, &start)) {
         return 0;
     }
 
-    return proc_new_zone(proc, min_start, len);
+    return _proc_zones_insert(&proc->zones, start, len);
 }
 
-/* FIXME: Think of more efficient way */
 proc_zone_t* proc_new_random_zone_backward(proc_t* proc, uint32_t len)
 {
     if (len % VMM_PAGE_SIZE) {
         len += VMM_PAGE_SIZE - (len % VMM_PAGE_SIZE);
     }
 
-    uint32_t zones_count = proc->zones.size;
-
-    /* Check if we can put it at the end */
-    proc_zone_t* ret = proc_new_zone(proc, KERNEL_BASE - len, len);
-    if (ret) {
-        return ret;
-    }
-
-    uint32_t max_end = 0;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(&proc->zones, i);
-        if (_proc_can_add_zone(proc, zone->start - len, len)) {
-            if (max_end < zone->start) {
-                max_end = zone->start;
-            }
-        }
-    }
-
-    if (max_end == 0) {
+    uint32_t start;
+    if (!_proc_zones_find_highest_gap(&proc->zones, len, &start)) {
         return 0;
     }
 
-    return proc_new_zone(proc, max_end - len, len);
+    return _proc_zones_insert(&proc->zones, start, len);
 }
 
-proc_zone_t* proc_find_zone_no_proc(dynamic_array_t* zones, uint32_t addr)
+proc_zone_t* proc_find_zone_no_proc(rbtree_t* zones, uint32_t addr)
 {
-    uint32_t zones_count = zones->size;
-
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(zones, i);
-        if (zone->start <= addr && addr < zone->start + zone->len) {
-            return zone;
-        }
+    proc_zone_t* zone = _proc_zones_lower_bound(zones, addr);
+    if (zone && zone->start <= addr) {
+        return zone;
     }
 
     return 0;
@@ -214,23 +331,64 @@ proc_zone_t* proc_find_zone(proc_t* proc, uint32_t addr)
     return proc_find_zone_no_proc(&proc->zones, addr);
 }
 
-int proc_delete_zone_no_proc(dynamic_array_t* zones, proc_zone_t* givzone)
+/**
+ * The function checks that [@start, @start + @len) is fully covered by
+ * writable zones.
+ */
+bool proc_is_range_writable(proc_t* proc, uint32_t start, uint32_t len)
 {
-    uint32_t zones_count = zones->size;
+    uint32_t end = start + len;
+    if (end < start) {
+        return false;
+    }
 
-    for (uint32_t i = 0; i < zones_count; i++) {
-        proc_zone_t* zone = (proc_zone_t*)dynamic_array_get(zones, i);
-        if (givzone == zone) {
-            _proc_swap_zones(zone, dynamic_array_get(zones, zones_count - 1));
-            dynamic_array_pop(zones);
-            return 0;
+    while (start < end) {
+        proc_zone_t* zone = proc_find_zone(proc, start);
+        if (!zone || !(zone->flags & ZONE_WRITABLE)) {
+            return false;
         }
+        start = _proc_zone_end(zone);
+    }
+    return true;
+}
+
+/**
+ * Splits an anonymous zone at @at, which has to lie inside of it. The zone
+ * keeps the part below @at, the returned one covers the rest.
+ */
+proc_zone_t* proc_split_zone(proc_t* proc, proc_zone_t* zone, uint32_t at)
+{
+    ASSERT(zone->start < at && at < _proc_zone_end(zone) && !(at & (VMM_PAGE_SIZE - 1)));
+    proc_zone_t* tail = kmem_cache_alloc(_proc_zone_cache);
+    if (!tail) {
+        return 0;
     }
 
-    return -EALREADY;
+    memset(tail, 0, sizeof(proc_zone_t));
+    tail->start = at;
+    tail->len = _proc_zone_end(zone) - at;
+    tail->type = zone->type;
+    tail->flags = zone->flags;
+
+    rbtree_erase(&proc->zones, &zone->node);
+    zone->len = at - zone->start;
+    _proc_zones_link(&proc->zones, zone);
+    _proc_zones_link(&proc->zones, tail);
+    return tail;
+}
+
+int proc_delete_zone_no_proc(rbtree_t* zones, proc_zone_t* givzone)
+{
+    if (proc_find_zone_no_proc(zones, givzone->start) != givzone) {
+        return -EALREADY;
+    }
+
+    rbtree_erase(zones, &givzone->node);
+    kmem_cache_free(_proc_zone_cache, givzone);
+    return 0;
 }
 
 int proc_delete_zone(proc_t* proc, proc_zone_t* givzone)
 {
     return proc_delete_zone_no_proc(&proc->zones, givzone);
-}
\ No newline at end of file
+}
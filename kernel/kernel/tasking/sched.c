@@ -6,6 +6,7 @@
 
 #include <algo/dynamic_array.h>
 #include <libkern/atomic.h>
+#include <libkern/bits/errno.h>
 #include <libkern/libkern.h>
 #include <libkern/log.h>
 #include <mem/kmalloc.h>
@@ -21,6 +22,20 @@
 // #define SCHED_DEBUG
 // #define SCHED_SHOW_STAT
 
+/**
+ * Every cpu has its own runqueues. A new thread is put on the least loaded
+ * cpu, a woken one goes back to the cpu it ran on, since its data could be
+ * still cached there.
+ * Cpus balance the load by pulling threads from the busiest cpu: an idle
+ * cpu tries it every time it schedules, a busy one once in
+ * SCHED_BALANCE_INTERVAL ticks. A thread is moved only if it's allowed on
+ * the cpu by its affinity mask, is not running, and its fpu state is not
+ * kept in registers of the cpu it's queued on. Threads which ran in the last
+ * SCHED_MIGRATION_COST ticks are cache hot, they are left alone unless
+ * balancing keeps failing.
+ * Runqueues of two cpus are locked in order of cpu ids.
+ */
+
 static time_t _sched_timeslices[];
 static int _enqueued_tasks;
 static uint32_t _active_cpus;
@@ -55,7 +70,9 @@ static void _create_idle_thread(cpu_t* cpu)
     proc_t* idle_proc = tasking_create_kernel_thread(_idle_thread, NULL);
     cpu->idle_thread = idle_proc->main_thread;
     idle_proc->prio = IDLE_PRIO;
+    lock_acquire(&cpu->sched.lock);
     _sched_enqueue_impl(&cpu->sched, idle_proc->main_thread);
+    lock_release(&cpu->sched.lock);
 }
 
 uint32_t active_cpu_count()
@@ -85,6 +102,7 @@ static void _init_cpu(cpu_t* cpu)
     memset(cpu->sched.slave_buf, 0, sizeof(runqueue_t) * TOTAL_PRIOS_COUNT);
     cpu->sched.next_read_prio = 0;
     cpu->sched.enqueued_tasks = 0;
+    lock_init(&cpu->sched.lock);
 
 #ifdef FPU_ENABLED
     cpu->fpu_for_thread = NULL;
@@ -160,17 +178,188 @@ void _sched_dequeue_impl(sched_data_t* sched, thread_t* thread)
     sched->enqueued_tasks--;
 }
 
-int _sched_find_cpu_with_less_load()
+/**
+ * Cpus are activated in any order, the ones which are not active yet have
+ * no idle thread.
+ */
+static inline bool _sched_cpu_is_active(cpu_t* cpu)
+{
+    return cpu->idle_thread != NULL;
+}
+
+static inline bool _sched_thread_allowed_on(thread_t* thread, int cpu_id)
+{
+    return (thread->cpu_mask >> cpu_id) & 1;
+}
+
+static inline int _sched_load(cpu_t* cpu)
+{
+    // The idle thread is always enqueued.
+    return cpu->sched.enqueued_tasks - 1;
+}
+
+static inline bool _sched_fpu_held_by(cpu_t* cpu, thread_t* thread)
+{
+#ifdef FPU_ENABLED
+    return cpu->fpu_for_thread == thread && cpu->fpu_for_pid == thread->tid;
+#else
+    return false;
+#endif // FPU_ENABLED
+}
+
+/**
+ * The function saves the fpu state of @thread if it's kept in registers of
+ * this cpu, so the thread could run on other cpus.
+ */
+static void _sched_release_fpu(thread_t* thread)
+{
+#ifdef FPU_ENABLED
+    cpu_t* cpu = THIS_CPU;
+    if (_sched_fpu_held_by(cpu, thread)) {
+        fpu_make_avail();
+        fpu_save(thread->fpu_state);
+        fpu_make_unavail();
+        cpu->fpu_for_thread = NULL;
+        cpu->fpu_for_pid = 0;
+    }
+#endif // FPU_ENABLED
+}
+
+/**
+ * The function returns the least loaded active cpu @thread is allowed on.
+ * The current cpu wins ties, it could share caches with the parent of a
+ * new thread.
+ */
+static int _sched_find_idlest_cpu(thread_t* thread)
+{
+    int this_cpu = system_cpu_id();
+    int id = -1;
+    int min_load = 0;
+    for (int i = 0; i < CPU_CNT; i++) {
+        int cpu_id = (this_cpu + i) % CPU_CNT;
+        if (!_sched_cpu_is_active(&cpus[cpu_id]) || !_sched_thread_allowed_on(thread, cpu_id)) {
+            continue;
+        }
+        int load = _sched_load(&cpus[cpu_id]);
+        if (id < 0 || load < min_load) {
+            min_load = load;
+            id = cpu_id;
+        }
+    }
+    return id < 0 ? this_cpu : id;
+}
+
+static inline void _sched_lock_pair(cpu_t* a, cpu_t* b)
+{
+    if (a->id > b->id) {
+        cpu_t* tmp = a;
+        a = b;
+        b = tmp;
+    }
+    lock_acquire(&a->sched.lock);
+    lock_acquire(&b->sched.lock);
+}
+
+static inline void _sched_unlock_pair(cpu_t* a, cpu_t* b)
+{
+    lock_release(&a->sched.lock);
+    lock_release(&b->sched.lock);
+}
+
+/**
+ * The function looks for a thread of @victim to move to @cpu. A thread which
+ * is still running (or saving its context) is the running thread of the
+ * victim, it's skipped. Called with runqueues of both cpus locked.
+ */
+static thread_t* _sched_find_thread_to_steal(cpu_t* cpu, cpu_t* victim)
+{
+    thread_t* hot_thread = NULL;
+    runqueue_t* bufs[] = { victim->sched.master_buf, victim->sched.slave_buf };
+    for (int buf = 0; buf < 2; buf++) {
+        for (int prio = MAX_PRIO; prio <= MIN_PRIO; prio++) {
+            for (thread_t* thread = bufs[buf][prio].head; thread; thread = thread->sched_next) {
+                if (thread == victim->running_thread || !_sched_thread_allowed_on(thread, cpu->id) || _sched_fpu_held_by(victim, thread)) {
+                    continue;
+                }
+                if (victim->stat_ticks_since_boot - thread->last_run_tick >= SCHED_MIGRATION_COST) {
+                    return thread;
+                }
+                if (!hot_thread) {
+                    hot_thread = thread;
+                }
+            }
+        }
+    }
+
+    if (cpu->sched.balance_failed >= SCHED_BALANCE_FAILED_MAX) {
+        return hot_thread;
+    }
+    return NULL;
+}
+
+/**
+ * The function pulls a thread from the busiest cpu to @cpu. Queues have to
+ * differ by SCHED_IMBALANCE_MIN, so threads don't bounce between cpus with
+ * almost the same load.
+ */
+static void _sched_balance(cpu_t* cpu)
 {
-    int mx = cpus[0].sched.enqueued_tasks;
-    int id = 0;
-    for (int i = 1; i < active_cpu_count(); i++) {
-        if (mx > cpus[i].sched.enqueued_tasks) {
-            mx = cpus[i].sched.enqueued_tasks;
-            id = i;
+    sched_data_t* sched = &cpu->sched;
+    int load = _sched_load(cpu);
+    if (load > 0 && cpu->stat_ticks_since_boot < sched->next_balance_tick) {
+        return;
+    }
+    sched->next_balance_tick = cpu->stat_ticks_since_boot + SCHED_BALANCE_INTERVAL;
+
+    cpu_t* busiest = NULL;
+    int max_load = load + SCHED_IMBALANCE_MIN - 1;
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (&cpus[i] == cpu || !_sched_cpu_is_active(&cpus[i])) {
+            continue;
+        }
+        int cpu_load = _sched_load(&cpus[i]);
+        if (cpu_load > max_load) {
+            max_load = cpu_load;
+            busiest = &cpus[i];
         }
     }
-    return id;
+    if (!busiest) {
+        return;
+    }
+
+    _sched_lock_pair(cpu, busiest);
+    thread_t* thread = NULL;
+    if (_sched_load(busiest) - _sched_load(cpu) >= SCHED_IMBALANCE_MIN) {
+        thread = _sched_find_thread_to_steal(cpu, busiest);
+    }
+    if (thread) {
+        _sched_dequeue_impl(&busiest->sched, thread);
+        thread->last_cpu = cpu->id;
+        _sched_enqueue_impl(sched, thread);
+        sched->balance_failed = 0;
+    } else {
+        sched->balance_failed++;
+    }
+    _sched_unlock_pair(cpu, busiest);
+
+#ifdef SCHED_DEBUG
+    if (thread) {
+        log("balance: task %d moved from cpu %d to cpu %d", thread->tid, busiest->id, cpu->id);
+    }
+#endif
+}
+
+static void _sched_enqueue_on_last_cpu(thread_t* thread)
+{
+    cpu_t* cpu = &cpus[thread->last_cpu];
+    lock_acquire(&cpu->sched.lock);
+    _sched_enqueue_impl(&cpu->sched, thread);
+    lock_release(&cpu->sched.lock);
+
+    // An idle cpu would notice the thread only on its next tick.
+    if (cpu->id != system_cpu_id() && cpu->running_thread == cpu->idle_thread) {
+        system_wake_cpu(cpu->id);
+    }
 }
 
 void scheduler_init()
@@ -181,36 +370,33 @@ void schedule_activate_cpu()
 {
     int id = system_cpu_id();
     ASSERT(id < CPU_CNT);
-    _init_cpu(&cpus[id]);
     cpus[id].id = id;
+    _init_cpu(&cpus[id]);
 }
 
-extern thread_list_t thread_list;
+/**
+ * Blocked threads are woken by the objects they wait on, so here
+ * we only need to fire expired timers.
+ */
 void sched_unblock_threads()
 {
-    thread_t* thread;
-
-    thread_list_node_t* __thread_list_node = thread_list.head;
-    while (__thread_list_node) {
-        for (int i = 0; i < THREADS_PER_NODE; i++) {
-            thread = &__thread_list_node->thread_storage[i];
-            if (thread->status == THREAD_BLOCKED && thread->blocker.reason != BLOCKER_INVALID) {
-                if (thread->blocker.should_unblock && thread->blocker.should_unblock(thread)) {
-                    thread->status = THREAD_RUNNING;
-                    thread->blocker.reason = BLOCKER_INVALID;
-                    sched_enqueue(thread);
-                }
-            }
-        }
-        __thread_list_node = __thread_list_node->next;
-    }
+    blocker_wake_expired();
+}
+
+static inline void _sched_requeue_running_thread()
+{
+    sched_data_t* sched = &cpus[RUNNING_THREAD->last_cpu].sched;
+    lock_acquire(&sched->lock);
+    _sched_add_to_end_of_runqueue(sched, RUNNING_THREAD);
+    lock_release(&sched->lock);
 }
 
 void resched_dont_save_context()
 {
     if (RUNNING_THREAD && RUNNING_THREAD->status == THREAD_RUNNING) {
         RUNNING_THREAD->stat_total_running_ticks += timeman_ticks_since_boot() - RUNNING_THREAD->start_time_in_ticks;
-        _sched_add_to_end_of_runqueue(&cpus[RUNNING_THREAD->last_cpu].sched, RUNNING_THREAD);
+        RUNNING_THREAD->last_run_tick = THIS_CPU->stat_ticks_since_boot;
+        _sched_requeue_running_thread();
     }
     switch_to_context(THIS_CPU->sched_context);
 }
@@ -219,8 +405,9 @@ void resched()
 {
     if (RUNNING_THREAD) {
         RUNNING_THREAD->stat_total_running_ticks += timeman_ticks_since_boot() - RUNNING_THREAD->start_time_in_ticks;
+        RUNNING_THREAD->last_run_tick = THIS_CPU->stat_ticks_since_boot;
         if (RUNNING_THREAD->status == THREAD_RUNNING) {
-            _sched_add_to_end_of_runqueue(&cpus[RUNNING_THREAD->last_cpu].sched, RUNNING_THREAD);
+            _sched_requeue_running_thread();
         }
         switch_contexts(&RUNNING_THREAD->context, THIS_CPU->sched_context);
     } else {
@@ -235,13 +422,14 @@ void sched_enqueue(thread_t* thread)
         thread->process->prio = MIN_PRIO;
     }
 
-    if (thread->last_cpu != LAST_CPU_NOT_SET) {
-        _sched_enqueue_impl(&cpus[thread->last_cpu].sched, thread);
-    } else {
-        int cpu = _sched_find_cpu_with_less_load();
-        _sched_enqueue_impl(&cpus[cpu].sched, thread);
-        thread->last_cpu = cpu;
+    // The fpu state of a woken thread could be kept by its last cpu, then
+    // the thread is moved away from a cpu out of its mask by sched().
+    if (thread->last_cpu == LAST_CPU_NOT_SET) {
+        thread->last_cpu = _sched_find_idlest_cpu(thread);
+    } else if (!_sched_thread_allowed_on(thread, thread->last_cpu) && !_sched_fpu_held_by(&cpus[thread->last_cpu], thread)) {
+        thread->last_cpu = _sched_find_idlest_cpu(thread);
     }
+    _sched_enqueue_on_last_cpu(thread);
 
 #ifdef SCHED_DEBUG
     log("enqueue task %d to cpu %d", thread->tid, thread->last_cpu);
@@ -249,28 +437,73 @@ void sched_enqueue(thread_t* thread)
     _enqueued_tasks++;
 }
 
+/**
+ * The thread could be moved to other cpu by balancing meanwhile, so its cpu
+ * is checked again with the lock held.
+ */
 void sched_dequeue(thread_t* thread)
 {
 #ifdef SCHED_DEBUG
     log("dequeue task %d", thread->tid);
 #endif
-    if (likely(thread->last_cpu != LAST_CPU_NOT_SET)) {
-        _sched_dequeue_impl(&cpus[thread->last_cpu].sched, thread);
-    } else {
-        log("dequeue error task %d", thread->tid);
+    for (;;) {
+        int cpu_id = __atomic_load_n(&thread->last_cpu, __ATOMIC_ACQUIRE);
+        if (unlikely(cpu_id == LAST_CPU_NOT_SET)) {
+            log("dequeue error task %d", thread->tid);
+            return;
+        }
+
+        sched_data_t* sched = &cpus[cpu_id].sched;
+        lock_acquire(&sched->lock);
+        if (thread->last_cpu == cpu_id) {
+            _sched_dequeue_impl(sched, thread);
+            lock_release(&sched->lock);
+            return;
+        }
+        lock_release(&sched->lock);
     }
 }
 
+/**
+ * The function limits cpus @thread runs on to @mask. A thread which is
+ * queued on a cpu out of the mask is moved by that cpu when it's picked
+ * to run.
+ */
+int sched_set_affinity(thread_t* thread, uint32_t mask)
+{
+    mask &= SCHED_CPU_MASK_ALL;
+    bool has_active_cpu = false;
+    for (int i = 0; i < CPU_CNT; i++) {
+        if (((mask >> i) & 1) && _sched_cpu_is_active(&cpus[i])) {
+            has_active_cpu = true;
+        }
+    }
+    if (!has_active_cpu) {
+        return -EINVAL;
+    }
+
+    thread->cpu_mask = mask;
+    if (thread == RUNNING_THREAD && !_sched_thread_allowed_on(thread, THIS_CPU->id)) {
+        resched();
+    }
+    return 0;
+}
+
 void sched()
 {
     for (;;) {
         sched_data_t* sched = &THIS_CPU->sched;
+        _sched_balance(THIS_CPU);
+        lock_acquire(&sched->lock);
         while (!sched->master_buf[sched->next_read_prio].head) {
             sched->next_read_prio++;
             if (sched->next_read_prio >= TOTAL_PRIOS_COUNT) {
                 if (THIS_CPU->id == 0) {
+                    // Both could enqueue threads to this cpu.
+                    lock_release(&sched->lock);
                     tasking_kill_dying();
                     sched_unblock_threads();
+                    lock_acquire(&sched->lock);
                 }
                 _sched_swap_buffers(sched);
             }
@@ -282,6 +515,20 @@ void sched()
             sched->master_buf[sched->next_read_prio].tail = NULL;
         }
         thread->sched_next = thread->sched_prev = NULL;
+
+        // The affinity mask could be changed while the thread was queued.
+        if (unlikely(!_sched_thread_allowed_on(thread, THIS_CPU->id))) {
+            int target_cpu = _sched_find_idlest_cpu(thread);
+            if (target_cpu != THIS_CPU->id) {
+                _sched_release_fpu(thread);
+                thread->last_cpu = target_cpu;
+                sched->enqueued_tasks--;
+                lock_release(&sched->lock);
+                _sched_enqueue_on_last_cpu(thread);
+                continue;
+            }
+        }
+        lock_release(&sched->lock);
 #ifdef SCHED_DEBUG
         log("next to run %d %x %x [cpu %d]", thread->tid, thread->process->prio, thread->tf, THIS_CPU->id);
 #endif
@@ -292,8 +539,10 @@ void sched()
         thread->last_cpu = THIS_CPU->id;
         thread->start_time_in_ticks = timeman_ticks_since_boot();
         thread->ticks_until_preemption = _sched_get_timeslice(thread);
+        thread->on_cpu = true;
         switchuvm(thread);
         switch_contexts(&(THIS_CPU->sched_context), thread->context);
+        blocker_switched_out(thread);
     }
 }
 
@@ -110,6 +110,16 @@ int signal_rem_pending(thread_t* thread, int signo)
 extern int _thread_setup_kstack(thread_t* thread, uint32_t esp);
 static int signal_setup_stack_to_handle_signal(thread_t* thread, int signo)
 {
+    // The state is pushed to the user stack, which must be writable.
+    uint32_t frame_size = SIGNAL_IMPL_FRAME_SIZE;
+    if (thread != RUNNING_THREAD) {
+        frame_size += 3 * sizeof(uint32_t);
+    }
+    uint32_t user_sp = get_stack_pointer(thread->tf);
+    if (!proc_is_range_writable(thread->process, user_sp - frame_size, frame_size)) {
+        return -EFAULT;
+    }
+
     system_disable_interrupts();
     pdirectory_t* prev_pdir = vmm_get_active_pdir();
     vmm_switch_pdir(thread->process->pdir);
@@ -184,8 +194,13 @@ int signal_restore_thread_after_handling_signal(thread_t* thread)
 
     /* If our thread was blocked, that means that it already has a context on stack, we need not to overwrite it */
     if (thread->blocker.reason != BLOCKER_INVALID) {
-        thread->status = THREAD_BLOCKED;
-        sched_dequeue(thread);
+        /* The object could be ready while the handler was running, so its wakeup is already lost. */
+        if (thread->blocker.should_unblock && thread->blocker.should_unblock(thread)) {
+            thread->blocker.reason = BLOCKER_INVALID;
+        } else {
+            thread->status = THREAD_BLOCKED;
+            sched_dequeue(thread);
+        }
         resched_dont_save_context();
     }
 
@@ -209,7 +224,11 @@ static int signal_default_action(int signo)
 static int signal_process(thread_t* thread, int signo)
 {
     if (thread->signal_handlers[signo]) {
-        signal_setup_stack_to_handle_signal(thread, signo);
+        if (signal_setup_stack_to_handle_signal(thread, signo) < 0) {
+            log_warn("Killed %d: bad stack for signal %d\n", thread->process->pid, signo);
+            proc_die(thread->process);
+            return SKIP;
+        }
         set_instruction_pointer(thread->tf, _signal_jumper_zone.start);
         return UNBLOCK;
     } else {
@@ -245,8 +264,8 @@ int signal_dispatch_pending(thread_t* thread)
     }
 
     if (ret == UNBLOCK) {
-        if (thread && thread->status == THREAD_BLOCKED && thread->blocker.should_unblock_for_signal) {
-            sched_enqueue(thread);
+        if (thread) {
+            blocker_wake_for_signal(thread);
         }
     }
 
@@ -15,16 +15,24 @@
 #include <platform/generic/system.h>
 #include <tasking/cpu.h>
 #include <tasking/dump.h>
+#include <tasking/futex.h>
 #include <tasking/sched.h>
 #include <tasking/tasking.h>
 #include <tasking/thread.h>
 
 #define TASKING_DEBUG
+#define TASKING_PDIR_BUCKETS 256
 
 cpu_t cpus[CPU_CNT];
 proc_t proc[MAX_PROCESS_COUNT];
 static uint32_t nxt_proc = 0;
 
+/* Procs are looked up by pdir on page faults. A pdir is a hardware table
+   without a spare field for a back pointer, so procs are chained into
+   buckets by the address of their pdir. */
+static proc_t* _tasking_pdir_buckets[TASKING_PDIR_BUCKETS];
+static lock_t _tasking_pdir_lock;
+
 static inline uint32_t _tasking_next_proc_id()
 {
     return atomic_add(&nxt_proc, 1) - 1;
@@ -80,16 +88,61 @@ proc_t* tasking_get_proc(uint32_t pid)
     return NULL;
 }
 
+static inline proc_t** _tasking_pdir_bucket(pdirectory_t* pdir)
+{
+    return &_tasking_pdir_buckets[((uint32_t)pdir / sizeof(pdirectory_t)) % TASKING_PDIR_BUCKETS];
+}
+
+/**
+ * The function sets the pdir of the proc and keeps the lookup table in sync.
+ * Kernel threads are not put into the table: they run in the kernel pdir or
+ * borrow the pdir of a user proc, which must stay the owner found by lookups.
+ */
+void tasking_set_proc_pdir(proc_t* p, pdirectory_t* pdir)
+{
+    lock_acquire(&_tasking_pdir_lock);
+    bool in_table = !p->is_kthread;
+    if (in_table && p->pdir && p->pdir != vmm_get_kernel_pdir()) {
+        proc_t** link = _tasking_pdir_bucket(p->pdir);
+        while (*link && *link != p) {
+            link = &(*link)->pdir_next;
+        }
+        if (*link) {
+            *link = p->pdir_next;
+        }
+    }
+
+    p->pdir = pdir;
+    p->pdir_next = NULL;
+    if (in_table && pdir && pdir != vmm_get_kernel_pdir()) {
+        proc_t** bucket = _tasking_pdir_bucket(pdir);
+        p->pdir_next = *bucket;
+        *bucket = p;
+    }
+    lock_release(&_tasking_pdir_lock);
+}
+
 proc_t* tasking_get_proc_by_pdir(pdirectory_t* pdir)
 {
     proc_t* p;
-    for (int i = 0; i < _tasking_get_proc_count(); i++) {
-        p = &proc[i];
+    if (pdir == vmm_get_kernel_pdir()) {
+        for (int i = 0; i < _tasking_get_proc_count(); i++) {
+            p = &proc[i];
+            if (p->status == PROC_ALIVE && p->pdir == pdir) {
+                return p;
+            }
+        }
+        return NULL;
+    }
+
+    lock_acquire(&_tasking_pdir_lock);
+    for (p = *_tasking_pdir_bucket(pdir); p; p = p->pdir_next) {
         if (p->status == PROC_ALIVE && p->pdir == pdir) {
-            return p;
+            break;
         }
     }
-    return NULL;
+    lock_release(&_tasking_pdir_lock);
+    return p;
 }
 
 static inline proc_t* _tasking_alloc_proc()
@@ -116,7 +169,7 @@ static proc_t* _tasking_setup_proc_with_uid(uid_t uid, gid_t gid)
 static proc_t* _tasking_fork_proc_from_current()
 {
     proc_t* new_proc = _tasking_setup_proc();
-    new_proc->pdir = vmm_new_forked_user_pdir();
+    tasking_set_proc_pdir(new_proc, vmm_new_forked_user_pdir());
     proc_copy_of(new_proc, RUNNING_THREAD);
     return new_proc;
 }
@@ -171,7 +224,9 @@ proc_t* tasking_run_kernel_thread(void* entry_point, void* data)
 
 void tasking_init()
 {
+    lock_init(&_tasking_pdir_lock);
     proc_init_storage();
+    futex_init();
     signal_init();
     dump_prepare_kernel_data();
 }
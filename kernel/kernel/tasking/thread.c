@@ -51,6 +51,7 @@ int thread_setup_main(proc_t* p, thread_t* thread)
     thread->process = p;
     thread->tid = p->pid;
     thread->last_cpu = LAST_CPU_NOT_SET;
+    thread->cpu_mask = SCHED_CPU_MASK_ALL;
 
     /* setting signal handlers to 0 */
     thread->signals_mask = 0xffffffff; /* for now all signals are legal */
@@ -78,6 +79,7 @@ int thread_setup(proc_t* p, thread_t* thread)
     thread->process = p;
     thread->tid = proc_alloc_pid();
     thread->last_cpu = LAST_CPU_NOT_SET;
+    thread->cpu_mask = SCHED_CPU_MASK_ALL;
 
     /* setting signal handlers to 0 */
     thread->signals_mask = 0xffffffff; /* for now all signals are legal */
@@ -97,6 +99,7 @@ int thread_setup(proc_t* p, thread_t* thread)
 int thread_copy_of(thread_t* thread, thread_t* from_thread)
 {
     memcpy(thread->tf, from_thread->tf, sizeof(trapframe_t));
+    thread->cpu_mask = from_thread->cpu_mask;
 #ifdef FPU_ENABLED
     memcpy(thread->fpu_state, from_thread->fpu_state, sizeof(fpu_state_t));
 #endif
@@ -159,11 +162,11 @@ int thread_fill_up_stack(thread_t* thread, int argc, char** argv, char** env)
     thread->tf->r[1] = array_esp;
 #endif
 
-    vmm_copy_to_pdir(thread->process->pdir, (uint8_t*)tmp_buf, get_stack_pointer(thread->tf), data_size_on_stack);
+    int err = vmm_copy_to_pdir(thread->process->pdir, (uint8_t*)tmp_buf, get_stack_pointer(thread->tf), data_size_on_stack);
 
     kfree(tmp_buf);
 
-    return 0;
+    return err;
 }
 
 int thread_kstack_free(thread_t* thread)
@@ -194,6 +197,9 @@ int thread_die(thread_t* thread)
 
     thread->status = THREAD_DYING;
     sched_dequeue(thread);
+    blocker_detach(thread);
+    wait_queue_wake_all(&thread->join_queue);
+    wait_queue_clear(&thread->join_queue);
     return 0;
 }
 
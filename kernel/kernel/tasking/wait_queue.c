@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <tasking/thread.h>
+#include <tasking/wait_queue.h>
+
+// #define WAIT_QUEUE_DEBUG
+
+static inline void _wait_queue_unlink_lockless(wait_queue_t* wq, wait_queue_entry_t* entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        wq->head = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        wq->tail = entry->prev;
+    }
+
+    entry->prev = entry->next = NULL;
+    entry->queue = NULL;
+}
+
+void wait_queue_init(wait_queue_t* wq)
+{
+    lock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+static void _wait_queue_add(wait_queue_t* wq, wait_queue_entry_t* entry)
+{
+    lock_acquire(&wq->lock);
+    entry->queue = wq;
+    entry->next = NULL;
+    entry->prev = wq->tail;
+    if (wq->tail) {
+        wq->tail->next = entry;
+    } else {
+        wq->head = entry;
+    }
+    wq->tail = entry;
+    lock_release(&wq->lock);
+}
+
+void wait_queue_add(wait_queue_t* wq, wait_queue_entry_t* entry, thread_t* thread)
+{
+    entry->thread = thread;
+    entry->callback = NULL;
+    entry->data = NULL;
+    _wait_queue_add(wq, entry);
+}
+
+/**
+ * Callback entries are not unlinked on wakeup, they stay in the queue
+ * until they are removed explicitly.
+ */
+void wait_queue_add_callback(wait_queue_t* wq, wait_queue_entry_t* entry, void (*callback)(wait_queue_entry_t*), void* data)
+{
+    entry->thread = NULL;
+    entry->callback = callback;
+    entry->data = data;
+    _wait_queue_add(wq, entry);
+}
+
+void wait_queue_remove(wait_queue_entry_t* entry)
+{
+    wait_queue_t* wq = entry->queue;
+    if (!wq) {
+        return;
+    }
+
+    lock_acquire(&wq->lock);
+    // The entry could be taken by a waker while we were acquiring the lock.
+    if (entry->queue == wq) {
+        _wait_queue_unlink_lockless(wq, entry);
+    }
+    lock_release(&wq->lock);
+}
+
+/**
+ * Wakes threads which blockers are satisfied. Woken entries are unlinked,
+ * the rest of the thread's entries are dropped by the thread itself.
+ * The queue is checked under its lock only, a waiter which is being added
+ * on another cpu could be missed otherwise.
+ */
+int wait_queue_wake_all(wait_queue_t* wq)
+{
+    int woken = 0;
+    lock_acquire(&wq->lock);
+    wait_queue_entry_t* entry = wq->head;
+    while (entry) {
+        wait_queue_entry_t* next = entry->next;
+        if (entry->callback) {
+            entry->callback(entry);
+        } else if (blocker_try_wake(entry->thread)) {
+            _wait_queue_unlink_lockless(wq, entry);
+            woken++;
+        }
+        entry = next;
+    }
+    lock_release(&wq->lock);
+
+#ifdef WAIT_QUEUE_DEBUG
+    log("Wait queue %x: woken %d", wq, woken);
+#endif
+    return woken;
+}
+
+/**
+ * Unlinks all entries, used when the object the queue belongs to goes away.
+ */
+void wait_queue_clear(wait_queue_t* wq)
+{
+    lock_acquire(&wq->lock);
+    while (wq->head) {
+        _wait_queue_unlink_lockless(wq, wq->head);
+    }
+    lock_release(&wq->lock);
+}
@@ -12,9 +12,10 @@
 // #define TIME_MANAGER_DEBUG
 
 time_t ticks_since_boot = 0;
-time_t ticks_since_second = 0;
-static time_t time_since_boot = 0;
-static time_t time_since_epoch = 0;
+static time_t boot_time_since_epoch = 0;
+
+/* Odd while the tick handler updates the clock. */
+static uint32_t clock_seq = 0;
 
 static uint32_t pref_sum_of_days_in_mounts[] = {
     0,
@@ -71,6 +72,7 @@ int timeman_setup()
 {
     uint8_t secs = 0, mins = 0, hrs = 0, day = 0, month = 0;
     uint32_t year = 1970;
+    time_t time_since_epoch = 0;
 
     // FIXME: Rewrite as a proper driver
 #ifdef __i386__
@@ -79,6 +81,11 @@ int timeman_setup()
 #elif __arm__
     time_since_epoch = pl031_read_rtc();
 #endif
+    boot_time_since_epoch = time_since_epoch - timeman_seconds_since_boot();
+
+    for (int i = 0; i < CPU_CNT; i++) {
+        timer_wheel_init(&cpus[i].timer_wheel, atomic_load(&ticks_since_boot));
+    }
 
 #ifdef TIME_MANAGER_DEBUG
     log("Loaded date: %d", time_since_epoch);
@@ -89,30 +96,72 @@ int timeman_setup()
 void timeman_timer_tick()
 {
     THIS_CPU->stat_ticks_since_boot++;
-    if (system_cpu_id() != 0) {
-        return;
+    if (system_cpu_id() == 0) {
+        atomic_add(&clock_seq, 1);
+        atomic_add(&ticks_since_boot, 1);
+        timer_sync_tick();
+        atomic_add(&clock_seq, 1);
     }
 
-    atomic_add(&ticks_since_second, 1);
+    timer_wheel_advance(&THIS_CPU->timer_wheel, atomic_load(&ticks_since_boot));
+}
+
+/**
+ * Takes a consistent pair of the tick counter and the time passed since
+ * that tick, which is provided by the platform timer.
+ */
+static void _timeman_read_clock(time_t* ticks, uint32_t* ns_since_tick)
+{
+    uint32_t seq;
+    do {
+        seq = atomic_load(&clock_seq);
+        *ticks = atomic_load(&ticks_since_boot);
+        *ns_since_tick = timer_ns_since_tick();
+    } while ((seq & 1) || seq != atomic_load(&clock_seq));
+}
+
+uint64_t timeman_monotonic_ns()
+{
+    time_t ticks;
+    uint32_t ns_since_tick;
+    _timeman_read_clock(&ticks, &ns_since_tick);
+    return (uint64_t)ticks * timeman_ns_per_tick() + ns_since_tick;
+}
+
+void timeman_monotonic(timespec_t* ts)
+{
+    time_t ticks;
+    uint32_t ns_since_tick;
+    _timeman_read_clock(&ticks, &ns_since_tick);
+    ts->tv_sec = ticks / TIMER_TICKS_PER_SECOND;
+    ts->tv_nsec = (ticks % TIMER_TICKS_PER_SECOND) * timeman_ns_per_tick() + ns_since_tick;
+}
 
-    if (ticks_since_second >= TIMER_TICKS_PER_SECOND) {
-        atomic_add(&time_since_boot, 1);
-        atomic_add(&time_since_epoch, 1);
-        atomic_store(&ticks_since_second, 0);
+void timeman_realtime(timespec_t* ts)
+{
+    timeman_monotonic(ts);
+    ts->tv_sec += boot_time_since_epoch;
+}
+
+uint64_t timeman_realtime_to_monotonic_ns(const timespec_t* ts)
+{
+    if (ts->tv_sec < boot_time_since_epoch) {
+        return 0;
     }
+    return (uint64_t)(ts->tv_sec - boot_time_since_epoch) * NSEC_PER_SEC + ts->tv_nsec;
 }
 
 time_t timeman_now()
 {
-    return atomic_load(&time_since_epoch);
+    return boot_time_since_epoch + timeman_seconds_since_boot();
 }
 
 time_t timeman_seconds_since_boot()
 {
-    return atomic_load(&time_since_boot);
+    return atomic_load(&ticks_since_boot) / TIMER_TICKS_PER_SECOND;
 }
 
 time_t timeman_get_ticks_from_last_second()
 {
-    return atomic_load(&ticks_since_second);
-}
\ No newline at end of file
+    return atomic_load(&ticks_since_boot) % TIMER_TICKS_PER_SECOND;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libkern/libkern.h>
+#include <libkern/log.h>
+#include <time/time_manager.h>
+#include <time/timer_wheel.h>
+
+// #define TIMER_WHEEL_DEBUG
+
+static inline bool _timer_wheel_tick_passed(uint32_t tick, uint32_t now_tick)
+{
+    return (int32_t)(tick - now_tick) <= 0;
+}
+
+static inline timer_entry_t** _timer_wheel_slot(timer_wheel_t* wheel, uint32_t tick)
+{
+    return &wheel->slots[tick % TIMER_WHEEL_SLOTS];
+}
+
+static void _timer_wheel_unlink_lockless(timer_wheel_t* wheel, timer_entry_t* entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        *_timer_wheel_slot(wheel, entry->expire_tick) = entry->next;
+    }
+
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+
+    entry->prev = entry->next = NULL;
+    entry->wheel = NULL;
+}
+
+void timer_wheel_init(timer_wheel_t* wheel, uint32_t now_tick)
+{
+    lock_init(&wheel->lock);
+    wheel->next_tick = now_tick;
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+}
+
+/**
+ * Schedules the callback to be called from the timer interrupt of the
+ * first tick which is not earlier than expire_ns. The callback is called
+ * with the wheel lock held, so it must not touch the wheel.
+ */
+void timer_wheel_add(timer_wheel_t* wheel, timer_entry_t* entry, uint64_t expire_ns, void (*callback)(void*), void* data)
+{
+    uint32_t expire_tick = (uint32_t)((expire_ns + timeman_ns_per_tick() - 1) / timeman_ns_per_tick());
+
+    lock_acquire(&wheel->lock);
+    if (_timer_wheel_tick_passed(expire_tick, wheel->next_tick)) {
+        expire_tick = wheel->next_tick;
+    }
+
+    entry->expire_tick = expire_tick;
+    entry->callback = callback;
+    entry->data = data;
+    entry->wheel = wheel;
+    entry->prev = NULL;
+
+    timer_entry_t** slot = _timer_wheel_slot(wheel, expire_tick);
+    entry->next = *slot;
+    if (*slot) {
+        (*slot)->prev = entry;
+    }
+    *slot = entry;
+    lock_release(&wheel->lock);
+}
+
+void timer_wheel_remove(timer_entry_t* entry)
+{
+    timer_wheel_t* wheel = entry->wheel;
+    if (!wheel) {
+        return;
+    }
+
+    lock_acquire(&wheel->lock);
+    /* The timer could fire while we were taking the lock. */
+    if (entry->wheel == wheel) {
+        _timer_wheel_unlink_lockless(wheel, entry);
+    }
+    lock_release(&wheel->lock);
+}
+
+void timer_wheel_advance(timer_wheel_t* wheel, uint32_t now_tick)
+{
+    lock_acquire(&wheel->lock);
+
+    /* If ticks were missed, visiting each slot once is enough. */
+    uint32_t slots_to_visit = now_tick - wheel->next_tick + 1;
+    if ((int32_t)slots_to_visit <= 0) {
+        lock_release(&wheel->lock);
+        return;
+    }
+    if (slots_to_visit > TIMER_WHEEL_SLOTS) {
+        slots_to_visit = TIMER_WHEEL_SLOTS;
+    }
+
+    for (uint32_t i = 0; i < slots_to_visit; i++) {
+        timer_entry_t* entry = *_timer_wheel_slot(wheel, wheel->next_tick + i);
+        while (entry) {
+            timer_entry_t* next = entry->next;
+            if (_timer_wheel_tick_passed(entry->expire_tick, now_tick)) {
+#ifdef TIMER_WHEEL_DEBUG
+                log("Timer wheel: fire %x at tick %d", entry, now_tick);
+#endif
+                _timer_wheel_unlink_lockless(wheel, entry);
+                entry->callback(entry->data);
+            }
+            entry = next;
+        }
+    }
+
+    wheel->next_tick = now_tick + 1;
+    lock_release(&wheel->lock);
+}
@@ -7,7 +7,13 @@ struct thread_create_params {
     uint32_t entry_point;
     uint32_t stack_start;
     uint32_t stack_size;
+    uint32_t arg; /* Passed to the entry point as the first argument. */
 };
 typedef struct thread_create_params thread_create_params_t;
 
+/* Operations of the futex syscall. */
+#define FUTEX_WAIT 0
+#define FUTEX_WAKE 1
+#define FUTEX_PRIVATE_FLAG 128 /* The futex is used by threads of one process only. */
+
 #endif // _LIBC_BITS_THREAD_H
\ No newline at end of file
@@ -2,14 +2,82 @@
 #define _LIBC_PTHREAD_H
 
 #include <bits/thread.h>
+#include <bits/time.h>
+#include <stddef.h>
 #include <sys/_structs.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
 __BEGIN_DECLS
 
-int pthread_create(void* func);
+#define PTHREAD_STACK_MIN 4096
+#define PTHREAD_STACK_DEFAULT (64 * 1024)
+
+struct __pthread;
+typedef struct __pthread* pthread_t;
+
+typedef struct {
+    size_t stack_size;
+} pthread_attr_t;
+
+/* 0 - unlocked, 1 - locked, 2 - locked and could have waiters. */
+typedef struct {
+    uint32_t state;
+} pthread_mutex_t;
+typedef struct {
+    int unused;
+} pthread_mutexattr_t;
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+
+typedef struct {
+    uint32_t seq;
+    uint32_t waiters;
+} pthread_cond_t;
+typedef struct {
+    int unused;
+} pthread_condattr_t;
+#define PTHREAD_COND_INITIALIZER { 0, 0 }
+
+/* The state is the number of readers or PTHREAD_RWLOCK_WRITER. */
+#define PTHREAD_RWLOCK_WRITER 0xffffffff
+typedef struct {
+    uint32_t state;
+    uint32_t waiters;
+} pthread_rwlock_t;
+typedef struct {
+    int unused;
+} pthread_rwlockattr_t;
+#define PTHREAD_RWLOCK_INITIALIZER { 0, 0 }
+
+int pthread_attr_init(pthread_attr_t* attr);
+int pthread_attr_destroy(pthread_attr_t* attr);
+int pthread_attr_setstacksize(pthread_attr_t* attr, size_t stack_size);
+int pthread_attr_getstacksize(const pthread_attr_t* attr, size_t* stack_size);
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg);
+int pthread_join(pthread_t thread, void** retval);
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr);
+int pthread_mutex_destroy(pthread_mutex_t* mutex);
+int pthread_mutex_lock(pthread_mutex_t* mutex);
+int pthread_mutex_trylock(pthread_mutex_t* mutex);
+int pthread_mutex_unlock(pthread_mutex_t* mutex);
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr);
+int pthread_cond_destroy(pthread_cond_t* cond);
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const timespec_t* abstime);
+int pthread_cond_signal(pthread_cond_t* cond);
+int pthread_cond_broadcast(pthread_cond_t* cond);
+
+int pthread_rwlock_init(pthread_rwlock_t* rwlock, const pthread_rwlockattr_t* attr);
+int pthread_rwlock_destroy(pthread_rwlock_t* rwlock);
+int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t* rwlock);
+int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock);
+int pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock);
+int pthread_rwlock_unlock(pthread_rwlock_t* rwlock);
 
 __END_DECLS
 
-#endif /* _LIBC_PTHREAD_H */
\ No newline at end of file
+#endif /* _LIBC_PTHREAD_H */
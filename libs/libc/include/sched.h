@@ -1,13 +1,28 @@
 #ifndef _LIBC_SCHED_H
 #define _LIBC_SCHED_H
 
+#include <stddef.h>
 #include <sys/cdefs.h>
 #include <sys/types.h>
 
 __BEGIN_DECLS
 
+#define CPU_SETSIZE 32
+
+typedef struct {
+    uint32_t __bits;
+} cpu_set_t;
+
+#define CPU_ZERO(set) ((set)->__bits = 0)
+#define CPU_SET(cpu, set) ((set)->__bits |= (1U << (cpu)))
+#define CPU_CLR(cpu, set) ((set)->__bits &= ~(1U << (cpu)))
+#define CPU_ISSET(cpu, set) (((set)->__bits >> (cpu)) & 1U)
+#define CPU_COUNT(set) (__builtin_popcount((set)->__bits))
+
 void sched_yield();
+int sched_setaffinity(pid_t pid, size_t cpusetsize, const cpu_set_t* mask);
+int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t* mask);
 
 __END_DECLS
 
-#endif // _LIBC_SCHED_H
\ No newline at end of file
+#endif // _LIBC_SCHED_H
@@ -18,8 +18,8 @@ void* memset(void* dest, int fill, size_t nbytes);
 /* Move 'nbytes' from 'src' to 'dest' */
 void* memmove(void* dest, const void* __restrict src, size_t nbytes);
 
-/* Copy 'nbytes' from 'src' to 'dest'. See the comment in the source file
-   about optimization and restricting pointers. */
+/* Copy 'nbytes' from 'src' to 'dest'. The implementation is picked for the
+   cpu at startup, see string/string.c. */
 void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes);
 
 /* Copy 'nbytes' from 'src' to 'dest', stopping if the current byte matches
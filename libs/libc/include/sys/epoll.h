@@ -0,0 +1,17 @@
+#ifndef _LIBC_SYS_EPOLL_H
+#define _LIBC_SYS_EPOLL_H
+
+#include <bits/sys/epoll.h>
+#include <stddef.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+int epoll_create(int size);
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t* event);
+int epoll_wait(int epfd, epoll_event_t* events, int maxevents, int timeout);
+
+__END_DECLS
+
+#endif // _LIBC_SYS_EPOLL_H
\ No newline at end of file
@@ -12,6 +12,8 @@ __BEGIN_DECLS
 int shared_buffer_create(uint8_t** buffer, size_t size);
 int shared_buffer_get(int id, uint8_t** buffer);
 int shared_buffer_free(int id);
+int shared_buffer_publish(int id, uint32_t key);
+int shared_buffer_find(uint32_t key);
 
 __END_DECLS
 
@@ -11,6 +11,8 @@ __BEGIN_DECLS
 int socket(int domain, int type, int protocol);
 int bind(int sockfd, const char* name, int len);
 int connect(int sockfd, const char* name, int len);
+int accept(int sockfd, char* name, int* len);
+int accept4(int sockfd, char* name, int* len, int flags);
 
 __END_DECLS
 
@@ -41,7 +41,7 @@ static inline int _syscall_impl(sysid_t sysid, int p1, int p2, int p3, int p4, i
 #define RETURN_WITH_ERRNO(res, on_suc, on_fail) \
     do {                                        \
         if ((int)res < 0) {                     \
-            set_errno(res);                     \
+            set_errno(-(int)res);               \
             return (on_fail);                   \
         }                                       \
         set_errno(0);                           \
@@ -31,6 +31,9 @@ uid_t getuid();
 /* sched */
 int nice(int inc);
 
+unsigned int sleep(unsigned int seconds);
+int usleep(uint32_t usec);
+
 __END_DECLS
 
 #endif // _LIBC_UNISTD_H
@@ -3,9 +3,11 @@ int errno;
 extern int _stdio_init();
 extern int _stdio_deinit();
 extern int _malloc_init();
+extern void _string_init();
 
 void _libc_init()
 {
+    _string_init();
     _malloc_init();
     _stdio_init();
     extern void (*__init_array_start[])(int, char**, char**) __attribute__((visibility("hidden")));
@@ -1,168 +1,222 @@
-#include "malloc.h"
-#include <stdbool.h>
-#include <stdint.h>
-#include <string.h>
-#include <sys/mman.h>
-
-#define ALIGNMENT (4)
-#define DEVIDE_SPACE_BOUNDARY (32)
-
-static malloc_header_t* memory[MALLOC_MAX_ALLOCATED_BLOCKS];
-static size_t allocated_blocks = 0;
-
-static int _alloc_new_block(size_t sz);
-
-static int _alloc_new_block(size_t sz)
-{
-    sz += sizeof(malloc_header_t);
-
-    // this will reduce system calls for the small memory allocations
-    size_t allocated_sz = sz > MALLOC_DEFAULT_BLOCK_SIZE ? sz : MALLOC_DEFAULT_BLOCK_SIZE;
-
-    int ret = (int)mmap(NULL, allocated_sz, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
-    if (ret < 0) {
-        return -1;
-    }
-    memory[allocated_blocks] = (void*)ret; // allocating a new block of memory
-    memory[allocated_blocks]->flags = 0;
-    memory[allocated_blocks]->next = 0;
-    memory[allocated_blocks]->prev = 0;
-    memory[allocated_blocks]->size = allocated_sz - sizeof(malloc_header_t);
-
-    allocated_blocks++;
-    return 0;
-}
-
-static inline char _malloc_need_to_divide_space(malloc_header_t* space, size_t alloc_size)
-{
-    return alloc_size + DEVIDE_SPACE_BOUNDARY <= space->size;
-}
-
-static inline char _malloc_can_fit_allocation(malloc_header_t* space, size_t alloc_size)
-{
-    uint32_t add[] = { 0, sizeof(malloc_header_t) };
-    return space->size >= (alloc_size + add[_malloc_need_to_divide_space(space, alloc_size)]);
-}
-
-void* malloc(size_t sz)
-{
-    if (!sz) {
-        return NULL;
-    }
-    sz += (ALIGNMENT - 1);
-    sz &= ~(uint32_t)(ALIGNMENT - 1);
-
-    void* res = slab_alloc(sz);
-    if (res) {
-        return res;
-    }
-
-    /* iterating over allocated by mmap blocks
-       and finding a first fit memory chunk */
-    malloc_header_t* first_fit = 0;
-    for (size_t i = 0; i < allocated_blocks; i++) {
-        malloc_header_t* cur_block = memory[i];
-        while (cur_block->next && !(block_is_free(cur_block) && _malloc_can_fit_allocation(cur_block, sz))) {
-            cur_block = cur_block->next;
-        }
-        if (block_is_free(cur_block) && _malloc_can_fit_allocation(cur_block, sz)) {
-            first_fit = cur_block;
-            break;
-        }
-    }
-
-    if (!first_fit) {
-        int err = _alloc_new_block(sz);
-        if (err) {
-            return NULL;
-        }
-        first_fit = memory[allocated_blocks - 1];
-    }
-
-    malloc_header_t* copy_next = first_fit->next;
-    size_t copy_size = first_fit->size;
-
-    first_fit->flags |= FLAG_ALLOCATED;
-    if (_malloc_need_to_divide_space(first_fit, sz)) {
-        first_fit->size = sz;
-        first_fit->next = (malloc_header_t*)((uintptr_t)first_fit + sz + sizeof(malloc_header_t));
-
-        // adjust the firstfit chunk
-        first_fit->next->flags = 0;
-        first_fit->next->size = copy_size - sz - sizeof(malloc_header_t);
-        first_fit->next->next = copy_next;
-        first_fit->next->prev = first_fit;
-
-        if (first_fit->next->next) {
-            first_fit->next->next->prev = first_fit->next;
-        }
-    }
-
-    return (void*)&((malloc_header_t*)first_fit)[1];
-}
-
-void free(void* mem)
-{
-    if (!mem) {
-        return;
-    }
-
-    malloc_header_t* mem_header = &((malloc_header_t*)mem)[-1];
-
-    if (block_is_slab(mem_header)) {
-        return slab_free(mem_header);
-    }
-
-    block_rem_flags(mem_header, FLAG_ALLOCATED);
-    while (mem_header->prev && block_is_free(mem_header->prev)) {
-        mem_header = mem_header->prev;
-    }
-
-    // Trying to glue the freed chunk with its neighbours.
-    while (mem_header->next && block_is_free(mem_header->next)) {
-        mem_header->size += mem_header->next->size + sizeof(malloc_header_t);
-
-        if (mem_header->next->next) {
-            mem_header->next->next->prev = mem_header;
-        }
-        mem_header->next = mem_header->next->next;
-    }
-}
-
-void* calloc(size_t num, size_t size)
-{
-    void* mem = malloc(num * size);
-    if (!mem) {
-        return NULL;
-    }
-
-    memset(mem, 0, num * size);
-    return mem;
-}
-
-void* realloc(void* ptr, size_t new_size)
-{
-    if (!ptr) {
-        return malloc(new_size);
-    }
-
-    size_t old_size = ((malloc_header_t*)ptr)[-1].size;
-    if (old_size == new_size) {
-        return ptr;
-    }
-
-    uint8_t* new_area = malloc(new_size);
-    if (!new_area) {
-        return NULL;
-    }
-
-    memcpy(new_area, ptr, new_size < old_size ? new_size : old_size);
-    free(ptr);
-
-    return new_area;
-}
-
-void _malloc_init()
-{
-    _slab_init();
-}
\ No newline at end of file
+#include "malloc.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Small sizes are served by slab.c, big ones get a mapping of their own,
+// which is given back to the system on free. A few freed mappings are kept
+// in a cache, so big buffers which are freed and allocated again in a loop
+// don't cost a pair of system calls each time.
+//
+// Threads share the heap, so it is guarded by a mutex. Per-thread caches
+// need thread local storage, which is not supported yet.
+
+static malloc_header_t* mapping_cache[MALLOC_MAPPING_CACHE_SIZE];
+static size_t mapping_cache_size = 0;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void _malloc_lock()
+{
+    pthread_mutex_lock(&heap_lock);
+}
+
+static inline void _malloc_unlock()
+{
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static inline size_t _malloc_mapping_size(size_t sz)
+{
+    return (sz + sizeof(malloc_header_t) + MALLOC_PAGE_SIZE - 1) & ~(size_t)(MALLOC_PAGE_SIZE - 1);
+}
+
+void* _malloc_map(void* addr, size_t size)
+{
+    int flags = MAP_ANONYMOUS | MAP_PRIVATE;
+    if (addr) {
+        flags |= MAP_FIXED;
+    }
+
+    // The kernel returns a negative error code instead of an address.
+    intptr_t ret = (intptr_t)mmap(addr, size, PROT_READ | PROT_WRITE, flags, 0, 0);
+    if (ret < 0 && ret > -MALLOC_PAGE_SIZE) {
+        return NULL;
+    }
+    return (void*)ret;
+}
+
+void _malloc_unmap(void* addr, size_t size)
+{
+    munmap(addr, size);
+}
+
+static malloc_header_t* _malloc_take_cached_mapping(size_t mapping_size)
+{
+    // Takes a mapping which is not more than twice as big as needed.
+    for (size_t i = 0; i < mapping_cache_size; i++) {
+        malloc_header_t* block = mapping_cache[i];
+        size_t cached_size = block->size + sizeof(malloc_header_t);
+        if (cached_size >= mapping_size && cached_size / 2 < mapping_size) {
+            mapping_cache[i] = mapping_cache[--mapping_cache_size];
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static void* _malloc_mapped(size_t sz)
+{
+    size_t mapping_size = _malloc_mapping_size(sz);
+    if (mapping_size < sz) {
+        return NULL;
+    }
+
+    malloc_header_t* block = _malloc_take_cached_mapping(mapping_size);
+    if (!block) {
+        block = _malloc_map(NULL, mapping_size);
+        if (!block) {
+            return NULL;
+        }
+        block->size = mapping_size - sizeof(malloc_header_t);
+    }
+
+    block->flags = FLAG_MAPPED | FLAG_ALLOCATED;
+    return (void*)&block[1];
+}
+
+static void _free_mapped(malloc_header_t* mem_header)
+{
+    block_rem_flags(mem_header, FLAG_ALLOCATED);
+    size_t mapping_size = mem_header->size + sizeof(malloc_header_t);
+    if (mapping_size <= MALLOC_MAPPING_CACHE_MAX && mapping_cache_size < MALLOC_MAPPING_CACHE_SIZE) {
+        mapping_cache[mapping_cache_size++] = mem_header;
+        return;
+    }
+    _malloc_unmap(mem_header, mapping_size);
+}
+
+// Maps pages right after the block, the kernel refuses if they are taken.
+static bool _malloc_grow_mapped(malloc_header_t* mem_header, size_t new_size)
+{
+    size_t mapping_size = mem_header->size + sizeof(malloc_header_t);
+    size_t new_mapping_size = _malloc_mapping_size(new_size);
+    if (new_mapping_size < new_size) {
+        return false;
+    }
+
+    uint8_t* tail = (uint8_t*)mem_header + mapping_size;
+    void* res = _malloc_map(tail, new_mapping_size - mapping_size);
+    if (res != tail) {
+        if (res) {
+            _malloc_unmap(res, new_mapping_size - mapping_size);
+        }
+        return false;
+    }
+
+    mem_header->size = new_mapping_size - sizeof(malloc_header_t);
+    return true;
+}
+
+static inline size_t _malloc_block_size(malloc_header_t* mem_header)
+{
+    if (block_is_slab(mem_header)) {
+        return slab_class_size(mem_header->slab->size_class);
+    }
+    return mem_header->size;
+}
+
+void* malloc(size_t sz)
+{
+    if (!sz) {
+        return NULL;
+    }
+
+    _malloc_lock();
+    void* res;
+    if (sz <= MALLOC_MAX_SLAB_SIZE) {
+        res = slab_alloc(sz);
+    } else {
+        res = _malloc_mapped(sz);
+    }
+    _malloc_unlock();
+    return res;
+}
+
+void free(void* mem)
+{
+    if (!mem) {
+        return;
+    }
+
+    malloc_header_t* mem_header = &((malloc_header_t*)mem)[-1];
+    if (block_is_free(mem_header)) {
+        return;
+    }
+
+    _malloc_lock();
+    if (block_is_slab(mem_header)) {
+        slab_free(mem_header);
+    } else {
+        _free_mapped(mem_header);
+    }
+    _malloc_unlock();
+}
+
+void* calloc(size_t num, size_t size)
+{
+    if (size && num > ((size_t)-1) / size) {
+        return NULL;
+    }
+
+    void* mem = malloc(num * size);
+    if (!mem) {
+        return NULL;
+    }
+
+    memset(mem, 0, num * size);
+    return mem;
+}
+
+void* realloc(void* ptr, size_t new_size)
+{
+    if (!ptr) {
+        return malloc(new_size);
+    }
+
+    malloc_header_t* mem_header = &((malloc_header_t*)ptr)[-1];
+    size_t old_size = _malloc_block_size(mem_header);
+
+    // The block is kept while it fits and is not mostly wasted.
+    if (new_size <= old_size) {
+        if (block_is_slab(mem_header) && (new_size > old_size / 2 || mem_header->slab->size_class == 0)) {
+            return ptr;
+        }
+        if (block_is_mapped(mem_header) && new_size > MALLOC_MAX_SLAB_SIZE && new_size > old_size / 2) {
+            return ptr;
+        }
+    } else if (block_is_mapped(mem_header)) {
+        _malloc_lock();
+        bool grown = _malloc_grow_mapped(mem_header, new_size);
+        _malloc_unlock();
+        if (grown) {
+            return ptr;
+        }
+    }
+
+    uint8_t* new_area = malloc(new_size);
+    if (!new_area) {
+        return NULL;
+    }
+
+    memcpy(new_area, ptr, new_size < old_size ? new_size : old_size);
+    free(ptr);
+
+    return new_area;
+}
+
+void _malloc_init()
+{
+    _slab_init();
+}
@@ -9,19 +9,51 @@
 
 __BEGIN_DECLS
 
-#define MALLOC_DEFAULT_BLOCK_SIZE 4096
-#define MALLOC_MAX_ALLOCATED_BLOCKS 64
+#define MALLOC_PAGE_SIZE 4096
+#define MALLOC_ALIGNMENT 8
+
+// Sizes up to MALLOC_MAX_SLAB_SIZE are rounded up to a power of two and
+// served from slabs of the size class, bigger ones get their own mapping.
+#define MALLOC_MIN_SLAB_SHIFT 4
+#define MALLOC_SIZE_CLASSES 8
+#define MALLOC_MAX_SLAB_SIZE (1 << (MALLOC_MIN_SLAB_SHIFT + MALLOC_SIZE_CLASSES - 1))
+
+#define MALLOC_MIN_SLAB_MAPPING (16 * 1024)
+#define MALLOC_MIN_SLAB_BLOCKS 32
+
+// Freed mappings of this size or less are kept to be reused.
+#define MALLOC_MAPPING_CACHE_SIZE 8
+#define MALLOC_MAPPING_CACHE_MAX (256 * 1024)
 
 #define FLAG_ALLOCATED (0x1)
 #define FLAG_SLAB (0x2)
+#define FLAG_MAPPED (0x4)
+
+struct __malloc_slab;
+
 struct __malloc_header {
-    size_t size;
+    union {
+        size_t size; // Usable size of a mapped block
+        struct __malloc_slab* slab; // Owner of a slab block
+    };
     uint32_t flags;
-    struct __malloc_header* next;
-    struct __malloc_header* prev;
 };
 typedef struct __malloc_header malloc_header_t;
 
+struct __malloc_slab {
+    struct __malloc_slab* next;
+    struct __malloc_slab* prev;
+    malloc_header_t* free_blocks;
+    uint8_t* untouched; // Blocks from here to the end were never given out
+    uint8_t* end;
+    uint32_t size_class;
+    uint32_t block_size;
+    uint32_t used;
+    uint32_t capacity;
+    size_t mapping_size;
+};
+typedef struct __malloc_slab malloc_slab_t;
+
 static inline bool block_has_flags(malloc_header_t* block, uint32_t flags)
 {
     return ((block->flags & flags) == flags);
@@ -52,6 +84,24 @@ static inline bool block_is_slab(malloc_header_t* block)
     return block_has_flags(block, FLAG_SLAB);
 }
 
+static inline bool block_is_mapped(malloc_header_t* block)
+{
+    return block_has_flags(block, FLAG_MAPPED);
+}
+
+static inline size_t slab_class_size(uint32_t size_class)
+{
+    return (size_t)1 << (MALLOC_MIN_SLAB_SHIFT + size_class);
+}
+
+static inline uint32_t slab_size_class(size_t size)
+{
+    if (size <= slab_class_size(0)) {
+        return 0;
+    }
+    return 32 - __builtin_clz(size - 1) - MALLOC_MIN_SLAB_SHIFT;
+}
+
 void _malloc_init();
 void _slab_init();
 
@@ -60,6 +110,9 @@ void free(void*);
 void* calloc(size_t, size_t);
 void* realloc(void*, size_t);
 
+void* _malloc_map(void* addr, size_t size);
+void _malloc_unmap(void* addr, size_t size);
+
 void* slab_alloc(size_t);
 void slab_free(malloc_header_t* mem_header);
 
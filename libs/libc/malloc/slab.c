@@ -3,77 +3,121 @@
 #include <string.h>
 #include <sys/mman.h>
 
-// Fast allocator for sizes 16, 32, 48, 64 bytes
+// Allocator for power-of-two sizes from 16 to MALLOC_MAX_SLAB_SIZE bytes.
+// Every size class keeps a list of slabs which have free blocks. A slab is
+// mapped when the list runs dry and unmapped once all of its blocks are
+// freed, but the last slab of the class is kept to avoid mapping churn.
 
-malloc_header_t* free_blocks[5];
+#define SLAB_HEADER_SIZE ((sizeof(malloc_slab_t) + MALLOC_ALIGNMENT - 1) & ~(MALLOC_ALIGNMENT - 1))
 
-void prepare_free_blocks(size_t size)
+static malloc_slab_t* partial_slabs[MALLOC_SIZE_CLASSES];
+
+static inline void _slab_link(malloc_slab_t* slab)
 {
-    int block_id = size >> 4;
-    const size_t alloc_size = MALLOC_DEFAULT_BLOCK_SIZE;
-    int ret = (int)mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, 0, 0);
-    if (ret < 0) {
-        free_blocks[block_id] = NULL;
-        return;
+    malloc_slab_t* head = partial_slabs[slab->size_class];
+    slab->prev = NULL;
+    slab->next = head;
+    if (head) {
+        head->prev = slab;
     }
+    partial_slabs[slab->size_class] = slab;
+}
 
-    void* raw_area = (void*)ret;
-    const size_t sizeof_block_with_header = size + sizeof(malloc_header_t);
-    size_t passed = 0;
-
-    free_blocks[block_id] = (malloc_header_t*)raw_area;
-    malloc_header_t* prev_header = NULL;
-
-    while (passed + sizeof_block_with_header <= alloc_size) {
-        malloc_header_t* current = (malloc_header_t*)raw_area;
-
-        current->flags = FLAG_SLAB | FLAG_ALLOCATED;
-        current->next = NULL;
-        current->prev = prev_header;
-        current->size = size;
+static inline void _slab_unlink(malloc_slab_t* slab)
+{
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        partial_slabs[slab->size_class] = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
 
-        prev_header = current;
-        raw_area += sizeof_block_with_header;
-        passed += sizeof_block_with_header;
+static malloc_slab_t* _slab_create(uint32_t size_class)
+{
+    size_t block_size = slab_class_size(size_class) + sizeof(malloc_header_t);
+    size_t mapping_size = SLAB_HEADER_SIZE + MALLOC_MIN_SLAB_BLOCKS * block_size;
+    if (mapping_size < MALLOC_MIN_SLAB_MAPPING) {
+        mapping_size = MALLOC_MIN_SLAB_MAPPING;
     }
+    mapping_size = (mapping_size + MALLOC_PAGE_SIZE - 1) & ~(MALLOC_PAGE_SIZE - 1);
 
-    malloc_header_t* next_header = NULL;
-    while (prev_header) {
-        prev_header->next = next_header;
-        prev_header = prev_header->prev;
+    malloc_slab_t* slab = _malloc_map(NULL, mapping_size);
+    if (!slab) {
+        return NULL;
     }
+
+    // Blocks are cut from the untouched part lazily, so pages of a new
+    // slab are not faulted in before they are needed.
+    slab->free_blocks = NULL;
+    slab->untouched = (uint8_t*)slab + SLAB_HEADER_SIZE;
+    slab->end = (uint8_t*)slab + mapping_size;
+    slab->size_class = size_class;
+    slab->block_size = block_size;
+    slab->used = 0;
+    slab->capacity = (mapping_size - SLAB_HEADER_SIZE) / block_size;
+    slab->mapping_size = mapping_size;
+    _slab_link(slab);
+    return slab;
 }
 
 void _slab_init()
 {
-    prepare_free_blocks(16);
-    prepare_free_blocks(32);
-    prepare_free_blocks(48);
-    prepare_free_blocks(64);
+    for (int i = 0; i < MALLOC_SIZE_CLASSES; i++) {
+        partial_slabs[i] = NULL;
+    }
 }
 
 void* slab_alloc(size_t size)
 {
-    if (size > 64) {
+    if (size > MALLOC_MAX_SLAB_SIZE) {
         return NULL;
     }
-    int block_id = ((size + 15) >> 4);
-    malloc_header_t* zone = free_blocks[block_id];
-    if (!zone) {
-        return NULL;
+
+    uint32_t size_class = slab_size_class(size);
+    malloc_slab_t* slab = partial_slabs[size_class];
+    if (!slab) {
+        slab = _slab_create(size_class);
+        if (!slab) {
+            return NULL;
+        }
+    }
+
+    malloc_header_t* block = slab->free_blocks;
+    if (block) {
+        slab->free_blocks = *(malloc_header_t**)&block[1];
+    } else {
+        block = (malloc_header_t*)slab->untouched;
+        block->slab = slab;
+        slab->untouched += slab->block_size;
     }
 
-    free_blocks[block_id] = zone->next;
-    return (void*)&((malloc_header_t*)zone)[1];
+    block->flags = FLAG_SLAB | FLAG_ALLOCATED;
+    slab->used++;
+    if (slab->used == slab->capacity) {
+        _slab_unlink(slab);
+    }
+    return (void*)&block[1];
 }
 
 void slab_free(malloc_header_t* mem_header)
 {
-    malloc_header_t* next = free_blocks[((mem_header->size) >> 4)];
-    free_blocks[((mem_header->size) >> 4)] = mem_header;
-    mem_header->next = next;
-    mem_header->prev = NULL;
-    if (next) {
-        next->prev = mem_header;
+    malloc_slab_t* slab = mem_header->slab;
+    if (slab->used == slab->capacity) {
+        _slab_link(slab);
     }
-}
\ No newline at end of file
+
+    block_rem_flags(mem_header, FLAG_ALLOCATED);
+    *(malloc_header_t**)&mem_header[1] = slab->free_blocks;
+    slab->free_blocks = mem_header;
+    slab->used--;
+
+    if (!slab->used && (slab->prev || slab->next)) {
+        _slab_unlink(slab);
+        _malloc_unmap(slab, slab->mapping_size);
+    }
+}
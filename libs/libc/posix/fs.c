@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/select.h>
 #include <sys/stat.h>
@@ -74,6 +75,28 @@ int select(int nfds, fd_set_t* readfds, fd_set_t* writefds, fd_set_t* exceptfds,
     RETURN_WITH_ERRNO(res, res, -1);
 }
 
+int epoll_create(int size)
+{
+    if (size <= 0) {
+        set_errno(EINVAL);
+        return -1;
+    }
+    int res = DO_SYSCALL_0(SYS_EPOLL_CREATE);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
+int epoll_ctl(int epfd, int op, int fd, epoll_event_t* event)
+{
+    int res = DO_SYSCALL_4(SYS_EPOLL_CTL, epfd, op, fd, event);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int epoll_wait(int epfd, epoll_event_t* events, int maxevents, int timeout)
+{
+    int res = DO_SYSCALL_4(SYS_EPOLL_WAIT, epfd, events, maxevents, timeout);
+    RETURN_WITH_ERRNO(res, res, -1);
+}
+
 void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
 {
     mmap_params_t mmap_params = { 0 };
@@ -7,6 +7,18 @@ void sched_yield()
     DO_SYSCALL_0(SYS_SCHEDYIELD);
 }
 
+int sched_setaffinity(pid_t pid, size_t cpusetsize, const cpu_set_t* mask)
+{
+    int res = DO_SYSCALL_3(SYS_SCHED_SETAFFINITY, pid, cpusetsize, mask);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int sched_getaffinity(pid_t pid, size_t cpusetsize, cpu_set_t* mask)
+{
+    int res = DO_SYSCALL_3(SYS_SCHED_GETAFFINITY, pid, cpusetsize, mask);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
 int nice(int inc)
 {
     int res = DO_SYSCALL_1(SYS_NICE, inc);
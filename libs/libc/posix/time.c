@@ -1,5 +1,7 @@
 #include <sys/time.h>
 #include <sysdep.h>
+#include <time.h>
+#include <unistd.h>
 
 int gettimeofday(timeval_t* tv, timezone_t* tz)
 {
@@ -10,4 +12,17 @@ int gettimeofday(timeval_t* tv, timezone_t* tz)
 int settimeofday(const timeval_t* tv, const timezone_t* tz)
 {
     return -1;
-}
\ No newline at end of file
+}
+
+unsigned int sleep(unsigned int seconds)
+{
+    timespec_t ts = { .tv_sec = seconds, .tv_nsec = 0 };
+    nanosleep(&ts, NULL);
+    return 0;
+}
+
+int usleep(uint32_t usec)
+{
+    timespec_t ts = { .tv_sec = usec / 1000000, .tv_nsec = (usec % 1000000) * 1000 };
+    return nanosleep(&ts, NULL);
+}
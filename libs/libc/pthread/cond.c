@@ -0,0 +1,79 @@
+#include "futex.h"
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+// Waiters sleep on the sequence number, which is changed by every signal,
+// so a signal which comes after the mutex is released is not lost. Signals
+// go to the kernel only if there are waiters.
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr)
+{
+    cond->seq = 0;
+    cond->waiters = 0;
+    return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond)
+{
+    return 0;
+}
+
+static int _pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, const timespec_t* timeout)
+{
+    uint32_t seq = __atomic_load_n(&cond->seq, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&cond->waiters, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(mutex);
+
+    int res = _futex_wait(&cond->seq, seq, timeout);
+
+    __atomic_fetch_sub(&cond->waiters, 1, __ATOMIC_RELAXED);
+    // Other threads could be woken with us, so the mutex is marked as
+    // having waiters to pass it on when it's unlocked.
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        _futex_wait(&mutex->state, 2, NULL);
+    }
+    return res == -ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex)
+{
+    return _pthread_cond_wait(cond, mutex, NULL);
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const timespec_t* abstime)
+{
+    timespec_t now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (abstime->tv_sec < now.tv_sec || (abstime->tv_sec == now.tv_sec && abstime->tv_nsec <= now.tv_nsec)) {
+        return ETIMEDOUT;
+    }
+
+    timespec_t timeout;
+    timeout.tv_sec = abstime->tv_sec - now.tv_sec;
+    if (abstime->tv_nsec >= now.tv_nsec) {
+        timeout.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+    } else {
+        timeout.tv_sec--;
+        timeout.tv_nsec = abstime->tv_nsec + 1000000000 - now.tv_nsec;
+    }
+    return _pthread_cond_wait(cond, mutex, &timeout);
+}
+
+int pthread_cond_signal(pthread_cond_t* cond)
+{
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_RELAXED)) {
+        _futex_wake(&cond->seq, 1);
+    }
+    return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond)
+{
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&cond->waiters, __ATOMIC_RELAXED)) {
+        _futex_wake(&cond->seq, FUTEX_WAKE_ALL);
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _LIBC_PTHREAD_FUTEX_H
+#define _LIBC_PTHREAD_FUTEX_H
+
+#include <bits/thread.h>
+#include <bits/time.h>
+#include <sysdep.h>
+
+#define FUTEX_WAKE_ALL 0x7fffffff
+
+// Threads of a process never share sync objects with other processes, so
+// all futexes are private ones, which the kernel keys by virtual address.
+
+static inline int _futex_wait(uint32_t* addr, uint32_t val, const timespec_t* timeout)
+{
+    return DO_SYSCALL_4(SYS_FUTEX, addr, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, val, timeout);
+}
+
+static inline int _futex_wake(uint32_t* addr, int count)
+{
+    return DO_SYSCALL_4(SYS_FUTEX, addr, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, count, 0);
+}
+
+#endif // _LIBC_PTHREAD_FUTEX_H
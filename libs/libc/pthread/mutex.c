@@ -0,0 +1,54 @@
+#include "futex.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+// A mutex is taken with a single atomic operation while there is no
+// contention. A thread which finds it locked marks it as having waiters
+// and sleeps on its futex, so only then unlock goes to the kernel.
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr)
+{
+    mutex->state = 0;
+    return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex)
+{
+    return 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+
+    if (state != 2) {
+        state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (state != 0) {
+        _futex_wait(&mutex->state, 2, NULL);
+        state = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+    return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex)
+{
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex)
+{
+    if (__atomic_fetch_sub(&mutex->state, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(&mutex->state, 0, __ATOMIC_RELEASE);
+        _futex_wake(&mutex->state, 1);
+    }
+    return 0;
+}
@@ -1,14 +1,98 @@
+#include "futex.h"
+#include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <sysdep.h>
 
-int pthread_create(void* func)
+// The control block of a thread lies at the top of its stack mapping, so
+// creating a thread takes a single mapping. The kernel sets done and wakes
+// its futex only when the thread has left its stack, so a joiner could
+// unmap it right away.
+struct __pthread {
+    void* (*start_routine)(void*);
+    void* arg;
+    void* retval;
+    void* stack;
+    size_t stack_size;
+    uint32_t done;
+};
+
+static void _pthread_entry(struct __pthread* thread)
+{
+    thread->retval = thread->start_routine(thread->arg);
+    DO_SYSCALL_1(SYS_THREAD_EXIT, &thread->done);
+}
+
+int pthread_attr_init(pthread_attr_t* attr)
+{
+    attr->stack_size = PTHREAD_STACK_DEFAULT;
+    return 0;
+}
+
+int pthread_attr_destroy(pthread_attr_t* attr)
+{
+    return 0;
+}
+
+int pthread_attr_setstacksize(pthread_attr_t* attr, size_t stack_size)
+{
+    if (stack_size < PTHREAD_STACK_MIN) {
+        return EINVAL;
+    }
+    attr->stack_size = stack_size;
+    return 0;
+}
+
+int pthread_attr_getstacksize(const pthread_attr_t* attr, size_t* stack_size)
 {
-    uint32_t start = (uint32_t)mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_STACK | MAP_PRIVATE, 0, 0);
+    *stack_size = attr->stack_size;
+    return 0;
+}
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg)
+{
+    size_t stack_size = attr ? attr->stack_size : PTHREAD_STACK_DEFAULT;
+    stack_size = (stack_size + sizeof(struct __pthread) + PTHREAD_STACK_MIN - 1) & ~(size_t)(PTHREAD_STACK_MIN - 1);
+
+    // The kernel returns a negative error code instead of an address.
+    void* stack = mmap(NULL, stack_size, PROT_READ | PROT_WRITE, MAP_STACK | MAP_PRIVATE, 0, 0);
+    if ((intptr_t)stack < 0 && (intptr_t)stack > -PTHREAD_STACK_MIN) {
+        return EAGAIN;
+    }
+
+    struct __pthread* self = (struct __pthread*)((uintptr_t)stack + stack_size - sizeof(struct __pthread));
+    self->start_routine = start_routine;
+    self->arg = arg;
+    self->retval = NULL;
+    self->stack = stack;
+    self->stack_size = stack_size;
+    self->done = 0;
+
     thread_create_params_t params;
-    params.stack_start = start;
-    params.stack_size = 4096;
-    params.entry_point = (uint32_t)func;
+    params.stack_start = (uint32_t)stack;
+    params.stack_size = ((uintptr_t)self - (uintptr_t)stack) & ~(uintptr_t)0xf;
+    params.entry_point = (uint32_t)_pthread_entry;
+    params.arg = (uint32_t)self;
     int res = DO_SYSCALL_1(SYS_PTHREADCREATE, &params);
-    RETURN_WITH_ERRNO(res, 0, res);
-}
\ No newline at end of file
+    if (res < 0) {
+        munmap(stack, stack_size);
+        return -res;
+    }
+
+    *thread = self;
+    return 0;
+}
+
+int pthread_join(pthread_t thread, void** retval)
+{
+    while (!__atomic_load_n(&thread->done, __ATOMIC_ACQUIRE)) {
+        _futex_wait(&thread->done, 0, NULL);
+    }
+
+    if (retval) {
+        *retval = thread->retval;
+    }
+    munmap(thread->stack, thread->stack_size);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include "futex.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+// Readers and writers take the lock with an atomic operation on its state.
+// Threads which have to wait sleep on the state, unlock wakes all of them
+// once the lock is free for a writer, and only if someone waits.
+
+int pthread_rwlock_init(pthread_rwlock_t* rwlock, const pthread_rwlockattr_t* attr)
+{
+    rwlock->state = 0;
+    rwlock->waiters = 0;
+    return 0;
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t* rwlock)
+{
+    return 0;
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t* rwlock)
+{
+    uint32_t state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+    while (state != PTHREAD_RWLOCK_WRITER) {
+        if (__atomic_compare_exchange_n(&rwlock->state, &state, state + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+    return EBUSY;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t* rwlock)
+{
+    while (pthread_rwlock_tryrdlock(rwlock) != 0) {
+        __atomic_fetch_add(&rwlock->waiters, 1, __ATOMIC_RELAXED);
+        _futex_wait(&rwlock->state, PTHREAD_RWLOCK_WRITER, NULL);
+        __atomic_fetch_sub(&rwlock->waiters, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t* rwlock)
+{
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&rwlock->state, &state, PTHREAD_RWLOCK_WRITER, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t* rwlock)
+{
+    for (;;) {
+        uint32_t state = 0;
+        if (__atomic_compare_exchange_n(&rwlock->state, &state, PTHREAD_RWLOCK_WRITER, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+        __atomic_fetch_add(&rwlock->waiters, 1, __ATOMIC_RELAXED);
+        _futex_wait(&rwlock->state, state, NULL);
+        __atomic_fetch_sub(&rwlock->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t* rwlock)
+{
+    uint32_t state = __atomic_load_n(&rwlock->state, __ATOMIC_RELAXED);
+    if (state == PTHREAD_RWLOCK_WRITER) {
+        __atomic_store_n(&rwlock->state, 0, __ATOMIC_RELEASE);
+    } else if (__atomic_sub_fetch(&rwlock->state, 1, __ATOMIC_RELEASE) != 0) {
+        return 0;
+    }
+
+    if (__atomic_load_n(&rwlock->waiters, __ATOMIC_RELAXED)) {
+        _futex_wake(&rwlock->state, FUTEX_WAKE_ALL);
+    }
+    return 0;
+}
@@ -17,4 +17,19 @@ int connect(int sockfd, const char* name, int len)
 {
     int res = DO_SYSCALL_3(SYS_CONNECT, sockfd, name, len);
     RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int accept(int sockfd, char* name, int* len)
+{
+    return accept4(sockfd, name, len, 0);
+}
+
+int accept4(int sockfd, char* name, int* len, int flags)
+{
+    // Local sockets have no names for the connecting side.
+    if (len) {
+        *len = 0;
+    }
+    int res = DO_SYSCALL_2(SYS_ACCEPT, sockfd, flags);
+    RETURN_WITH_ERRNO(res, res, -1);
 }
\ No newline at end of file
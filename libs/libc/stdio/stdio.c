@@ -140,7 +140,7 @@ int fputc(int c, FILE* stream)
 {
     int res = fwrite(&c, 1, 1, stream);
     if (!res)
-        return -errno;
+        return EOF;
 
     return c;
 }
@@ -163,7 +163,7 @@ int fputs(const char* s, FILE* stream)
     int res = fwrite(s, len, 1, stream);
 
     if (!res)
-        return -errno;
+        return EOF;
 
     return res;
 }
@@ -504,7 +504,7 @@ static int _open_file(FILE* file, const char* path, const char* mode)
 
     int fd = open(path, flags);
     if (fd < 0)
-        return errno;
+        return -errno;
 
     file->_file = fd;
     return 0;
@@ -518,7 +518,11 @@ static FILE* _fopen_internal(const char* path, const char* mode)
 
     _init_stream(file);
     _resize_buf(file, BUFSIZ);
-    _open_file(file, path, mode);
+    if (_open_file(file, path, mode) < 0) {
+        _free_buf(file);
+        free(file);
+        return NULL;
+    }
     return file;
 }
 
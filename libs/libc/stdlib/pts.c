@@ -23,7 +23,7 @@ int ptsname_r(int fd, char* buf, size_t buflen)
 
     fstat_t stat;
     if (fstat(fd, &stat) < 0) {
-        return errno;
+        return -errno;
     }
 
     if (!MASTER_PTY(stat.dev)) {
@@ -1,137 +1,290 @@
-/*
- * Copyright (c) 2021, Krisna Pranav
- *
- * SPDX-License-Identifier: BSD-2-Clause
- */
-#include <string.h>
-
-#ifdef __i386__
-void* memset(void* dest, int fill, size_t nbytes)
-{
-    for (int i = 0; i < nbytes; ++i)
-        ((uint8_t*)dest)[i] = fill;
-
-    return dest;
-}
-#endif //__i386__
-
-void* memmove(void* dest, const void* src, size_t nbytes)
-{
-    if (src > dest) {
-        memcpy(dest, src, nbytes);
-        return dest;
-    }
-
-    for (int i = nbytes - 1; i >= 0; --i)
-        ((uint8_t*)dest)[i] = ((uint8_t*)src)[i];
-
-    return dest;
-}
-
-/* This optimized version of memcpy uses 32 bit chunks to copy over data on
-   the 32 bit architecture this library is built for. If this function gets
-   used on a 64 bit arch, be sure to use 8 byte chunks so each chunk fits
-   in a single register. The important part is this should be compiled with
-   atleast -O1 or -Os, because -O0 just makes this function too big for what
-   it does.
-
-   GCC does a better job at optimizing this if the pointers are restricted,
-   making the copying part have less instructions. Clang on the other hand
-   does not really change anything if the pointers are restricted or not. */
-void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes)
-{
-    size_t chunks, rest, i;
-
-    rest = nbytes % 4;
-    chunks = (nbytes - rest) >> 2;
-
-    if (!chunks)
-        goto skip_chunks;
-
-    for (i = 0; i < chunks; i++)
-        ((uint32_t*)dest)[i] = ((uint32_t*)src)[i];
-
-skip_chunks:
-
-    /* Multiplying chunks by 4 will give us the offset of the 'rest' bytes,
-       which were not copied over along with the 4 byte chunks. */
-    chunks <<= 2;
-
-    for (i = 0; i < rest; i++)
-        ((uint8_t*)dest)[chunks + i] = ((uint8_t*)src)[chunks + i];
-
-    return dest;
-}
-
-void* memccpy(void* dest, const void* src, int stop, size_t nbytes)
-{
-    for (int i = 0; i < nbytes; i++) {
-        *((uint8_t*)dest + i) = *((uint8_t*)src + i);
-
-        if (*((uint8_t*)src + i) == stop)
-            return ((uint8_t*)dest + i + 1);
-    }
-    return NULL;
-}
-
-int memcmp(const void* src1, const void* src2, size_t nbytes)
-{
-    const uint8_t* first = src1;
-    const uint8_t* second = src2;
-
-    for (int i = 0; i < nbytes; i++) {
-        /* Return the difference if the byte does not match. */
-        if (first[i] != second[i])
-            return (int)first[i] - (int)second[i];
-    }
-
-    return 0;
-}
-
-int strcmp(const char* a, const char* b)
-{
-    while (*a == *b && *a != '\0' && *b != '\0') {
-        a++;
-        b++;
-    }
-
-    if (*a < *b) {
-        return -1;
-    }
-    if (*a > *b) {
-        return 1;
-    }
-    return 0;
-}
-
-size_t strlen(const char* str)
-{
-    size_t i = 0;
-    while (str[i])
-        ++i;
-    return i;
-}
-
-char* strcpy(char* dest, const char* src)
-{
-    size_t i;
-    for (i = 0; src[i] != 0; i++)
-        dest[i] = src[i];
-
-    dest[i] = '\0';
-    return dest;
-}
-
-char* strncpy(char* dest, const char* src, size_t nbytes)
-{
-    size_t i;
-
-    for (i = 0; i < nbytes && src[i] != 0; i++)
-        dest[i] = src[i];
-
-    /* Fill the rest with null bytes */
-    for (; i < nbytes; i++)
-        dest[i] = 0;
-
-    return dest;
-}
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+#include <string.h>
+
+/* Word-at-a-time routines read memory through this type, so the compiler
+   doesn't assume it can't alias the bytes of the buffers. */
+typedef uint32_t __attribute__((__may_alias__)) word_t;
+#define WORD_MASK (sizeof(word_t) - 1)
+#define WORD_ONES 0x01010101u
+#define WORD_HIGHS 0x80808080u
+#define WORD_HAS_ZERO(w) (((w)-WORD_ONES) & ~(w)&WORD_HIGHS)
+
+#ifdef __i386__
+/* Copies and fills use string instructions, which are fast on every x86
+   cpu once the destination is aligned. CPUs with SSE2 move big buffers with
+   128 bit registers instead, that is picked by _string_init(). SSE2 makes
+   the process use the FPU state, so it's not worth for short buffers. */
+#define STRING_SSE2_THRESHOLD 512
+
+static void* _memcpy_rep(void* __restrict dest, const void* __restrict src, size_t nbytes)
+{
+    void* ret = dest;
+    if (nbytes >= 16) {
+        size_t head = (-(size_t)dest) & WORD_MASK;
+        size_t words = (nbytes - head) >> 2;
+        nbytes = (nbytes - head) & WORD_MASK;
+        asm volatile("rep movsb"
+                     : "+D"(dest), "+S"(src), "+c"(head)
+                     :
+                     : "memory");
+        asm volatile("rep movsl"
+                     : "+D"(dest), "+S"(src), "+c"(words)
+                     :
+                     : "memory");
+    }
+    asm volatile("rep movsb"
+                 : "+D"(dest), "+S"(src), "+c"(nbytes)
+                 :
+                 : "memory");
+    return ret;
+}
+
+static void* _memset_rep(void* dest, int fill, size_t nbytes)
+{
+    void* ret = dest;
+    uint32_t pattern = (uint8_t)fill * WORD_ONES;
+    if (nbytes >= 16) {
+        size_t head = (-(size_t)dest) & WORD_MASK;
+        size_t words = (nbytes - head) >> 2;
+        nbytes = (nbytes - head) & WORD_MASK;
+        asm volatile("rep stosb"
+                     : "+D"(dest), "+c"(head)
+                     : "a"(pattern)
+                     : "memory");
+        asm volatile("rep stosl"
+                     : "+D"(dest), "+c"(words)
+                     : "a"(pattern)
+                     : "memory");
+    }
+    asm volatile("rep stosb"
+                 : "+D"(dest), "+c"(nbytes)
+                 : "a"(pattern)
+                 : "memory");
+    return ret;
+}
+
+__attribute__((target("sse2"))) static void* _memcpy_sse2(void* __restrict dest, const void* __restrict src, size_t nbytes)
+{
+    if (nbytes < STRING_SSE2_THRESHOLD) {
+        return _memcpy_rep(dest, src, nbytes);
+    }
+
+    uint8_t* d = dest;
+    const uint8_t* s = src;
+    size_t head = (-(size_t)d) & 15;
+    _memcpy_rep(d, s, head);
+    d += head, s += head, nbytes -= head;
+
+    // Stores are aligned, loads could be not.
+    for (size_t blocks = nbytes >> 6; blocks; blocks--, d += 64, s += 64) {
+        asm volatile("movdqu (%1), %%xmm0\n"
+                     "movdqu 16(%1), %%xmm1\n"
+                     "movdqu 32(%1), %%xmm2\n"
+                     "movdqu 48(%1), %%xmm3\n"
+                     "movdqa %%xmm0, (%0)\n"
+                     "movdqa %%xmm1, 16(%0)\n"
+                     "movdqa %%xmm2, 32(%0)\n"
+                     "movdqa %%xmm3, 48(%0)\n"
+                     :
+                     : "r"(d), "r"(s)
+                     : "memory", "xmm0", "xmm1", "xmm2", "xmm3");
+    }
+
+    _memcpy_rep(d, s, nbytes & 63);
+    return dest;
+}
+
+__attribute__((target("sse2"))) static void* _memset_sse2(void* dest, int fill, size_t nbytes)
+{
+    if (nbytes < STRING_SSE2_THRESHOLD) {
+        return _memset_rep(dest, fill, nbytes);
+    }
+
+    uint8_t* d = dest;
+    size_t head = (-(size_t)d) & 15;
+    _memset_rep(d, fill, head);
+    d += head, nbytes -= head;
+
+    uint32_t pattern = (uint8_t)fill * WORD_ONES;
+    typedef uint32_t vec_t __attribute__((vector_size(16)));
+    vec_t vec = { pattern, pattern, pattern, pattern };
+    for (size_t blocks = nbytes >> 6; blocks; blocks--, d += 64) {
+        asm volatile("movdqa %1, (%0)\n"
+                     "movdqa %1, 16(%0)\n"
+                     "movdqa %1, 32(%0)\n"
+                     "movdqa %1, 48(%0)\n"
+                     :
+                     : "r"(d), "x"(vec)
+                     : "memory");
+    }
+
+    _memset_rep(d, fill, nbytes & 63);
+    return dest;
+}
+
+static void* (*_memcpy_impl)(void* __restrict, const void* __restrict, size_t) = _memcpy_rep;
+static void* (*_memset_impl)(void*, int, size_t) = _memset_rep;
+
+static inline int _string_has_sse2()
+{
+    uint32_t eax, ebx, ecx, edx;
+    asm volatile("cpuid"
+                 : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+                 : "a"(1), "c"(0));
+    return (edx >> 26) & 1;
+}
+
+void _string_init()
+{
+    if (_string_has_sse2()) {
+        _memcpy_impl = _memcpy_sse2;
+        _memset_impl = _memset_sse2;
+    }
+}
+
+void* memset(void* dest, int fill, size_t nbytes)
+{
+    return _memset_impl(dest, fill, nbytes);
+}
+
+void* memcpy(void* __restrict dest, const void* __restrict src, size_t nbytes)
+{
+    return _memcpy_impl(dest, src, nbytes);
+}
+#else
+/* aarch32 has memset and memcpy in string/routines/aarch32. */
+void _string_init()
+{
+}
+#endif //__i386__
+
+/* Copying forward is safe when the destination is lower, every routine
+   above reads a block before it writes it. */
+void* memmove(void* dest, const void* src, size_t nbytes)
+{
+    if (dest <= src || (uint8_t*)dest >= (uint8_t*)src + nbytes) {
+        memcpy(dest, src, nbytes);
+        return dest;
+    }
+
+    uint8_t* d = (uint8_t*)dest + nbytes;
+    const uint8_t* s = (const uint8_t*)src + nbytes;
+    if ((((size_t)d ^ (size_t)s) & WORD_MASK) == 0) {
+        while (nbytes && ((size_t)d & WORD_MASK)) {
+            *--d = *--s;
+            nbytes--;
+        }
+        for (; nbytes >= sizeof(word_t); nbytes -= sizeof(word_t)) {
+            d -= sizeof(word_t), s -= sizeof(word_t);
+            *(word_t*)d = *(const word_t*)s;
+        }
+    }
+
+    while (nbytes--) {
+        *--d = *--s;
+    }
+    return dest;
+}
+
+void* memccpy(void* dest, const void* src, int stop, size_t nbytes)
+{
+    for (int i = 0; i < nbytes; i++) {
+        *((uint8_t*)dest + i) = *((uint8_t*)src + i);
+
+        if (*((uint8_t*)src + i) == stop)
+            return ((uint8_t*)dest + i + 1);
+    }
+    return NULL;
+}
+
+int memcmp(const void* src1, const void* src2, size_t nbytes)
+{
+    const uint8_t* first = src1;
+    const uint8_t* second = src2;
+
+    /* Skip equal words, the bytes of the first different one are compared
+       below. */
+    if ((((size_t)first ^ (size_t)second) & WORD_MASK) == 0) {
+        while (nbytes && ((size_t)first & WORD_MASK)) {
+            if (*first != *second)
+                return (int)*first - (int)*second;
+            first++, second++, nbytes--;
+        }
+        while (nbytes >= sizeof(word_t) && *(const word_t*)first == *(const word_t*)second) {
+            first += sizeof(word_t), second += sizeof(word_t), nbytes -= sizeof(word_t);
+        }
+    }
+
+    for (size_t i = 0; i < nbytes; i++) {
+        /* Return the difference if the byte does not match. */
+        if (first[i] != second[i])
+            return (int)first[i] - (int)second[i];
+    }
+
+    return 0;
+}
+
+int strcmp(const char* a, const char* b)
+{
+    while (*a == *b && *a != '\0' && *b != '\0') {
+        a++;
+        b++;
+    }
+
+    if (*a < *b) {
+        return -1;
+    }
+    if (*a > *b) {
+        return 1;
+    }
+    return 0;
+}
+
+/* Aligned words never cross a page, so reading the whole word with the
+   terminator is safe. */
+size_t strlen(const char* str)
+{
+    const char* ptr = str;
+    while ((size_t)ptr & WORD_MASK) {
+        if (!*ptr)
+            return ptr - str;
+        ptr++;
+    }
+
+    const word_t* word = (const word_t*)ptr;
+    while (!WORD_HAS_ZERO(*word))
+        word++;
+
+    ptr = (const char*)word;
+    while (*ptr)
+        ptr++;
+    return ptr - str;
+}
+
+char* strcpy(char* dest, const char* src)
+{
+    size_t i;
+    for (i = 0; src[i] != 0; i++)
+        dest[i] = src[i];
+
+    dest[i] = '\0';
+    return dest;
+}
+
+char* strncpy(char* dest, const char* src, size_t nbytes)
+{
+    size_t i;
+
+    for (i = 0; i < nbytes && src[i] != 0; i++)
+        dest[i] = src[i];
+
+    /* Fill the rest with null bytes */
+    for (; i < nbytes; i++)
+        dest[i] = 0;
+
+    return dest;
+}
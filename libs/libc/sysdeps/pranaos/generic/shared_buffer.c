@@ -18,3 +18,16 @@ int shared_buffer_free(int id)
     int res = DO_SYSCALL_1(SYS_SHBUF_FREE, id);
     RETURN_WITH_ERRNO(res, res, res);
 }
+
+
+int shared_buffer_publish(int id, uint32_t key)
+{
+    int res = DO_SYSCALL_2(SYS_SHBUF_PUBLISH, id, key);
+    RETURN_WITH_ERRNO(res, res, res);
+}
+
+int shared_buffer_find(uint32_t key)
+{
+    int res = DO_SYSCALL_1(SYS_SHBUF_FIND, key);
+    RETURN_WITH_ERRNO(res, res, res);
+}
\ No newline at end of file
@@ -120,6 +120,22 @@ int clock_gettime(clockid_t clk_id, timespec_t* tp)
     RETURN_WITH_ERRNO(res, res, -1);
 }
 
+int nanosleep(const timespec_t* req, timespec_t* rem)
+{
+    int res = DO_SYSCALL_2(SYS_NANOSLEEP, req, rem);
+    RETURN_WITH_ERRNO(res, 0, -1);
+}
+
+int clock_nanosleep(clockid_t clk_id, int flags, const timespec_t* req, timespec_t* rem)
+{
+    // clock_nanosleep returns an error number instead of setting errno.
+    int res = DO_SYSCALL_4(SYS_CLOCK_NANOSLEEP, clk_id, flags, req, rem);
+    if (res < 0) {
+        return -res;
+    }
+    return 0;
+}
+
 // TODO: Implement
 int clock_getres(clockid_t clk_id, timespec_t* res) { return -1; }
 int clock_settime(clockid_t clk_id, const timespec_t* tp) { return -1; }
@@ -10,6 +10,7 @@
 #include <libfoundation/EventReceiver.h>
 #include <libfoundation/Receivers.h>
 #include <memory>
+#include <sys/time.h>
 #include <vector>
 
 namespace LFoundation {
@@ -52,19 +53,18 @@ public:
 
     EventLoop();
 
-    inline void add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write)
-    {
-        m_waiting_fds.push_back(FDWaiter(fd, on_read, on_write));
-    }
+    void add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write);
+    void update(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write);
+    void remove(int fd);
 
     inline void add(const Timer& timer)
     {
-        m_timers.push_back(timer);
+        add_timer(std::make_unique<Timer>(timer));
     }
 
     inline void add(Timer&& timer)
     {
-        m_timers.push_back(std::move(timer));
+        add_timer(std::make_unique<Timer>(std::move(timer)));
     }
 
     inline void add(EventReceiver& rec, Event* ptr)
@@ -79,10 +79,22 @@ public:
     int run();
 
 private:
+    void add_timer(std::unique_ptr<Timer> timer);
+    int find_waiter(int fd) const;
+    timeval_t* wait_timeout(timeval_t& timeout);
+
     bool m_stop_flag { false };
     int m_exit_code { 0 };
-    std::vector<FDWaiter> m_waiting_fds;
-    std::vector<Timer> m_timers;
+    int m_epoll_fd { -1 };
+    // Fds are registered in the epoll instance with their index in the vector.
+    std::vector<std::unique_ptr<FDWaiter>> m_waiting_fds;
+    std::vector<int> m_free_fd_slots;
+    // Removed waiters are kept alive until their queued events are dispatched.
+    std::vector<std::unique_ptr<FDWaiter>> m_removed_fds;
+    // Min-heap of timers ordered by their expire time.
+    std::vector<std::unique_ptr<Timer>> m_timers;
+    // One-shot timers which are kept alive until their events are dispatched.
+    std::vector<std::unique_ptr<Timer>> m_fired_timers;
     std::vector<QueuedEvent> m_event_queue;
 };
 } // namespace LFoundation
\ No newline at end of file
@@ -70,9 +70,11 @@ public:
 
     void receive_event(std::unique_ptr<Event> event) override
     {
-        if (event->type() == Event::Type::FdWaiterRead) {
+        // Callbacks are cleared when the fd is removed from the loop,
+        // while its events could still be queued.
+        if (event->type() == Event::Type::FdWaiterRead && m_on_read) {
             m_on_read();
-        } else if (event->type() == Event::Type::FdWaiterWrite) {
+        } else if (event->type() == Event::Type::FdWaiterWrite && m_on_write) {
             m_on_write();
         }
     }
@@ -142,6 +144,12 @@ public:
     }
 
     inline bool repeated() const { return m_repeat; }
+    inline const std::timespec& expire_time() const { return m_expire_time; }
+    inline bool expires_after(const Timer& other) const
+    {
+        return m_expire_time.tv_sec > other.m_expire_time.tv_sec || (m_expire_time.tv_sec == other.m_expire_time.tv_sec && m_expire_time.tv_nsec > other.m_expire_time.tv_nsec);
+    }
+
     inline bool expired(const std::timespec& now) const
     {
         return now.tv_sec > m_expire_time.tv_sec || (now.tv_sec == m_expire_time.tv_sec && now.tv_nsec >= m_expire_time.tv_nsec);
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace LFoundation {
+
+// Decompresses deflate streams into a buffer which holds the whole output,
+// so back references are plain copies inside it. The input is pulled piece
+// by piece from a provider, so a stream split between several buffers (like
+// PNG IDAT chunks) is never joined.
+//
+// Huffman codes are decoded with a lookup table indexed by the next FastBits
+// bits of input; the few longer codes are decoded bit by bit.
+class Inflater {
+public:
+    // Sets data and size to the next piece of input, false when there is none.
+    using InputProvider = std::function<bool(const uint8_t*& data, size_t& size)>;
+
+    explicit Inflater(InputProvider provider)
+        : m_provider(provider)
+    {
+    }
+
+    // Both return the number of bytes written to out, -1 if the stream is
+    // broken or does not fit into out_size bytes.
+    int inflate(uint8_t* out, size_t out_size);
+    int inflate_zlib(uint8_t* out, size_t out_size);
+
+private:
+    static constexpr int MaxBits = 15;
+    static constexpr int FastBits = 10;
+    static constexpr int MaxLitLenCodes = 288;
+    static constexpr int MaxDistCodes = 30;
+
+    struct Huffman {
+        // symbol << 4 | length for codes of up to FastBits bits, 0 otherwise.
+        uint16_t fast[1 << FastBits];
+        uint16_t count[MaxBits + 1];
+        uint16_t symbol[MaxLitLenCodes];
+    };
+
+    static bool build(Huffman& huff, const uint8_t* lengths, int n);
+
+    bool next_input();
+
+    inline uint8_t next_byte()
+    {
+        if (m_in == m_in_end && !next_input()) {
+            // Reading past the end gives zeros, which is caught once the
+            // bits are really used.
+            m_overrun++;
+            return 0;
+        }
+        return *m_in++;
+    }
+
+    inline void refill()
+    {
+        if (m_bitcnt > 24) {
+            return;
+        }
+
+        // Takes as many whole bytes as fit at once. Bits above m_bitcnt
+        // must stay clear, so the rest of the word is dropped.
+        if (m_in_end - m_in >= 4) {
+            uint32_t word = m_in[0] | (m_in[1] << 8) | (m_in[2] << 16) | ((uint32_t)m_in[3] << 24);
+            int bytes = (32 - m_bitcnt) >> 3;
+            if (bytes < 4) {
+                word &= (1u << (bytes * 8)) - 1;
+            }
+            m_bitbuf |= word << m_bitcnt;
+            m_bitcnt += bytes * 8;
+            m_in += bytes;
+            return;
+        }
+
+        while (m_bitcnt <= 24) {
+            m_bitbuf |= (uint32_t)next_byte() << m_bitcnt;
+            m_bitcnt += 8;
+        }
+    }
+
+    inline uint32_t bits(int cnt)
+    {
+        refill();
+        uint32_t val = m_bitbuf & ((1u << cnt) - 1);
+        m_bitbuf >>= cnt;
+        m_bitcnt -= cnt;
+        return val;
+    }
+
+    inline int decode(const Huffman& huff)
+    {
+        refill();
+        uint16_t entry = huff.fast[m_bitbuf & ((1 << FastBits) - 1)];
+        if (entry) {
+            m_bitbuf >>= entry & 15;
+            m_bitcnt -= entry & 15;
+            return entry >> 4;
+        }
+        return decode_slow(huff);
+    }
+
+    int decode_slow(const Huffman& huff);
+    bool broken() const { return m_overrun * 8 > m_bitcnt; }
+
+    bool stored(uint8_t* out, size_t out_size);
+    bool codes(uint8_t* out, size_t out_size, const Huffman& lencode, const Huffman& distcode);
+    bool fixed(uint8_t* out, size_t out_size);
+    bool dynamic(uint8_t* out, size_t out_size);
+
+    InputProvider m_provider;
+    const uint8_t* m_in { nullptr };
+    const uint8_t* m_in_end { nullptr };
+    uint32_t m_bitbuf { 0 };
+    int m_bitcnt { 0 };
+    // Zero bytes given out after the input was over.
+    int m_overrun { 0 };
+    size_t m_out_pos { 0 };
+};
+
+} // namespace LFoundation
\ No newline at end of file
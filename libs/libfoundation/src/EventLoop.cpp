@@ -4,14 +4,14 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#include <algorithm>
 #include <cstring>
 #include <ctime>
 #include <iostream>
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/Logger.h>
 #include <memory>
-#include <sched.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -19,50 +19,171 @@ namespace LFoundation {
 
 EventLoop* s_LFoundation_EventLoop_the = nullptr;
 
+static constexpr int EventsPerWait = 16;
+
 EventLoop::EventLoop()
 {
     s_LFoundation_EventLoop_the = this;
+    m_epoll_fd = epoll_create(1);
+    if (m_epoll_fd < 0) {
+        Logger::debug << "EventLoop: can't create epoll instance" << std::endl;
+    }
 }
 
-void EventLoop::check_fds()
+static inline epoll_event_t waiter_epoll_event(int slot, std::function<void(void)>& on_read, std::function<void(void)>& on_write)
 {
-    if (m_waiting_fds.size() == 0) {
-        return;
+    epoll_event_t event;
+    event.events = 0;
+    if (on_read) {
+        event.events |= EPOLLIN;
+    }
+    if (on_write) {
+        event.events |= EPOLLOUT;
+    }
+    event.data.u32 = slot;
+    return event;
+}
+
+void EventLoop::add(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write)
+{
+    int slot = m_waiting_fds.size();
+    if (!m_free_fd_slots.empty()) {
+        slot = m_free_fd_slots.back();
+        m_free_fd_slots.pop_back();
+        m_waiting_fds[slot] = std::make_unique<FDWaiter>(fd, on_read, on_write);
+    } else {
+        m_waiting_fds.push_back(std::make_unique<FDWaiter>(fd, on_read, on_write));
     }
-    fd_set_t readfds;
-    fd_set_t writefds;
-    FD_ZERO(&readfds);
-    FD_ZERO(&writefds);
-    int nfds = -1;
+
+    epoll_event_t event = waiter_epoll_event(slot, on_read, on_write);
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        Logger::debug << "EventLoop: can't watch fd " << fd << std::endl;
+        m_waiting_fds[slot] = nullptr;
+        m_free_fd_slots.push_back(slot);
+    }
+}
+
+int EventLoop::find_waiter(int fd) const
+{
     for (int i = 0; i < m_waiting_fds.size(); i++) {
-        if (m_waiting_fds[i].m_on_read) {
-            FD_SET(m_waiting_fds[i].m_fd, &readfds);
-        }
-        if (m_waiting_fds[i].m_on_write) {
-            FD_SET(m_waiting_fds[i].m_fd, &writefds);
-        }
-        if (nfds < m_waiting_fds[i].m_fd) {
-            nfds = m_waiting_fds[i].m_fd;
+        if (m_waiting_fds[i] && m_waiting_fds[i]->fd() == fd) {
+            return i;
         }
     }
+    return -1;
+}
 
-    // For now, that means, that we don't wait for fds.
-    timeval_t timeout;
+// Changes the callbacks of a registered fd, e.g. to wait for it to become
+// writable only while there is data to send.
+void EventLoop::update(int fd, std::function<void(void)> on_read, std::function<void(void)> on_write)
+{
+    int slot = find_waiter(fd);
+    if (slot < 0) {
+        return;
+    }
+
+    m_waiting_fds[slot]->m_on_read = on_read;
+    m_waiting_fds[slot]->m_on_write = on_write;
+    epoll_event_t event = waiter_epoll_event(slot, on_read, on_write);
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        Logger::debug << "EventLoop: can't update fd " << fd << std::endl;
+    }
+}
+
+// Must be called before the fd is closed.
+void EventLoop::remove(int fd)
+{
+    int slot = find_waiter(fd);
+    if (slot < 0) {
+        return;
+    }
+
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    m_waiting_fds[slot]->m_on_read = nullptr;
+    m_waiting_fds[slot]->m_on_write = nullptr;
+    m_removed_fds.push_back(std::move(m_waiting_fds[slot]));
+    m_free_fd_slots.push_back(slot);
+}
+
+static inline bool timer_expires_later(const std::unique_ptr<Timer>& a, const std::unique_ptr<Timer>& b)
+{
+    return a->expires_after(*b);
+}
+
+void EventLoop::add_timer(std::unique_ptr<Timer> timer)
+{
+    m_timers.push_back(std::move(timer));
+    std::push_heap(m_timers.begin(), m_timers.end(), timer_expires_later);
+}
+
+// Returns how long the loop may sleep: not at all if there are queued events,
+// until the nearest timer if there are timers, and forever otherwise (nullptr).
+timeval_t* EventLoop::wait_timeout(timeval_t& timeout)
+{
     timeout.tv_sec = 0;
     timeout.tv_usec = 0;
 
-    int res = select(nfds + 1, &readfds, &writefds, nullptr, &timeout);
+    if (!m_event_queue.empty()) {
+        return &timeout;
+    }
 
-    for (int i = 0; i < m_waiting_fds.size(); i++) {
-        if (m_waiting_fds[i].m_on_read) {
-            if (FD_ISSET(m_waiting_fds[i].m_fd, &readfds)) {
-                m_event_queue.push_back(QueuedEvent(m_waiting_fds[i], new FDWaiterReadEvent()));
-            }
+    if (m_timers.empty()) {
+        return nullptr;
+    }
+
+    std::timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const std::timespec& expire = m_timers.front()->expire_time();
+    if (m_timers.front()->expired(now)) {
+        return &timeout;
+    }
+
+    std::time_t secs = expire.tv_sec - now.tv_sec;
+    std::time_t nsecs;
+    if (expire.tv_nsec >= now.tv_nsec) {
+        nsecs = expire.tv_nsec - now.tv_nsec;
+    } else {
+        secs--;
+        nsecs = expire.tv_nsec + 1000000000 - now.tv_nsec;
+    }
+
+    // Round up, waking up before the deadline would only make us spin.
+    timeout.tv_sec = secs;
+    timeout.tv_usec = (nsecs + 999) / 1000;
+    if (timeout.tv_usec >= 1000000) {
+        timeout.tv_sec++;
+        timeout.tv_usec -= 1000000;
+    }
+    return &timeout;
+}
+
+static inline int timeout_in_ms(const timeval_t* timeout)
+{
+    if (!timeout) {
+        return -1;
+    }
+    return timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+}
+
+void EventLoop::check_fds()
+{
+    // Sleeps in the kernel until one of fds is ready or the nearest timer expires.
+    // Only fds which are ready are returned, so the cost does not depend on the
+    // number of watched fds.
+    timeval_t timeout;
+    epoll_event_t events[EventsPerWait];
+    int res = epoll_wait(m_epoll_fd, events, EventsPerWait, timeout_in_ms(wait_timeout(timeout)));
+    if (res < 0) {
+        return;
+    }
+
+    for (int i = 0; i < res; i++) {
+        FDWaiter& waiter = *m_waiting_fds[events[i].data.u32];
+        if ((events[i].events & EPOLLIN) && waiter.m_on_read) {
+            m_event_queue.push_back(QueuedEvent(waiter, new FDWaiterReadEvent()));
         }
-        if (m_waiting_fds[i].m_on_write) {
-            if (FD_ISSET(m_waiting_fds[i].m_fd, &writefds)) {
-                m_event_queue.push_back(QueuedEvent(m_waiting_fds[i], new FDWaiterWriteEvent()));
-            }
+        if ((events[i].events & EPOLLOUT) && waiter.m_on_write) {
+            m_event_queue.push_back(QueuedEvent(waiter, new FDWaiterWriteEvent()));
         }
     }
 }
@@ -76,16 +197,26 @@ void EventLoop::check_timers()
     std::timespec tp;
     clock_gettime(CLOCK_MONOTONIC, &tp);
 
-    for (auto& timer : m_timers) {
-        if (!timer.expired(tp)) {
-            continue;
+    // Repeated timers are put back after the loop, so a timer with
+    // a zero interval fires once per pump.
+    std::vector<std::unique_ptr<Timer>> reloaded_timers;
+    while (!m_timers.empty() && m_timers.front()->expired(tp)) {
+        std::pop_heap(m_timers.begin(), m_timers.end(), timer_expires_later);
+        std::unique_ptr<Timer> timer = std::move(m_timers.back());
+        m_timers.pop_back();
+
+        m_event_queue.push_back(QueuedEvent(*timer, new TimerEvent()));
+
+        if (timer->repeated()) {
+            timer->reload(tp);
+            reloaded_timers.push_back(std::move(timer));
+        } else {
+            m_fired_timers.push_back(std::move(timer));
         }
+    }
 
-        m_event_queue.push_back(QueuedEvent(timer, new TimerEvent()));
-
-        if (timer.repeated()) {
-            timer.reload(tp);
-        }
+    for (int i = 0; i < reloaded_timers.size(); i++) {
+        add_timer(std::move(reloaded_timers[i]));
     }
 }
 
@@ -98,10 +229,8 @@ void EventLoop::check_timers()
     for (auto& event : events_to_dispatch) {
         event.receiver.receive_event(std::move(event.event));
     }
-
-    if (!events_to_dispatch.size()) {
-        sched_yield();
-    }
+    m_fired_timers.clear();
+    m_removed_fds.clear();
 }
 
 int EventLoop::run()
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cstring>
+#include <libfoundation/compress/Inflate.h>
+
+namespace LFoundation {
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const uint8_t dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+bool Inflater::next_input()
+{
+    const uint8_t* data;
+    size_t size;
+    do {
+        if (!m_provider(data, size)) {
+            return false;
+        }
+    } while (!size);
+
+    m_in = data;
+    m_in_end = data + size;
+    return true;
+}
+
+// Builds canonical codes from code lengths. Incomplete codes are allowed,
+// since deflate uses them for a single distance code.
+bool Inflater::build(Huffman& huff, const uint8_t* lengths, int n)
+{
+    memset(huff.count, 0, sizeof(huff.count));
+    memset(huff.fast, 0, sizeof(huff.fast));
+    for (int sym = 0; sym < n; sym++) {
+        huff.count[lengths[sym]]++;
+    }
+    huff.count[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= MaxBits; len++) {
+        left <<= 1;
+        left -= huff.count[len];
+        if (left < 0) {
+            return false;
+        }
+    }
+
+    uint16_t offs[MaxBits + 1];
+    uint16_t next_code[MaxBits + 1];
+    offs[1] = 0;
+    next_code[1] = 0;
+    for (int len = 1; len < MaxBits; len++) {
+        offs[len + 1] = offs[len] + huff.count[len];
+        next_code[len + 1] = (next_code[len] + huff.count[len]) << 1;
+    }
+
+    for (int sym = 0; sym < n; sym++) {
+        int len = lengths[sym];
+        if (!len) {
+            continue;
+        }
+
+        huff.symbol[offs[len]++] = sym;
+        uint32_t code = next_code[len]++;
+        if (len > FastBits) {
+            continue;
+        }
+
+        // The stream keeps codes starting from their top bit, so the
+        // table is indexed by reversed codes.
+        uint32_t rev = 0;
+        for (int i = 0; i < len; i++) {
+            rev = (rev << 1) | ((code >> i) & 1);
+        }
+        for (uint32_t i = rev; i < (1 << FastBits); i += (1 << len)) {
+            huff.fast[i] = (sym << 4) | len;
+        }
+    }
+    return true;
+}
+
+int Inflater::decode_slow(const Huffman& huff)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len <= MaxBits; len++) {
+        code |= (m_bitbuf >> (len - 1)) & 1;
+        int count = huff.count[len];
+        if (code - count < first) {
+            m_bitbuf >>= len;
+            m_bitcnt -= len;
+            return huff.symbol[index + (code - first)];
+        }
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+bool Inflater::stored(uint8_t* out, size_t out_size)
+{
+    m_bitbuf >>= m_bitcnt & 7;
+    m_bitcnt -= m_bitcnt & 7;
+
+    uint32_t len = bits(16);
+    uint32_t nlen = bits(16);
+    if (len != (~nlen & 0xffff) || broken() || len > out_size - m_out_pos) {
+        return false;
+    }
+
+    // Whole bytes which are already in the bit buffer go first.
+    for (; len && m_bitcnt >= 8; len--) {
+        out[m_out_pos++] = m_bitbuf & 0xff;
+        m_bitbuf >>= 8;
+        m_bitcnt -= 8;
+    }
+
+    while (len) {
+        if (m_in == m_in_end && !next_input()) {
+            return false;
+        }
+        size_t chunk = m_in_end - m_in;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(&out[m_out_pos], m_in, chunk);
+        m_out_pos += chunk;
+        m_in += chunk;
+        len -= chunk;
+    }
+    return true;
+}
+
+bool Inflater::codes(uint8_t* out, size_t out_size, const Huffman& lencode, const Huffman& distcode)
+{
+    for (;;) {
+        int sym = decode(lencode);
+        if (sym < 0) {
+            return false;
+        }
+
+        if (sym < 256) {
+            if (m_out_pos == out_size) {
+                return false;
+            }
+            out[m_out_pos++] = sym;
+            continue;
+        }
+
+        if (sym == 256) {
+            return !broken();
+        }
+
+        sym -= 257;
+        if (sym >= 29) {
+            return false;
+        }
+        size_t len = length_base[sym] + bits(length_extra[sym]);
+
+        int dist_sym = decode(distcode);
+        if (dist_sym < 0 || dist_sym >= MaxDistCodes) {
+            return false;
+        }
+        size_t dist = dist_base[dist_sym] + bits(dist_extra[dist_sym]);
+        if (dist > m_out_pos || len > out_size - m_out_pos || broken()) {
+            return false;
+        }
+
+        uint8_t* to = &out[m_out_pos];
+        const uint8_t* from = to - dist;
+        m_out_pos += len;
+        if (dist >= len) {
+            memcpy(to, from, len);
+        } else {
+            // Overlapping copies repeat the last dist bytes.
+            while (len--) {
+                *to++ = *from++;
+            }
+        }
+    }
+}
+
+bool Inflater::fixed(uint8_t* out, size_t out_size)
+{
+    static Huffman lencode, distcode;
+    static bool built = false;
+
+    if (!built) {
+        uint8_t lengths[MaxLitLenCodes];
+        int sym = 0;
+        for (; sym < 144; sym++) {
+            lengths[sym] = 8;
+        }
+        for (; sym < 256; sym++) {
+            lengths[sym] = 9;
+        }
+        for (; sym < 280; sym++) {
+            lengths[sym] = 7;
+        }
+        for (; sym < MaxLitLenCodes; sym++) {
+            lengths[sym] = 8;
+        }
+        build(lencode, lengths, MaxLitLenCodes);
+
+        for (sym = 0; sym < MaxDistCodes; sym++) {
+            lengths[sym] = 5;
+        }
+        build(distcode, lengths, MaxDistCodes);
+        built = true;
+    }
+
+    return codes(out, out_size, lencode, distcode);
+}
+
+bool Inflater::dynamic(uint8_t* out, size_t out_size)
+{
+    static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    uint8_t lengths[MaxLitLenCodes + MaxDistCodes];
+    Huffman lencode, distcode;
+
+    int nlen = bits(5) + 257;
+    int ndist = bits(5) + 1;
+    int ncode = bits(4) + 4;
+    if (nlen > MaxLitLenCodes || ndist > MaxDistCodes) {
+        return false;
+    }
+
+    int index = 0;
+    for (; index < ncode; index++) {
+        lengths[order[index]] = bits(3);
+    }
+    for (; index < 19; index++) {
+        lengths[order[index]] = 0;
+    }
+    if (!build(lencode, lengths, 19)) {
+        return false;
+    }
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int sym = decode(lencode);
+        if (sym < 0) {
+            return false;
+        }
+        if (sym < 16) {
+            lengths[index++] = sym;
+            continue;
+        }
+
+        int len = 0;
+        int repeat;
+        if (sym == 16) {
+            if (!index) {
+                return false;
+            }
+            len = lengths[index - 1];
+            repeat = 3 + bits(2);
+        } else if (sym == 17) {
+            repeat = 3 + bits(3);
+        } else {
+            repeat = 11 + bits(7);
+        }
+
+        if (index + repeat > nlen + ndist) {
+            return false;
+        }
+        while (repeat--) {
+            lengths[index++] = len;
+        }
+    }
+
+    // A block without an end code could never finish.
+    if (!lengths[256] || broken()) {
+        return false;
+    }
+    if (!build(lencode, lengths, nlen) || !build(distcode, lengths + nlen, ndist)) {
+        return false;
+    }
+    return codes(out, out_size, lencode, distcode);
+}
+
+int Inflater::inflate(uint8_t* out, size_t out_size)
+{
+    m_out_pos = 0;
+    bool last;
+    do {
+        last = bits(1);
+        bool ok = false;
+        switch (bits(2)) {
+        case 0:
+            ok = stored(out, out_size);
+            break;
+        case 1:
+            ok = fixed(out, out_size);
+            break;
+        case 2:
+            ok = dynamic(out, out_size);
+            break;
+        default:
+            break;
+        }
+
+        if (!ok || broken()) {
+            return -1;
+        }
+    } while (!last);
+
+    return m_out_pos;
+}
+
+int Inflater::inflate_zlib(uint8_t* out, size_t out_size)
+{
+    uint32_t cmf = bits(8);
+    uint32_t flg = bits(8);
+    // Only deflate without a preset dictionary is used in practice.
+    if ((cmf & 0x0f) != 8 || (cmf * 256 + flg) % 31 || (flg & 0x20) || broken()) {
+        return -1;
+    }
+    return inflate(out, out_size);
+}
+
+} // namespace LFoundation
\ No newline at end of file
@@ -72,6 +72,13 @@ public:
     inline uint8_t blue() const { return m_b; }
     inline void set_alpha(uint8_t alpha) { m_opacity = 255 - alpha; }
 
+    // Rounded x / 255 for x in 0..255*255, without a division.
+    static inline uint8_t div255(int x)
+    {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
     inline uint32_t u32() const
     {
         uint32_t clr = (m_opacity << 24)
@@ -92,6 +99,16 @@ public:
             return;
         }
 
+        // Over an opaque color the result stays opaque, which needs no division.
+        if (alpha() == 255) {
+            int alpha_of_it = clr.alpha();
+            int alpha_of_me = 255 - alpha_of_it;
+            m_r = div255(red() * alpha_of_me + clr.red() * alpha_of_it);
+            m_g = div255(green() * alpha_of_me + clr.green() * alpha_of_it);
+            m_b = div255(blue() * alpha_of_me + clr.blue() * alpha_of_it);
+            return;
+        }
+
         int alpha_c = 255 * (alpha() + clr.alpha()) - alpha() * clr.alpha();
         int alpha_of_me = alpha() * (255 - clr.alpha());
         int alpha_of_it = 255 * clr.alpha();
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <libg/Color.h>
+#include <libg/PixelBitmap.h>
+#include <sys/types.h>
+
+namespace LG {
+
+// Decoded images shared between processes. An entry is a shared buffer
+// published under a key made of the path and the mtime of the image file.
+// The buffer starts with a header naming the file, which is checked on
+// lookup, since keys of different files could collide.
+//
+// The kernel keeps an entry while some process which created or found it is
+// alive, and unpublishes the least recently used ones when there are too
+// many. Only big images get an entry. Their pixels are shared by everyone
+// who loads the file, so they are read-only once published.
+class BitmapCache {
+public:
+    static constexpr size_t MinCachedSize = 64 * 1024;
+
+    BitmapCache(const char* path, uint32_t mtime);
+    ~BitmapCache() = default;
+
+    // Points bitmap to the cached pixels of the file, if there are any.
+    bool find(PixelBitmap& bitmap) const;
+
+    // Gives memory for the pixels of a new entry, nullptr if the image
+    // is not worth caching.
+    Color* allocate(size_t width, size_t height);
+
+    // Makes the entry visible to others once the pixels are ready. If
+    // another process was first, its pixels are used by bitmap instead.
+    void publish(PixelBitmap& bitmap);
+
+    // Drops the entry, if the image could not be decoded.
+    void discard();
+
+private:
+    static constexpr uint32_t Magic = 0x42434731;
+    static constexpr size_t MaxPath = 108;
+
+    // Takes 128 bytes, the pixels follow it.
+    struct Header {
+        uint32_t magic;
+        uint32_t mtime;
+        uint32_t width;
+        uint32_t height;
+        uint32_t format;
+        char path[MaxPath];
+    };
+
+    bool open(int id, PixelBitmap& bitmap) const;
+
+    const char* m_path;
+    uint32_t m_mtime;
+    uint32_t m_key;
+    int m_id { -1 };
+    Header* m_header { nullptr };
+};
+
+} // namespace LG
\ No newline at end of file
@@ -8,9 +8,11 @@
 
 #include <libfoundation/ByteOrder.h>
 #include <libg/Color.h>
+#include <libg/ImageLoaders/BitmapCache.h>
 #include <libg/PixelBitmap.h>
 #include <libg/Rect.h>
 #include <string>
+#include <vector>
 
 namespace LG {
 namespace PNG {
@@ -73,54 +75,9 @@ namespace PNG {
         uint8_t* m_ptr { nullptr };
     };
 
-    class Scanline {
-    public:
-        Scanline() = default;
-        Scanline(int type, void* ptr)
-            : m_filter_type(type)
-            , m_ptr(ptr)
-        {
-        }
-        ~Scanline() = default;
-
-        void set(int type, void* ptr) { m_ptr = ptr; }
-        int filter_type() const { return m_filter_type; }
-        uint8_t* data() const { return (uint8_t*)m_ptr; }
-
-    private:
-        int m_filter_type { 0 };
-        void* m_ptr { nullptr };
-        size_t m_len { 0 };
-    };
-
-    class ScanlineKeeper {
-    public:
-        ScanlineKeeper() = default;
-        ~ScanlineKeeper() { invalidate(); }
-
-        inline void init(void* ptr) { m_ptr = ptr; }
-        inline void init(void* ptr, uint8_t color_length) { m_ptr = ptr, m_color_length = color_length; }
-
-        void invalidate()
-        {
-            if (m_ptr) {
-                free(m_ptr);
-                m_data.clear();
-                m_ptr = nullptr;
-            }
-        }
-
-        inline void add(Scanline&& el) { m_data.push_back(std::move(el)); }
-        inline void set_color_length(uint8_t color_length) { m_color_length = color_length; }
-        inline uint8_t color_length() const { return m_color_length; }
-
-        inline std::vector<Scanline>& scanlines() { return m_data; }
-        inline const std::vector<Scanline>& scanlines() const { return m_data; }
-
-    private:
-        uint8_t m_color_length { 0 };
-        void* m_ptr { nullptr };
-        std::vector<Scanline> m_data;
+    struct DataChunk {
+        const uint8_t* data;
+        size_t len;
     };
 
     class PNGLoader {
@@ -128,6 +85,8 @@ namespace PNG {
         PNGLoader() = default;
         ~PNGLoader() = default;
 
+        // Big images are shared through BitmapCache, so the pixels of
+        // a loaded file could be used by other processes too.
         PixelBitmap load_from_file(const std::string& path);
         PixelBitmap load_from_mem(const uint8_t* ptr);
 
@@ -136,8 +95,8 @@ namespace PNG {
     private:
         bool check_header(const uint8_t* ptr) const;
 
-        void proccess_stream(PixelBitmap& bitmap);
-        void process_compressed_data(PixelBitmap& bitmap);
+        bool proccess_stream(PixelBitmap& bitmap);
+        bool process_compressed_data(PixelBitmap& bitmap);
         bool read_chunk(PixelBitmap& bitmap);
         void read_IHDR(ChunkHeader& header, PixelBitmap& bitmap);
         void read_TEXT(ChunkHeader& header, PixelBitmap& bitmap);
@@ -145,14 +104,13 @@ namespace PNG {
         void read_ORNT(ChunkHeader& header, PixelBitmap& bitmap);
         void read_IDAT(ChunkHeader& header, PixelBitmap& bitmap);
 
-        uint8_t paeth_predictor(int a, int b, int c);
-        void unfilter_scanlines();
-        void copy_scanlines_to_bitmap(PixelBitmap& bitmap);
+        template <int ColorLength>
+        bool unfilter_to_bitmap(uint8_t* data, PixelBitmap& bitmap);
 
-        std::vector<uint8_t> m_compressed_data;
+        std::vector<DataChunk> m_data_chunks;
         DataStreamer m_streamer;
         IHDRChunk m_ihdr_chunk;
-        ScanlineKeeper m_scanline_keeper;
+        BitmapCache* m_cache { nullptr };
     };
 
 } // namespace PNG
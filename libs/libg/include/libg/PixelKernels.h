@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <libg/Color.h>
+
+namespace LG {
+
+// Kernels which work on a span of pixels of one row. Blending kernels
+// draw the source over the destination; destination pixels which are not
+// fully opaque are blended with Color::mix_with, the rest take the fast
+// path which keeps them opaque.
+struct PixelKernels {
+    const char* name;
+
+    void (*blend)(Color* dst, const Color* src, size_t count);
+    void (*blend_color)(Color* dst, const Color& color, size_t count);
+    // The alpha of the i-th pixel is alpha + i * alpha_step, clamped to 0..255.
+    void (*blend_gradient)(Color* dst, const Color& color, int alpha, int alpha_step, size_t count);
+    // The mask holds 8-bit coverage of each pixel, which scales its alpha.
+    void (*blend_color_masked)(Color* dst, const Color& color, const uint8_t* mask, size_t count);
+    void (*copy_masked)(Color* dst, const Color* src, const uint8_t* mask, size_t count);
+    void (*fill)(Color* dst, const Color& color, size_t count);
+};
+
+// The fastest kernels the CPU supports, picked on the first call.
+const PixelKernels& pixel_kernels();
+// The portable kernels, which the others fall back to.
+const PixelKernels& generic_pixel_kernels();
+
+inline uint8_t gradient_alpha(int alpha, int alpha_step, size_t i)
+{
+    int res = alpha + (int)i * alpha_step;
+    return res < 0 ? 0 : (res > 255 ? 255 : res);
+}
+
+} // namespace LG
\ No newline at end of file
@@ -68,16 +68,20 @@ public:
         return !(*this == p);
     }
 
-    void encode(EncodedMessage& buf) const override
+    static constexpr size_t EncodedSize = 2 * FixedEncodedSize<T>::value;
+
+    size_t encoded_size() const override { return EncodedSize; }
+
+    void encode(uint8_t*& buf) const override
     {
         Encoder::append(buf, m_x);
         Encoder::append(buf, m_y);
     }
 
-    void decode(const char* buf, size_t& offset) override
+    void decode(const char* buf, size_t size, size_t& offset) override
     {
-        Encoder::decode(buf, offset, m_x);
-        Encoder::decode(buf, offset, m_y);
+        Encoder::decode(buf, size, offset, m_x);
+        Encoder::decode(buf, size, offset, m_y);
     }
 
 private:
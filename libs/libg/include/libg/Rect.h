@@ -64,8 +64,11 @@ public:
     bool intersects(const Rect& other) const;
     LG::Rect intersection(const Rect& other) const;
 
-    void encode(EncodedMessage& buf) const override;
-    void decode(const char* buf, size_t& offset) override;
+    static constexpr size_t EncodedSize = Point<int>::EncodedSize + 2 * FixedEncodedSize<size_t>::value;
+
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t*& buf) const override;
+    void decode(const char* buf, size_t size, size_t& offset) override;
 
     bool operator==(const Rect& r) const
     {
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#pragma once
+
+#include <libg/Rect.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace LG {
+
+// A set of pixels kept as y-x banded rects: the region is cut into horizontal
+// bands, each band is a sorted list of rects of the same height which don't
+// touch each other. Bands are sorted top to bottom and neighbouring bands with
+// the same spans are merged, so a region has exactly one representation and
+// its rects never overlap.
+class Region {
+public:
+    Region() = default;
+    Region(const Rect& rect);
+
+    inline bool empty() const { return m_rects.empty(); }
+    inline const std::vector<Rect>& rects() const { return m_rects; }
+    inline void clear() { m_rects.resize(0); }
+
+    Rect bounds() const;
+    size_t area() const;
+    bool intersects(const Rect& rect) const;
+
+    void unite(const Rect& rect);
+    void unite(const Region& other);
+    void subtract(const Rect& rect);
+    void subtract(const Region& other);
+    void intersect(const Rect& rect);
+    void intersect(const Region& other);
+
+    Region intersection(const Rect& rect) const;
+
+    bool operator==(const Region& other) const;
+    bool operator!=(const Region& other) const { return !(*this == other); }
+
+private:
+    enum class Op {
+        Union,
+        Subtract,
+        Intersect,
+    };
+
+    struct Span {
+        int x0;
+        int x1; // exclusive
+    };
+
+    void combine(const Region& other, Op op);
+    void append_band(int y0, int y1, const std::vector<Span>& spans);
+
+    static int band_at(const std::vector<Rect>& rects, size_t& index, int y, std::vector<Span>& spans);
+    static void combine_spans(const std::vector<Span>& a, const std::vector<Span>& b, Op op, std::vector<Span>& result);
+
+    std::vector<Rect> m_rects;
+};
+
+} // namespace LG
\ No newline at end of file
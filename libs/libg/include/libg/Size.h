@@ -31,16 +31,20 @@ public:
     inline size_t width() const { return m_width; }
     inline size_t height() const { return m_height; }
 
-    void encode(EncodedMessage& buf) const override
+    static constexpr size_t EncodedSize = 2 * FixedEncodedSize<size_t>::value;
+
+    size_t encoded_size() const override { return EncodedSize; }
+
+    void encode(uint8_t*& buf) const override
     {
         Encoder::append(buf, m_width);
         Encoder::append(buf, m_height);
     }
 
-    void decode(const char* buf, size_t& offset) override
+    void decode(const char* buf, size_t size, size_t& offset) override
     {
-        Encoder::decode(buf, offset, m_width);
-        Encoder::decode(buf, offset, m_height);
+        Encoder::decode(buf, size, offset, m_width);
+        Encoder::decode(buf, size, offset, m_height);
     }
 
     bool operator==(const Size& r) const
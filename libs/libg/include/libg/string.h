@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include <cstring>
 #include <libg/Point.h>
 #include <libipc/Decodable.h>
 #include <libipc/Encodable.h>
@@ -19,21 +20,25 @@ class string : public std::string, public Encodable<string>, public Decodable<st
 public:
     using std::string::string;
 
-    void encode(EncodedMessage& buf) const override
+    size_t encoded_size() const override { return size() + 1; }
+
+    void encode(uint8_t*& buf) const override
     {
-        for (int i = 0; i < size(); i++) {
-            buf.push_back(at(i));
-        }
-        buf.push_back('\0');
+        memcpy(buf, data(), size());
+        buf += size();
+        *buf++ = '\0';
     }
 
-    void decode(const char* buf, size_t& offset) override
+    // A string which is not terminated within the message ends with it.
+    void decode(const char* buf, size_t size, size_t& offset) override
     {
-        while (buf[offset] != '\0') {
+        while (offset < size && buf[offset] != '\0') {
             push_back(buf[offset]);
             offset++;
         }
-        offset++;
+        if (offset < size) {
+            offset++;
+        }
     }
 };
 } // namespace LG
\ No newline at end of file
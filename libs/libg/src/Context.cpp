@@ -8,9 +8,27 @@
 #include <libfoundation/Math.h>
 #include <libfoundation/Memory.h>
 #include <libg/Context.h>
+#include <libg/PixelKernels.h>
 
 namespace LG {
 
+// Coverage of rounded corners is computed for this many pixels at once
+// and then drawn by a masked kernel.
+static constexpr int MaskChunk = 64;
+
+// Coverage of a pixel at the squared distance dist from the center of a
+// corner, antialiased over one pixel at the edge.
+static inline uint8_t corner_coverage(int dist, int radius2, size_t radius)
+{
+    if (dist <= radius2) {
+        return 255;
+    }
+
+    float fdist = 0.5 - (LFoundation::fast_sqrt((float)(dist)) - radius);
+    fdist = std::max(std::min(fdist, 1.0f), 0.0f);
+    return fdist * 255;
+}
+
 Context::Context(PixelBitmap& bitmap)
     : m_bitmap(bitmap)
     , m_origin_clip(0, 0, bitmap.width(), bitmap.height())
@@ -95,12 +113,12 @@ void Context::draw(const Point<int>& start, const PixelBitmap& bitmap)
     int max_y = draw_bounds.max_y();
     int offset_x = -start.x() - m_draw_offset.x() + m_bitmap_offset.x();
     int offset_y = -start.y() - m_draw_offset.y() + m_bitmap_offset.y();
+    int bitmap_x = min_x + offset_x;
     int bitmap_y = min_y + offset_y;
+    int len_x = max_x - min_x + 1;
+    auto& kernels = pixel_kernels();
     for (int y = min_y; y <= max_y; y++, bitmap_y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++, bitmap_x++) {
-            m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
-        }
+        kernels.blend(&m_bitmap[y][min_x], &bitmap[bitmap_y][bitmap_x], len_x);
     }
 }
 
@@ -124,12 +142,12 @@ void Context::draw_with_bounds(const Rect& rect, const PixelBitmap& bitmap)
     int max_y = draw_bounds.max_y();
     int offset_x = -rect.min_x() - m_draw_offset.x() + m_bitmap_offset.x();
     int offset_y = -rect.min_y() - m_draw_offset.y() + m_bitmap_offset.y();
+    int bitmap_x = min_x + offset_x;
     int bitmap_y = min_y + offset_y;
+    int len_x = max_x - min_x + 1;
+    auto& kernels = pixel_kernels();
     for (int y = min_y; y <= max_y; y++, bitmap_y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++, bitmap_x++) {
-            m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
-        }
+        kernels.blend(&m_bitmap[y][min_x], &bitmap[bitmap_y][bitmap_x], len_x);
     }
 }
 
@@ -251,11 +269,11 @@ void Context::mix(const Rect& rect)
     int min_y = draw_bounds.min_y();
     int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
+    int len_x = max_x - min_x + 1;
     const auto& color = fill_color();
+    auto& kernels = pixel_kernels();
     for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            m_bitmap[y][x].mix_with(color);
-        }
+        kernels.blend_color(&m_bitmap[y][min_x], color, len_x);
     }
 }
 
@@ -278,14 +296,15 @@ void Context::fill(const Rect& rect)
         return;
     }
 
-    auto color = fill_color().u32();
+    const auto& color = fill_color();
     int min_x = draw_bounds.min_x();
     int min_y = draw_bounds.min_y();
     int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
     int len_x = max_x - min_x + 1;
+    auto& kernels = pixel_kernels();
     for (int y = min_y; y <= max_y; y++) {
-        LFoundation::fast_set((uint32_t*)&m_bitmap[y][min_x], color, len_x);
+        kernels.fill(&m_bitmap[y][min_x], color, len_x);
     }
 }
 
@@ -312,23 +331,18 @@ void Context::draw_rounded_helper(const Point<int>& start, size_t radius, const
     int offset_x = -(start.x() - radius) - m_draw_offset.x() + m_bitmap_offset.x();
     int offset_y = -(start.y() - radius) - m_draw_offset.y() + m_bitmap_offset.y();
     int bitmap_y = min_y + offset_y;
+    auto& kernels = pixel_kernels();
+    uint8_t mask[MaskChunk];
 
-    for (int y = min_y; y <= max_y; y++) {
-        int bitmap_x = min_x + offset_x;
-        for (int x = min_x; x <= max_x; x++) {
-            int x2 = (x - center.x()) * (x - center.x());
-            int y2 = (y - center.y()) * (y - center.y());
-            int dist = x2 + y2;
-            if (dist <= radius2) {
-                m_bitmap[y][x].mix_with(bitmap[bitmap_y][bitmap_x]);
-            } else {
-                auto color = bitmap[bitmap_y][bitmap_x];
-                float fdist = 0.5 - (LFoundation::fast_sqrt((float)(dist)) - radius);
-                fdist = std::max(std::min(fdist, 1.0f), 0.0f);
-                int alpha = int(color.alpha() * fdist);
-                color.set_alpha(alpha);
-                m_bitmap[y][x].mix_with(color);
+    for (int y = min_y; y <= max_y; y++, bitmap_y++) {
+        int y2 = (y - center.y()) * (y - center.y());
+        for (int x = min_x; x <= max_x; x += MaskChunk) {
+            int len = std::min(MaskChunk, max_x - x + 1);
+            for (int i = 0; i < len; i++) {
+                int x2 = (x + i - center.x()) * (x + i - center.x());
+                mask[i] = corner_coverage(x2 + y2, radius2, radius);
             }
+            kernels.copy_masked(&m_bitmap[y][x], &bitmap[bitmap_y][x + offset_x], mask, len);
         }
     }
 }
@@ -348,26 +362,24 @@ void Context::fill_rounded_helper(const Point<int>& start, size_t radius)
         return;
     }
 
-    auto color = fill_color();
+    const auto& color = fill_color();
     int min_x = draw_bounds.min_x();
     int min_y = draw_bounds.min_y();
     int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
     int radius2 = radius * radius;
+    auto& kernels = pixel_kernels();
+    uint8_t mask[MaskChunk];
+
     for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            int x2 = (x - center.x()) * (x - center.x());
-            int y2 = (y - center.y()) * (y - center.y());
-            int dist = x2 + y2;
-            if (dist <= radius2) {
-                m_bitmap[y][x].mix_with(fill_color());
-            } else {
-                float fdist = 0.5 - (LFoundation::fast_sqrt((float)(dist)) - radius);
-                fdist = std::max(std::min(fdist, 1.0f), 0.0f);
-                int alpha = int(fill_color().alpha() * fdist);
-                color.set_alpha(alpha);
-                m_bitmap[y][x].mix_with(color);
+        int y2 = (y - center.y()) * (y - center.y());
+        for (int x = min_x; x <= max_x; x += MaskChunk) {
+            int len = std::min(MaskChunk, max_x - x + 1);
+            for (int i = 0; i < len; i++) {
+                int x2 = (x + i - center.x()) * (x + i - center.x());
+                mask[i] = corner_coverage(x2 + y2, radius2, radius);
             }
+            kernels.blend_color_masked(&m_bitmap[y][x], color, mask, len);
         }
     }
 }
@@ -388,30 +400,39 @@ void Context::shadow_rounded_helper(const Point<int>& start, size_t radius, cons
         return;
     }
 
-    auto color = fill_color();
+    const auto& color = fill_color();
     float shading_spread = shading.spread();
-    float std_alpha = color.alpha();
-    std_alpha /= (shading_spread - 1);
+    float std_coverage = 255.0f / std::max(shading_spread - 1, 1.0f);
     int min_x = draw_bounds.min_x();
     int min_y = draw_bounds.min_y();
     int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
     int radius2 = radius * radius;
+    auto& kernels = pixel_kernels();
+    uint8_t mask[MaskChunk];
+
+    // The shadow fades out with the distance from the edge of the corner.
+    auto coverage = [&](int dist) -> uint8_t {
+        if (dist <= radius2) {
+            return 0;
+        }
+        float fdist = LFoundation::fast_sqrt((float)(dist)) - radius;
+        if (fdist <= 0.1) {
+            return 0;
+        }
+        fdist = std::max(shading_spread - fdist, 0.0f);
+        return std::min(std_coverage * fdist, 255.0f);
+    };
+
     for (int y = min_y; y <= max_y; y++) {
-        for (int x = min_x; x <= max_x; x++) {
-            int x2 = (x - center.x()) * (x - center.x());
-            int y2 = (y - center.y()) * (y - center.y());
-            int dist = x2 + y2;
-            if (dist > radius2) {
-                float fdist = LFoundation::fast_sqrt((float)(dist)) - radius;
-                if (fdist > 0.1) {
-                    fdist = shading_spread - fdist;
-                    fdist = std::max(fdist, 0.0f);
-                    int alpha = std_alpha * fdist;
-                    color.set_alpha(alpha);
-                    m_bitmap[y][x].mix_with(color);
-                }
+        int y2 = (y - center.y()) * (y - center.y());
+        for (int x = min_x; x <= max_x; x += MaskChunk) {
+            int len = std::min(MaskChunk, max_x - x + 1);
+            for (int i = 0; i < len; i++) {
+                int x2 = (x + i - center.x()) * (x + i - center.x());
+                mask[i] = coverage(x2 + y2);
             }
+            kernels.blend_color_masked(&m_bitmap[y][x], color, mask, len);
         }
     }
 }
@@ -496,61 +517,58 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
     int min_y = draw_bounds.min_y();
     int max_x = draw_bounds.max_x();
     int max_y = draw_bounds.max_y();
+    int len_x = max_x - min_x + 1;
     auto color = fill_color();
+    auto& kernels = pixel_kernels();
 
+    // Alphas are tracked as ints and clamped by the kernels, so a gradient
+    // which overshoots its final alpha does not wrap around.
     int alpha_diff = color.alpha() - shading.final_alpha();
+    int alpha = color.alpha();
     int step, skipped_steps, end_x;
 
     switch (shading.type()) {
     case Shading::Type::TopToBottom:
         step = alpha_diff / orig_bounds.height();
         skipped_steps = min_y - orig_bounds.min_y();
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
 
         for (int y = min_y; y <= max_y; y++) {
-            for (int x = min_x; x <= max_x; x++) {
-                m_bitmap[y][x].mix_with(color);
-            }
-            color.set_alpha(color.alpha() - step);
+            color.set_alpha(std::max(std::min(alpha, 255), 0));
+            kernels.blend_color(&m_bitmap[y][min_x], color, len_x);
+            alpha -= step;
         }
         return;
 
     case Shading::Type::BottomToTop:
         step = alpha_diff / orig_bounds.height();
         skipped_steps = orig_bounds.max_y() - max_y;
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
 
         for (int y = max_y; y >= min_y; y--) {
-            for (int x = min_x; x <= max_x; x++) {
-                m_bitmap[y][x].mix_with(color);
-            }
-            color.set_alpha(color.alpha() - step);
+            color.set_alpha(std::max(std::min(alpha, 255), 0));
+            kernels.blend_color(&m_bitmap[y][min_x], color, len_x);
+            alpha -= step;
         }
         return;
 
     case Shading::Type::LeftToRight:
         step = alpha_diff / orig_bounds.width();
         skipped_steps = min_x - orig_bounds.min_x();
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
 
-        for (int x = min_x; x <= max_x; x++) {
-            for (int y = min_y; y <= max_y; y++) {
-                m_bitmap[y][x].mix_with(color);
-            }
-            color.set_alpha(color.alpha() - step);
+        for (int y = min_y; y <= max_y; y++) {
+            kernels.blend_gradient(&m_bitmap[y][min_x], color, alpha, -step, len_x);
         }
         return;
 
     case Shading::Type::RightToLeft:
         step = alpha_diff / orig_bounds.width();
         skipped_steps = orig_bounds.max_x() - max_x;
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= (skipped_steps + len_x - 1) * step;
 
-        for (int x = max_x; x >= min_x; x--) {
-            for (int y = min_y; y <= max_y; y++) {
-                m_bitmap[y][x].mix_with(color);
-            }
-            color.set_alpha(color.alpha() - step);
+        for (int y = min_y; y <= max_y; y++) {
+            kernels.blend_gradient(&m_bitmap[y][min_x], color, alpha, step, len_x);
         }
         return;
 
@@ -561,21 +579,19 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
             return;
         }
 
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
         end_x = std::min(min_x + (int)orig_bounds.height() - skipped_steps, max_x);
 
         for (int y = max_y; y >= min_y; y--) {
-            auto cur_color = color;
-            for (int x = min_x; x <= end_x; x++) {
-                m_bitmap[y][x].mix_with(cur_color);
-                cur_color.set_alpha(cur_color.alpha() - step);
+            if (end_x >= min_x) {
+                kernels.blend_gradient(&m_bitmap[y][min_x], color, alpha, -step, end_x - min_x + 1);
             }
             end_x--;
             if (!end_x) {
                 return;
             }
 
-            color.set_alpha(color.alpha() - step);
+            alpha -= step;
         }
         return;
 
@@ -586,21 +602,19 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
             return;
         }
 
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
         end_x = std::min(min_x + (int)orig_bounds.height() - skipped_steps, max_x);
 
         for (int y = min_y; y <= max_y; y++) {
-            auto cur_color = color;
-            for (int x = min_x; x <= end_x; x++) {
-                m_bitmap[y][x].mix_with(cur_color);
-                cur_color.set_alpha(cur_color.alpha() - step);
+            if (end_x >= min_x) {
+                kernels.blend_gradient(&m_bitmap[y][min_x], color, alpha, -step, end_x - min_x + 1);
             }
             end_x--;
             if (!end_x) {
                 return;
             }
 
-            color.set_alpha(color.alpha() - step);
+            alpha -= step;
         }
         return;
 
@@ -611,21 +625,17 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
             return;
         }
 
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
         end_x = std::max(max_x - ((int)orig_bounds.height() - skipped_steps), min_x);
 
         for (int y = max_y; y >= min_y; y--) {
-            auto cur_color = color;
-            for (int x = max_x; x >= end_x; x--) {
-                m_bitmap[y][x].mix_with(cur_color);
-                cur_color.set_alpha(cur_color.alpha() - step);
-            }
+            kernels.blend_gradient(&m_bitmap[y][end_x], color, alpha - (max_x - end_x) * step, step, max_x - end_x + 1);
             end_x++;
             if (end_x == max_x) {
                 return;
             }
 
-            color.set_alpha(color.alpha() - step);
+            alpha -= step;
         }
         return;
 
@@ -636,21 +646,17 @@ void Context::draw_shading(const Rect& rect, const Shading& shading)
             return;
         }
 
-        color.set_alpha(color.alpha() - skipped_steps * step);
+        alpha -= skipped_steps * step;
         end_x = std::max(max_x - ((int)orig_bounds.height() - skipped_steps), min_x);
 
         for (int y = min_y; y <= max_y; y++) {
-            auto cur_color = color;
-            for (int x = max_x; x >= end_x; x--) {
-                m_bitmap[y][x].mix_with(cur_color);
-                cur_color.set_alpha(cur_color.alpha() - step);
-            }
+            kernels.blend_gradient(&m_bitmap[y][end_x], color, alpha - (max_x - end_x) * step, step, max_x - end_x + 1);
             end_x++;
             if (end_x == max_x) {
                 return;
             }
 
-            color.set_alpha(color.alpha() - step);
+            alpha -= step;
         }
         return;
 
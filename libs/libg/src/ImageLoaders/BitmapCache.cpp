@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <cstring>
+#include <libg/ImageLoaders/BitmapCache.h>
+#include <sys/shared_buffer.h>
+
+namespace LG {
+
+static uint32_t cache_key(const char* path, uint32_t mtime)
+{
+    // FNV-1a of the path, mixed with the mtime. Key 0 is not allowed.
+    uint32_t key = 2166136261u;
+    for (; *path; path++) {
+        key = (key ^ (uint8_t)*path) * 16777619u;
+    }
+    key ^= mtime * 2654435761u;
+    return key ? key : 1;
+}
+
+BitmapCache::BitmapCache(const char* path, uint32_t mtime)
+    : m_path(path)
+    , m_mtime(mtime)
+    , m_key(cache_key(path, mtime))
+{
+}
+
+bool BitmapCache::open(int id, PixelBitmap& bitmap) const
+{
+    Header* header;
+    if (shared_buffer_get(id, (uint8_t**)&header) != 0) {
+        return false;
+    }
+
+    if (header->magic != Magic || header->mtime != m_mtime || strcmp(header->path, m_path) != 0) {
+        return false;
+    }
+
+    bitmap = PixelBitmap((Color*)&header[1], header->width, header->height, (PixelBitmapFormat)header->format);
+    return true;
+}
+
+bool BitmapCache::find(PixelBitmap& bitmap) const
+{
+    int id = shared_buffer_find(m_key);
+    if (id < 0) {
+        return false;
+    }
+
+    // Finding the entry makes us its holder, which is given back if the
+    // entry belongs to another file.
+    if (!open(id, bitmap)) {
+        shared_buffer_free(id);
+        return false;
+    }
+    return true;
+}
+
+Color* BitmapCache::allocate(size_t width, size_t height)
+{
+    size_t pixels_size = width * height * sizeof(Color);
+    if (pixels_size < MinCachedSize || strlen(m_path) >= MaxPath) {
+        return nullptr;
+    }
+
+    m_id = shared_buffer_create((uint8_t**)&m_header, sizeof(Header) + pixels_size);
+    if (m_id < 0) {
+        m_header = nullptr;
+        return nullptr;
+    }
+
+    m_header->magic = 0;
+    m_header->mtime = m_mtime;
+    m_header->width = width;
+    m_header->height = height;
+    strcpy(m_header->path, m_path);
+    return (Color*)&m_header[1];
+}
+
+void BitmapCache::publish(PixelBitmap& bitmap)
+{
+    if (m_id < 0) {
+        return;
+    }
+
+    m_header->format = bitmap.format();
+    m_header->magic = Magic;
+    if (shared_buffer_publish(m_id, m_key) == 0) {
+        return;
+    }
+
+    // Someone decoded the same image meanwhile. Our copy is freed, unless
+    // the published one is another file with the same key.
+    if (find(bitmap)) {
+        shared_buffer_free(m_id);
+    }
+    m_id = -1;
+    m_header = nullptr;
+}
+
+void BitmapCache::discard()
+{
+    if (m_id < 0) {
+        return;
+    }
+
+    shared_buffer_free(m_id);
+    m_id = -1;
+    m_header = nullptr;
+}
+
+} // namespace LG
\ No newline at end of file
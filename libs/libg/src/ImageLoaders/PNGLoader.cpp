@@ -7,7 +7,7 @@
 #include <cstring>
 #include <fcntl.h>
 #include <libfoundation/Logger.h>
-#include <libfoundation/compress/puff.h>
+#include <libfoundation/compress/Inflate.h>
 #include <libg/ImageLoaders/PNGLoader.h>
 #include <memory>
 #include <sys/mman.h>
@@ -33,8 +33,17 @@ namespace PNG {
         fstat_t stat;
         fstat(fd, &stat);
 
+        BitmapCache cache(path.c_str(), stat.mtime);
+        PixelBitmap bitmap;
+        if (cache.find(bitmap)) {
+            close(fd);
+            return bitmap;
+        }
+
         uint8_t* ptr = (uint8_t*)mmap(NULL, stat.size, PROT_READ, MAP_PRIVATE, fd, 0);
-        PixelBitmap bitmap = load_from_mem(ptr);
+        m_cache = &cache;
+        bitmap = load_from_mem(ptr);
+        m_cache = nullptr;
 
         munmap(ptr, stat.size);
         close(fd);
@@ -56,7 +65,15 @@ namespace PNG {
         streamer().read(m_ihdr_chunk.filter_method);
         streamer().read(m_ihdr_chunk.interlace_method);
 
-        bitmap.resize(m_ihdr_chunk.width, m_ihdr_chunk.height);
+        Color* pixels = nullptr;
+        if (m_cache) {
+            pixels = m_cache->allocate(m_ihdr_chunk.width, m_ihdr_chunk.height);
+        }
+        if (pixels) {
+            bitmap = PixelBitmap(pixels, m_ihdr_chunk.width, m_ihdr_chunk.height);
+        } else {
+            bitmap.resize(m_ihdr_chunk.width, m_ihdr_chunk.height);
+        }
 
 #ifdef PNGLOADER_DEGUG
         Logger::debug << "IHDR: " << m_ihdr_chunk.width << " " << m_ihdr_chunk.depth << " " << m_ihdr_chunk.compression_method << " " << m_ihdr_chunk.filter_method << " " << m_ihdr_chunk.color_type << std::endl;
@@ -78,67 +95,14 @@ namespace PNG {
         streamer().skip(header.len);
     }
 
-    // TODO: Currently support only comprssion type 0
+    // The data stays in the file, it is inflated straight from the chunks.
     void PNGLoader::read_IDAT(ChunkHeader& header, PixelBitmap& bitmap)
     {
-        size_t buf_size = m_compressed_data.size();
-        m_compressed_data.resize(buf_size + header.len);
-        memcpy(&m_compressed_data.data()[buf_size], streamer().ptr(), header.len);
+        m_data_chunks.push_back({ streamer().ptr(), header.len });
         streamer().skip(header.len);
     }
 
-    void PNGLoader::process_compressed_data(PixelBitmap& bitmap)
-    {
-        size_t datalen = m_compressed_data.size();
-        size_t destlen = 0;
-        int ret = puff(0, &destlen, m_compressed_data.data() + 2, &datalen);
-        uint8_t* unzipped_data = (uint8_t*)malloc(destlen);
-        puff(unzipped_data, &destlen, m_compressed_data.data() + 2, &datalen);
-        DataStreamer local_streamer(unzipped_data);
-        m_scanline_keeper.init(unzipped_data);
-
-        if (m_ihdr_chunk.color_type == 2) {
-            m_scanline_keeper.set_color_length(3);
-            if (m_ihdr_chunk.depth == 8) {
-                for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                    uint8_t scanline_filter;
-                    local_streamer.read(scanline_filter);
-
-                    if (scanline_filter > 4) {
-                        Logger::debug << "Invalid PNG filter: " << scanline_filter << std::endl;
-                        continue;
-                    }
-
-                    size_t len_of_scanline = (m_scanline_keeper.color_length() * m_ihdr_chunk.width * m_ihdr_chunk.depth + 7) / 8;
-                    m_scanline_keeper.add(Scanline(scanline_filter, local_streamer.ptr()));
-                    local_streamer.skip(len_of_scanline);
-                }
-            }
-        } else if (m_ihdr_chunk.color_type == 6) {
-            m_scanline_keeper.set_color_length(4);
-            if (m_ihdr_chunk.depth == 8) {
-                for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                    uint8_t scanline_filter;
-                    local_streamer.read(scanline_filter);
-
-                    if (scanline_filter > 4) {
-                        Logger::debug << "Invalid PNG filter: " << scanline_filter << std::endl;
-                        continue;
-                    }
-
-                    size_t len_of_scanline = (m_scanline_keeper.color_length() * m_ihdr_chunk.width * m_ihdr_chunk.depth + 7) / 8;
-                    m_scanline_keeper.add(Scanline(scanline_filter, local_streamer.ptr()));
-                    local_streamer.skip(len_of_scanline);
-                }
-            }
-        }
-
-        unfilter_scanlines();
-        copy_scanlines_to_bitmap(bitmap);
-        m_scanline_keeper.invalidate();
-    }
-
-    uint8_t PNGLoader::paeth_predictor(int a, int b, int c)
+    static inline uint8_t paeth_predictor(int a, int b, int c)
     {
         int p = a + b - c;
         int pa = abs(p - a);
@@ -151,89 +115,132 @@ namespace PNG {
         return c;
     }
 
-    void PNGLoader::unfilter_scanlines()
+    // Undoes the filter of a scanline in place. The prior scanline is
+    // already unfiltered, it is all zeros for the first one.
+    template <int ColorLength>
+    static bool unfilter_scanline(int filter, uint8_t* line, const uint8_t* prior, size_t len)
     {
-        for (int i = 0; i < m_ihdr_chunk.height; i++) {
-            if (m_scanline_keeper.scanlines()[i].filter_type() == 1) { // Sub
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    if (j >= m_scanline_keeper.color_length()) {
-                        prev = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += prev;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 2) { // Up
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    if (i > 0) {
-                        prev = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += prev;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 3) { // Average
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int prev = 0;
-                    int prior = 0;
-                    if (i > 0) {
-                        prior = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    if (j >= m_scanline_keeper.color_length()) {
-                        prev = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += (prev + prior) / 2;
-                }
-            } else if (m_scanline_keeper.scanlines()[i].filter_type() == 4) { // Paeth
-                int width = m_ihdr_chunk.width * m_scanline_keeper.color_length();
-                for (int j = 0; j < width; j++) {
-                    int a = 0;
-                    int b = 0;
-                    int c = 0;
-                    if (i > 0) {
-                        b = m_scanline_keeper.scanlines()[i - 1].data()[j];
-                    }
-                    if (j >= m_scanline_keeper.color_length()) {
-                        a = m_scanline_keeper.scanlines()[i].data()[j - m_scanline_keeper.color_length()];
-                        if (i > 0) {
-                            c = m_scanline_keeper.scanlines()[i - 1].data()[j - m_scanline_keeper.color_length()];
-                        }
-                    }
-                    m_scanline_keeper.scanlines()[i].data()[j] += paeth_predictor(a, b, c);
-                }
+        switch (filter) {
+        case 0: // None
+            return true;
+        case 1: // Sub
+            for (size_t i = ColorLength; i < len; i++) {
+                line[i] += line[i - ColorLength];
+            }
+            return true;
+        case 2: // Up
+            for (size_t i = 0; i < len; i++) {
+                line[i] += prior[i];
+            }
+            return true;
+        case 3: // Average
+            for (size_t i = 0; i < ColorLength; i++) {
+                line[i] += prior[i] / 2;
+            }
+            for (size_t i = ColorLength; i < len; i++) {
+                line[i] += (line[i - ColorLength] + prior[i]) / 2;
+            }
+            return true;
+        case 4: // Paeth
+            for (size_t i = 0; i < ColorLength; i++) {
+                line[i] += prior[i];
+            }
+            for (size_t i = ColorLength; i < len; i++) {
+                line[i] += paeth_predictor(line[i - ColorLength], prior[i], prior[i - ColorLength]);
             }
+            return true;
+        default:
+            Logger::debug << "Invalid PNG filter: " << filter << std::endl;
+            return false;
         }
     }
 
-    void PNGLoader::copy_scanlines_to_bitmap(PixelBitmap& bitmap)
+    // Each scanline is unfiltered and converted to pixels at once, while
+    // it is still in the cache.
+    template <int ColorLength>
+    bool PNGLoader::unfilter_to_bitmap(uint8_t* data, PixelBitmap& bitmap)
     {
-        if (m_ihdr_chunk.color_type == 2) {
-            bitmap.set_format(PixelBitmapFormat::RGB);
-            for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                auto& scanline = m_scanline_keeper.scanlines()[i];
-                for (int j = 0, bit = 0; j < m_ihdr_chunk.width; j++) {
-                    int r = scanline.data()[bit++];
-                    int g = scanline.data()[bit++];
-                    int b = scanline.data()[bit++];
-                    int alpha = 255;
-                    bitmap[i][j] = Color(r, g, b, alpha);
-                }
+        size_t len = m_ihdr_chunk.width * ColorLength;
+        uint8_t* zero_line = (uint8_t*)calloc(len, 1);
+        if (!zero_line) {
+            return false;
+        }
+        const uint8_t* prior = zero_line;
+
+        for (int y = 0; y < m_ihdr_chunk.height; y++) {
+            uint8_t* line = data + 1;
+            if (!unfilter_scanline<ColorLength>(data[0], line, prior, len)) {
+                free(zero_line);
+                return false;
+            }
+
+            Color* pixels = bitmap[y];
+            for (int x = 0; x < m_ihdr_chunk.width; x++, line += ColorLength) {
+                uint8_t alpha = ColorLength == 4 ? line[3] : 255;
+                pixels[x] = Color(line[0], line[1], line[2], alpha);
             }
+
+            prior = data + 1;
+            data += len + 1;
+        }
+
+        free(zero_line);
+        bitmap.set_format(ColorLength == 4 ? PixelBitmapFormat::RGBA : PixelBitmapFormat::RGB);
+        return true;
+    }
+
+    // TODO: Currently support only 8-bit RGB and RGBA without interlacing.
+    bool PNGLoader::process_compressed_data(PixelBitmap& bitmap)
+    {
+        int color_length = 0;
+        if (m_ihdr_chunk.color_type == 2) {
+            color_length = 3;
+        } else if (m_ihdr_chunk.color_type == 6) {
+            color_length = 4;
+        }
+
+        if (!bitmap.data()) {
+            Logger::debug << "PNGLoader: no image header" << std::endl;
+            return false;
+        }
+
+        if (!color_length || m_ihdr_chunk.depth != 8 || m_ihdr_chunk.interlace_method != 0) {
+            Logger::debug << "PNGLoader: unsupported format" << std::endl;
+            return false;
+        }
+
+        // Each scanline is prefixed with its filter type.
+        size_t data_len = (m_ihdr_chunk.width * color_length + 1) * m_ihdr_chunk.height;
+        uint8_t* data = (uint8_t*)malloc(data_len);
+        if (!data) {
+            return false;
         }
-        if (m_ihdr_chunk.color_type == 6) {
-            bitmap.set_format(PixelBitmapFormat::RGBA);
-            for (int i = 0; i < m_ihdr_chunk.height; i++) {
-                auto& scanline = m_scanline_keeper.scanlines()[i];
-                for (int j = 0, bit = 0; j < m_ihdr_chunk.width; j++) {
-                    int r = scanline.data()[bit++];
-                    int g = scanline.data()[bit++];
-                    int b = scanline.data()[bit++];
-                    int alpha = scanline.data()[bit++];
-                    bitmap[i][j] = Color(r, g, b, alpha);
-                }
+
+        size_t next_chunk = 0;
+        LFoundation::Inflater inflater([this, &next_chunk](const uint8_t*& chunk_data, size_t& chunk_len) {
+            if (next_chunk == m_data_chunks.size()) {
+                return false;
             }
+            chunk_data = m_data_chunks[next_chunk].data;
+            chunk_len = m_data_chunks[next_chunk].len;
+            next_chunk++;
+            return true;
+        });
+
+        if (inflater.inflate_zlib(data, data_len) != (int)data_len) {
+            Logger::debug << "PNGLoader: broken image data" << std::endl;
+            free(data);
+            return false;
+        }
+
+        bool res;
+        if (color_length == 3) {
+            res = unfilter_to_bitmap<3>(data, bitmap);
+        } else {
+            res = unfilter_to_bitmap<4>(data, bitmap);
         }
+        free(data);
+        return res;
     }
 
     bool PNGLoader::read_chunk(PixelBitmap& bitmap)
@@ -271,11 +278,11 @@ namespace PNG {
         return true;
     }
 
-    void PNGLoader::proccess_stream(PixelBitmap& bitmap)
+    bool PNGLoader::proccess_stream(PixelBitmap& bitmap)
     {
-        int len = 0;
+        m_data_chunks.clear();
         while (read_chunk(bitmap)) { }
-        process_compressed_data(bitmap);
+        return process_compressed_data(bitmap);
     }
 
     PixelBitmap PNGLoader::load_from_mem(const uint8_t* ptr)
@@ -292,7 +299,16 @@ namespace PNG {
         }
 
         streamer().set(ptr + png_header_size);
-        proccess_stream(bitmap);
+        if (!proccess_stream(bitmap)) {
+            if (m_cache) {
+                m_cache->discard();
+            }
+            return PixelBitmap();
+        }
+
+        if (m_cache) {
+            m_cache->publish(bitmap);
+        }
         return bitmap;
     }
 
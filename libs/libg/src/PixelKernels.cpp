@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <libfoundation/Memory.h>
+#include <libg/PixelKernels.h>
+
+namespace LG {
+
+#ifdef __i386__
+bool cpu_has_sse2();
+extern const PixelKernels sse2_pixel_kernels;
+#elif defined(__ARM_NEON)
+extern const PixelKernels neon_pixel_kernels;
+#endif
+
+static void blend_generic(Color* dst, const Color* src, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[i].mix_with(src[i]);
+    }
+}
+
+static void blend_color_generic(Color* dst, const Color& color, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[i].mix_with(color);
+    }
+}
+
+static void blend_gradient_generic(Color* dst, const Color& color, int alpha, int alpha_step, size_t count)
+{
+    auto clr = color;
+    for (size_t i = 0; i < count; i++) {
+        clr.set_alpha(gradient_alpha(alpha, alpha_step, i));
+        dst[i].mix_with(clr);
+    }
+}
+
+static void blend_color_masked_generic(Color* dst, const Color& color, const uint8_t* mask, size_t count)
+{
+    auto clr = color;
+    for (size_t i = 0; i < count; i++) {
+        clr.set_alpha(Color::div255(color.alpha() * mask[i]));
+        dst[i].mix_with(clr);
+    }
+}
+
+static void copy_masked_generic(Color* dst, const Color* src, const uint8_t* mask, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        auto clr = src[i];
+        clr.set_alpha(Color::div255(clr.alpha() * mask[i]));
+        dst[i].mix_with(clr);
+    }
+}
+
+static void fill_generic(Color* dst, const Color& color, size_t count)
+{
+    LFoundation::fast_set((uint32_t*)dst, color.u32(), count);
+}
+
+static const PixelKernels s_generic_pixel_kernels = {
+    "generic",
+    blend_generic,
+    blend_color_generic,
+    blend_gradient_generic,
+    blend_color_masked_generic,
+    copy_masked_generic,
+    fill_generic,
+};
+
+static const PixelKernels* s_pixel_kernels = nullptr;
+
+const PixelKernels& generic_pixel_kernels()
+{
+    return s_generic_pixel_kernels;
+}
+
+const PixelKernels& pixel_kernels()
+{
+    // Picking twice gives the same result, so a race here is harmless.
+    if (s_pixel_kernels) {
+        return *s_pixel_kernels;
+    }
+
+    s_pixel_kernels = &s_generic_pixel_kernels;
+#ifdef __i386__
+    if (cpu_has_sse2()) {
+        s_pixel_kernels = &sse2_pixel_kernels;
+    }
+#elif defined(__ARM_NEON)
+    // The arm target is built for Cortex-A15 with NEON, so it is always there.
+    s_pixel_kernels = &neon_pixel_kernels;
+#endif
+    return *s_pixel_kernels;
+}
+
+} // namespace LG
\ No newline at end of file
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifdef __ARM_NEON
+
+#include <arm_neon.h>
+#include <libg/PixelKernels.h>
+
+namespace LG {
+
+// Pixels are processed 8 at a time, split into planes of b, g, r and
+// opacity by vld4, so each channel is a vector of its own.
+
+static inline bool all_opaque(const uint8x8x4_t& pixels)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(pixels.val[3]), 0) == 0;
+}
+
+static inline bool all_zero(uint8x8_t val)
+{
+    return vget_lane_u64(vreinterpret_u64_u8(val), 0) == 0;
+}
+
+static inline uint8x8_t div255(uint16x8_t x)
+{
+    x = vaddq_u16(x, vdupq_n_u16(128));
+    return vaddhn_u16(x, vshrq_n_u16(x, 8));
+}
+
+static inline uint8x8_t blend_channel(uint8x8_t d, uint8x8_t s, uint8x8_t alpha)
+{
+    return div255(vmlal_u8(vmull_u8(s, alpha), d, vmvn_u8(alpha)));
+}
+
+// Draws 8 source pixels over 8 opaque ones.
+static inline void blend8(uint8x8x4_t& d, const uint8x8x4_t& s, uint8x8_t alpha)
+{
+    d.val[0] = blend_channel(d.val[0], s.val[0], alpha);
+    d.val[1] = blend_channel(d.val[1], s.val[1], alpha);
+    d.val[2] = blend_channel(d.val[2], s.val[2], alpha);
+    d.val[3] = vdup_n_u8(0);
+}
+
+static inline uint8x8x4_t splat(const Color& color)
+{
+    uint8x8x4_t res;
+    res.val[0] = vdup_n_u8(color.blue());
+    res.val[1] = vdup_n_u8(color.green());
+    res.val[2] = vdup_n_u8(color.red());
+    res.val[3] = vdup_n_u8(255 - color.alpha());
+    return res;
+}
+
+static void blend_neon(Color* dst, const Color* src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t*)&src[i]);
+        uint8x8_t alpha = vmvn_u8(s.val[3]);
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        uint8x8x4_t d = vld4_u8((const uint8_t*)&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 8; j++) {
+                dst[j].mix_with(src[j]);
+            }
+            continue;
+        }
+        blend8(d, s, alpha);
+        vst4_u8((uint8_t*)&dst[i], d);
+    }
+
+    for (; i < count; i++) {
+        dst[i].mix_with(src[i]);
+    }
+}
+
+static void fill_neon(Color* dst, const Color& color, size_t count)
+{
+    uint32x4_t s = vdupq_n_u32(color.u32());
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        vst1q_u32((uint32_t*)&dst[i], s);
+    }
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+static void blend_color_neon(Color* dst, const Color& color, size_t count)
+{
+    if (color.alpha() == 0) {
+        return;
+    }
+
+    uint8x8x4_t s = splat(color);
+    uint8x8_t alpha = vdup_n_u8(color.alpha());
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t d = vld4_u8((const uint8_t*)&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 8; j++) {
+                dst[j].mix_with(color);
+            }
+            continue;
+        }
+        blend8(d, s, alpha);
+        vst4_u8((uint8_t*)&dst[i], d);
+    }
+
+    for (; i < count; i++) {
+        dst[i].mix_with(color);
+    }
+}
+
+static void blend_gradient_neon(Color* dst, const Color& color, int alpha, int alpha_step, size_t count)
+{
+    static const int32_t lanes[4] = { 0, 1, 2, 3 };
+    uint8x8x4_t s = splat(color);
+    int32x4_t step = vdupq_n_s32(alpha_step);
+    int32x4_t cur_lo = vmlaq_s32(vdupq_n_s32(alpha), vld1q_s32(lanes), step);
+    int32x4_t cur_hi = vaddq_s32(cur_lo, vdupq_n_s32(4 * alpha_step));
+    int32x4_t inc = vdupq_n_s32(8 * alpha_step);
+    auto clr = color;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, cur_lo = vaddq_s32(cur_lo, inc), cur_hi = vaddq_s32(cur_hi, inc)) {
+        // Saturating narrowing clamps the alpha to 0..255.
+        uint16x8_t wide = vcombine_u16(vqmovun_s32(cur_lo), vqmovun_s32(cur_hi));
+        uint8x8_t cur_alpha = vqmovn_u16(wide);
+        if (all_zero(cur_alpha)) {
+            continue;
+        }
+
+        uint8x8x4_t d = vld4_u8((const uint8_t*)&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 8; j++) {
+                clr.set_alpha(gradient_alpha(alpha, alpha_step, j));
+                dst[j].mix_with(clr);
+            }
+            continue;
+        }
+        blend8(d, s, cur_alpha);
+        vst4_u8((uint8_t*)&dst[i], d);
+    }
+
+    for (; i < count; i++) {
+        clr.set_alpha(gradient_alpha(alpha, alpha_step, i));
+        dst[i].mix_with(clr);
+    }
+}
+
+static void blend_color_masked_neon(Color* dst, const Color& color, const uint8_t* mask, size_t count)
+{
+    uint8x8x4_t s = splat(color);
+    uint8x8_t color_alpha = vdup_n_u8(color.alpha());
+    auto clr = color;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8_t alpha = div255(vmull_u8(color_alpha, vld1_u8(&mask[i])));
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        uint8x8x4_t d = vld4_u8((const uint8_t*)&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 8; j++) {
+                clr.set_alpha(Color::div255(color.alpha() * mask[j]));
+                dst[j].mix_with(clr);
+            }
+            continue;
+        }
+        blend8(d, s, alpha);
+        vst4_u8((uint8_t*)&dst[i], d);
+    }
+
+    for (; i < count; i++) {
+        clr.set_alpha(Color::div255(color.alpha() * mask[i]));
+        dst[i].mix_with(clr);
+    }
+}
+
+static void copy_masked_neon(Color* dst, const Color* src, const uint8_t* mask, size_t count)
+{
+    auto copy_pixel = [&](size_t j) {
+        auto clr = src[j];
+        clr.set_alpha(Color::div255(clr.alpha() * mask[j]));
+        dst[j].mix_with(clr);
+    };
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t*)&src[i]);
+        uint8x8_t alpha = div255(vmull_u8(vmvn_u8(s.val[3]), vld1_u8(&mask[i])));
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        uint8x8x4_t d = vld4_u8((const uint8_t*)&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 8; j++) {
+                copy_pixel(j);
+            }
+            continue;
+        }
+        blend8(d, s, alpha);
+        vst4_u8((uint8_t*)&dst[i], d);
+    }
+
+    for (; i < count; i++) {
+        copy_pixel(i);
+    }
+}
+
+extern const PixelKernels neon_pixel_kernels = {
+    "neon",
+    blend_neon,
+    blend_color_neon,
+    blend_gradient_neon,
+    blend_color_masked_neon,
+    copy_masked_neon,
+    fill_neon,
+};
+
+} // namespace LG
+
+#endif // __ARM_NEON
\ No newline at end of file
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifdef __i386__
+
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <libg/PixelKernels.h>
+
+// The library is built for plain i386, so SSE2 is enabled per function
+// and these kernels are used only if cpuid reports it.
+#define SSE2 __attribute__((target("sse2")))
+
+namespace LG {
+
+bool cpu_has_sse2()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return edx & bit_SSE2;
+}
+
+SSE2 static inline __m128i load4(const void* ptr)
+{
+    return _mm_loadu_si128((const __m128i*)ptr);
+}
+
+SSE2 static inline void store4(void* ptr, __m128i val)
+{
+    _mm_storeu_si128((__m128i*)ptr, val);
+}
+
+SSE2 static inline bool all_opaque(__m128i pixels)
+{
+    __m128i opacity = _mm_and_si128(pixels, _mm_set1_epi32(0xff000000));
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(opacity, _mm_setzero_si128())) == 0xffff;
+}
+
+SSE2 static inline bool all_zero(__m128i val)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(val, _mm_setzero_si128())) == 0xffff;
+}
+
+// Alpha of each pixel in the low byte of its 32-bit lane.
+SSE2 static inline __m128i alpha_of(__m128i pixels)
+{
+    return _mm_srli_epi32(_mm_xor_si128(pixels, _mm_set1_epi32(-1)), 24);
+}
+
+SSE2 static inline __m128i div255_epi16(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Loads 4 bytes of coverage, one per 32-bit lane.
+SSE2 static inline __m128i load_mask4(const uint8_t* mask)
+{
+    uint32_t val;
+    __builtin_memcpy(&val, mask, sizeof(val));
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(val), zero), zero);
+}
+
+// Both are at most 255 and live in the low half of 32-bit lanes.
+SSE2 static inline __m128i scale_alpha(__m128i alpha, __m128i mask)
+{
+    return div255_epi16(_mm_mullo_epi16(alpha, mask));
+}
+
+SSE2 static inline __m128i blend_channels(__m128i d, __m128i s, __m128i alpha)
+{
+    __m128i inv_alpha = _mm_xor_si128(alpha, _mm_set1_epi16(255));
+    return div255_epi16(_mm_add_epi16(_mm_mullo_epi16(s, alpha), _mm_mullo_epi16(d, inv_alpha)));
+}
+
+// Draws 4 source pixels over 4 opaque ones. Channels are widened to 16 bits,
+// the alpha of each pixel is copied to all its channels.
+SSE2 static inline __m128i blend4(__m128i d, __m128i s, __m128i alpha)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i alpha_lo = _mm_unpacklo_epi32(alpha, alpha);
+    __m128i alpha_hi = _mm_unpackhi_epi32(alpha, alpha);
+    alpha_lo = _mm_or_si128(alpha_lo, _mm_slli_epi32(alpha_lo, 16));
+    alpha_hi = _mm_or_si128(alpha_hi, _mm_slli_epi32(alpha_hi, 16));
+
+    __m128i lo = blend_channels(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), alpha_lo);
+    __m128i hi = blend_channels(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), alpha_hi);
+    return _mm_and_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0x00ffffff));
+}
+
+SSE2 static void blend_sse2(Color* dst, const Color* src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = load4(&src[i]);
+        __m128i alpha = alpha_of(s);
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        __m128i d = load4(&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 4; j++) {
+                dst[j].mix_with(src[j]);
+            }
+            continue;
+        }
+        store4(&dst[i], blend4(d, s, alpha));
+    }
+
+    for (; i < count; i++) {
+        dst[i].mix_with(src[i]);
+    }
+}
+
+SSE2 static void fill_sse2(Color* dst, const Color& color, size_t count)
+{
+    __m128i s = _mm_set1_epi32(color.u32());
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        store4(&dst[i], s);
+    }
+    for (; i < count; i++) {
+        dst[i] = color;
+    }
+}
+
+SSE2 static void blend_color_sse2(Color* dst, const Color& color, size_t count)
+{
+    if (color.alpha() == 0) {
+        return;
+    }
+
+    __m128i s = _mm_set1_epi32(color.u32());
+    __m128i alpha = _mm_set1_epi32(color.alpha());
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i d = load4(&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 4; j++) {
+                dst[j].mix_with(color);
+            }
+            continue;
+        }
+        store4(&dst[i], blend4(d, s, alpha));
+    }
+
+    for (; i < count; i++) {
+        dst[i].mix_with(color);
+    }
+}
+
+SSE2 static void blend_gradient_sse2(Color* dst, const Color& color, int alpha, int alpha_step, size_t count)
+{
+    __m128i s = _mm_set1_epi32(color.u32());
+    __m128i cur_alpha = _mm_setr_epi32(alpha, alpha + alpha_step, alpha + 2 * alpha_step, alpha + 3 * alpha_step);
+    __m128i inc = _mm_set1_epi32(4 * alpha_step);
+    __m128i max_alpha = _mm_set1_epi32(255);
+    auto clr = color;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, cur_alpha = _mm_add_epi32(cur_alpha, inc)) {
+        __m128i clamped = _mm_andnot_si128(_mm_cmplt_epi32(cur_alpha, _mm_setzero_si128()), cur_alpha);
+        __m128i over = _mm_cmpgt_epi32(clamped, max_alpha);
+        clamped = _mm_or_si128(_mm_andnot_si128(over, clamped), _mm_and_si128(over, max_alpha));
+        if (all_zero(clamped)) {
+            continue;
+        }
+
+        __m128i d = load4(&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 4; j++) {
+                clr.set_alpha(gradient_alpha(alpha, alpha_step, j));
+                dst[j].mix_with(clr);
+            }
+            continue;
+        }
+        store4(&dst[i], blend4(d, s, clamped));
+    }
+
+    for (; i < count; i++) {
+        clr.set_alpha(gradient_alpha(alpha, alpha_step, i));
+        dst[i].mix_with(clr);
+    }
+}
+
+SSE2 static void blend_color_masked_sse2(Color* dst, const Color& color, const uint8_t* mask, size_t count)
+{
+    __m128i s = _mm_set1_epi32(color.u32());
+    __m128i color_alpha = _mm_set1_epi32(color.alpha());
+    auto clr = color;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i alpha = scale_alpha(color_alpha, load_mask4(&mask[i]));
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        __m128i d = load4(&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 4; j++) {
+                clr.set_alpha(Color::div255(color.alpha() * mask[j]));
+                dst[j].mix_with(clr);
+            }
+            continue;
+        }
+        store4(&dst[i], blend4(d, s, alpha));
+    }
+
+    for (; i < count; i++) {
+        clr.set_alpha(Color::div255(color.alpha() * mask[i]));
+        dst[i].mix_with(clr);
+    }
+}
+
+SSE2 static void copy_masked_sse2(Color* dst, const Color* src, const uint8_t* mask, size_t count)
+{
+    auto copy_pixel = [&](size_t j) {
+        auto clr = src[j];
+        clr.set_alpha(Color::div255(clr.alpha() * mask[j]));
+        dst[j].mix_with(clr);
+    };
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = load4(&src[i]);
+        __m128i alpha = scale_alpha(alpha_of(s), load_mask4(&mask[i]));
+        if (all_zero(alpha)) {
+            continue;
+        }
+
+        __m128i d = load4(&dst[i]);
+        if (!all_opaque(d)) {
+            for (size_t j = i; j < i + 4; j++) {
+                copy_pixel(j);
+            }
+            continue;
+        }
+        store4(&dst[i], blend4(d, s, alpha));
+    }
+
+    for (; i < count; i++) {
+        copy_pixel(i);
+    }
+}
+
+extern const PixelKernels sse2_pixel_kernels = {
+    "sse2",
+    blend_sse2,
+    blend_color_sse2,
+    blend_gradient_sse2,
+    blend_color_masked_sse2,
+    copy_masked_sse2,
+    fill_sse2,
+};
+
+} // namespace LG
+
+#endif // __i386__
\ No newline at end of file
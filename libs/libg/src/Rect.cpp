@@ -15,18 +15,18 @@ Rect::Rect(int x, int y, size_t width, size_t height)
 {
 }
 
-void Rect::encode(EncodedMessage& buf) const
+void Rect::encode(uint8_t*& buf) const
 {
     Encoder::append(buf, m_origin);
     Encoder::append(buf, m_width);
     Encoder::append(buf, m_height);
 }
 
-void Rect::decode(const char* buf, size_t& offset)
+void Rect::decode(const char* buf, size_t size, size_t& offset)
 {
-    Encoder::decode(buf, offset, m_origin);
-    Encoder::decode(buf, offset, m_width);
-    Encoder::decode(buf, offset, m_height);
+    Encoder::decode(buf, size, offset, m_origin);
+    Encoder::decode(buf, size, offset, m_width);
+    Encoder::decode(buf, size, offset, m_height);
 }
 
 } // namespace LG
\ No newline at end of file
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <algorithm>
+#include <libg/Region.h>
+#include <utility>
+
+namespace LG {
+
+static constexpr int NoEdge = 0x7fffffff;
+
+Region::Region(const Rect& rect)
+{
+    if (!rect.empty()) {
+        m_rects.push_back(rect);
+    }
+}
+
+Rect Region::bounds() const
+{
+    if (empty()) {
+        return Rect(0, 0, 0, 0);
+    }
+
+    Rect res = m_rects[0];
+    for (int i = 1; i < m_rects.size(); i++) {
+        res.unite(m_rects[i]);
+    }
+    return res;
+}
+
+size_t Region::area() const
+{
+    size_t res = 0;
+    for (int i = 0; i < m_rects.size(); i++) {
+        res += m_rects[i].square();
+    }
+    return res;
+}
+
+bool Region::intersects(const Rect& rect) const
+{
+    for (int i = 0; i < m_rects.size(); i++) {
+        if (m_rects[i].intersects(rect)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Region::unite(const Rect& rect)
+{
+    if (rect.empty()) {
+        return;
+    }
+    combine(Region(rect), Op::Union);
+}
+
+void Region::unite(const Region& other)
+{
+    if (other.empty()) {
+        return;
+    }
+    if (empty()) {
+        m_rects = other.m_rects;
+        return;
+    }
+    combine(other, Op::Union);
+}
+
+void Region::subtract(const Rect& rect)
+{
+    if (rect.empty() || !intersects(rect)) {
+        return;
+    }
+    combine(Region(rect), Op::Subtract);
+}
+
+void Region::subtract(const Region& other)
+{
+    if (empty() || other.empty()) {
+        return;
+    }
+    combine(other, Op::Subtract);
+}
+
+void Region::intersect(const Rect& rect)
+{
+    if (empty()) {
+        return;
+    }
+    combine(Region(rect), Op::Intersect);
+}
+
+void Region::intersect(const Region& other)
+{
+    if (empty()) {
+        return;
+    }
+    combine(other, Op::Intersect);
+}
+
+Region Region::intersection(const Rect& rect) const
+{
+    Region res(*this);
+    res.intersect(rect);
+    return res;
+}
+
+bool Region::operator==(const Region& other) const
+{
+    if (m_rects.size() != other.m_rects.size()) {
+        return false;
+    }
+    for (int i = 0; i < m_rects.size(); i++) {
+        if (m_rects[i] != other.m_rects[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Fills spans with the band which covers y and returns the next y where
+// the region changes. Bands above y are skipped by moving the index.
+int Region::band_at(const std::vector<Rect>& rects, size_t& index, int y, std::vector<Span>& spans)
+{
+    spans.resize(0);
+    while (index < rects.size() && rects[index].max_y() < y) {
+        index++;
+    }
+    if (index == rects.size()) {
+        return NoEdge;
+    }
+
+    int top = rects[index].min_y();
+    if (top > y) {
+        return top;
+    }
+
+    for (size_t i = index; i < rects.size() && rects[i].min_y() == top; i++) {
+        spans.push_back({ rects[i].min_x(), rects[i].max_x() + 1 });
+    }
+    return rects[index].max_y() + 1;
+}
+
+// Walks the edges of both span lists left to right and keeps the parts
+// where the operation says the pixel is inside. Touching spans come out
+// merged, since both edges are passed at once.
+void Region::combine_spans(const std::vector<Span>& a, const std::vector<Span>& b, Op op, std::vector<Span>& result)
+{
+    auto edge = [](const std::vector<Span>& spans, size_t i) {
+        return (i & 1) ? spans[i / 2].x1 : spans[i / 2].x0;
+    };
+
+    result.resize(0);
+    size_t a_edges = 2 * a.size();
+    size_t b_edges = 2 * b.size();
+    size_t ia = 0, ib = 0;
+    bool in_a = false, in_b = false, was_inside = false;
+    int start = 0;
+
+    while (ia < a_edges || ib < b_edges) {
+        int x = std::min(ia < a_edges ? edge(a, ia) : NoEdge, ib < b_edges ? edge(b, ib) : NoEdge);
+        while (ia < a_edges && edge(a, ia) == x) {
+            in_a = !in_a, ia++;
+        }
+        while (ib < b_edges && edge(b, ib) == x) {
+            in_b = !in_b, ib++;
+        }
+
+        bool inside = false;
+        switch (op) {
+        case Op::Union:
+            inside = in_a || in_b;
+            break;
+        case Op::Subtract:
+            inside = in_a && !in_b;
+            break;
+        case Op::Intersect:
+            inside = in_a && in_b;
+            break;
+        }
+
+        if (inside && !was_inside) {
+            start = x;
+        } else if (!inside && was_inside) {
+            result.push_back({ start, x });
+        }
+        was_inside = inside;
+    }
+}
+
+// Adds a band below the existing ones. If the band continues the last one
+// with the same spans, the last band just grows down.
+void Region::append_band(int y0, int y1, const std::vector<Span>& spans)
+{
+    if (spans.empty()) {
+        return;
+    }
+
+    size_t last = m_rects.size();
+    while (last > 0 && m_rects[last - 1].min_y() == m_rects.back().min_y()) {
+        last--;
+    }
+
+    bool continues = !m_rects.empty() && m_rects.back().max_y() + 1 == y0 && m_rects.size() - last == spans.size();
+    for (size_t i = 0; continues && i < spans.size(); i++) {
+        auto& rect = m_rects[last + i];
+        continues = rect.min_x() == spans[i].x0 && rect.max_x() + 1 == spans[i].x1;
+    }
+
+    if (continues) {
+        for (size_t i = last; i < m_rects.size(); i++) {
+            m_rects[i].set_height(y1 - m_rects[i].min_y());
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < spans.size(); i++) {
+        m_rects.push_back(Rect(spans[i].x0, y0, spans[i].x1 - spans[i].x0, y1 - y0));
+    }
+}
+
+// Cuts the plane into horizontal strips at every y where either region
+// changes. Inside a strip both regions are a fixed list of spans, so the
+// operation is done on spans and the strip becomes a band of the result.
+void Region::combine(const Region& other, Op op)
+{
+    Region result;
+    std::vector<Span> a_spans;
+    std::vector<Span> b_spans;
+    std::vector<Span> spans;
+    size_t ia = 0, ib = 0;
+
+    int y = NoEdge;
+    if (!m_rects.empty()) {
+        y = m_rects[0].min_y();
+    }
+    if (!other.m_rects.empty()) {
+        y = std::min(y, other.m_rects[0].min_y());
+    }
+
+    while (y != NoEdge) {
+        int a_next = band_at(m_rects, ia, y, a_spans);
+        int b_next = band_at(other.m_rects, ib, y, b_spans);
+        int next = std::min(a_next, b_next);
+        if (next == NoEdge) {
+            break;
+        }
+
+        if (!a_spans.empty() || !b_spans.empty()) {
+            combine_spans(a_spans, b_spans, op, spans);
+            result.append_band(y, next, spans);
+        }
+        y = next;
+    }
+
+    m_rects = std::move(result.m_rects);
+}
+
+} // namespace LG
\ No newline at end of file
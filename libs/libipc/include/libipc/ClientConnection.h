@@ -1,12 +1,15 @@
 #pragma once
 #include <cstdlib>
+#include <cstring>
 #include <libfoundation/Event.h>
 #include <libfoundation/EventLoop.h>
 #include <libfoundation/EventReceiver.h>
 #include <libfoundation/Logger.h>
 #include <libipc/Message.h>
 #include <libipc/MessageDecoder.h>
+#include <libipc/MessageStream.h>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 template <typename ServerDecoder, typename ClientDecoder>
@@ -14,6 +17,7 @@ class ClientConnection : public LFoundation::EventReceiver {
 public:
     ClientConnection(int sock_fd, ServerDecoder& server_decoder, ClientDecoder& client_decoder)
         : m_connection_fd(sock_fd)
+        , m_stream(sock_fd)
         , m_server_decoder(server_decoder)
         , m_client_decoder(client_decoder)
         , m_messages()
@@ -22,16 +26,26 @@ public:
 
     void set_accepted_key(int key) { m_accepted_key = key; }
 
-    bool send_message(const Message& msg) const
+    // False once the server has closed the connection or sent garbage.
+    inline bool connected() const { return m_connected; }
+
+    // The fd is blocking, so the client waits while the server is busy
+    // instead of losing messages.
+    bool send_message(const Message& msg)
     {
-        auto encoded_msg = msg.encode();
-        int wrote = write(m_connection_fd, encoded_msg.data(), encoded_msg.size());
-        return wrote == encoded_msg.size();
+        if (!m_connected || !m_stream.send(msg)) {
+            disconnect();
+            return false;
+        }
+        return true;
     }
 
+    // Returns nullptr if the connection is lost before the answer comes.
     std::unique_ptr<Message> send_sync(const Message& msg)
     {
-        bool status = send_message(msg);
+        if (!send_message(msg)) {
+            return nullptr;
+        }
         return wait_for_answer(msg);
     }
 
@@ -39,53 +53,67 @@ public:
     {
         for (;;) {
             for (int i = 0; i < m_messages.size(); i++) {
-                if (m_messages[i] && m_messages[i]->key() == msg.key() && m_messages[i]->id() == msg.reply_id()) {
-                    return m_messages[i].release();
+                if (m_messages[i]->key() == msg.key() && m_messages[i]->id() == msg.reply_id()) {
+                    std::unique_ptr<Message> answer = std::move(m_messages[i]);
+                    if (i != m_messages.size() - 1) {
+                        m_messages[i] = std::move(m_messages.back());
+                    }
+                    m_messages.pop_back();
+                    return answer;
                 }
             }
-            pump_messages();
+            if (!pump_messages()) {
+                return nullptr;
+            }
         }
     }
 
-    void pump_messages()
+    // Returns false if the connection is lost.
+    bool pump_messages()
     {
-        std::vector<char> buf;
+        if (!m_connected) {
+            return false;
+        }
 
-        char tmpbuf[1024];
+        if (!m_stream.receive()) {
+            Logger::debug << getpid() << " :: ClientConnection disconnected" << std::endl;
+            disconnect();
+            return false;
+        }
 
-        int read_cnt;
-        while ((read_cnt = read(m_connection_fd, tmpbuf, sizeof(tmpbuf)))) {
-            if (read_cnt <= 0) {
-                Logger::debug << getpid() << " :: ClientConnection read error" << std::endl;
-                return;
-            }
-            size_t buf_size = buf.size();
-            buf.resize(buf_size + read_cnt);
-            memcpy((uint8_t*)&buf.data()[buf_size], (uint8_t*)tmpbuf, read_cnt);
-            if (read_cnt < sizeof(tmpbuf)) {
-                break;
+        bool had_deferred = !m_deferred.empty();
+        bool valid = m_stream.for_each_message([this](const char* buf, size_t size) {
+            // Events for the client are copied as they are and decoded when
+            // handled. Answers to sync requests are decoded right away.
+            if (MessageDecoder::peek_decoder_magic(buf, size) == m_client_decoder.magic()) {
+                size_t at = m_deferred.size();
+                uint32_t len = size;
+                m_deferred.resize(at + MessageStream::HeaderSize + size);
+                memcpy(&m_deferred.data()[at], &len, MessageStream::HeaderSize);
+                memcpy(&m_deferred.data()[at + MessageStream::HeaderSize], buf, size);
+                return true;
             }
-        }
 
-        size_t msg_len = 0;
-        size_t buf_size = buf.size();
-        for (size_t i = 0; i < buf_size; i += msg_len) {
-            msg_len = 0;
-            if (auto response = m_client_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
-                m_messages.push_back(std::move(response));
-            } else if (auto response = m_server_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
+            size_t msg_len = 0;
+            if (auto response = m_server_decoder.decode(buf, size, msg_len)) {
                 m_messages.push_back(std::move(response));
-            } else {
-                Logger::debug << getpid() << " :: ClientConnection read error" << std::endl;
-                std::abort();
+                return true;
             }
+            return false;
+        });
+
+        if (!valid) {
+            Logger::debug << getpid() << " :: ClientConnection read error" << std::endl;
+            disconnect();
+            return false;
         }
 
-        if (m_messages.size() > 0) {
+        if (!had_deferred && !m_deferred.empty()) {
             // Note: We send an event to ourselves and use CallEvent to recognize the
             // event as sign to start processing of messages.
             LFoundation::EventLoop::the().add(*this, new LFoundation::CallEvent(nullptr));
         }
+        return true;
     }
 
     void receive_event(std::unique_ptr<LFoundation::Event> event) override
@@ -93,19 +121,42 @@ public:
         if (event->type() == LFoundation::Event::Type::DeferredInvoke) {
             // Note: The event was sent from pump_messages() and callback of CallEvent is 0!
             // Do NOT call callback here!
-            auto msg = std::move(m_messages);
-            for (int i = 0; i < msg.size(); i++) {
-                if (msg[i] && msg[i]->decoder_magic() == m_client_decoder.magic() && msg[i]->key() == m_accepted_key) {
-                    m_client_decoder.handle(*msg[i]);
+            // Handlers could send sync requests, which read more events,
+            // so the events are taken out before handling.
+            std::swap(m_deferred, m_handling);
+            size_t offset = 0;
+            while (offset < m_handling.size()) {
+                uint32_t len;
+                memcpy(&len, &m_handling.data()[offset], MessageStream::HeaderSize);
+                const char* buf = &m_handling.data()[offset + MessageStream::HeaderSize];
+                if (MessageDecoder::peek_key(buf, len) == m_accepted_key) {
+                    std::unique_ptr<Message> answer;
+                    m_client_decoder.decode_and_handle(buf, len, answer);
                 }
+                offset += MessageStream::HeaderSize + len;
             }
+            m_handling.resize(0);
         }
     }
 
 private:
+    // The fd is left open for the owner, only its listener is dropped.
+    void disconnect()
+    {
+        if (m_connected) {
+            m_connected = false;
+            LFoundation::EventLoop::the().remove(m_connection_fd);
+        }
+    }
+
+    bool m_connected { true };
     int m_accepted_key { -1 };
     int m_connection_fd;
+    MessageStream m_stream;
     std::vector<std::unique_ptr<Message>> m_messages;
+    // Framed events waiting for the deferred invoke, and the ones being handled.
+    std::vector<char> m_deferred;
+    std::vector<char> m_handling;
     ServerDecoder& m_server_decoder;
     ClientDecoder& m_client_decoder;
 };
\ No newline at end of file
@@ -4,5 +4,5 @@
 template <typename T>
 class Decodable {
 public:
-    virtual void decode(const char* buf, size_t& offset) { }
+    virtual void decode(const char* buf, size_t size, size_t& offset) { }
 };
\ No newline at end of file
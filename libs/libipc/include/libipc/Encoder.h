@@ -1,90 +1,108 @@
 #pragma once
-#include <vector>
-
-typedef std::vector<uint8_t> EncodedMessage;
+#include <cstddef>
+#include <sys/types.h>
 
+// Values are written at the cursor, which is moved past them. Integers take
+// 4 bytes, the lowest byte goes first. The caller reserves the room, see
+// encoded_size().
 class Encoder {
 public:
     ~Encoder() = default;
 
-    static void append(EncodedMessage& buf, int val)
+    static void append(uint8_t*& buf, unsigned int val)
     {
-        buf.push_back((uint8_t)val);
-        buf.push_back((uint8_t)(val >> 8));
-        buf.push_back((uint8_t)(val >> 16));
-        buf.push_back((uint8_t)(val >> 24));
+        buf[0] = (uint8_t)val;
+        buf[1] = (uint8_t)(val >> 8);
+        buf[2] = (uint8_t)(val >> 16);
+        buf[3] = (uint8_t)(val >> 24);
+        buf += 4;
     }
 
-    static void append(EncodedMessage& buf, unsigned int val)
+    static void append(uint8_t*& buf, int val) { append(buf, (unsigned int)val); }
+    static void append(uint8_t*& buf, unsigned long val) { append(buf, (unsigned int)val); }
+
+    template <typename T>
+    static void append(uint8_t*& buf, const T& value)
     {
-        buf.push_back((uint8_t)val);
-        buf.push_back((uint8_t)(val >> 8));
-        buf.push_back((uint8_t)(val >> 16));
-        buf.push_back((uint8_t)(val >> 24));
+        value.encode(buf);
     }
 
-    static void append(EncodedMessage& buf, unsigned long val)
+    static constexpr size_t encoded_size(int) { return 4; }
+    static constexpr size_t encoded_size(unsigned int) { return 4; }
+    static constexpr size_t encoded_size(unsigned long) { return 4; }
+
+    template <typename T>
+    static size_t encoded_size(const T& value)
     {
-        buf.push_back((uint8_t)val);
-        buf.push_back((uint8_t)(val >> 8));
-        buf.push_back((uint8_t)(val >> 16));
-        buf.push_back((uint8_t)(val >> 24));
+        return value.encoded_size();
     }
 
-    static void decode(const char* buf, size_t& offset, unsigned long& val)
+    // Reads stop at size, the length of the message. A value which does not
+    // fit is read as zero and the cursor is moved to the end.
+    static void decode(const char* buf, size_t size, size_t& offset, unsigned long& val)
     {
-        uint8_t b0 = buf[offset++];
-        uint8_t b1 = buf[offset++];
-        uint8_t b2 = buf[offset++];
-        uint8_t b3 = buf[offset++];
+        val = decode_u32(buf, size, offset);
+    }
 
-        val = 0;
-        val |= (uint8_t(b3) << 24);
-        val |= (uint8_t(b2) << 16);
-        val |= (uint8_t(b1) << 8);
-        val |= (uint8_t(b0));
+    static void decode(const char* buf, size_t size, size_t& offset, unsigned int& val)
+    {
+        val = decode_u32(buf, size, offset);
     }
 
-    static void decode(const char* buf, size_t& offset, unsigned int& val)
+    static void decode(const char* buf, size_t size, size_t& offset, int& val)
     {
-        uint8_t b0 = buf[offset++];
-        uint8_t b1 = buf[offset++];
-        uint8_t b2 = buf[offset++];
-        uint8_t b3 = buf[offset++];
+        val = (int)decode_u32(buf, size, offset);
+    }
 
-        val = 0;
-        val |= (uint8_t(b3) << 24);
-        val |= (uint8_t(b2) << 16);
-        val |= (uint8_t(b1) << 8);
-        val |= (uint8_t(b0));
+    template <typename T>
+    static void decode(const char* buf, size_t size, size_t& offset, T& value)
+    {
+        value.decode(buf, size, offset);
     }
 
-    static void decode(const char* buf, size_t& offset, int& val)
+private:
+    Encoder() = default;
+
+    static uint32_t decode_u32(const char* buf, size_t size, size_t& offset)
     {
+        if (offset > size || size - offset < 4) {
+            offset = size;
+            return 0;
+        }
+
         uint8_t b0 = buf[offset++];
         uint8_t b1 = buf[offset++];
         uint8_t b2 = buf[offset++];
         uint8_t b3 = buf[offset++];
 
-        val = 0;
-        val |= (uint8_t(b3) << 24);
-        val |= (uint8_t(b2) << 16);
-        val |= (uint8_t(b1) << 8);
-        val |= (uint8_t(b0));
+        uint32_t val = 0;
+        val |= (uint32_t(b3) << 24);
+        val |= (uint32_t(b2) << 16);
+        val |= (uint32_t(b1) << 8);
+        val |= (uint32_t(b0));
+        return val;
     }
+};
 
-    template <typename T>
-    static void append(EncodedMessage& buf, T& value)
-    {
-        value.encode(buf);
-    }
+// Size of a value on the wire for types with a fixed layout. Such types
+// provide EncodedSize, so messages built of them know their size at
+// compile time.
+template <typename T>
+struct FixedEncodedSize {
+    static constexpr size_t value = T::EncodedSize;
+};
 
-    template <typename T>
-    static void decode(const char* buf, size_t& offset, T& value)
-    {
-        value.decode(buf, offset);
-    }
+template <>
+struct FixedEncodedSize<int> {
+    static constexpr size_t value = 4;
+};
 
-private:
-    Encoder() = default;
+template <>
+struct FixedEncodedSize<unsigned int> {
+    static constexpr size_t value = 4;
+};
+
+template <>
+struct FixedEncodedSize<unsigned long> {
+    static constexpr size_t value = 4;
 };
\ No newline at end of file
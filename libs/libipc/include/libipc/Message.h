@@ -1,8 +1,7 @@
 #pragma once
+#include <cstddef>
 #include <sys/types.h>
-#include <vector>
 
-typedef std::vector<uint8_t> EncodedMessage;
 typedef int message_key_t;
 
 class Message {
@@ -14,5 +13,9 @@ public:
     virtual int id() const { return 0; }
     virtual message_key_t key() const { return -1; }
     virtual int reply_id() const { return -1; } // -1 means that there is no reply.
-    virtual EncodedMessage encode() const { return std::vector<uint8_t>(); }
+
+    // Messages are encoded right into the buffer of the sender, which
+    // has to have room for encoded_size() bytes.
+    virtual size_t encoded_size() const { return 0; }
+    virtual void encode(uint8_t* buf) const { }
 };
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include <libipc/Encoder.h>
 #include <libipc/Message.h>
 #include <memory>
 
@@ -7,7 +8,30 @@ public:
     MessageDecoder() = default;
     virtual ~MessageDecoder() = default;
 
+    // Every message starts with the magic of its decoder and its id. Messages
+    // of key protected decoders are followed by the key. These allow to route
+    // a message before decoding it.
+    static int peek_decoder_magic(const char* buf, size_t size)
+    {
+        return peek_int(buf, size, 0);
+    }
+
+    static message_key_t peek_key(const char* buf, size_t size)
+    {
+        return peek_int(buf, size, 2 * sizeof(uint32_t));
+    }
+
     virtual int magic() { return 0; }
     virtual std::unique_ptr<Message> decode(const char* buf, size_t size, size_t& decoded_msg_len) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const Message&) { return nullptr; }
+
+private:
+    static int peek_int(const char* buf, size_t size, size_t offset)
+    {
+        int val = -1;
+        if (size >= offset + sizeof(uint32_t)) {
+            Encoder::decode(buf, size, offset, val);
+        }
+        return val;
+    }
 };
\ No newline at end of file
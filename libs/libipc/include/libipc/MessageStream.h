@@ -0,0 +1,113 @@
+#pragma once
+#include <cstring>
+#include <errno.h>
+#include <libipc/Message.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <vector>
+
+// A connection carries a stream of bytes, so each message is sent with its
+// length in front. Messages which are split between reads are kept until the
+// rest arrives, and data which the peer can't take yet is kept until it can.
+// Both buffers are reused, so messages are encoded and decoded in place and
+// nothing is allocated once the buffers have grown to the traffic.
+// Messages are small (bitmaps go through shared buffers), so a bigger length
+// means a broken peer, and a peer which lets MaxPendingOutput pile up is
+// treated as gone instead of growing the buffer forever.
+class MessageStream {
+public:
+    static constexpr size_t HeaderSize = sizeof(uint32_t);
+    static constexpr size_t ReadChunkSize = 1024;
+    static constexpr size_t MaxMessageSize = 64 * 1024;
+    static constexpr size_t MaxPendingOutput = 256 * 1024;
+
+    explicit MessageStream(int fd)
+        : m_fd(fd)
+    {
+    }
+
+    inline int fd() const { return m_fd; }
+    inline bool has_pending_output() const { return m_out_offset < m_out.size(); }
+
+    // Returns false if the connection is broken, the message is too big or
+    // the peer has left too much unread.
+    bool send(const Message& msg)
+    {
+        uint32_t len = msg.encoded_size();
+        size_t at = m_out.size();
+        if (len > MaxMessageSize || at - m_out_offset + HeaderSize + len > MaxPendingOutput) {
+            return false;
+        }
+
+        m_out.resize(at + HeaderSize + len);
+        memcpy(&m_out.data()[at], &len, HeaderSize);
+        msg.encode(&m_out.data()[at + HeaderSize]);
+        return flush();
+    }
+
+    // Writes pending data. A blocking fd waits for the peer to read,
+    // a non-blocking one keeps the rest for the next call.
+    bool flush()
+    {
+        while (has_pending_output()) {
+            int wrote = write(m_fd, &m_out.data()[m_out_offset], m_out.size() - m_out_offset);
+            if (wrote < 0) {
+                return errno == EAGAIN;
+            }
+            m_out_offset += wrote;
+        }
+        m_out.resize(0);
+        m_out_offset = 0;
+        return true;
+    }
+
+    // Reads what is available. Returns false if the peer has closed
+    // the connection.
+    bool receive()
+    {
+        size_t buf_size = m_in.size();
+        m_in.resize(buf_size + ReadChunkSize);
+        int read_cnt = read(m_fd, &m_in.data()[buf_size], ReadChunkSize);
+        m_in.resize(buf_size + (read_cnt > 0 ? read_cnt : 0));
+        if (read_cnt < 0) {
+            return errno == EAGAIN;
+        }
+        return read_cnt > 0;
+    }
+
+    // Calls the callback with each complete message. Returns false if
+    // the stream is corrupted or announces a message over MaxMessageSize.
+    template <typename Callback>
+    bool for_each_message(Callback callback)
+    {
+        size_t offset = 0;
+        while (m_in.size() - offset >= HeaderSize) {
+            uint32_t len;
+            memcpy(&len, &m_in.data()[offset], HeaderSize);
+            if (len > MaxMessageSize) {
+                return false;
+            }
+            if (m_in.size() - offset - HeaderSize < len) {
+                break;
+            }
+
+            if (!callback(&m_in.data()[offset + HeaderSize], len)) {
+                return false;
+            }
+            offset += HeaderSize + len;
+        }
+
+        size_t remaining = m_in.size() - offset;
+        if (offset && remaining) {
+            memmove(m_in.data(), &m_in.data()[offset], remaining);
+        }
+        m_in.resize(remaining);
+        return true;
+    }
+
+private:
+    int m_fd;
+    std::vector<char> m_in;
+    std::vector<uint8_t> m_out;
+    size_t m_out_offset { 0 };
+};
\ No newline at end of file
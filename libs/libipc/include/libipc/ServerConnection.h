@@ -1,10 +1,20 @@
 #pragma once
 #include <cstdlib>
+#include <fcntl.h>
+#include <libfoundation/EventLoop.h>
 #include <libfoundation/Logger.h>
 #include <libipc/Message.h>
 #include <libipc/MessageDecoder.h>
+#include <libipc/MessageStream.h>
+#include <memory>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <vector>
 
+// Each client gets its own connection, accepted from the listening socket.
+// Clients are identified by their ids, which are used as message keys.
+// Ids are not reused, since the server keeps objects of closed clients
+// (e.g. windows) keyed by them.
 template <typename ServerDecoder, typename ClientDecoder>
 class ServerConnection {
 public:
@@ -15,51 +25,172 @@ public:
     {
     }
 
-    bool send_message(const Message& msg) const
+    // Called when the listening socket is readable.
+    void accept_client()
     {
-        auto encoded_msg = msg.encode();
-        int wrote = write(m_connection_fd, encoded_msg.data(), encoded_msg.size());
-        return wrote == encoded_msg.size();
+        m_disconnected_clients.clear();
+        int fd = accept4(m_connection_fd, nullptr, nullptr, O_NONBLOCK);
+        if (fd < 0) {
+            return;
+        }
+
+        int id = m_next_client_id++;
+        m_clients.push_back(Client { id, std::make_unique<MessageStream>(fd) });
+        LFoundation::EventLoop::the().add(
+            fd, [this, id] {
+                pump_messages(id);
+            },
+            nullptr);
     }
 
-    void pump_messages()
+    // The client being served now, valid only while its messages are handled.
+    inline int current_client_id() const { return m_current_client_id; }
+
+    // Messages are routed by their keys. The server never waits for a client:
+    // if the client does not read, the rest is sent when its socket is writable.
+    // A client which falls MessageStream::MaxPendingOutput behind is disconnected.
+    bool send_message(const Message& msg)
     {
-        std::vector<char> buf;
+        return send_message(msg.key(), msg);
+    }
 
-        char tmpbuf[1024];
+    bool send_message(int client_id, const Message& msg)
+    {
+        MessageStream* stream_ptr = find_client(client_id);
+        if (!stream_ptr) {
+            return false;
+        }
 
-        int read_cnt;
-        while ((read_cnt = read(m_connection_fd, tmpbuf, sizeof(tmpbuf)))) {
-            if (read_cnt <= 0) {
-                Logger::debug << getpid() << " :: ServerConnection read error" << std::endl;
-                return;
-            }
-            size_t buf_size = buf.size();
-            buf.resize(buf_size + read_cnt);
-            memcpy(&buf.data()[buf_size], tmpbuf, read_cnt);
-            if (read_cnt < sizeof(tmpbuf)) {
-                break;
-            }
+        auto& stream = *stream_ptr;
+        bool had_pending_output = stream.has_pending_output();
+        if (!stream.send(msg)) {
+            Logger::debug << getpid() << " :: ServerConnection dropping client " << client_id << std::endl;
+            disconnect(client_id);
+            return false;
         }
 
-        size_t msg_len = 0;
-        size_t buf_size = buf.size();
-        for (int i = 0; i < buf_size; i += msg_len) {
-            msg_len = 0;
-            if (auto response = m_server_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
-                if (auto answer = m_server_decoder.handle(*response)) {
-                    send_message(*answer);
-                }
-            } else if (auto response = m_client_decoder.decode((buf.data() + i), read_cnt - i, msg_len)) {
+        if (!had_pending_output && stream.has_pending_output()) {
+            wait_until_writable(client_id, true);
+        }
+        return true;
+    }
 
-            } else {
-                std::abort();
+    void pump_messages(int client_id)
+    {
+        m_disconnected_clients.clear();
+        MessageStream* stream_ptr = find_client(client_id);
+        if (!stream_ptr) {
+            return;
+        }
+
+        auto& stream = *stream_ptr;
+        if (!stream.receive()) {
+            disconnect(client_id);
+            return;
+        }
+
+        m_current_client_id = client_id;
+        bool valid = stream.for_each_message([this, client_id](const char* buf, size_t size) {
+            // Requests are handled right in the read buffer. Messages for
+            // the client decoder are not expected here and are skipped.
+            int magic = MessageDecoder::peek_decoder_magic(buf, size);
+            if (magic == m_server_decoder.magic()) {
+                std::unique_ptr<Message> answer;
+                if (!m_server_decoder.decode_and_handle(buf, size, answer)) {
+                    return false;
+                }
+                if (answer) {
+                    send_message(client_id, *answer);
+                }
+            } else if (magic != m_client_decoder.magic()) {
+                return false;
             }
+            // The client could be disconnected while sending the answer.
+            return find_client(client_id) != nullptr;
+        });
+        m_current_client_id = -1;
+
+        if (!valid && find_client(client_id)) {
+            Logger::debug << getpid() << " :: ServerConnection read error from " << client_id << std::endl;
+            disconnect(client_id);
         }
     }
 
 private:
+    struct Client {
+        int id;
+        std::unique_ptr<MessageStream> stream;
+    };
+
+    // There are a few clients, so they are looked up linearly.
+    int find_client_index(int client_id) const
+    {
+        for (int i = 0; i < m_clients.size(); i++) {
+            if (m_clients[i].id == client_id) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    MessageStream* find_client(int client_id) const
+    {
+        int index = find_client_index(client_id);
+        return index < 0 ? nullptr : m_clients[index].stream.get();
+    }
+
+    void wait_until_writable(int client_id, bool wait)
+    {
+        int fd = find_client(client_id)->fd();
+        if (wait) {
+            LFoundation::EventLoop::the().update(
+                fd, [this, client_id] { pump_messages(client_id); },
+                [this, client_id] { flush(client_id); });
+        } else {
+            LFoundation::EventLoop::the().update(
+                fd, [this, client_id] { pump_messages(client_id); },
+                nullptr);
+        }
+    }
+
+    void flush(int client_id)
+    {
+        MessageStream* stream_ptr = find_client(client_id);
+        if (!stream_ptr) {
+            return;
+        }
+
+        auto& stream = *stream_ptr;
+        if (!stream.flush()) {
+            disconnect(client_id);
+            return;
+        }
+        if (!stream.has_pending_output()) {
+            wait_until_writable(client_id, false);
+        }
+    }
+
+    void disconnect(int client_id)
+    {
+        // Keeps the stream alive till the next pump, since its messages
+        // could be handled now.
+        int index = find_client_index(client_id);
+        std::unique_ptr<MessageStream> stream = std::move(m_clients[index].stream);
+        if (index != m_clients.size() - 1) {
+            m_clients[index] = std::move(m_clients.back());
+        }
+        m_clients.pop_back();
+
+        LFoundation::EventLoop::the().remove(stream->fd());
+        close(stream->fd());
+        m_disconnected_clients.push_back(std::move(stream));
+    }
+
     int m_connection_fd;
+    int m_current_client_id { -1 };
+    int m_next_client_id { 1 };
+    std::vector<Client> m_clients;
+    std::vector<std::unique_ptr<MessageStream>> m_disconnected_clients;
     ServerDecoder& m_server_decoder;
     ClientDecoder& m_client_decoder;
 };
\ No newline at end of file
@@ -18,8 +18,8 @@ public:
 
     template <class T>
     inline std::unique_ptr<T> send_sync_message(const Message& msg) { return std::unique_ptr<T>(m_connection_with_server.send_sync(msg)); }
-    inline bool send_async_message(const Message& msg) const { return m_connection_with_server.send_message(msg); }
-    inline void listen() { m_connection_with_server.pump_messages(); }
+    inline bool send_async_message(const Message& msg) { return m_connection_with_server.send_message(msg); }
+    void listen();
 
     // We use connection id as an unique key.
     inline int key() const { return m_connection_id; }
@@ -6,6 +6,7 @@
 
 #pragma once
 #include <libg/Context.h>
+#include <vector>
 
 namespace UI {
 
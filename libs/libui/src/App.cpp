@@ -26,7 +26,7 @@ void App::receive_event(std::unique_ptr<LFoundation::Event> event)
         WindowCloseRequestEvent& own_event = *(WindowCloseRequestEvent*)event.get();
         auto message = DestroyWindowMessage(m_server_connection.key(), own_event.window_id());
         auto reply = m_server_connection.send_sync_message<DestroyWindowMessageReply>(message);
-        m_event_loop.stop(reply->status());
+        m_event_loop.stop(reply ? reply->status() : -1);
     }
 }
 
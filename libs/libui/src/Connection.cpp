@@ -10,8 +10,8 @@
 #include <libui/Window.h>
 #include <memory>
 #include <new>
-#include <sched.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 // #define DEBUG_CONNECTION
 
@@ -37,13 +37,13 @@ Connection::Connection(int connection_fd)
     s_the = this;
     if (m_connection_fd > 0) {
         bool connected = false;
-        // Trying to connect for 100 times. If unsuccesfull, it crashes.
+        // Trying to connect for 100 times, 10ms apart. If unsuccesfull, it crashes.
         for (int i = 0; i < 100; i++) {
             if (connect(m_connection_fd, "/tmp/win.sock", 13) == 0) {
                 connected = true;
                 break;
             }
-            sched_yield();
+            usleep(10000);
         }
         if (!connected) {
             goto crash;
@@ -66,9 +66,21 @@ void Connection::setup_listners()
         nullptr);
 }
 
+// The app can't work without the window server, so it quits once the
+// connection is lost.
+void Connection::listen()
+{
+    if (!m_connection_with_server.pump_messages()) {
+        LFoundation::EventLoop::the().stop(-1);
+    }
+}
+
 void Connection::greeting()
 {
     auto resp_message = send_sync_message<GreetMessageReply>(GreetMessage(getpid()));
+    if (!resp_message) {
+        exit(-1);
+    }
     m_connection_id = resp_message->connection_id();
     m_connection_with_server.set_accepted_key(m_connection_id);
 #ifdef DEBUG_CONNECTION
@@ -80,6 +92,9 @@ int Connection::new_window(const Window& window)
 {
     auto message = CreateWindowMessage(key(), window.type(), window.bounds().width(), window.bounds().height(), window.buffer().id(), window.icon_path());
     auto resp_message = send_sync_message<CreateWindowMessageReply>(message);
+    if (!resp_message) {
+        return -1;
+    }
 #ifdef DEBUG_CONNECTION
     Logger::debug << "New window created" << std::endl;
 #endif
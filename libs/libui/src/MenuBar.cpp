@@ -23,7 +23,9 @@ Menu& MenuBar::add_menu(LG::string&& title)
     Menu* new_menu = new Menu(*this, std::move(title));
     auto& connection = App::the().connection();
     auto resp_message = connection.send_sync_message<MenuBarCreateMenuMessageReply>(MenuBarCreateMenuMessage(connection.key(), m_host_window_id, new_menu->title()));
-    new_menu->set_menu_id(resp_message->menu_id());
+    if (resp_message) {
+        new_menu->set_menu_id(resp_message->menu_id());
+    }
     m_menus.push_back(new_menu);
     return *new_menu;
 }
@@ -19,13 +19,13 @@ public:
     int reply_id() const override { return 2; }
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t);
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
     }
 
 private:
@@ -44,14 +44,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t connection_id() const { return m_connection_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_connection_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_connection_id);
     }
 
 private:
@@ -79,18 +79,17 @@ public:
     uint32_t height() const { return m_height; }
     int buffer_id() const { return m_buffer_id; }
     LG::string icon_path() const { return m_icon_path; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_type) + Encoder::encoded_size(m_width) + Encoder::encoded_size(m_height) + Encoder::encoded_size(m_buffer_id) + Encoder::encoded_size(m_icon_path); }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_type);
-        Encoder::append(buffer, m_width);
-        Encoder::append(buffer, m_height);
-        Encoder::append(buffer, m_buffer_id);
-        Encoder::append(buffer, m_icon_path);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_type);
+        Encoder::append(buf, m_width);
+        Encoder::append(buf, m_height);
+        Encoder::append(buf, m_buffer_id);
+        Encoder::append(buf, m_icon_path);
     }
 
 private:
@@ -114,14 +113,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
     }
 
 private:
@@ -141,14 +140,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
     }
 
 private:
@@ -168,14 +167,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     uint32_t status() const { return m_status; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_status);
     }
 
 private:
@@ -201,17 +200,17 @@ public:
     int buffer_id() const { return m_buffer_id; }
     int format() const { return m_format; }
     LG::Rect bounds() const { return m_bounds; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value + FixedEncodedSize<LG::Rect>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_buffer_id);
-        Encoder::append(buffer, m_format);
-        Encoder::append(buffer, m_bounds);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_buffer_id);
+        Encoder::append(buf, m_format);
+        Encoder::append(buf, m_bounds);
     }
 
 private:
@@ -238,16 +237,16 @@ public:
     uint32_t window_id() const { return m_window_id; }
     uint32_t color() const { return m_color; }
     int text_style() const { return m_text_style; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_color);
-        Encoder::append(buffer, m_text_style);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_color);
+        Encoder::append(buf, m_text_style);
     }
 
 private:
@@ -271,15 +270,14 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_title); }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_title);
     }
 
 private:
@@ -302,15 +300,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<LG::Rect>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_rect);
     }
 
 private:
@@ -333,15 +331,15 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     uint32_t target_window_id() const { return m_target_window_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_target_window_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_target_window_id);
     }
 
 private:
@@ -364,15 +362,14 @@ public:
     int decoder_magic() const override { return 320; }
     uint32_t window_id() const { return m_window_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_title); }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_title);
     }
 
 private:
@@ -395,15 +392,15 @@ public:
     int decoder_magic() const override { return 320; }
     int status() const { return m_status; }
     uint32_t menu_id() const { return m_menu_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        Encoder::append(buffer, m_menu_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_status);
+        Encoder::append(buf, m_menu_id);
     }
 
 private:
@@ -430,17 +427,16 @@ public:
     uint32_t menu_id() const { return m_menu_id; }
     int item_id() const { return m_item_id; }
     LG::string title() const { return m_title; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_window_id) + Encoder::encoded_size(m_menu_id) + Encoder::encoded_size(m_item_id) + Encoder::encoded_size(m_title); }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_window_id);
-        Encoder::append(buffer, m_menu_id);
-        Encoder::append(buffer, m_item_id);
-        Encoder::append(buffer, m_title);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_window_id);
+        Encoder::append(buf, m_menu_id);
+        Encoder::append(buf, m_item_id);
+        Encoder::append(buf, m_title);
     }
 
 private:
@@ -463,14 +459,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 320; }
     int status() const { return m_status; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_status);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_status);
     }
 
 private:
@@ -486,14 +482,14 @@ public:
     {
         int msg_id, decoder_magic;
         size_t saved_dml = decoded_msg_len;
-        Encoder::decode(buf, decoded_msg_len, decoder_magic);
-        Encoder::decode(buf, decoded_msg_len, msg_id);
+        Encoder::decode(buf, size, decoded_msg_len, decoder_magic);
+        Encoder::decode(buf, size, decoded_msg_len, msg_id);
         if (magic() != decoder_magic) {
             decoded_msg_len = saved_dml;
             return nullptr;
         }
         message_key_t secret_key;
-        Encoder::decode(buf, decoded_msg_len, secret_key);
+        Encoder::decode(buf, size, decoded_msg_len, secret_key);
 
         uint32_t var_connection_id;
         int var_type;
@@ -517,63 +513,63 @@ public:
         case 1:
             return new GreetMessage(secret_key);
         case 2:
-            Encoder::decode(buf, decoded_msg_len, var_connection_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_connection_id);
             return new GreetMessageReply(secret_key, var_connection_id);
         case 3:
-            Encoder::decode(buf, decoded_msg_len, var_type);
-            Encoder::decode(buf, decoded_msg_len, var_width);
-            Encoder::decode(buf, decoded_msg_len, var_height);
-            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
-            Encoder::decode(buf, decoded_msg_len, var_icon_path);
+            Encoder::decode(buf, size, decoded_msg_len, var_type);
+            Encoder::decode(buf, size, decoded_msg_len, var_width);
+            Encoder::decode(buf, size, decoded_msg_len, var_height);
+            Encoder::decode(buf, size, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_icon_path);
             return new CreateWindowMessage(secret_key, var_type, var_width, var_height, var_buffer_id, var_icon_path);
         case 4:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
             return new CreateWindowMessageReply(secret_key, var_window_id);
         case 5:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
             return new DestroyWindowMessage(secret_key, var_window_id);
         case 6:
-            Encoder::decode(buf, decoded_msg_len, var_status);
+            Encoder::decode(buf, size, decoded_msg_len, var_status);
             return new DestroyWindowMessageReply(secret_key, var_status);
         case 7:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_buffer_id);
-            Encoder::decode(buf, decoded_msg_len, var_format);
-            Encoder::decode(buf, decoded_msg_len, var_bounds);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_buffer_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_format);
+            Encoder::decode(buf, size, decoded_msg_len, var_bounds);
             return new SetBufferMessage(secret_key, var_window_id, var_buffer_id, var_format, var_bounds);
         case 8:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_color);
-            Encoder::decode(buf, decoded_msg_len, var_text_style);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_color);
+            Encoder::decode(buf, size, decoded_msg_len, var_text_style);
             return new SetBarStyleMessage(secret_key, var_window_id, var_color, var_text_style);
         case 9:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_title);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_title);
             return new SetTitleMessage(secret_key, var_window_id, var_title);
         case 10:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_rect);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_rect);
             return new InvalidateMessage(secret_key, var_window_id, var_rect);
         case 11:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_target_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_target_window_id);
             return new AskBringToFrontMessage(secret_key, var_window_id, var_target_window_id);
         case 12:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_title);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_title);
             return new MenuBarCreateMenuMessage(secret_key, var_window_id, var_title);
         case 13:
-            Encoder::decode(buf, decoded_msg_len, var_status);
-            Encoder::decode(buf, decoded_msg_len, var_menu_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_status);
+            Encoder::decode(buf, size, decoded_msg_len, var_menu_id);
             return new MenuBarCreateMenuMessageReply(secret_key, var_status, var_menu_id);
         case 14:
-            Encoder::decode(buf, decoded_msg_len, var_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_menu_id);
-            Encoder::decode(buf, decoded_msg_len, var_item_id);
-            Encoder::decode(buf, decoded_msg_len, var_title);
+            Encoder::decode(buf, size, decoded_msg_len, var_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_menu_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_item_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_title);
             return new MenuBarCreateItemMessage(secret_key, var_window_id, var_menu_id, var_item_id, var_title);
         case 15:
-            Encoder::decode(buf, decoded_msg_len, var_status);
+            Encoder::decode(buf, size, decoded_msg_len, var_status);
             return new MenuBarCreateItemMessageReply(secret_key, var_status);
         default:
             decoded_msg_len = saved_dml;
@@ -581,6 +577,139 @@ public:
         }
     }
 
+    // Decodes the message in place and passes it to its handler. Nothing is
+    // allocated unless the handler answers. Returns false if the message is
+    // not for this decoder or is malformed.
+    bool decode_and_handle(const char* buf, size_t size, std::unique_ptr<Message>& answer)
+    {
+        if (size < 3 * sizeof(uint32_t)) {
+            return false;
+        }
+
+        size_t offset = 0;
+        int msg_id, decoder_magic;
+        Encoder::decode(buf, size, offset, decoder_magic);
+        Encoder::decode(buf, size, offset, msg_id);
+        if (magic() != decoder_magic) {
+            return false;
+        }
+        message_key_t secret_key;
+        Encoder::decode(buf, size, offset, secret_key);
+
+        switch (msg_id) {
+        case 1: {
+            if (size != GreetMessage::EncodedSize) {
+                return false;
+            }
+            answer = handle(GreetMessage(secret_key));
+            return true;
+        }
+        case 3: {
+            int var_type;
+            Encoder::decode(buf, size, offset, var_type);
+            uint32_t var_width;
+            Encoder::decode(buf, size, offset, var_width);
+            uint32_t var_height;
+            Encoder::decode(buf, size, offset, var_height);
+            int var_buffer_id;
+            Encoder::decode(buf, size, offset, var_buffer_id);
+            LG::string var_icon_path;
+            Encoder::decode(buf, size, offset, var_icon_path);
+            answer = handle(CreateWindowMessage(secret_key, var_type, var_width, var_height, var_buffer_id, var_icon_path));
+            return true;
+        }
+        case 5: {
+            if (size != DestroyWindowMessage::EncodedSize) {
+                return false;
+            }
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            answer = handle(DestroyWindowMessage(secret_key, var_window_id));
+            return true;
+        }
+        case 7: {
+            if (size != SetBufferMessage::EncodedSize) {
+                return false;
+            }
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            int var_buffer_id;
+            Encoder::decode(buf, size, offset, var_buffer_id);
+            int var_format;
+            Encoder::decode(buf, size, offset, var_format);
+            LG::Rect var_bounds;
+            Encoder::decode(buf, size, offset, var_bounds);
+            answer = handle(SetBufferMessage(secret_key, var_window_id, var_buffer_id, var_format, var_bounds));
+            return true;
+        }
+        case 8: {
+            if (size != SetBarStyleMessage::EncodedSize) {
+                return false;
+            }
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            uint32_t var_color;
+            Encoder::decode(buf, size, offset, var_color);
+            int var_text_style;
+            Encoder::decode(buf, size, offset, var_text_style);
+            answer = handle(SetBarStyleMessage(secret_key, var_window_id, var_color, var_text_style));
+            return true;
+        }
+        case 9: {
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            LG::string var_title;
+            Encoder::decode(buf, size, offset, var_title);
+            answer = handle(SetTitleMessage(secret_key, var_window_id, var_title));
+            return true;
+        }
+        case 10: {
+            if (size != InvalidateMessage::EncodedSize) {
+                return false;
+            }
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            LG::Rect var_rect;
+            Encoder::decode(buf, size, offset, var_rect);
+            answer = handle(InvalidateMessage(secret_key, var_window_id, var_rect));
+            return true;
+        }
+        case 11: {
+            if (size != AskBringToFrontMessage::EncodedSize) {
+                return false;
+            }
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            uint32_t var_target_window_id;
+            Encoder::decode(buf, size, offset, var_target_window_id);
+            answer = handle(AskBringToFrontMessage(secret_key, var_window_id, var_target_window_id));
+            return true;
+        }
+        case 12: {
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            LG::string var_title;
+            Encoder::decode(buf, size, offset, var_title);
+            answer = handle(MenuBarCreateMenuMessage(secret_key, var_window_id, var_title));
+            return true;
+        }
+        case 14: {
+            uint32_t var_window_id;
+            Encoder::decode(buf, size, offset, var_window_id);
+            uint32_t var_menu_id;
+            Encoder::decode(buf, size, offset, var_menu_id);
+            int var_item_id;
+            Encoder::decode(buf, size, offset, var_item_id);
+            LG::string var_title;
+            Encoder::decode(buf, size, offset, var_title);
+            answer = handle(MenuBarCreateItemMessage(secret_key, var_window_id, var_menu_id, var_item_id, var_title));
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
     std::unique_ptr<Message> handle(const Message& msg) override
     {
         if (magic() != msg.decoder_magic()) {
@@ -641,16 +770,16 @@ public:
     int win_id() const { return m_win_id; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_x);
+        Encoder::append(buf, m_y);
     }
 
 private:
@@ -678,17 +807,17 @@ public:
     int type() const { return m_type; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_type);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_type);
+        Encoder::append(buf, m_x);
+        Encoder::append(buf, m_y);
     }
 
 private:
@@ -715,16 +844,16 @@ public:
     int win_id() const { return m_win_id; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_x);
+        Encoder::append(buf, m_y);
     }
 
 private:
@@ -752,17 +881,17 @@ public:
     int wheel_data() const { return m_wheel_data; }
     uint32_t x() const { return m_x; }
     uint32_t y() const { return m_y; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_wheel_data);
-        Encoder::append(buffer, m_x);
-        Encoder::append(buffer, m_y);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_wheel_data);
+        Encoder::append(buf, m_x);
+        Encoder::append(buf, m_y);
     }
 
 private:
@@ -787,15 +916,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     uint32_t kbd_key() const { return m_kbd_key; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<uint32_t>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_kbd_key);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_kbd_key);
     }
 
 private:
@@ -816,14 +945,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<LG::Rect>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_rect);
     }
 
 private:
@@ -843,14 +972,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
     }
 
 private:
@@ -872,15 +1001,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     LG::Rect rect() const { return m_rect; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<LG::Rect>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_rect);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_rect);
     }
 
 private:
@@ -901,14 +1030,14 @@ public:
     int key() const override { return m_key; }
     int decoder_magic() const override { return 737; }
     int reason() const { return m_reason; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_reason);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_reason);
     }
 
 private:
@@ -930,15 +1059,15 @@ public:
     int decoder_magic() const override { return 737; }
     int win_id() const { return m_win_id; }
     int item_id() const { return m_item_id; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_item_id);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_item_id);
     }
 
 private:
@@ -963,16 +1092,16 @@ public:
     int win_id() const { return m_win_id; }
     int changed_window_id() const { return m_changed_window_id; }
     int type() const { return m_type; }
-    EncodedMessage encode() const override
+    static constexpr size_t EncodedSize = 3 * sizeof(uint32_t) + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value + FixedEncodedSize<int>::value;
+    size_t encoded_size() const override { return EncodedSize; }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_changed_window_id);
-        Encoder::append(buffer, m_type);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_changed_window_id);
+        Encoder::append(buf, m_type);
     }
 
 private:
@@ -998,16 +1127,15 @@ public:
     int win_id() const { return m_win_id; }
     int changed_window_id() const { return m_changed_window_id; }
     LG::string icon_path() const { return m_icon_path; }
-    EncodedMessage encode() const override
+    size_t encoded_size() const override { return 3 * sizeof(uint32_t) + Encoder::encoded_size(m_win_id) + Encoder::encoded_size(m_changed_window_id) + Encoder::encoded_size(m_icon_path); }
+    void encode(uint8_t* buf) const override
     {
-        EncodedMessage buffer;
-        Encoder::append(buffer, decoder_magic());
-        Encoder::append(buffer, id());
-        Encoder::append(buffer, key());
-        Encoder::append(buffer, m_win_id);
-        Encoder::append(buffer, m_changed_window_id);
-        Encoder::append(buffer, m_icon_path);
-        return buffer;
+        Encoder::append(buf, decoder_magic());
+        Encoder::append(buf, id());
+        Encoder::append(buf, key());
+        Encoder::append(buf, m_win_id);
+        Encoder::append(buf, m_changed_window_id);
+        Encoder::append(buf, m_icon_path);
     }
 
 private:
@@ -1025,14 +1153,14 @@ public:
     {
         int msg_id, decoder_magic;
         size_t saved_dml = decoded_msg_len;
-        Encoder::decode(buf, decoded_msg_len, decoder_magic);
-        Encoder::decode(buf, decoded_msg_len, msg_id);
+        Encoder::decode(buf, size, decoded_msg_len, decoder_magic);
+        Encoder::decode(buf, size, decoded_msg_len, msg_id);
         if (magic() != decoder_magic) {
             decoded_msg_len = saved_dml;
             return nullptr;
         }
         message_key_t secret_key;
-        Encoder::decode(buf, decoded_msg_len, secret_key);
+        Encoder::decode(buf, size, decoded_msg_len, secret_key);
 
         int var_win_id;
         uint32_t var_x;
@@ -1048,57 +1176,57 @@ public:
 
         switch (msg_id) {
         case 1:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_x);
-            Encoder::decode(buf, decoded_msg_len, var_y);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_x);
+            Encoder::decode(buf, size, decoded_msg_len, var_y);
             return new MouseMoveMessage(secret_key, var_win_id, var_x, var_y);
         case 2:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_type);
-            Encoder::decode(buf, decoded_msg_len, var_x);
-            Encoder::decode(buf, decoded_msg_len, var_y);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_type);
+            Encoder::decode(buf, size, decoded_msg_len, var_x);
+            Encoder::decode(buf, size, decoded_msg_len, var_y);
             return new MouseActionMessage(secret_key, var_win_id, var_type, var_x, var_y);
         case 3:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_x);
-            Encoder::decode(buf, decoded_msg_len, var_y);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_x);
+            Encoder::decode(buf, size, decoded_msg_len, var_y);
             return new MouseLeaveMessage(secret_key, var_win_id, var_x, var_y);
         case 4:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_wheel_data);
-            Encoder::decode(buf, decoded_msg_len, var_x);
-            Encoder::decode(buf, decoded_msg_len, var_y);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_wheel_data);
+            Encoder::decode(buf, size, decoded_msg_len, var_x);
+            Encoder::decode(buf, size, decoded_msg_len, var_y);
             return new MouseWheelMessage(secret_key, var_win_id, var_wheel_data, var_x, var_y);
         case 5:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_kbd_key);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_kbd_key);
             return new KeyboardMessage(secret_key, var_win_id, var_kbd_key);
         case 6:
-            Encoder::decode(buf, decoded_msg_len, var_rect);
+            Encoder::decode(buf, size, decoded_msg_len, var_rect);
             return new DisplayMessage(secret_key, var_rect);
         case 7:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
             return new WindowCloseRequestMessage(secret_key, var_win_id);
         case 8:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_rect);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_rect);
             return new ResizeMessage(secret_key, var_win_id, var_rect);
         case 9:
-            Encoder::decode(buf, decoded_msg_len, var_reason);
+            Encoder::decode(buf, size, decoded_msg_len, var_reason);
             return new DisconnectMessage(secret_key, var_reason);
         case 10:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_item_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_item_id);
             return new MenuBarActionMessage(secret_key, var_win_id, var_item_id);
         case 11:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_changed_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_type);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_changed_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_type);
             return new NotifyWindowStatusChangedMessage(secret_key, var_win_id, var_changed_window_id, var_type);
         case 12:
-            Encoder::decode(buf, decoded_msg_len, var_win_id);
-            Encoder::decode(buf, decoded_msg_len, var_changed_window_id);
-            Encoder::decode(buf, decoded_msg_len, var_icon_path);
+            Encoder::decode(buf, size, decoded_msg_len, var_win_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_changed_window_id);
+            Encoder::decode(buf, size, decoded_msg_len, var_icon_path);
             return new NotifyWindowIconChangedMessage(secret_key, var_win_id, var_changed_window_id, var_icon_path);
         default:
             decoded_msg_len = saved_dml;
@@ -1106,6 +1234,170 @@ public:
         }
     }
 
+    // Decodes the message in place and passes it to its handler. Nothing is
+    // allocated unless the handler answers. Returns false if the message is
+    // not for this decoder or is malformed.
+    bool decode_and_handle(const char* buf, size_t size, std::unique_ptr<Message>& answer)
+    {
+        if (size < 3 * sizeof(uint32_t)) {
+            return false;
+        }
+
+        size_t offset = 0;
+        int msg_id, decoder_magic;
+        Encoder::decode(buf, size, offset, decoder_magic);
+        Encoder::decode(buf, size, offset, msg_id);
+        if (magic() != decoder_magic) {
+            return false;
+        }
+        message_key_t secret_key;
+        Encoder::decode(buf, size, offset, secret_key);
+
+        switch (msg_id) {
+        case 1: {
+            if (size != MouseMoveMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            uint32_t var_x;
+            Encoder::decode(buf, size, offset, var_x);
+            uint32_t var_y;
+            Encoder::decode(buf, size, offset, var_y);
+            answer = handle(MouseMoveMessage(secret_key, var_win_id, var_x, var_y));
+            return true;
+        }
+        case 2: {
+            if (size != MouseActionMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            int var_type;
+            Encoder::decode(buf, size, offset, var_type);
+            uint32_t var_x;
+            Encoder::decode(buf, size, offset, var_x);
+            uint32_t var_y;
+            Encoder::decode(buf, size, offset, var_y);
+            answer = handle(MouseActionMessage(secret_key, var_win_id, var_type, var_x, var_y));
+            return true;
+        }
+        case 3: {
+            if (size != MouseLeaveMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            uint32_t var_x;
+            Encoder::decode(buf, size, offset, var_x);
+            uint32_t var_y;
+            Encoder::decode(buf, size, offset, var_y);
+            answer = handle(MouseLeaveMessage(secret_key, var_win_id, var_x, var_y));
+            return true;
+        }
+        case 4: {
+            if (size != MouseWheelMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            int var_wheel_data;
+            Encoder::decode(buf, size, offset, var_wheel_data);
+            uint32_t var_x;
+            Encoder::decode(buf, size, offset, var_x);
+            uint32_t var_y;
+            Encoder::decode(buf, size, offset, var_y);
+            answer = handle(MouseWheelMessage(secret_key, var_win_id, var_wheel_data, var_x, var_y));
+            return true;
+        }
+        case 5: {
+            if (size != KeyboardMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            uint32_t var_kbd_key;
+            Encoder::decode(buf, size, offset, var_kbd_key);
+            answer = handle(KeyboardMessage(secret_key, var_win_id, var_kbd_key));
+            return true;
+        }
+        case 6: {
+            if (size != DisplayMessage::EncodedSize) {
+                return false;
+            }
+            LG::Rect var_rect;
+            Encoder::decode(buf, size, offset, var_rect);
+            answer = handle(DisplayMessage(secret_key, var_rect));
+            return true;
+        }
+        case 7: {
+            if (size != WindowCloseRequestMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            answer = handle(WindowCloseRequestMessage(secret_key, var_win_id));
+            return true;
+        }
+        case 8: {
+            if (size != ResizeMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            LG::Rect var_rect;
+            Encoder::decode(buf, size, offset, var_rect);
+            answer = handle(ResizeMessage(secret_key, var_win_id, var_rect));
+            return true;
+        }
+        case 9: {
+            if (size != DisconnectMessage::EncodedSize) {
+                return false;
+            }
+            int var_reason;
+            Encoder::decode(buf, size, offset, var_reason);
+            answer = handle(DisconnectMessage(secret_key, var_reason));
+            return true;
+        }
+        case 10: {
+            if (size != MenuBarActionMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            int var_item_id;
+            Encoder::decode(buf, size, offset, var_item_id);
+            answer = handle(MenuBarActionMessage(secret_key, var_win_id, var_item_id));
+            return true;
+        }
+        case 11: {
+            if (size != NotifyWindowStatusChangedMessage::EncodedSize) {
+                return false;
+            }
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            int var_changed_window_id;
+            Encoder::decode(buf, size, offset, var_changed_window_id);
+            int var_type;
+            Encoder::decode(buf, size, offset, var_type);
+            answer = handle(NotifyWindowStatusChangedMessage(secret_key, var_win_id, var_changed_window_id, var_type));
+            return true;
+        }
+        case 12: {
+            int var_win_id;
+            Encoder::decode(buf, size, offset, var_win_id);
+            int var_changed_window_id;
+            Encoder::decode(buf, size, offset, var_changed_window_id);
+            LG::string var_icon_path;
+            Encoder::decode(buf, size, offset, var_icon_path);
+            answer = handle(NotifyWindowIconChangedMessage(secret_key, var_win_id, var_changed_window_id, var_icon_path));
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
     std::unique_ptr<Message> handle(const Message& msg) override
     {
         if (magic() != msg.decoder_magic()) {
@@ -1155,3 +1447,4 @@ public:
     virtual std::unique_ptr<Message> handle(const NotifyWindowStatusChangedMessage& msg) { return nullptr; }
     virtual std::unique_ptr<Message> handle(const NotifyWindowIconChangedMessage& msg) { return nullptr; }
 };
+
@@ -56,24 +56,17 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
 
 [[gnu::flatten]] void Compositor::refresh()
 {
-    if (m_invalidated_areas.size() == 0) {
+    if (m_invalidated_areas.empty()) {
         return;
     }
 
     auto& screen = Screen::the();
     auto& wm = WindowManager::the();
-    auto invalidated_areas = std::move(m_invalidated_areas);
+    LG::Region invalidated_region = std::move(m_invalidated_areas);
+    invalidated_region.intersect(screen.bounds());
+    auto& invalidated_areas = invalidated_region.rects();
     LG::Context ctx(screen.write_bitmap());
 
-    auto is_window_area_invalidated = [&](const std::vector<LG::Rect>& areas, const LG::Rect& area) -> bool {
-        for (int i = 0; i < areas.size(); i++) {
-            if (area.intersects(areas[i])) {
-                return true;
-            }
-        }
-        return false;
-    };
-
     auto draw_wallpaper_for_area = [&](const LG::Rect& area) {
         ctx.add_clip(area);
         ctx.draw({ 0, 0 }, m_resource_manager.background());
@@ -98,8 +91,25 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
 #endif // TARGET_DESKTOP
 
 #ifdef TARGET_DESKTOP
-    for (int i = 0; i < invalidated_areas.size(); i++) {
-        draw_wallpaper_for_area(invalidated_areas[i]);
+    // Windows are walked from the top one down. Each window gets the damaged
+    // area which is still uncovered and then hides its opaque part from the
+    // windows below, so the wallpaper is drawn only where nothing covers it
+    // and opaque pixels are drawn once.
+    auto& windows = wm.windows();
+    LG::Region uncovered = invalidated_region;
+    std::vector<LG::Region> window_areas;
+    for (auto it = windows.begin(); it != windows.end(); it++) {
+        auto& window = *(*it);
+        if (!window.visible() || !uncovered.intersects(window.bounds())) {
+            window_areas.push_back(LG::Region());
+            continue;
+        }
+        window_areas.push_back(uncovered.intersection(window.bounds()));
+        uncovered.subtract(window.opaque_region());
+    }
+
+    for (int i = 0; i < uncovered.rects().size(); i++) {
+        draw_wallpaper_for_area(uncovered.rects()[i]);
     }
 #elif TARGET_MOBILE
     // Draw wallpaper only in case when WM contains only homescreen app.
@@ -110,21 +120,22 @@ void Compositor::copy_changes_to_second_buffer(const std::vector<LG::Rect>& area
     }
 #endif // TARGET_DESKTOP
 
-    auto& windows = wm.windows();
 #ifdef TARGET_DESKTOP
-    for (auto it = windows.rbegin(); it != windows.rend(); it++) {
+    // Back to front, since translucent parts are blended with what is below.
+    int window_index = window_areas.size() - 1;
+    for (auto it = windows.rbegin(); it != windows.rend(); it++, window_index--) {
         auto& window = *(*it);
-        if (window.visible() && is_window_area_invalidated(invalidated_areas, window.bounds())) {
-            for (int i = 0; i < invalidated_areas.size(); i++) {
-                draw_window(window, invalidated_areas[i]);
-            }
+        auto& areas = window_areas[window_index].rects();
+        for (int i = 0; i < areas.size(); i++) {
+            draw_window(window, areas[i]);
         }
     }
 #elif TARGET_MOBILE
     // Draw wallpaper only in case when WM contains homescreen app.
+    auto& windows = wm.windows();
     if (windows.begin() != windows.end()) {
         auto& window = *(*windows.begin());
-        if (is_window_area_invalidated(invalidated_areas, window.bounds())) {
+        if (invalidated_region.intersects(window.bounds())) {
             for (int i = 0; i < invalidated_areas.size(); i++) {
                 draw_window(window, invalidated_areas[i]);
             }
@@ -7,6 +7,7 @@
 #pragma once
 #include "../shared/Connections/WSConnection.h"
 #include "ServerDecoder.h"
+#include <libg/Region.h>
 #include <libipc/ServerConnection.h>
 #include <vector>
 
@@ -32,42 +33,7 @@ public:
 
     void refresh();
 
-    void optimized_invalidate_insert(std::vector<LG::Rect>& data, const LG::Rect& inv_area)
-    {
-        auto area = inv_area;
-        bool intersects = false;
-        int int_index = 0;
-        for (auto& rect : data) {
-            if (rect.contains(area)) {
-                return;
-            }
-        }
-
-        for (auto& rect : data) {
-            if (rect.intersects(area)) {
-                intersects = true;
-                break;
-            }
-            int_index++;
-        }
-
-        if (!intersects) {
-            data.push_back(area);
-            return;
-        }
-
-        data[int_index].unite(area);
-        for (int i = int_index + 1; i < data.size(); i++) {
-            if (data[int_index].intersects(data[i])) {
-                data[int_index].unite(data[i]);
-                std::swap(data[i], data.back());
-                data.pop_back();
-                i--;
-            }
-        }
-    }
-
-    inline void invalidate(const LG::Rect& area) { optimized_invalidate_insert(m_invalidated_areas, area); }
+    inline void invalidate(const LG::Rect& area) { m_invalidated_areas.unite(area); }
     inline CursorManager& cursor_manager() { return m_cursor_manager; }
     inline const CursorManager& cursor_manager() const { return m_cursor_manager; }
     inline ResourceManager& resource_manager() { return m_resource_manager; }
@@ -87,7 +53,9 @@ public:
 private:
     void copy_changes_to_second_buffer(const std::vector<LG::Rect>& areas);
 
-    std::vector<LG::Rect> m_invalidated_areas;
+    // Damaged parts of the screen, kept as a region, so overlapping
+    // invalidations are redrawn only once.
+    LG::Region m_invalidated_areas;
     MenuBar& m_menu_bar;
     Popup& m_popup;
     CursorManager& m_cursor_manager;
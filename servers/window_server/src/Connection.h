@@ -24,16 +24,16 @@ public:
 
     inline void listen()
     {
-        m_connection_with_clients.pump_messages();
+        m_connection_with_clients.accept_client();
     }
 
-    inline bool send_async_message(const Message& msg) const { return m_connection_with_clients.send_message(msg); }
-    inline int alloc_connection() { return ++m_connections_number; }
+    inline bool send_async_message(const Message& msg) { return m_connection_with_clients.send_message(msg); }
+    // Each client has its own socket, so the id of the socket is used as the connection id.
+    inline int current_connection_id() const { return m_connection_with_clients.current_client_id(); }
     void receive_event(std::unique_ptr<LFoundation::Event> event) override;
 
 private:
     int m_connection_fd;
-    int m_connections_number { 0 };
     ServerConnection<WindowServerDecoder, BaseWindowClientDecoder> m_connection_with_clients;
     WindowServerDecoder m_server_decoder;
     BaseWindowClientDecoder m_client_decoder;
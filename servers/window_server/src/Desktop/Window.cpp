@@ -6,6 +6,7 @@
 
 #include "Window.h"
 #include "../WindowManager.h"
+#include <algorithm>
 #include <utility>
 
 namespace WinServer::Desktop {
@@ -68,6 +69,42 @@ void Window::did_size_change(const LG::Size& size)
     recalc_bounds(size);
 }
 
+static void subtract_corners(LG::Region& region, const LG::Rect& rect, const LG::CornerMask& mask)
+{
+    size_t radius = std::min(mask.radius(), std::min(rect.width(), rect.height()) / 2);
+    if (mask.top_rounded()) {
+        region.subtract(LG::Rect(rect.min_x(), rect.min_y(), radius, radius));
+        region.subtract(LG::Rect(rect.max_x() - radius + 1, rect.min_y(), radius, radius));
+    }
+    if (mask.bottom_rounded()) {
+        region.subtract(LG::Rect(rect.min_x(), rect.max_y() - radius + 1, radius, radius));
+        region.subtract(LG::Rect(rect.max_x() - radius + 1, rect.max_y() - radius + 1, radius, radius));
+    }
+}
+
+// Parts of the window which hide everything under them, so the compositor
+// does not draw there what is below. These are the content, unless it has
+// an alpha channel, and the header filled with the frame color. Rounded
+// corners and the shadow are blended, so they are left out.
+LG::Region Window::opaque_region() const
+{
+    LG::Region region;
+    if (!content_bitmap().has_alpha_channel()) {
+        auto content = LG::Rect(content_bounds().min_x(), content_bounds().min_y(), content_bitmap().width(), content_bitmap().height());
+        content.intersect(bounds());
+        region.unite(content);
+        subtract_corners(region, content, m_corner_mask);
+    }
+
+    if (frame().visible() && frame().color().alpha() == 255) {
+        auto header = LG::Rect(bounds().min_x() + frame().left_border_size(), bounds().min_y() + frame().std_top_border_frame_size(), bounds().width() - 2 * frame().left_border_size(), frame().top_border_size() - frame().std_top_border_frame_size());
+        LG::Region header_region(header);
+        subtract_corners(header_region, header, LG::CornerMask(4, true, false));
+        region.unite(header_region);
+    }
+    return region;
+}
+
 void Window::on_style_change()
 {
     WindowManager::the().on_window_style_change(*this);
@@ -12,6 +12,7 @@
 #include <libfoundation/SharedBuffer.h>
 #include <libg/PixelBitmap.h>
 #include <libg/Rect.h>
+#include <libg/Region.h>
 #include <sys/types.h>
 #include <utility>
 
@@ -47,6 +48,7 @@ public:
     }
 
     inline const LG::CornerMask& corner_mask() const { return m_corner_mask; }
+    LG::Region opaque_region() const;
 
     inline const LG::string& icon_path() const { return m_icon_path; }
 
@@ -12,6 +12,7 @@
 #include <libfoundation/EventReceiver.h>
 #include <libg/Context.h>
 #include <libg/PixelBitmap.h>
+#include <vector>
 
 namespace WinServer {
 class Compositor;
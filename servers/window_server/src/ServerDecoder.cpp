@@ -13,7 +13,7 @@ namespace WinServer {
 
 std::unique_ptr<Message> WindowServerDecoder::handle(const GreetMessage& msg)
 {
-    return new GreetMessageReply(msg.key(), Connection::the().alloc_connection());
+    return new GreetMessageReply(msg.key(), Connection::the().current_connection_id());
 }
 
 #ifdef TARGET_DESKTOP
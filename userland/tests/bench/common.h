@@ -18,4 +18,6 @@ static inline int to_usec()
     return sec * 1000000 + diff;
 }
 
+void bench_memory();
+void bench_pixel_kernels();
 void bench_pngloader();
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "common.h"
 #include <cstdio>
 #include <cstdlib>
+#include <sys/shared_buffer.h>
 #include <unistd.h>
 
 char* bench_name;
@@ -28,10 +29,46 @@ void bench_kernel()
     }
 }
 
+// Shared buffers are placed with the kernel bitmap allocator, mixed sizes
+// leave holes which have to be searched.
+void bench_shared_buffers()
+{
+    const int live_max = 32;
+    int live[live_max];
+    int live_cnt = 0;
+    uint32_t seed = 1;
+
+    RUN_BENCH("SHBUF", 3)
+    {
+        for (int i = 0; i < 100000; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t rnd = seed >> 8;
+            if (live_cnt < live_max && (rnd & 1)) {
+                uint8_t* buf;
+                size_t size = (1 + (rnd >> 1) % ((rnd & 6) ? 4 : 64)) * 4096 - 64;
+                int id = shared_buffer_create(&buf, size);
+                if (id >= 0) {
+                    live[live_cnt++] = id;
+                }
+            } else if (live_cnt) {
+                int k = (rnd >> 1) % live_cnt;
+                shared_buffer_free(live[k]);
+                live[k] = live[--live_cnt];
+            }
+        }
+        while (live_cnt) {
+            shared_buffer_free(live[--live_cnt]);
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
     bench_kernel();
+    bench_shared_buffers();
+    bench_memory();
     bench_pngloader();
+    bench_pixel_kernels();
     printf("[BENCH END]\n\n");
     fflush(stdout);
     return 0;
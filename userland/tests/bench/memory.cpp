@@ -0,0 +1,102 @@
+#include "common.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+static constexpr size_t BufferSize = 1 << 20;
+static constexpr size_t BytesPerRun = 16 << 20;
+static constexpr size_t MoveDistance = 8;
+
+enum class MemRoutine {
+    Copy,
+    Fill,
+    Move,
+    Compare,
+};
+
+static std::vector<uint8_t> dst;
+static std::vector<uint8_t> src;
+
+static void run_routine(MemRoutine routine, size_t offset, size_t misalign, size_t size)
+{
+    switch (routine) {
+    case MemRoutine::Copy:
+        memcpy(&dst[offset + misalign], &src[offset], size);
+        break;
+    case MemRoutine::Fill:
+        memset(&dst[offset + misalign], offset, size);
+        break;
+    case MemRoutine::Move:
+        // Overlapping and the destination is higher, so it's copied backwards.
+        memmove(&dst[offset + misalign + MoveDistance], &dst[offset], size);
+        break;
+    case MemRoutine::Compare:
+        if (memcmp(&src[offset + misalign], &dst[offset + misalign], size)) {
+            printf("memcmp: buffers differ\n");
+        }
+        break;
+    }
+}
+
+// Every run handles the same amount of bytes split into chunks of @size,
+// so short chunks show the call overhead and long ones show the bandwidth.
+static void bench_routine(const char* routine_name, MemRoutine routine, size_t size, size_t misalign)
+{
+    char name[64];
+    size_t chunks = BytesPerRun / size;
+    size_t per_buffer = (BufferSize - MoveDistance - misalign) / size;
+    snprintf(name, sizeof(name), "%s %u%s", routine_name, (uint32_t)size, misalign ? " UNALIGNED" : "");
+
+    for (int run = 0; run < 3; run++) {
+        gettimeofday(&tv, &tz);
+        for (size_t i = 0; i < chunks; i++) {
+            run_routine(routine, (i % per_buffer) * size, misalign, size);
+        }
+        gettimeofday(&ttv, &tz);
+
+        int usec = to_usec();
+        int msec = usec / 1000 ? usec / 1000 : 1;
+        printf("[BENCH][%s] %d (usec) %u (KB/s)\n", name, usec, (uint32_t)(BytesPerRun / 1024 * 1000 / msec));
+        fflush(stdout);
+    }
+}
+
+void bench_memory()
+{
+    dst.resize(BufferSize);
+    src.resize(BufferSize);
+
+    const size_t sizes[] = { 16, 64, 256, 4096, 65536 };
+    const struct {
+        const char* name;
+        MemRoutine routine;
+    } routines[] = {
+        { "MEMCPY", MemRoutine::Copy },
+        { "MEMSET", MemRoutine::Fill },
+        { "MEMMOVE", MemRoutine::Move },
+        { "MEMCMP", MemRoutine::Compare },
+    };
+
+    for (auto& it : routines) {
+        // Compared buffers are equal, so memcmp goes through all bytes.
+        if (it.routine == MemRoutine::Compare) {
+            memcpy(&dst[0], &src[0], BufferSize);
+        }
+        for (size_t size : sizes) {
+            bench_routine(it.name, it.routine, size, 0);
+        }
+        bench_routine(it.name, it.routine, 4096, 3);
+    }
+
+    for (size_t i = 0; i < BufferSize; i++) {
+        src[i] = 'a' + i % 26;
+    }
+    src[4096 + 16] = '\0';
+    RUN_BENCH("STRLEN 4096", 3)
+    {
+        volatile size_t len;
+        for (size_t i = 0; i < BytesPerRun / 4096; i++) {
+            len = strlen((const char*)&src[16 - i % 16]);
+        }
+    }
+}
@@ -0,0 +1,85 @@
+#include "common.h"
+#include <cstdio>
+#include <libg/PixelKernels.h>
+#include <vector>
+
+static constexpr int ScreenWidth = 1024;
+static constexpr int ScreenHeight = 768;
+
+static std::vector<LG::Color> dst;
+static std::vector<LG::Color> src;
+static std::vector<uint8_t> mask;
+
+// Each run draws a whole 1024x768 screen row by row.
+static void bench_kernels(const LG::PixelKernels& kernels)
+{
+    char name[64];
+    LG::Color color(60, 120, 200, 140);
+
+    snprintf(name, sizeof(name), "BLEND %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.blend(&dst[y * ScreenWidth], &src[y * ScreenWidth], ScreenWidth);
+        }
+    }
+
+    snprintf(name, sizeof(name), "BLEND COLOR %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.blend_color(&dst[y * ScreenWidth], color, ScreenWidth);
+        }
+    }
+
+    snprintf(name, sizeof(name), "BLEND GRADIENT %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.blend_gradient(&dst[y * ScreenWidth], color, 255, -1, ScreenWidth);
+        }
+    }
+
+    snprintf(name, sizeof(name), "BLEND COLOR MASKED %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.blend_color_masked(&dst[y * ScreenWidth], color, &mask[0], ScreenWidth);
+        }
+    }
+
+    snprintf(name, sizeof(name), "COPY MASKED %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.copy_masked(&dst[y * ScreenWidth], &src[y * ScreenWidth], &mask[0], ScreenWidth);
+        }
+    }
+
+    snprintf(name, sizeof(name), "FILL %s", kernels.name);
+    RUN_BENCH(name, 5)
+    {
+        for (int y = 0; y < ScreenHeight; y++) {
+            kernels.fill(&dst[y * ScreenWidth], color, ScreenWidth);
+        }
+    }
+}
+
+void bench_pixel_kernels()
+{
+    dst.resize(ScreenWidth * ScreenHeight);
+    src.resize(ScreenWidth * ScreenHeight);
+    mask.resize(ScreenWidth);
+    for (int i = 0; i < ScreenWidth * ScreenHeight; i++) {
+        dst[i] = LG::Color(i % 256, (i / 256) % 256, 128);
+        src[i] = LG::Color(255 - i % 256, 64, (i / 1024) % 256, i % 256);
+    }
+    for (int i = 0; i < ScreenWidth; i++) {
+        mask[i] = i % 256;
+    }
+
+    bench_kernels(LG::generic_pixel_kernels());
+    if (&LG::pixel_kernels() != &LG::generic_pixel_kernels()) {
+        bench_kernels(LG::pixel_kernels());
+    }
+}
\ No newline at end of file
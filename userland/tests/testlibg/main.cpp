@@ -0,0 +1,118 @@
+#include <libg/Rect.h>
+#include <libg/Region.h>
+#include <stdio.h>
+
+static int failed = 0;
+
+static void check(bool ok, const char* name)
+{
+    if (!ok) {
+        printf("%s failed\n", name);
+        failed++;
+    }
+}
+
+static bool is_banded(const LG::Region& region)
+{
+    auto& rects = region.rects();
+    for (int i = 0; i < rects.size(); i++) {
+        for (int j = i + 1; j < rects.size(); j++) {
+            if (rects[i].intersects(rects[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void union_test()
+{
+    LG::Region region(LG::Rect(0, 0, 10, 10));
+    region.unite(LG::Rect(5, 5, 10, 10));
+    check(region.area() == 175, "union: overlapping area");
+    check(region.rects().size() == 3, "union: overlapping bands");
+    check(is_banded(region), "union: overlapping rects are disjoint");
+
+    LG::Region same(LG::Rect(0, 0, 10, 10));
+    same.unite(LG::Rect(0, 0, 10, 10));
+    check(same == LG::Region(LG::Rect(0, 0, 10, 10)), "union: same rect");
+
+    LG::Region side(LG::Rect(0, 0, 10, 10));
+    side.unite(LG::Rect(10, 0, 10, 10));
+    check(side == LG::Region(LG::Rect(0, 0, 20, 10)), "union: touching spans merge");
+
+    LG::Region below(LG::Rect(0, 0, 10, 10));
+    below.unite(LG::Rect(0, 10, 10, 10));
+    check(below == LG::Region(LG::Rect(0, 0, 10, 20)), "union: equal bands coalesce");
+
+    LG::Region apart(LG::Rect(0, 0, 10, 10));
+    apart.unite(LG::Rect(20, 20, 10, 10));
+    check(apart.area() == 200 && apart.rects().size() == 2, "union: disjoint rects");
+    check(apart.bounds().min_x() == 0 && apart.bounds().max_x() == 29, "union: bounds");
+
+    LG::Region empty;
+    empty.unite(LG::Rect(3, 3, 0, 5));
+    check(empty.empty(), "union: empty rect");
+}
+
+void subtract_test()
+{
+    LG::Region hole(LG::Rect(0, 0, 30, 30));
+    hole.subtract(LG::Rect(10, 10, 10, 10));
+    check(hole.area() == 800, "subtract: hole area");
+    check(hole.rects().size() == 4, "subtract: hole bands");
+    check(!hole.intersects(LG::Rect(10, 10, 10, 10)), "subtract: hole is empty");
+    check(is_banded(hole), "subtract: hole rects are disjoint");
+
+    LG::Region all(LG::Rect(0, 0, 10, 10));
+    all.subtract(LG::Rect(-5, -5, 20, 20));
+    check(all.empty(), "subtract: covering rect");
+
+    LG::Region none(LG::Rect(0, 0, 10, 10));
+    none.subtract(LG::Rect(20, 20, 10, 10));
+    check(none == LG::Region(LG::Rect(0, 0, 10, 10)), "subtract: disjoint rect");
+
+    LG::Region edge(LG::Rect(0, 0, 10, 10));
+    edge.subtract(LG::Rect(5, 0, 10, 10));
+    check(edge == LG::Region(LG::Rect(0, 0, 5, 10)), "subtract: edge");
+
+    LG::Region refill = hole;
+    refill.unite(LG::Rect(10, 10, 10, 10));
+    check(refill == LG::Region(LG::Rect(0, 0, 30, 30)), "subtract: refilled hole");
+}
+
+void intersect_test()
+{
+    LG::Region region(LG::Rect(0, 0, 10, 10));
+    region.intersect(LG::Rect(5, 5, 10, 10));
+    check(region == LG::Region(LG::Rect(5, 5, 5, 5)), "intersect: overlapping rects");
+
+    LG::Region apart(LG::Rect(0, 0, 10, 10));
+    apart.intersect(LG::Rect(20, 20, 10, 10));
+    check(apart.empty(), "intersect: disjoint rects");
+
+    LG::Region hole(LG::Rect(0, 0, 30, 30));
+    hole.subtract(LG::Rect(10, 10, 10, 10));
+    LG::Region cut = hole.intersection(LG::Rect(5, 5, 20, 20));
+    check(cut.area() == 300, "intersect: region area");
+    check(!cut.intersects(LG::Rect(10, 10, 10, 10)), "intersect: keeps the hole");
+    check(is_banded(cut), "intersect: rects are disjoint");
+
+    LG::Region other(LG::Rect(0, 0, 15, 30));
+    other.intersect(hole);
+    check(other.area() == 400, "intersect: two regions");
+}
+
+int main()
+{
+    union_test();
+    subtract_test();
+    intersect_test();
+
+    if (failed) {
+        printf("testlibg: %d checks failed\n", failed);
+        return 1;
+    }
+    printf("testlibg ok\n");
+    return 0;
+}
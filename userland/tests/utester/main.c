@@ -1,9 +1,13 @@
 #include <fcntl.h>
+#include <pthread.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
 void exectest(void)
@@ -90,6 +94,47 @@ void mem(void)
     }
 }
 
+// allocations of every size class are filled and checked, big blocks
+// are grown with realloc, which must keep their contents.
+void malloctest(void)
+{
+    char* ptrs[64];
+
+    write(1, "malloc test\n", 12);
+    for (int round = 0; round < 4; round++) {
+        for (int i = 0; i < 64; i++) {
+            size_t size = (size_t)1 << (i % 14);
+            ptrs[i] = malloc(size);
+            if (!ptrs[i] || ((size_t)ptrs[i] & 7)) {
+                write(1, "malloc failed\n", 14);
+                exit(-1);
+            }
+            memset(ptrs[i], i, size);
+        }
+        for (int i = 0; i < 64; i++) {
+            size_t size = (size_t)1 << (i % 14);
+            if (ptrs[i][0] != i || ptrs[i][size - 1] != i) {
+                write(1, "malloc corrupted\n", 17);
+                exit(-1);
+            }
+            free(ptrs[i]);
+        }
+    }
+
+    char* big = malloc(8192);
+    memset(big, 7, 8192);
+    for (size_t size = 16384; size <= 256 * 1024; size *= 2) {
+        big = realloc(big, size);
+        if (!big || big[0] != 7 || big[8191] != 7) {
+            write(1, "realloc failed\n", 15);
+            exit(-1);
+        }
+    }
+    free(big);
+
+    write(1, "malloc ok\n", 10);
+}
+
 char buf[512];
 // four processes write different files at the same
 // time, to test block allocation.
@@ -159,6 +204,155 @@ void fourfiles(void)
     write(1, "fourfiles ok\n", 13);
 }
 
+// a child writes through a shared mapping, the parent sees the change
+// in its own mapping and in the file after munmap.
+void mmapshared(void)
+{
+    int fd, pid;
+    char* ptr;
+
+    write(1, "mmap shared test\n", 17);
+    unlink("mmap.e");
+    fd = open("mmap.e", O_CREAT | O_RDWR);
+    if (fd < 0) {
+        write(1, "create failed\n", 14);
+        exit(-1);
+    }
+
+    memset(buf, 'a', 512);
+    for (int i = 0; i < 8; i++) {
+        if (write(fd, buf, 512) != 512) {
+            write(1, "write failed\n", 13);
+            exit(-1);
+        }
+    }
+
+    ptr = (char*)mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if ((int)ptr <= 0) {
+        write(1, "mmap failed\n", 12);
+        exit(-1);
+    }
+
+    if ((pid = fork()) == 0) {
+        ptr[10] = 'b';
+        exit(0);
+    }
+    wait(pid);
+
+    if (ptr[10] != 'b' || ptr[11] != 'a') {
+        write(1, "mapping not shared\n", 19);
+        exit(-1);
+    }
+    munmap(ptr, 4096);
+
+    lseek(fd, 0, SEEK_SET);
+    if (read(fd, buf, 512) != 512 || buf[10] != 'b' || buf[11] != 'a') {
+        write(1, "not written back\n", 17);
+        exit(-1);
+    }
+    close(fd);
+    unlink("mmap.e");
+
+    write(1, "mmap shared ok\n", 15);
+}
+
+// threads with small stacks add to a counter under a mutex, the last
+// one signals the main thread.
+#define PTHREAD_TEST_THREADS 4
+#define PTHREAD_TEST_ROUNDS 1000
+
+static pthread_mutex_t pthread_test_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pthread_test_cond = PTHREAD_COND_INITIALIZER;
+static int pthread_test_counter;
+static int pthread_test_finished;
+
+void* pthread_test_worker(void* arg)
+{
+    for (int i = 0; i < PTHREAD_TEST_ROUNDS; i++) {
+        pthread_mutex_lock(&pthread_test_lock);
+        pthread_test_counter++;
+        pthread_mutex_unlock(&pthread_test_lock);
+    }
+
+    pthread_mutex_lock(&pthread_test_lock);
+    if (++pthread_test_finished == PTHREAD_TEST_THREADS) {
+        pthread_cond_signal(&pthread_test_cond);
+    }
+    pthread_mutex_unlock(&pthread_test_lock);
+    return arg;
+}
+
+void pthreadtest(void)
+{
+    pthread_t threads[PTHREAD_TEST_THREADS];
+    pthread_attr_t attr;
+
+    write(1, "pthread test\n", 13);
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, PTHREAD_STACK_MIN);
+    for (int i = 0; i < PTHREAD_TEST_THREADS; i++) {
+        if (pthread_create(&threads[i], &attr, pthread_test_worker, (void*)i) != 0) {
+            write(1, "pthread_create failed\n", 22);
+            exit(-1);
+        }
+    }
+
+    pthread_mutex_lock(&pthread_test_lock);
+    while (pthread_test_finished != PTHREAD_TEST_THREADS) {
+        pthread_cond_wait(&pthread_test_cond, &pthread_test_lock);
+    }
+    pthread_mutex_unlock(&pthread_test_lock);
+
+    for (int i = 0; i < PTHREAD_TEST_THREADS; i++) {
+        void* res;
+        pthread_join(threads[i], &res);
+        if ((int)res != i) {
+            write(1, "wrong result\n", 13);
+            exit(-1);
+        }
+    }
+
+    if (pthread_test_counter != PTHREAD_TEST_THREADS * PTHREAD_TEST_ROUNDS) {
+        write(1, "counter mismatch\n", 17);
+        exit(-1);
+    }
+    pthread_attr_destroy(&attr);
+
+    write(1, "pthread ok\n", 11);
+}
+
+void affinitytest(void)
+{
+    cpu_set_t mask, saved;
+
+    write(1, "affinity test\n", 14);
+    if (sched_getaffinity(0, sizeof(saved), &saved) < 0 || !CPU_ISSET(0, &saved)) {
+        write(1, "getaffinity failed\n", 19);
+        exit(-1);
+    }
+
+    CPU_ZERO(&mask);
+    CPU_SET(0, &mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) < 0) {
+        write(1, "setaffinity failed\n", 19);
+        exit(-1);
+    }
+    sched_getaffinity(0, sizeof(mask), &mask);
+    if (CPU_COUNT(&mask) != 1 || !CPU_ISSET(0, &mask)) {
+        write(1, "affinity mismatch\n", 18);
+        exit(-1);
+    }
+
+    CPU_ZERO(&mask);
+    if (sched_setaffinity(0, sizeof(mask), &mask) == 0) {
+        write(1, "empty mask accepted\n", 20);
+        exit(-1);
+    }
+    sched_setaffinity(0, sizeof(saved), &saved);
+
+    write(1, "affinity ok\n", 12);
+}
+
 void dirfile(void)
 {
     int fd;
@@ -229,12 +423,85 @@ void testsignals()
     }
 }
 
+void sleeptest()
+{
+    write(1, "sleep test\n", 11);
+
+    timespec_t start, end;
+    timespec_t req = { .tv_sec = 0, .tv_nsec = 50000000 };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (nanosleep(&req, NULL) < 0) {
+        write(1, "nanosleep failed\n", 17);
+        exit(-1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    long long elapsed_ns = (long long)(end.tv_sec - start.tv_sec) * 1000000000 + (long long)end.tv_nsec - (long long)start.tv_nsec;
+    if (elapsed_ns < 50000000) {
+        write(1, "woke up too early\n", 18);
+        exit(-1);
+    }
+
+    write(1, "sleep OK\n", 9);
+}
+
+void epolltest()
+{
+    write(1, "epoll test\n", 11);
+
+    epoll_event_t event;
+    int epfd = epoll_create(1);
+    if (epfd < 0) {
+        write(1, "epoll_create failed\n", 20);
+        exit(-1);
+    }
+
+    if (epoll_wait(epfd, &event, 1, 0) != 0) {
+        write(1, "empty epoll is ready\n", 21);
+        exit(-1);
+    }
+
+    int fd = open("../readme", 0);
+    if (fd < 0) {
+        write(1, "can't open file\n", 16);
+        exit(-1);
+    }
+
+    event.events = EPOLLIN;
+    event.data.u32 = 42;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        write(1, "epoll_ctl failed\n", 17);
+        exit(-1);
+    }
+
+    event.data.u32 = 0;
+    if (epoll_wait(epfd, &event, 1, 100) != 1 || event.data.u32 != 42 || !(event.events & EPOLLIN)) {
+        write(1, "file is not reported\n", 21);
+        exit(-1);
+    }
+
+    close(fd);
+    if (epoll_wait(epfd, &event, 1, 0) != 0) {
+        write(1, "closed fd is reported\n", 22);
+        exit(-1);
+    }
+    close(epfd);
+
+    write(1, "epoll OK\n", 9);
+}
+
 int main(int argc, char** argv)
 {
     testsignals();
+    sleeptest();
+    epolltest();
     mem();
+    malloctest();
     exectest();
     fourfiles();
+    mmapshared();
+    pthreadtest();
+    affinitytest();
     dirfile();
     return 0;
 }
\ No newline at end of file
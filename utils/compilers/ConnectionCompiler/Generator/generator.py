@@ -1,5 +1,10 @@
 
 
+# Types which are encoded with a varying number of bytes. Messages built of
+# other types have a fixed layout, so their size is known at compile time.
+VARIABLE_SIZE_TYPES = {"LG::string"}
+
+
 class Message:
     def __init__(self, name, id, reply_id, decoder_magic, params, protected=False):
         self.name = name
@@ -9,6 +14,17 @@ class Message:
         self.params = params
         self.protected = protected
 
+    def header_size(self):
+        # decoder_magic, id and key for protected messages.
+        fields = 3 if self.protected else 2
+        return "{0} * sizeof(uint32_t)".format(fields)
+
+    def has_fixed_size(self):
+        for i in self.params:
+            if i[0] in VARIABLE_SIZE_TYPES:
+                return False
+        return True
+
 
 class Generator:
 
@@ -25,8 +41,8 @@ class Generator:
         res = ""
         if len(params) > 0:
             for i in params:
-                res += "{0} {1},".format(i[0], i[1])
-            res = res[:-1]
+                res += "{0} {1}, ".format(i[0], i[1])
+            res = res[:-2]
         return res
 
     def message_create_std_funcs(self, msg):
@@ -64,20 +80,31 @@ class Generator:
         else:
             self.out(res+" {}", 1)
 
+    def message_create_size(self, msg):
+        if msg.has_fixed_size():
+            size = msg.header_size()
+            for i in msg.params:
+                size += " + FixedEncodedSize<{0}>::value".format(i[0])
+            self.out(
+                "static constexpr size_t EncodedSize = {0};".format(size), 1)
+            self.out(
+                "size_t encoded_size() const override { return EncodedSize; }", 1)
+        else:
+            size = msg.header_size()
+            for i in msg.params:
+                size += " + Encoder::encoded_size(m_{0})".format(i[1])
+            self.out(
+                "size_t encoded_size() const override {{ return {0}; }}".format(size), 1)
+
     def message_create_encoder(self, msg):
-        self.out("EncodedMessage encode() const override".format(
-            msg.decoder_magic), 1)
+        self.out("void encode(uint8_t* buf) const override", 1)
         self.out("{", 1)
-
-        self.out("EncodedMessage buffer;", 2)
-        self.out("Encoder::append(buffer, decoder_magic());", 2)
-        self.out("Encoder::append(buffer, id());", 2)
+        self.out("Encoder::append(buf, decoder_magic());", 2)
+        self.out("Encoder::append(buf, id());", 2)
         if msg.protected:
-            self.out("Encoder::append(buffer, key());", 2)
+            self.out("Encoder::append(buf, key());", 2)
         for i in msg.params:
-            self.out("Encoder::append(buffer, m_{0});".format(i[1]), 2)
-
-        self.out("return buffer;", 2)
+            self.out("Encoder::append(buf, m_{0});".format(i[1]), 2)
         self.out("}", 1)
 
     def generate_message(self, msg):
@@ -85,7 +112,9 @@ class Generator:
         self.out("public:")
         self.message_create_constructor(msg)
         self.message_create_std_funcs(msg)
+        self.message_create_size(msg)
         self.message_create_encoder(msg)
+        self.out("")
         self.out("private:")
         self.message_create_vars(msg)
         self.out("};")
@@ -110,7 +139,7 @@ class Generator:
             params_str = params_str[:-2]
         for i in msg.params:
             self.out(
-                "Encoder::decode(buf, decoded_msg_len, var_{0});".format(i[1]), offset)
+                "Encoder::decode(buf, size, decoded_msg_len, var_{0});".format(i[1]), offset)
         self.out("return new {0}({1});".format(msg.name, params_str), offset)
 
     def decoder_create_std_funcs(self, decoder):
@@ -123,8 +152,8 @@ class Generator:
         self.out("{", 1)
         self.out("int msg_id, decoder_magic;", 2)
         self.out("size_t saved_dml = decoded_msg_len;", 2)
-        self.out("Encoder::decode(buf, decoded_msg_len, decoder_magic);", 2)
-        self.out("Encoder::decode(buf, decoded_msg_len, msg_id);", 2)
+        self.out("Encoder::decode(buf, size, decoded_msg_len, decoder_magic);", 2)
+        self.out("Encoder::decode(buf, size, decoded_msg_len, msg_id);", 2)
         self.out("if (magic() != decoder_magic) {", 2)
         self.out("decoded_msg_len = saved_dml;", 3)
         self.out("return nullptr;", 3)
@@ -132,14 +161,14 @@ class Generator:
 
         if decoder.protected:
             self.out("message_key_t secret_key;", 2)
-            self.out("Encoder::decode(buf, decoded_msg_len, secret_key);", 2)
+            self.out("Encoder::decode(buf, size, decoded_msg_len, secret_key);", 2)
             self.out("", 0)
 
         self.decoder_create_vars(decoder.messages, 2)
 
         unique_msg_id = 1
-        self.out("", 2)
-        self.out("switch(msg_id) {", 2)
+        self.out("")
+        self.out("switch (msg_id) {", 2)
         for (name, params) in decoder.messages.items():
             self.out("case {0}:".format(unique_msg_id), 2)
             # Here it doen't need to know the real reply_id, so we can put 0 here.
@@ -152,7 +181,7 @@ class Generator:
         self.out("return nullptr;", 3)
         self.out("}", 2)
         self.out("}", 1)
-        self.out("", 1)
+        self.out("")
 
     def decoder_create_handle(self, decoder):
         self.out("std::unique_ptr<Message> handle(const Message& msg) override", 1)
@@ -162,8 +191,8 @@ class Generator:
         self.out("}", 2)
 
         unique_msg_id = 1
-        self.out("", 2)
-        self.out("switch(msg.id()) {", 2)
+        self.out("")
+        self.out("switch (msg.id()) {", 2)
         for (name, params) in decoder.messages.items():
             if name in decoder.functions:
                 self.out("case {0}:".format(unique_msg_id), 2)
@@ -176,7 +205,62 @@ class Generator:
         self.out("return nullptr;", 3)
         self.out("}", 2)
         self.out("}", 1)
-        self.out("", 1)
+        self.out("")
+
+    def decoder_create_decode_and_handle(self, decoder):
+        self.out(
+            "// Decodes the message in place and passes it to its handler. Nothing is", 1)
+        self.out(
+            "// allocated unless the handler answers. Returns false if the message is", 1)
+        self.out("// not for this decoder or is malformed.", 1)
+        self.out(
+            "bool decode_and_handle(const char* buf, size_t size, std::unique_ptr<Message>& answer)", 1)
+        self.out("{", 1)
+        header = Message("", 0, 0, decoder.magic, [], decoder.protected)
+        self.out("if (size < {0}) {{".format(header.header_size()), 2)
+        self.out("return false;", 3)
+        self.out("}", 2)
+        self.out("", 0)
+        self.out("size_t offset = 0;", 2)
+        self.out("int msg_id, decoder_magic;", 2)
+        self.out("Encoder::decode(buf, size, offset, decoder_magic);", 2)
+        self.out("Encoder::decode(buf, size, offset, msg_id);", 2)
+        self.out("if (magic() != decoder_magic) {", 2)
+        self.out("return false;", 3)
+        self.out("}", 2)
+        if decoder.protected:
+            self.out("message_key_t secret_key;", 2)
+            self.out("Encoder::decode(buf, size, offset, secret_key);", 2)
+
+        unique_msg_id = 1
+        self.out("")
+        self.out("switch (msg_id) {", 2)
+        for (name, params) in decoder.messages.items():
+            if name in decoder.functions:
+                msg = Message(name, unique_msg_id, 0,
+                              decoder.magic, params, decoder.protected)
+                self.out("case {0}: {{".format(unique_msg_id), 2)
+                if msg.has_fixed_size():
+                    self.out("if (size != {0}::EncodedSize) {{".format(name), 3)
+                    self.out("return false;", 4)
+                    self.out("}", 3)
+                args = "secret_key, " if decoder.protected else ""
+                for i in params:
+                    self.out("{0} var_{1};".format(i[0], i[1]), 3)
+                    self.out(
+                        "Encoder::decode(buf, size, offset, var_{0});".format(i[1]), 3)
+                    args += "var_{0}, ".format(i[1])
+                self.out("answer = handle({0}({1}));".format(name, args[:-2]), 3)
+                self.out("return true;", 3)
+                self.out("}", 2)
+
+            unique_msg_id += 1
+
+        self.out("default:", 2)
+        self.out("return false;", 3)
+        self.out("}", 2)
+        self.out("}", 1)
+        self.out("")
 
     def decoder_create_virtual_handle(self, decoder):
         for (accept, ret) in decoder.functions.items():
@@ -186,9 +270,10 @@ class Generator:
     def generate_decoder(self, decoder):
         self.out("class {0} : public MessageDecoder {{".format(decoder.name))
         self.out("public:")
-        self.out("{0}() {{}}".format(decoder.name), 1)
+        self.out("{0}() {{ }}".format(decoder.name), 1)
         self.decoder_create_std_funcs(decoder)
         self.decoder_create_decode(decoder)
+        self.decoder_create_decode_and_handle(decoder)
         self.decoder_create_handle(decoder)
         self.decoder_create_virtual_handle(decoder)
         self.out("};")
@@ -199,11 +284,11 @@ class Generator:
         self.out("// See .ipc file")
         self.out("")
         self.out("#pragma once")
-        self.out("#include <libipc/Encoder.h>")
-        self.out("#include <libipc/ClientConnection.h>")
-        self.out("#include <libipc/ServerConnection.h>")
         self.out("#include <libg/Rect.h>")
         self.out("#include <libg/string.h>")
+        self.out("#include <libipc/ClientConnection.h>")
+        self.out("#include <libipc/Encoder.h>")
+        self.out("#include <libipc/ServerConnection.h>")
         self.out("#include <new>")
         self.out("")
 